@@ -311,6 +311,8 @@ function Controls({
 						dpi,
 						baseDpi: 72,
 						isInPreview: isPreviewMode,
+						previewScale: 1,
+						signal,
 					},
 				);
 				if (signal.aborted) return;
@@ -5,10 +5,33 @@ globalThis._AI_DENO_ = {
   op_ai_deno_get_user_locale: () => {
     return "ja_JP";
   },
+  op_ai_deno_get_effect_stats: (effectId: string) => {
+    return "null";
+  },
   op_aideno_debug_enabled: () => {
     return true;
   },
   op_ai_get_plugin_version: () => {
     return "0.0.1";
   },
+  op_ai_deno_wait_cancelled: async (token: bigint) => {
+    return false;
+  },
+  op_ai_deno_is_cancelled: (token: bigint) => {
+    return false;
+  },
+  op_ai_deno_trace_enabled: () => {
+    return false;
+  },
+  op_ai_deno_trace_now: () => {
+    return performance.now() * 1e6;
+  },
+  op_ai_deno_trace_record: () => {},
+  op_ai_deno_pipeline_cache_record: () => {},
+  op_ai_deno_pipeline_cache_load: () => {
+    return "[]";
+  },
+  op_ai_deno_report_init_failure: (effectId: string, message: string) => {
+    alert(message);
+  },
 };
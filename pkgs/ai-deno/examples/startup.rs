@@ -0,0 +1,58 @@
+//! Startup time of a runtime, from `initialize_runtime_worker` until
+//! `getLiveEffects` answered, without and with the V8 code cache.
+//!
+//! Run with `just bench-startup`. The first runtime of the process also pays
+//! for the V8 platform and is not counted.
+
+use ai_deno::{
+    dispose_json_function_result, dispose_runtime_worker, get_live_effects,
+    initialize_runtime_worker, JsonFunctionResult,
+};
+use std::time::Instant;
+
+const DISABLE_ENV: &str = "AI_DENO_NO_CODE_CACHE";
+
+extern "C" fn alert(_: *const JsonFunctionResult) {}
+
+fn start_runtime() -> f64 {
+    let start = Instant::now();
+
+    let ai_main = initialize_runtime_worker(alert, 0);
+    assert!(!ai_main.is_null(), "failed to start the runtime");
+
+    let result = get_live_effects(ai_main);
+    let elapsed = start.elapsed().as_secs_f64() * 1000.0;
+
+    assert!(unsafe { (*result).success }, "getLiveEffects failed");
+    dispose_json_function_result(result);
+    dispose_runtime_worker(ai_main);
+
+    elapsed
+}
+
+fn measure(iterations: usize) -> (f64, f64) {
+    let times: Vec<f64> = (0..iterations).map(|_| start_runtime()).collect();
+    let best = times.iter().cloned().fold(f64::MAX, f64::min);
+    let mean = times.iter().sum::<f64>() / times.len() as f64;
+    (best, mean)
+}
+
+fn main() {
+    let iterations = std::env::args()
+        .nth(1)
+        .and_then(|arg| arg.parse().ok())
+        .unwrap_or(5);
+
+    std::env::set_var(DISABLE_ENV, "1");
+    start_runtime();
+    let (cold_best, cold_mean) = measure(iterations);
+
+    std::env::remove_var(DISABLE_ENV);
+    // Writes the cache of every module
+    start_runtime();
+    let (cached_best, cached_mean) = measure(iterations);
+
+    println!("{:<12} {:>10} {:>10}", "code cache", "best", "mean");
+    println!("{:<12} {:>8.1}ms {:>8.1}ms", "off", cold_best, cold_mean);
+    println!("{:<12} {:>8.1}ms {:>8.1}ms", "on", cached_best, cached_mean);
+}
@@ -0,0 +1,200 @@
+//! Cancellation of superseded live effect renders.
+//!
+//! The host numbers preview renders with a generation that grows with every
+//! parameter change. Each cancellable `go_live_effect` registers a token for
+//! its generation, and `cancel_live_effect_renders` cancels every token of an
+//! older one, from any thread. Generation 0 is outside that order: its tokens
+//! are only cancelled one by one, through the call that owns them (a
+//! `go_live_effect_submit` ticket). JS observes a token as an `AbortSignal` (through
+//! `op_ai_deno_wait_cancelled`), and the host stops waiting for a cancelled call
+//! even if the effect ignores the signal.
+
+use dashmap::DashMap;
+use once_cell::sync::Lazy;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Arc;
+use tokio::sync::Notify;
+
+pub struct CancellationToken {
+    pub id: u64,
+    pub generation: u64,
+    cancelled: AtomicBool,
+    finished: AtomicBool,
+    changed: Notify,
+}
+
+impl CancellationToken {
+    pub fn is_cancelled(&self) -> bool {
+        self.cancelled.load(Ordering::SeqCst)
+    }
+
+    fn is_finished(&self) -> bool {
+        self.finished.load(Ordering::SeqCst)
+    }
+
+    pub fn cancel(&self) {
+        if !self.cancelled.swap(true, Ordering::SeqCst) {
+            self.changed.notify_waiters();
+        }
+    }
+
+    /// Resolves with true once cancelled, or false once the render finished first
+    pub async fn settled(&self) -> bool {
+        loop {
+            // Registered before checking the flags so a concurrent change can't be missed
+            let notified = self.changed.notified();
+            tokio::pin!(notified);
+            notified.as_mut().enable();
+
+            if self.is_cancelled() {
+                return true;
+            }
+            if self.is_finished() {
+                return false;
+            }
+
+            notified.await;
+        }
+    }
+
+    /// Resolves only when cancelled
+    pub async fn cancelled(&self) {
+        if !self.settled().await {
+            std::future::pending::<()>().await;
+        }
+    }
+}
+
+static NEXT_TOKEN_ID: AtomicU64 = AtomicU64::new(1);
+static TOKENS: Lazy<DashMap<u64, Arc<CancellationToken>>> = Lazy::new(DashMap::new);
+/// Renders of a generation below this are cancelled, even if they register later
+static CANCELLED_BELOW: AtomicU64 = AtomicU64::new(0);
+
+/// Starts tracking a render of `generation`. Pair with `finish`.
+pub fn register(generation: u64) -> Arc<CancellationToken> {
+    let token = Arc::new(CancellationToken {
+        id: NEXT_TOKEN_ID.fetch_add(1, Ordering::SeqCst),
+        generation,
+        cancelled: AtomicBool::new(false),
+        finished: AtomicBool::new(false),
+        changed: Notify::new(),
+    });
+
+    TOKENS.insert(token.id, token.clone());
+
+    if generation != 0 && generation < CANCELLED_BELOW.load(Ordering::SeqCst) {
+        token.cancel();
+    }
+
+    token
+}
+
+pub fn find(id: u64) -> Option<Arc<CancellationToken>> {
+    TOKENS.get(&id).map(|token| token.clone())
+}
+
+/// Stops tracking `token` and settles anything still waiting on it
+pub fn finish(token: &CancellationToken) {
+    token.finished.store(true, Ordering::SeqCst);
+    token.changed.notify_waiters();
+    TOKENS.remove(&token.id);
+}
+
+/// Cancels every tracked render of a generation below `generation`
+pub fn cancel_below(generation: u64) {
+    CANCELLED_BELOW.fetch_max(generation, Ordering::SeqCst);
+
+    for token in TOKENS.iter() {
+        if token.generation != 0 && token.generation < generation {
+            token.cancel();
+        }
+    }
+}
+
+/// Renders still tracked
+pub fn pending() -> usize {
+    TOKENS.len()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::Mutex;
+
+    // Generations are process wide, so scenarios must not interleave
+    static SERIAL: Mutex<()> = Mutex::new(());
+
+    fn next_generation() -> u64 {
+        CANCELLED_BELOW.load(Ordering::SeqCst) + 1
+    }
+
+    #[test]
+    fn cancels_older_generations_only() {
+        let _serial = SERIAL.lock().unwrap();
+        let generation = next_generation();
+
+        let older = register(generation);
+        let newer = register(generation + 1);
+
+        cancel_below(generation + 1);
+        assert!(older.is_cancelled());
+        assert!(!newer.is_cancelled());
+
+        finish(&older);
+        finish(&newer);
+        assert!(find(older.id).is_none());
+    }
+
+    #[test]
+    fn late_registrations_of_stale_generations_start_cancelled() {
+        let _serial = SERIAL.lock().unwrap();
+        let generation = next_generation();
+
+        cancel_below(generation + 1);
+        let token = register(generation);
+        assert!(token.is_cancelled());
+        finish(&token);
+    }
+
+    #[test]
+    fn generation_zero_is_only_cancelled_explicitly() {
+        let _serial = SERIAL.lock().unwrap();
+        let generation = next_generation();
+
+        let token = register(0);
+        cancel_below(generation + 1);
+        assert!(!token.is_cancelled());
+
+        token.cancel();
+        assert!(token.is_cancelled());
+        finish(&token);
+    }
+
+    #[test]
+    fn settles_on_cancel_and_on_finish() {
+        let _serial = SERIAL.lock().unwrap();
+        let generation = next_generation();
+        let runtime = tokio::runtime::Builder::new_current_thread()
+            .enable_all()
+            .build()
+            .unwrap();
+
+        let cancelled = register(generation);
+        let waiter = {
+            let token = cancelled.clone();
+            std::thread::spawn(move || {
+                tokio::runtime::Builder::new_current_thread()
+                    .build()
+                    .unwrap()
+                    .block_on(async move { token.settled().await })
+            })
+        };
+        cancel_below(generation + 1);
+        assert!(waiter.join().unwrap());
+        finish(&cancelled);
+
+        let finished = register(generation + 1);
+        finish(&finished);
+        assert!(!runtime.block_on(finished.settled()));
+    }
+}
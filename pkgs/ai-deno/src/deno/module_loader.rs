@@ -9,7 +9,7 @@ use deno_runtime::{
     deno_core::{
         error::ModuleLoaderError, url::Url, FastString, ModuleCodeString, ModuleLoadResponse,
         ModuleLoader, ModuleName, ModuleSource, ModuleSourceCode, ModuleSpecifier, ModuleType,
-        RequestedModuleType, ResolutionKind, SourceMapData,
+        RequestedModuleType, ResolutionKind, SourceCodeCacheInfo, SourceMapData,
     },
     deno_fs::{sync::MaybeArc, RealFs},
     deno_node::{NodeExtInitServices, NodeResolver, NodeResolverRc},
@@ -24,7 +24,17 @@ use node_resolver::{
 };
 use npm_package_manager::{parse_npm_specifier, NpmPackageManager};
 use require_loader::AiDenoRequireLoader;
-use std::{borrow::Cow, collections::HashSet, path::PathBuf, rc::Rc, str::FromStr, sync::Arc};
+use std::{
+    borrow::Cow,
+    cell::RefCell,
+    collections::{HashMap, HashSet},
+    future::Future,
+    path::PathBuf,
+    pin::Pin,
+    rc::Rc,
+    str::FromStr,
+    sync::Arc,
+};
 use sys_traits::{impls::RealSys, FsRead};
 
 mod cache_provider;
@@ -35,6 +45,7 @@ use super::transpiler::transpile;
 
 mod cache_db;
 mod cjs_code_analyzer;
+pub mod code_cache;
 mod http_client;
 mod jsr_package_manager;
 mod npm_client;
@@ -46,6 +57,10 @@ type ExtensionTranspiler = dyn Fn(
     ModuleCodeString,
 ) -> Result<(ModuleCodeString, Option<SourceMapData>), JsErrorBox>;
 
+/// Module sources handed over in memory (the bundled main.mjs), served by `load`
+/// instead of fetching so they go through the code cache like any other module
+pub type EmbeddedModules = Rc<RefCell<HashMap<ModuleSpecifier, String>>>;
+
 pub struct AiDenoModuleLoaderInit {
     pub package_root_dir: PathBuf,
     pub allowed_module_schemas: HashSet<String>,
@@ -74,6 +89,8 @@ pub struct AiDenoModuleLoader {
     pub pkg_manager: NpmPackageManager,
     pub jsr_manager: JsrPackageManager,
     pub allowed_module_schemas: HashSet<String>,
+    pub embedded_modules: EmbeddedModules,
+    code_cache: Arc<code_cache::CodeCache>,
     sys: Arc<RealSys>,
 }
 
@@ -149,6 +166,10 @@ impl AiDenoModuleLoader {
 
         let jsr_manager = JsrPackageManager::new(options.package_root_dir.clone());
 
+        let code_cache = Arc::new(code_cache::CodeCache::new(
+            options.package_root_dir.join("cache").join("code"),
+        ));
+
         Self {
             // package_root_dir,
             // cache_provider: Arc::new(MemoryModuleCacheProvider::default()),
@@ -163,6 +184,8 @@ impl AiDenoModuleLoader {
             pkg_manager,
             jsr_manager,
             allowed_module_schemas: options.allowed_module_schemas,
+            embedded_modules: Rc::new(RefCell::new(HashMap::new())),
+            code_cache,
             sys: Arc::new(real_sys),
         }
     }
@@ -558,7 +581,15 @@ impl ModuleLoader for AiDenoModuleLoader {
                 module_specifier.clone()
             };
 
-            let (content, final_url) = loader.fetch_module_content(&actual_specifier).await?;
+            let embedded = loader
+                .embedded_modules
+                .borrow()
+                .get(&actual_specifier)
+                .cloned();
+            let (content, final_url) = match embedded {
+                Some(content) => (content, actual_specifier.clone()),
+                None => loader.fetch_module_content(&actual_specifier).await?,
+            };
             let module_type = loader.determine_module_type(&final_url, &content);
 
             if module_type == ModuleType::Json && requested_module_type != RequestedModuleType::Json
@@ -570,15 +601,47 @@ impl ModuleLoader for AiDenoModuleLoader {
 
             deno_println!("Loaded module: {}", final_url);
 
+            // JSON modules are not compiled, so there is nothing to cache
+            let code_cache = (module_type == ModuleType::JavaScript
+                && loader.code_cache.is_enabled())
+            .then(|| {
+                let hash = code_cache::CodeCache::source_hash(&content);
+                SourceCodeCacheInfo {
+                    hash,
+                    data: loader
+                        .code_cache
+                        .get(final_url.as_str(), hash)
+                        .map(Cow::Owned),
+                }
+            });
+
             let module_source = ModuleSource::new_with_redirect(
                 module_type,
                 ModuleSourceCode::String(content.into()),
                 &module_specifier,
                 &final_url,
-                None,
+                code_cache,
             );
 
             Ok(module_source)
         }))
     }
+
+    /// Called by deno_core with the cache it made for a module that had none, or
+    /// whose cached data V8 rejected
+    fn code_cache_ready(
+        &self,
+        module_specifier: ModuleSpecifier,
+        hash: u64,
+        code_cache: &[u8],
+    ) -> Pin<Box<dyn Future<Output = ()>>> {
+        if let Err(e) = self
+            .code_cache
+            .set(module_specifier.as_str(), hash, code_cache)
+        {
+            deno_println!("code_cache: failed to store {}: {}", module_specifier, e);
+        }
+
+        Box::pin(async {})
+    }
 }
@@ -0,0 +1,172 @@
+//! V8 code cache of loaded modules, kept in `~/.ai-deno/cache/code`.
+//!
+//! Compiling the bundled main.mjs and the effect modules it imports is most of
+//! the runtime's startup. With a code cache V8 deserializes the compiled
+//! functions instead of parsing them again, and the cache survives plugin
+//! restarts here.
+//!
+//! An entry is named after the module specifier and holds the hash of the
+//! source it was made from, so a changed module misses and is written again.
+//! V8 rejects data of another V8 version or flags by itself, deno_core then
+//! asks for a fresh cache.
+
+use std::fs::{self, File};
+use std::io::{self, Read, Write};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use twox_hash::XxHash64;
+
+use crate::deno_println;
+
+const MAGIC: &[u8; 4] = b"AIVC";
+/// magic, source hash
+const HEADER_LEN: usize = 4 + 8;
+const ENTRY_EXTENSION: &str = "bin";
+
+/// Set to run without reading or writing the cache, e.g. to compare startup times
+pub const DISABLE_ENV: &str = "AI_DENO_NO_CODE_CACHE";
+
+static TMP_COUNTER: AtomicUsize = AtomicUsize::new(0);
+
+pub struct CodeCache {
+    dir: PathBuf,
+    enabled: bool,
+}
+
+impl CodeCache {
+    pub fn new(dir: PathBuf) -> Self {
+        Self {
+            dir,
+            enabled: std::env::var(DISABLE_ENV).is_err(),
+        }
+    }
+
+    pub fn is_enabled(&self) -> bool {
+        self.enabled
+    }
+
+    /// Hash that `get` and `set` compare entries against
+    pub fn source_hash(source: &str) -> u64 {
+        XxHash64::oneshot(0, source.as_bytes())
+    }
+
+    fn entry_path(&self, specifier: &str) -> PathBuf {
+        self.dir.join(format!(
+            "{:016x}.{}",
+            XxHash64::oneshot(0, specifier.as_bytes()),
+            ENTRY_EXTENSION
+        ))
+    }
+
+    /// Cached data for `specifier`, None when there is none for this source
+    pub fn get(&self, specifier: &str, source_hash: u64) -> Option<Vec<u8>> {
+        if !self.enabled {
+            return None;
+        }
+
+        let mut bytes = Vec::new();
+        File::open(self.entry_path(specifier))
+            .ok()?
+            .read_to_end(&mut bytes)
+            .ok()?;
+
+        if bytes.len() <= HEADER_LEN || &bytes[..4] != MAGIC {
+            return None;
+        }
+        if u64::from_le_bytes(bytes[4..HEADER_LEN].try_into().unwrap()) != source_hash {
+            return None;
+        }
+
+        bytes.drain(..HEADER_LEN);
+        Some(bytes)
+    }
+
+    pub fn set(&self, specifier: &str, source_hash: u64, data: &[u8]) -> io::Result<()> {
+        if !self.enabled || data.is_empty() {
+            return Ok(());
+        }
+
+        fs::create_dir_all(&self.dir)?;
+
+        let path = self.entry_path(specifier);
+        // Readers only ever see complete entries, also with several runtimes
+        // (workers) writing the same module at once
+        let tmp_path = path.with_extension(format!(
+            "tmp{}-{}",
+            std::process::id(),
+            TMP_COUNTER.fetch_add(1, Ordering::Relaxed)
+        ));
+
+        {
+            let mut file = File::create(&tmp_path)?;
+            file.write_all(MAGIC)?;
+            file.write_all(&source_hash.to_le_bytes())?;
+            file.write_all(data)?;
+        }
+
+        if let Err(e) = fs::rename(&tmp_path, &path) {
+            let _ = fs::remove_file(&tmp_path);
+            return Err(e);
+        }
+
+        deno_println!("code_cache: stored {} bytes for {}", data.len(), specifier);
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_cache(name: &str) -> CodeCache {
+        let dir = std::env::temp_dir().join(format!(
+            "ai-deno-code-cache-{}-{}",
+            name,
+            std::process::id()
+        ));
+        let _ = fs::remove_dir_all(&dir);
+        CodeCache { dir, enabled: true }
+    }
+
+    #[test]
+    fn round_trips_entries() {
+        let cache = temp_cache("round-trip");
+        let hash = CodeCache::source_hash("export default 1;");
+        cache.set("file:///main.js", hash, &[1, 2, 3]).unwrap();
+
+        assert_eq!(cache.get("file:///main.js", hash), Some(vec![1, 2, 3]));
+        assert_eq!(cache.get("file:///other.js", hash), None);
+    }
+
+    #[test]
+    fn misses_on_changed_source() {
+        let cache = temp_cache("changed-source");
+        let hash = CodeCache::source_hash("export default 1;");
+        cache.set("file:///main.js", hash, &[1, 2, 3]).unwrap();
+
+        let changed = CodeCache::source_hash("export default 2;");
+        assert_eq!(cache.get("file:///main.js", changed), None);
+
+        cache.set("file:///main.js", changed, &[4]).unwrap();
+        assert_eq!(cache.get("file:///main.js", changed), Some(vec![4]));
+    }
+
+    #[test]
+    fn ignores_foreign_files() {
+        let cache = temp_cache("foreign");
+        fs::create_dir_all(&cache.dir).unwrap();
+        fs::write(cache.entry_path("file:///main.js"), b"not a cache entry").unwrap();
+
+        assert_eq!(cache.get("file:///main.js", 0), None);
+    }
+
+    #[test]
+    fn disabled_cache_stores_nothing() {
+        let mut cache = temp_cache("disabled");
+        cache.enabled = false;
+        cache.set("file:///main.js", 1, &[1]).unwrap();
+
+        assert!(!cache.dir.exists());
+        assert_eq!(cache.get("file:///main.js", 1), None);
+    }
+}
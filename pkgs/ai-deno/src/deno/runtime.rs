@@ -64,7 +64,7 @@ use std::task::Poll;
 use std::time::Duration;
 use sys_traits::impls::RealSys;
 
-use super::module_loader::{self, AiDenoModuleLoader, AiDenoModuleLoaderInit};
+use super::module_loader::{self, AiDenoModuleLoader, AiDenoModuleLoaderInit, EmbeddedModules};
 
 pub struct RuntimeInit {
     pub extensions: Vec<deno_runtime::deno_core::Extension>,
@@ -91,6 +91,7 @@ pub struct Runtime {
     deno_runtime: JsRuntime,
     // container: RuntimeContainer,
     cwd: PathBuf,
+    embedded_modules: EmbeddedModules,
 }
 
 impl Runtime {
@@ -191,6 +192,7 @@ impl Runtime {
             deno_runtime: runtime,
             // container:runtime,
             cwd,
+            embedded_modules: services.embedded_modules,
         })
     }
 
@@ -315,17 +317,19 @@ impl Runtime {
             FastString::from(module.contents().to_string()),
         )?;
 
+        // Loaded through the module loader rather than from code, so it gets the
+        // V8 code cache
+        self.embedded_modules
+            .borrow_mut()
+            .insert(module_specifier.clone(), code.as_str().to_string());
+
         let js_runtime = self.deno_runtime();
 
         deno_println!("is main: {}", main);
         let module_id: deno_runtime::deno_core::ModuleId = if main {
-            js_runtime
-                .load_main_es_module_from_code(&module_specifier, code)
-                .await
+            js_runtime.load_main_es_module(&module_specifier).await
         } else {
-            js_runtime
-                .load_side_es_module_from_code(&module_specifier, code)
-                .await
+            js_runtime.load_side_es_module(&module_specifier).await
         }
         .or_else(|e| {
             return Err(Error::ModuleNotFound(format!(
@@ -444,6 +448,7 @@ struct RuntimeServices {
     feature_checker: Arc<deno_runtime::FeatureChecker>,
     fs: Arc<deno_runtime::deno_fs::RealFs>,
     node_services: deno_node::NodeExtInitServices<NpmPackageManager, NpmPackageManager, RealSys>,
+    embedded_modules: EmbeddedModules,
 }
 
 fn runtime_options_factory(
@@ -613,6 +618,7 @@ fn get_all_extensions(
         feature_checker,
         fs,
         node_services,
+        embedded_modules: mod_loader.embedded_modules.clone(),
     };
 
     (extensions, services)
@@ -742,17 +748,7 @@ mod tests {
     use crate::deno::module::Module;
     use crate::ext::{ai_user_extension, AiExtOptions};
 
-    // Mock C functions for testing
-    #[no_mangle]
-    pub extern "C" fn ai_deno_alert(_msg: *const std::os::raw::c_char) {
-        // No-op for tests
-    }
-
-    #[no_mangle]
-    pub extern "C" fn ai_deno_get_user_locale() -> *const std::os::raw::c_char {
-        // Return a static string pointer for testing
-        b"en_US\0".as_ptr() as *const std::os::raw::c_char
-    }
+    // Host callbacks are stubbed in crate::stub_host
 
     #[test]
     fn test_module_with_top_level_await() {
@@ -856,7 +852,9 @@ mod tests {
     #[test]
     fn test_actual_main_mjs_with_load() {
         let mut runtime = Runtime::new(RuntimeInit {
-            extensions: vec![ai_user_extension::init(AiExtOptions {})],
+            extensions: vec![ai_user_extension::init(AiExtOptions {
+                user_locale: "en_US".to_string(),
+            })],
             ..Default::default()
         })
         .unwrap();
@@ -0,0 +1,558 @@
+//! Content-addressed cache of live effect outputs, kept in `~/.ai-deno/cache/results`.
+//!
+//! An entry is named after everything its pixels depend on (effect id and
+//! version, params, input pixels, DPI and size), so entries are never
+//! invalidated: a changed input simply misses. Reopening an unchanged document
+//! therefore reads its effects back instead of recomputing them.
+//!
+//! Entries are deflated at the fastest level on a background thread and
+//! memory-mapped on read. The directory is kept under a byte budget by deleting
+//! the least recently read entries. Its size is counted once when the cache is
+//! first used and kept up to date by writes, so only going over the budget
+//! rescans the directory.
+
+use flate2::read::DeflateDecoder;
+use flate2::write::DeflateEncoder;
+use flate2::Compression;
+use memmap2::Mmap;
+use once_cell::sync::{Lazy, OnceCell};
+use std::ffi::{c_char, CStr};
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, BufWriter, Read, Write};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{sync_channel, SyncSender, TrySendError};
+use std::sync::Mutex;
+use std::time::SystemTime;
+use twox_hash::XxHash64;
+
+use crate::dai_println;
+
+const MAGIC: &[u8; 4] = b"AIDC";
+const FORMAT_VERSION: u32 = 1;
+/// magic, format version, width, height, raw byte length
+const HEADER_LEN: usize = 4 + 4 + 4 + 4 + 8;
+const ENTRY_EXTENSION: &str = "bin";
+/// Entries are written as `<name>.tmp<pid>` and renamed once complete
+const TEMP_EXTENSION_PREFIX: &str = "tmp";
+
+pub const DEFAULT_BUDGET: u64 = 1024 * 1024 * 1024;
+/// Writes waiting for the background thread. Beyond this they are dropped.
+const PENDING_WRITES: usize = 8;
+
+/// Identifies a cached output, see `DiskCacheKey` for the fields
+#[derive(Clone, Debug, PartialEq)]
+pub struct ResultKey {
+    pub effect_id: String,
+    pub effect_version: String,
+    pub params_hash: u64,
+    pub pixels_hash: u64,
+    pub dpi: i32,
+    pub width: u32,
+    pub height: u32,
+}
+
+impl ResultKey {
+    fn file_name(&self) -> String {
+        let mut bytes = Vec::with_capacity(64 + self.effect_id.len());
+        // Outputs of another plugin build may differ even for the same effect version
+        bytes.extend_from_slice(crate::VERSION.as_bytes());
+        bytes.push(0);
+        bytes.extend_from_slice(self.effect_id.as_bytes());
+        bytes.push(0);
+        bytes.extend_from_slice(self.effect_version.as_bytes());
+        bytes.push(0);
+        bytes.extend_from_slice(&self.params_hash.to_le_bytes());
+        bytes.extend_from_slice(&self.pixels_hash.to_le_bytes());
+        bytes.extend_from_slice(&self.dpi.to_le_bytes());
+        bytes.extend_from_slice(&self.width.to_le_bytes());
+        bytes.extend_from_slice(&self.height.to_le_bytes());
+
+        // 128 bits, so a collision (which would show a wrong image) is out of reach
+        format!(
+            "{:016x}{:016x}.{}",
+            XxHash64::oneshot(0, &bytes),
+            XxHash64::oneshot(0x9e37_79b9_7f4a_7c15, &bytes),
+            ENTRY_EXTENSION
+        )
+    }
+}
+
+/// Key as passed by the host. Strings are NUL terminated UTF-8.
+#[repr(C)]
+pub struct DiskCacheKey {
+    pub effect_id: *const c_char,
+    /// Effect version as reported by `getLiveEffects`, e.g. "1.0"
+    pub effect_version: *const c_char,
+    /// Hash of the params JSON
+    pub params_hash: u64,
+    /// Hash of the source pixels as rasterized by the host
+    pub pixels_hash: u64,
+    pub dpi: i32,
+    /// Source size
+    pub width: u32,
+    pub height: u32,
+}
+
+impl DiskCacheKey {
+    pub fn to_result_key(&self) -> ResultKey {
+        ResultKey {
+            effect_id: unsafe { CStr::from_ptr(self.effect_id) }
+                .to_string_lossy()
+                .into_owned(),
+            effect_version: unsafe { CStr::from_ptr(self.effect_version) }
+                .to_string_lossy()
+                .into_owned(),
+            params_hash: self.params_hash,
+            pixels_hash: self.pixels_hash,
+            dpi: self.dpi,
+            width: self.width,
+            height: self.height,
+        }
+    }
+}
+
+/// Output read back from the cache
+pub struct CachedPixels {
+    pub width: u32,
+    pub height: u32,
+    pub data: Vec<u8>,
+}
+
+struct PendingWrite {
+    key: ResultKey,
+    width: u32,
+    height: u32,
+    data: Vec<u8>,
+}
+
+pub struct DiskCache {
+    dir: PathBuf,
+    /// 0 disables the cache
+    budget: AtomicU64,
+    writer: Mutex<Option<SyncSender<PendingWrite>>>,
+    dropped_writes: AtomicUsize,
+    /// Set once the directory has been swept and counted, see `open`
+    opened: OnceCell<()>,
+    /// Bytes of entries in the directory, as far as this process knows
+    used: AtomicU64,
+}
+
+pub static DISK_CACHE: Lazy<DiskCache> =
+    Lazy::new(|| DiskCache::new(crate::package_root_dir().join("cache").join("results")));
+
+impl DiskCache {
+    pub fn new(dir: PathBuf) -> Self {
+        Self {
+            dir,
+            budget: AtomicU64::new(DEFAULT_BUDGET),
+            writer: Mutex::new(None),
+            dropped_writes: AtomicUsize::new(0),
+            opened: OnceCell::new(),
+            used: AtomicU64::new(0),
+        }
+    }
+
+    /// Removes temp files left by a crash mid-write and counts the entries.
+    /// Runs on first use, later calls return at once.
+    fn open(&self) {
+        self.opened.get_or_init(|| {
+            let read_dir = match fs::read_dir(&self.dir) {
+                Ok(read_dir) => read_dir,
+                Err(_) => return,
+            };
+
+            let mut used = 0;
+            for entry in read_dir.filter_map(|entry| entry.ok()) {
+                let path = entry.path();
+                if is_entry_file(&path) {
+                    used += entry.metadata().map_or(0, |meta| meta.len());
+                } else if is_stale_temp_file(&path) {
+                    let _ = fs::remove_file(&path);
+                }
+            }
+            self.used.store(used, Ordering::SeqCst);
+        });
+    }
+
+    pub fn set_budget(&self, budget: u64) {
+        self.budget.store(budget, Ordering::SeqCst);
+        self.open();
+        if let Err(e) = self.evict() {
+            dai_println!("disk_cache: eviction failed: {}", e);
+        }
+    }
+
+    pub fn budget(&self) -> u64 {
+        self.budget.load(Ordering::SeqCst)
+    }
+
+    pub fn is_enabled(&self) -> bool {
+        self.budget() > 0
+    }
+
+    /// Writes dropped because the background thread fell behind
+    pub fn dropped_writes(&self) -> usize {
+        self.dropped_writes.load(Ordering::SeqCst)
+    }
+
+    fn entry_path(&self, key: &ResultKey) -> PathBuf {
+        self.dir.join(key.file_name())
+    }
+
+    pub fn read(&self, key: &ResultKey) -> Option<CachedPixels> {
+        if !self.is_enabled() {
+            return None;
+        }
+
+        self.open();
+
+        let path = self.entry_path(key);
+        let file = File::open(&path).ok()?;
+
+        match read_entry(&file) {
+            Ok(pixels) => {
+                drop(file);
+                touch(&path);
+                Some(pixels)
+            }
+            Err(e) => {
+                dai_println!("disk_cache: dropping unreadable entry {:?}: {}", path, e);
+                let len = file.metadata().map_or(0, |meta| meta.len());
+                drop(file);
+                if fs::remove_file(&path).is_ok() {
+                    self.sub_used(len);
+                }
+                None
+            }
+        }
+    }
+
+    /// Writes on the calling thread. Hosts go through `write_in_background`.
+    pub fn write(&self, key: &ResultKey, width: u32, height: u32, data: &[u8]) -> io::Result<()> {
+        if !self.is_enabled() {
+            return Ok(());
+        }
+
+        fs::create_dir_all(&self.dir)?;
+        self.open();
+
+        let path = self.entry_path(key);
+        // Readers only ever see complete entries
+        let tmp_path =
+            path.with_extension(format!("{}{}", TEMP_EXTENSION_PREFIX, std::process::id()));
+
+        {
+            let mut writer = BufWriter::new(File::create(&tmp_path)?);
+            writer.write_all(MAGIC)?;
+            writer.write_all(&FORMAT_VERSION.to_le_bytes())?;
+            writer.write_all(&width.to_le_bytes())?;
+            writer.write_all(&height.to_le_bytes())?;
+            writer.write_all(&(data.len() as u64).to_le_bytes())?;
+
+            let mut encoder = DeflateEncoder::new(writer, Compression::fast());
+            encoder.write_all(data)?;
+            encoder.finish()?.flush()?;
+        }
+
+        let written = fs::metadata(&tmp_path)?.len();
+        // The same key may be written twice when two renders race
+        let replaced = fs::metadata(&path).map_or(0, |meta| meta.len());
+        if let Err(e) = fs::rename(&tmp_path, &path) {
+            let _ = fs::remove_file(&tmp_path);
+            return Err(e);
+        }
+
+        self.sub_used(replaced);
+        let used = self.used.fetch_add(written, Ordering::SeqCst) + written;
+        if used > self.budget() {
+            self.evict()?;
+        }
+        Ok(())
+    }
+
+    fn sub_used(&self, len: u64) {
+        let _ = self
+            .used
+            .fetch_update(Ordering::SeqCst, Ordering::SeqCst, |used| {
+                Some(used.saturating_sub(len))
+            });
+    }
+
+    /// Writes on a background thread, so compression never delays the effect that
+    /// produced `data`. Returns false when the write was dropped.
+    pub fn write_in_background(
+        &'static self,
+        key: ResultKey,
+        width: u32,
+        height: u32,
+        data: Vec<u8>,
+    ) -> bool {
+        if !self.is_enabled() {
+            return false;
+        }
+
+        let mut writer = self.writer.lock().unwrap();
+        let sender = writer.get_or_insert_with(|| {
+            let (sender, receiver) = sync_channel::<PendingWrite>(PENDING_WRITES);
+            std::thread::Builder::new()
+                .name("ai-deno-disk-cache".to_string())
+                .spawn(move || {
+                    for pending in receiver {
+                        if let Err(e) =
+                            self.write(&pending.key, pending.width, pending.height, &pending.data)
+                        {
+                            dai_println!("disk_cache: write failed: {}", e);
+                        }
+                    }
+                })
+                .expect("ai-deno: Failed to spawn disk cache writer");
+            sender
+        });
+
+        match sender.try_send(PendingWrite {
+            key,
+            width,
+            height,
+            data,
+        }) {
+            Ok(()) => true,
+            Err(TrySendError::Full(_)) => {
+                self.dropped_writes.fetch_add(1, Ordering::SeqCst);
+                false
+            }
+            Err(TrySendError::Disconnected(_)) => {
+                *writer = None;
+                false
+            }
+        }
+    }
+
+    /// Deletes least recently read entries until the directory fits the budget.
+    /// Rescans the directory, which also corrects the running byte count.
+    pub fn evict(&self) -> io::Result<()> {
+        let budget = self.budget();
+
+        let read_dir = match fs::read_dir(&self.dir) {
+            Ok(read_dir) => read_dir,
+            Err(e) if e.kind() == io::ErrorKind::NotFound => return Ok(()),
+            Err(e) => return Err(e),
+        };
+
+        let mut entries: Vec<(PathBuf, u64, SystemTime)> = read_dir
+            .filter_map(|entry| entry.ok())
+            .filter(|entry| is_entry_file(&entry.path()))
+            .filter_map(|entry| {
+                let meta = entry.metadata().ok()?;
+                let modified = meta.modified().unwrap_or(SystemTime::UNIX_EPOCH);
+                Some((entry.path(), meta.len(), modified))
+            })
+            .collect();
+
+        let mut total: u64 = entries.iter().map(|(_, len, _)| len).sum();
+        if total <= budget {
+            self.used.store(total, Ordering::SeqCst);
+            return Ok(());
+        }
+
+        entries.sort_by_key(|(_, _, modified)| *modified);
+        for (path, len, _) in entries {
+            if total <= budget {
+                break;
+            }
+            if fs::remove_file(&path).is_ok() {
+                total -= len;
+            }
+        }
+
+        self.used.store(total, Ordering::SeqCst);
+        Ok(())
+    }
+}
+
+fn is_entry_file(path: &Path) -> bool {
+    path.extension().map_or(false, |ext| ext == ENTRY_EXTENSION)
+}
+
+/// Nothing of this process is mid-write yet when the cache opens, so a temp file
+/// found then is left over by a crash. A host sharing the directory may still be
+/// writing it, in which case it just fails that write.
+fn is_stale_temp_file(path: &Path) -> bool {
+    path.extension()
+        .and_then(|ext| ext.to_str())
+        .map_or(false, |ext| ext.starts_with(TEMP_EXTENSION_PREFIX))
+}
+
+/// Recency for eviction. Best effort: on a read-only directory, or without
+/// write access to the entry, it keeps its old mtime and only goes earlier.
+fn touch(path: &Path) {
+    if let Ok(file) = OpenOptions::new().write(true).open(path) {
+        let _ = file.set_modified(SystemTime::now());
+    }
+}
+
+fn read_entry(file: &File) -> io::Result<CachedPixels> {
+    let map = unsafe { Mmap::map(file)? };
+    if map.len() < HEADER_LEN || &map[0..4] != MAGIC {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "not a cache entry",
+        ));
+    }
+
+    let u32_at = |at: usize| u32::from_le_bytes(map[at..at + 4].try_into().unwrap());
+    if u32_at(4) != FORMAT_VERSION {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "unknown format version",
+        ));
+    }
+
+    let width = u32_at(8);
+    let height = u32_at(12);
+    let byte_length = u64::from_le_bytes(map[16..24].try_into().unwrap()) as usize;
+
+    let mut data = Vec::with_capacity(byte_length);
+    DeflateDecoder::new(&map[HEADER_LEN..]).read_to_end(&mut data)?;
+
+    if data.len() != byte_length || byte_length < width as usize * height as usize * 4 {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "truncated entry",
+        ));
+    }
+
+    Ok(CachedPixels {
+        width,
+        height,
+        data,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_cache(name: &str) -> DiskCache {
+        let dir = std::env::temp_dir().join(format!(
+            "ai-deno-disk-cache-{}-{}",
+            name,
+            std::process::id()
+        ));
+        let _ = fs::remove_dir_all(&dir);
+        DiskCache::new(dir)
+    }
+
+    fn key(params_hash: u64) -> ResultKey {
+        ResultKey {
+            effect_id: "la.hanak.test".to_string(),
+            effect_version: "1.0".to_string(),
+            params_hash,
+            pixels_hash: 42,
+            dpi: 72,
+            width: 4,
+            height: 2,
+        }
+    }
+
+    fn pixels(seed: u8) -> Vec<u8> {
+        (0..4 * 2 * 4)
+            .map(|i| (i as u8).wrapping_mul(seed))
+            .collect()
+    }
+
+    #[test]
+    fn round_trips_entries() {
+        let cache = temp_cache("round-trip");
+        cache.write(&key(1), 4, 2, &pixels(3)).unwrap();
+
+        let read = cache.read(&key(1)).unwrap();
+        assert_eq!((read.width, read.height), (4, 2));
+        assert_eq!(read.data, pixels(3));
+
+        assert!(cache.read(&key(2)).is_none());
+        let _ = fs::remove_dir_all(&cache.dir);
+    }
+
+    #[test]
+    fn drops_corrupted_entries() {
+        let cache = temp_cache("corrupted");
+        cache.write(&key(1), 4, 2, &pixels(3)).unwrap();
+
+        let path = cache.entry_path(&key(1));
+        let mut bytes = fs::read(&path).unwrap();
+        bytes.truncate(HEADER_LEN + 2);
+        fs::write(&path, bytes).unwrap();
+
+        assert!(cache.read(&key(1)).is_none());
+        assert!(!path.exists());
+        let _ = fs::remove_dir_all(&cache.dir);
+    }
+
+    #[test]
+    fn evicts_least_recently_read_entries() {
+        let cache = temp_cache("evict");
+        for i in 0..3 {
+            cache.write(&key(i), 4, 2, &pixels(3)).unwrap();
+            // Make mtimes distinct even on coarse filesystems
+            let path = cache.entry_path(&key(i));
+            let file = OpenOptions::new().write(true).open(&path).unwrap();
+            file.set_modified(SystemTime::UNIX_EPOCH + std::time::Duration::from_secs(i + 1))
+                .unwrap();
+        }
+
+        // Reading the oldest one makes it the most recent
+        assert!(cache.read(&key(0)).is_some());
+
+        let entry_len = fs::metadata(cache.entry_path(&key(0))).unwrap().len();
+        cache.set_budget(entry_len * 2);
+
+        assert!(cache.entry_path(&key(0)).exists());
+        assert!(!cache.entry_path(&key(1)).exists());
+        assert!(cache.entry_path(&key(2)).exists());
+        let _ = fs::remove_dir_all(&cache.dir);
+    }
+
+    #[test]
+    fn evicts_once_writes_go_over_budget() {
+        let cache = temp_cache("running-total");
+        cache.write(&key(0), 4, 2, &pixels(3)).unwrap();
+        let entry_len = fs::metadata(cache.entry_path(&key(0))).unwrap().len();
+
+        cache.budget.store(entry_len * 2, Ordering::SeqCst);
+        for i in 1..4 {
+            cache.write(&key(i), 4, 2, &pixels(3)).unwrap();
+        }
+
+        let kept = (0..4)
+            .filter(|i| cache.entry_path(&key(*i)).exists())
+            .count();
+        assert_eq!(kept, 2);
+        assert_eq!(cache.used.load(Ordering::SeqCst), entry_len * 2);
+        let _ = fs::remove_dir_all(&cache.dir);
+    }
+
+    #[test]
+    fn sweeps_stale_temp_files_on_open() {
+        let cache = temp_cache("stale-temp");
+        fs::create_dir_all(&cache.dir).unwrap();
+        let stale = cache.entry_path(&key(1)).with_extension("tmp1");
+        fs::write(&stale, b"partial").unwrap();
+
+        cache.write(&key(2), 4, 2, &pixels(3)).unwrap();
+
+        assert!(!stale.exists());
+        assert!(cache.entry_path(&key(2)).exists());
+        let _ = fs::remove_dir_all(&cache.dir);
+    }
+
+    #[test]
+    fn disabled_cache_neither_reads_nor_writes() {
+        let cache = temp_cache("disabled");
+        cache.set_budget(0);
+        cache.write(&key(1), 4, 2, &pixels(3)).unwrap();
+
+        assert!(!cache.entry_path(&key(1)).exists());
+        assert!(cache.read(&key(1)).is_none());
+    }
+}
@@ -0,0 +1,653 @@
+//! Long-lived threads that own a Deno runtime.
+//!
+//! A Deno runtime is bound to the thread that created it, so every runtime
+//! (the main one and the pooled ones for parallel rendering) lives on an
+//! executor thread of its own. FFI calls are shipped to it through a bounded
+//! queue, which keeps the host's thread free of the runtime's state and lets
+//! the JS event loop's `LocalSet` live across calls.
+//!
+//! Calls are either blocking (`run`) or future-style (`submit`, then wait on
+//! or poll the returned `Pending`).
+//!
+//! The host expects its callbacks (alerts, color adjustments, ...) on the thread
+//! that called into it, not on an executor. A job hands them to the thread
+//! waiting for it with `call_on_caller` or `post_to_caller`, which runs them
+//! while it waits and sends their result back.
+
+use std::cell::RefCell;
+use std::ffi::c_void;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::mpsc::{self, Receiver, RecvError, SyncSender, TryRecvError};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+use std::time::Instant;
+
+use crate::dai_println;
+use crate::AiMain;
+
+/// Calls waiting for the executor. Submitting beyond this blocks the caller.
+const QUEUE_CAPACITY: usize = 64;
+
+type Job = Box<dyn FnOnce(&mut AiMain) + Send>;
+
+/// A host callback, run on the thread waiting for the job that made it
+pub type HostCall = Box<dyn FnOnce() + Send>;
+
+/// Host calls nobody waited for, run by the next caller waiting on the executor
+type Deferred = Arc<Mutex<Vec<HostCall>>>;
+
+type CallerSender = Box<dyn Fn(HostCall) -> Result<(), HostCall>>;
+
+/// What a job sends the thread waiting for it
+enum ToCaller<R> {
+    HostCall(HostCall),
+    Done(R),
+}
+
+struct Queued {
+    job: Job,
+    queued_at: Instant,
+}
+
+/// Counters of an executor since it started. Times are in microseconds.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default)]
+pub struct ExecutorMetrics {
+    /// Calls submitted but not started yet
+    pub queue_depth: u64,
+    pub max_queue_depth: u64,
+    pub completed: u64,
+    /// Time calls spent in the queue
+    pub total_wait_us: u64,
+    pub max_wait_us: u64,
+    /// Time calls spent running on the executor
+    pub total_exec_us: u64,
+    pub max_exec_us: u64,
+}
+
+#[derive(Default)]
+struct Counters {
+    submitted: AtomicU64,
+    started: AtomicU64,
+    max_queue_depth: AtomicU64,
+    completed: AtomicU64,
+    total_wait_us: AtomicU64,
+    max_wait_us: AtomicU64,
+    total_exec_us: AtomicU64,
+    max_exec_us: AtomicU64,
+}
+
+pub struct Executor {
+    /// Taken on drop to close the queue
+    jobs: Option<SyncSender<Queued>>,
+    counters: Arc<Counters>,
+    deferred: Deferred,
+    thread: Option<JoinHandle<()>>,
+}
+
+/// Result of a submitted job. Waiting or polling on it also runs the host calls
+/// the job makes, on the waiting thread.
+pub struct Pending<R> {
+    receiver: Receiver<ToCaller<R>>,
+    deferred: Deferred,
+}
+
+thread_local! {
+    /// Tasks the JS side spawns (WebGPU callbacks among them) run here. Reused by
+    /// every call on the executor instead of being rebuilt each time.
+    static LOCAL_SET: RefCell<Option<tokio::task::LocalSet>> = RefCell::new(None);
+
+    /// Host calls of the running job go to its caller through this, which
+    /// hands them back when the caller stopped waiting
+    static CALLER: RefCell<Option<CallerSender>> = RefCell::new(None);
+
+    static DEFERRED: RefCell<Option<Deferred>> = RefCell::new(None);
+}
+
+/// Runs `call` on the thread waiting for the running job and waits for its
+/// result. None when nothing can run it: outside an executor, or for a job
+/// nobody waits for (`warm_up_live_effects`).
+pub fn call_on_caller<R, F>(call: F) -> Option<R>
+where
+    R: Send + 'static,
+    F: FnOnce() -> R + Send + 'static,
+{
+    let (reply, result) = mpsc::sync_channel(1);
+    let call: HostCall = Box::new(move || {
+        let _ = reply.send(call());
+    });
+
+    let sent = CALLER.with(|caller| match caller.borrow().as_ref() {
+        Some(caller) => caller(call).is_ok(),
+        None => false,
+    });
+
+    if !sent {
+        return None;
+    }
+    result.recv().ok()
+}
+
+/// Runs `call` on the thread waiting for the running job, without waiting for
+/// it. When nobody waits, the next caller of this executor runs it.
+pub fn post_to_caller<F>(call: F)
+where
+    F: FnOnce() + Send + 'static,
+{
+    let unsent = CALLER.with(|caller| match caller.borrow().as_ref() {
+        Some(caller) => caller(Box::new(call)).err(),
+        None => Some(Box::new(call) as HostCall),
+    });
+
+    if let Some(call) = unsent {
+        DEFERRED.with(|deferred| match deferred.borrow().as_ref() {
+            Some(deferred) => deferred.lock().unwrap().push(call),
+            None => dai_println!("post_to_caller: dropped a host call made off an executor"),
+        });
+    }
+}
+
+/// Routes `post_to_caller` and `call_on_caller` to a job's caller while it runs
+struct CallerScope;
+
+impl CallerScope {
+    fn enter(caller: CallerSender) -> Self {
+        CALLER.with(|slot| *slot.borrow_mut() = Some(caller));
+        CallerScope
+    }
+}
+
+impl Drop for CallerScope {
+    fn drop(&mut self) {
+        // Also on panic, or the caller would wait on the dropped job forever
+        CALLER.with(|slot| slot.borrow_mut().take());
+    }
+}
+
+impl<R> Pending<R> {
+    fn run_deferred(&self) {
+        let calls = std::mem::take(&mut *self.deferred.lock().unwrap());
+        for call in calls {
+            call();
+        }
+    }
+
+    /// Waits for the result. Fails if the job panicked or never ran.
+    pub fn recv(&self) -> Result<R, RecvError> {
+        loop {
+            match self.receiver.recv()? {
+                ToCaller::HostCall(call) => call(),
+                ToCaller::Done(result) => {
+                    // Jobs before this one are done too, and so are their host calls
+                    self.run_deferred();
+                    return Ok(result);
+                }
+            }
+        }
+    }
+
+    pub fn try_recv(&self) -> Result<R, TryRecvError> {
+        loop {
+            match self.receiver.try_recv()? {
+                ToCaller::HostCall(call) => call(),
+                ToCaller::Done(result) => {
+                    self.run_deferred();
+                    return Ok(result);
+                }
+            }
+        }
+    }
+}
+
+/// Blocks on `future` within the executor's `LocalSet`
+pub fn block_on_local<F: std::future::Future>(
+    tokio_runtime: &tokio::runtime::Runtime,
+    future: F,
+) -> F::Output {
+    // Taken out for the call, so a nested call falls back to a set of its own
+    let local_set = LOCAL_SET
+        .with(|slot| slot.borrow_mut().take())
+        .unwrap_or_default();
+    let output = local_set.block_on(tokio_runtime, future);
+    LOCAL_SET.with(|slot| *slot.borrow_mut() = Some(local_set));
+    output
+}
+
+impl Executor {
+    /// Starts an executor whose runtime is built by `create` on the executor
+    /// thread. Calls submitted before it's ready wait for it.
+    pub fn spawn<F>(name: String, create: F) -> std::io::Result<Executor>
+    where
+        F: FnOnce() -> Box<AiMain> + Send + 'static,
+    {
+        let (sender, receiver) = mpsc::sync_channel::<Queued>(QUEUE_CAPACITY);
+        let counters = Arc::new(Counters::default());
+        let thread_counters = counters.clone();
+        let deferred = Deferred::default();
+        let thread_deferred = deferred.clone();
+
+        let thread = std::thread::Builder::new().name(name).spawn(move || {
+            DEFERRED.with(|slot| *slot.borrow_mut() = Some(thread_deferred));
+            let mut ai_main = create();
+            let counters = thread_counters;
+
+            for Queued { job, queued_at } in receiver {
+                counters.started.fetch_add(1, Ordering::SeqCst);
+                let wait_us = queued_at.elapsed().as_micros() as u64;
+                counters.total_wait_us.fetch_add(wait_us, Ordering::Relaxed);
+                counters.max_wait_us.fetch_max(wait_us, Ordering::Relaxed);
+
+                let started_at = Instant::now();
+                job(&mut *ai_main);
+
+                let exec_us = started_at.elapsed().as_micros() as u64;
+                counters.total_exec_us.fetch_add(exec_us, Ordering::Relaxed);
+                counters.max_exec_us.fetch_max(exec_us, Ordering::Relaxed);
+                counters.completed.fetch_add(1, Ordering::SeqCst);
+            }
+
+            dai_println!("Executor stopped");
+        })?;
+
+        Ok(Executor {
+            jobs: Some(sender),
+            counters,
+            deferred,
+            thread: Some(thread),
+        })
+    }
+
+    /// Queues `job` and returns where its result will arrive. It fails without
+    /// a value if the job panicked.
+    pub fn submit<R, F>(&self, job: F) -> Option<Pending<R>>
+    where
+        R: Send + 'static,
+        F: FnOnce(&mut AiMain) -> R + Send + 'static,
+    {
+        let (reply, receiver) = mpsc::channel();
+        let job: Job = Box::new(move |ai_main| {
+            let host_calls = reply.clone();
+            let result = {
+                let _scope = CallerScope::enter(Box::new(move |call| {
+                    host_calls
+                        .send(ToCaller::HostCall(call))
+                        .map_err(|e| match e.0 {
+                            ToCaller::HostCall(call) => call,
+                            ToCaller::Done(_) => unreachable!(),
+                        })
+                }));
+                job(ai_main)
+            };
+            let _ = reply.send(ToCaller::Done(result));
+        });
+
+        let sender = self.jobs.as_ref()?;
+
+        let depth = self.counters.submitted.fetch_add(1, Ordering::SeqCst) + 1
+            - self.counters.started.load(Ordering::SeqCst);
+        self.counters
+            .max_queue_depth
+            .fetch_max(depth, Ordering::Relaxed);
+
+        sender
+            .send(Queued {
+                job,
+                queued_at: Instant::now(),
+            })
+            .ok()?;
+
+        Some(Pending {
+            receiver,
+            deferred: self.deferred.clone(),
+        })
+    }
+
+    /// Runs `job` on the executor and waits for its result
+    pub fn run<R, F>(&self, job: F) -> Option<R>
+    where
+        R: Send + 'static,
+        F: FnOnce(&mut AiMain) -> R + Send + 'static,
+    {
+        self.submit(job)?.recv().ok()
+    }
+
+    pub fn metrics(&self) -> ExecutorMetrics {
+        let c = &self.counters;
+        let submitted = c.submitted.load(Ordering::SeqCst);
+        let started = c.started.load(Ordering::SeqCst);
+
+        ExecutorMetrics {
+            queue_depth: submitted.saturating_sub(started),
+            max_queue_depth: c.max_queue_depth.load(Ordering::Relaxed),
+            completed: c.completed.load(Ordering::SeqCst),
+            total_wait_us: c.total_wait_us.load(Ordering::Relaxed),
+            max_wait_us: c.max_wait_us.load(Ordering::Relaxed),
+            total_exec_us: c.total_exec_us.load(Ordering::Relaxed),
+            max_exec_us: c.max_exec_us.load(Ordering::Relaxed),
+        }
+    }
+}
+
+impl Drop for Executor {
+    fn drop(&mut self) {
+        // Closing the queue lets the executor finish what was queued, then exit
+        self.jobs.take();
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+/// Pointers the caller keeps valid until the call on the executor completed
+pub struct CallerPtr<T>(pub *mut T);
+
+unsafe impl<T> Send for CallerPtr<T> {}
+
+impl<T> CallerPtr<T> {
+    pub fn get(&self) -> *mut T {
+        self.0
+    }
+}
+
+pub fn from_opaque<'a>(ai_main_ref: *mut c_void) -> &'a Executor {
+    unsafe { &*(ai_main_ref as *const Executor) }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::stub_host::{spawn_stub_runtime, HOST_CALLS};
+    use crate::{
+        dispose_go_live_effect_result, dispose_json_function_result, go_live_effect,
+        go_live_effect_submit, live_effect_adjust_colors, live_effect_ticket_cancel,
+        live_effect_ticket_is_ready, live_effect_ticket_wait, ImageDataPayload, OpaqueAiMain,
+    };
+    use std::ffi::CString;
+    use std::sync::atomic::AtomicUsize;
+    use std::sync::{Arc, Condvar, Mutex};
+
+    const EFFECTS: &str = r#"
+        export async function goLiveEffect(id, params, env, width, height, data) {
+            // Keeps the runtime busy long enough for requests to overlap
+            const until = Date.now() + params.delay;
+            while (Date.now() < until) {}
+            await Promise.resolve();
+            const out = new Uint8ClampedArray(data.length);
+            for (let i = 0; i < data.length; i++) out[i] = data[i] + params.add;
+            return { width, height, data: out };
+        }
+
+        export function liveEffectAdjustColors(id, params, adjustColor) {
+            const color = adjustColor({ r: 1, g: 0.5, b: 0, a: 1 });
+            return { hasChanged: color.g === 0.5, params };
+        }
+    "#;
+
+    /// Hands each request a free runtime, like the host's dispatcher does
+    struct Leases {
+        free: Mutex<Vec<usize>>,
+        returned: Condvar,
+    }
+
+    impl Leases {
+        fn acquire(&self) -> usize {
+            let mut free = self.free.lock().unwrap();
+            loop {
+                if let Some(index) = free.pop() {
+                    return index;
+                }
+                free = self.returned.wait(free).unwrap();
+            }
+        }
+
+        fn release(&self, index: usize) {
+            self.free.lock().unwrap().push(index);
+            self.returned.notify_one();
+        }
+    }
+
+    #[test]
+    fn runs_on_executor_thread() {
+        let executor = spawn_stub_runtime("executor_test.js", EFFECTS);
+        let caller = std::thread::current().id();
+
+        let ran_on = executor.run(|_| std::thread::current().id()).unwrap();
+        assert_ne!(ran_on, caller);
+        assert_eq!(executor.run(|_| 42), Some(42));
+    }
+
+    #[test]
+    fn host_calls_run_on_the_calling_thread() {
+        let executor = spawn_stub_runtime("executor_test.js", EFFECTS);
+        let caller = std::thread::current().id();
+
+        let (called_on, posted_on) = executor
+            .run(|_| {
+                let (posted, posted_on) = mpsc::channel();
+                post_to_caller(move || posted.send(std::thread::current().id()).unwrap());
+                let called_on = call_on_caller(|| std::thread::current().id());
+                (called_on, posted_on.recv().unwrap())
+            })
+            .unwrap();
+        assert_eq!(called_on, Some(caller));
+        assert_eq!(posted_on, caller);
+
+        // Nobody waits for this one, its host call goes to the next caller
+        let (posted, posted_on) = mpsc::channel();
+        drop(executor.submit(move |_| {
+            assert_eq!(call_on_caller(|| ()), None);
+            post_to_caller(move || posted.send(std::thread::current().id()).unwrap());
+        }));
+        executor.run(|_| ()).unwrap();
+        assert_eq!(posted_on.try_recv(), Ok(caller));
+    }
+
+    #[test]
+    fn adjust_color_callback_runs_on_the_calling_thread() {
+        let executor = spawn_stub_runtime("executor_test.js", EFFECTS);
+        let effect_id = CString::new("adjust").unwrap();
+        let params = CString::new("{}").unwrap();
+        let before = HOST_CALLS.with(|calls| calls.get());
+
+        let result = live_effect_adjust_colors(
+            &executor as *const Executor as OpaqueAiMain,
+            effect_id.as_ptr(),
+            params.as_ptr(),
+            std::ptr::null_mut(),
+        );
+        let result_ref = unsafe { &*result };
+        assert!(result_ref.success);
+        let json = unsafe { std::ffi::CStr::from_ptr(result_ref.json) }.to_string_lossy();
+        assert!(json.contains(r#""hasChanged":true"#), "{}", json);
+        dispose_json_function_result(result);
+
+        assert_eq!(HOST_CALLS.with(|calls| calls.get()), before + 1);
+    }
+
+    #[test]
+    fn submitted_calls_complete_in_order_and_are_measured() {
+        let executor = spawn_stub_runtime("executor_test.js", EFFECTS);
+
+        let receivers: Vec<_> = (0..10)
+            .map(|i| {
+                executor
+                    .submit(move |_| {
+                        std::thread::sleep(std::time::Duration::from_millis(1));
+                        i
+                    })
+                    .unwrap()
+            })
+            .collect();
+
+        let results: Vec<_> = receivers.iter().map(|r| r.recv().unwrap()).collect();
+        assert_eq!(results, (0..10).collect::<Vec<_>>());
+
+        let metrics = executor.metrics();
+        assert_eq!(metrics.queue_depth, 0);
+        assert!(metrics.max_queue_depth >= 2);
+        assert!(metrics.completed >= 10);
+        assert!(metrics.total_exec_us >= 10 * 1000);
+        assert!(metrics.max_wait_us > 0);
+    }
+
+    #[test]
+    fn submitted_render_can_be_polled_then_waited() {
+        let executor = spawn_stub_runtime("executor_test.js", EFFECTS);
+        let mut pixels = vec![1u8; 2 * 2 * 4];
+
+        let effect_id = CString::new("add").unwrap();
+        let params = CString::new(r#"{"add":2,"delay":50}"#).unwrap();
+        let env = CString::new(r#"{"dpi":72,"baseDpi":72,"isInPreview":false}"#).unwrap();
+        let mut input = ImageDataPayload {
+            width: 2,
+            height: 2,
+            data_ptr: pixels.as_mut_ptr() as *mut c_void,
+            byte_length: pixels.len(),
+        };
+
+        let ticket = go_live_effect_submit(
+            &executor as *const Executor as OpaqueAiMain,
+            effect_id.as_ptr(),
+            params.as_ptr(),
+            env.as_ptr(),
+            &mut input,
+            0,
+            0,
+        );
+        // The strings are copied, the caller may free them right away
+        drop((effect_id, params, env));
+        assert!(!live_effect_ticket_is_ready(ticket));
+
+        let result = live_effect_ticket_wait(ticket);
+        let result_ref = unsafe { &*result };
+        assert!(result_ref.success);
+        let lease = unsafe { &*result_ref.data };
+        let bytes =
+            unsafe { std::slice::from_raw_parts(lease.data_ptr as *const u8, lease.byte_length) };
+        assert!(bytes.iter().all(|&b| b == 3));
+        dispose_go_live_effect_result(result);
+    }
+
+    #[test]
+    fn cancelled_tickets_are_skipped_or_aborted() {
+        let executor = spawn_stub_runtime("executor_test.js", EFFECTS);
+        let env = CString::new(r#"{"dpi":72,"baseDpi":72,"isInPreview":false}"#).unwrap();
+        let effect_id = CString::new("add").unwrap();
+        let params = CString::new(r#"{"add":2,"delay":50}"#).unwrap();
+
+        let mut running_pixels = vec![1u8; 4];
+        let mut queued_pixels = vec![1u8; 4];
+        let submit = |pixels: &mut Vec<u8>| {
+            let mut input = ImageDataPayload {
+                width: 1,
+                height: 1,
+                data_ptr: pixels.as_mut_ptr() as *mut c_void,
+                byte_length: pixels.len(),
+            };
+            go_live_effect_submit(
+                &executor as *const Executor as OpaqueAiMain,
+                effect_id.as_ptr(),
+                params.as_ptr(),
+                env.as_ptr(),
+                &mut input,
+                0,
+                0,
+            )
+        };
+
+        let running = submit(&mut running_pixels);
+        let queued = submit(&mut queued_pixels);
+        live_effect_ticket_cancel(queued);
+        live_effect_ticket_cancel(running);
+
+        for ticket in [running, queued] {
+            let result = live_effect_ticket_wait(ticket);
+            let result_ref = unsafe { &*result };
+            assert!(!result_ref.success);
+            assert!(result_ref.cancelled);
+            dispose_go_live_effect_result(result);
+        }
+        assert_eq!(queued_pixels, vec![1u8; 4]);
+    }
+
+    #[test]
+    fn concurrent_requests_are_isolated() {
+        const RUNTIMES: usize = 4;
+        const CALLERS: usize = 16;
+        const REQUESTS: usize = 8;
+
+        let runtimes: Arc<Vec<Executor>> = Arc::new(
+            (0..RUNTIMES)
+                .map(|_| spawn_stub_runtime("executor_test.js", EFFECTS))
+                .collect(),
+        );
+        let leases = Arc::new(Leases {
+            free: Mutex::new((0..RUNTIMES).collect()),
+            returned: Condvar::new(),
+        });
+        let in_flight = Arc::new(AtomicUsize::new(0));
+        let peak = Arc::new(AtomicUsize::new(0));
+
+        let callers: Vec<_> = (0..CALLERS)
+            .map(|caller| {
+                let (runtimes, leases) = (runtimes.clone(), leases.clone());
+                let (in_flight, peak) = (in_flight.clone(), peak.clone());
+
+                std::thread::spawn(move || {
+                    for request in 0..REQUESTS {
+                        let add = ((caller * REQUESTS + request) % 200) as u8;
+                        let mut pixels = vec![request as u8; 8 * 8 * 4];
+
+                        let index = leases.acquire();
+                        let now = in_flight.fetch_add(1, Ordering::SeqCst) + 1;
+                        peak.fetch_max(now, Ordering::SeqCst);
+
+                        let effect_id = CString::new("add").unwrap();
+                        let params =
+                            CString::new(format!(r#"{{"add":{},"delay":2}}"#, add)).unwrap();
+                        let env =
+                            CString::new(r#"{"dpi":72,"baseDpi":72,"isInPreview":false}"#).unwrap();
+                        let mut input = ImageDataPayload {
+                            width: 8,
+                            height: 8,
+                            data_ptr: pixels.as_mut_ptr() as *mut c_void,
+                            byte_length: pixels.len(),
+                        };
+
+                        let result = go_live_effect(
+                            &runtimes[index] as *const Executor as OpaqueAiMain,
+                            effect_id.as_ptr(),
+                            params.as_ptr(),
+                            env.as_ptr(),
+                            &mut input,
+                            0,
+                            0,
+                        );
+
+                        in_flight.fetch_sub(1, Ordering::SeqCst);
+                        leases.release(index);
+
+                        let result_ref = unsafe { &*result };
+                        assert!(result_ref.success);
+                        let lease = unsafe { &*result_ref.data };
+                        let bytes = unsafe {
+                            std::slice::from_raw_parts(
+                                lease.data_ptr as *const u8,
+                                lease.byte_length,
+                            )
+                        };
+                        assert!(bytes.iter().all(|&b| b == request as u8 + add));
+                        dispose_go_live_effect_result(result);
+                    }
+                })
+            })
+            .collect();
+
+        for caller in callers {
+            caller.join().unwrap();
+        }
+
+        assert!(peak.load(Ordering::SeqCst) > 1, "requests never overlapped");
+        assert!(peak.load(Ordering::SeqCst) <= RUNTIMES);
+    }
+}
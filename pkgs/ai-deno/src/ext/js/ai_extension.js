@@ -1,13 +1,31 @@
 import {
   op_ai_alert,
   op_ai_deno_get_user_locale,
+  op_ai_deno_get_effect_stats,
   op_aideno_debug_enabled,
   op_ai_get_plugin_version,
+  op_ai_deno_wait_cancelled,
+  op_ai_deno_is_cancelled,
+  op_ai_deno_trace_enabled,
+  op_ai_deno_trace_now,
+  op_ai_deno_trace_record,
+  op_ai_deno_pipeline_cache_record,
+  op_ai_deno_pipeline_cache_load,
+  op_ai_deno_report_init_failure,
 } from "ext:core/ops";
 
 globalThis._AI_DENO_ = {
   op_ai_alert,
   op_ai_deno_get_user_locale,
+  op_ai_deno_get_effect_stats,
   op_aideno_debug_enabled,
   op_ai_get_plugin_version,
+  op_ai_deno_wait_cancelled,
+  op_ai_deno_is_cancelled,
+  op_ai_deno_trace_enabled,
+  op_ai_deno_trace_now,
+  op_ai_deno_trace_record,
+  op_ai_deno_pipeline_cache_record,
+  op_ai_deno_pipeline_cache_load,
+  op_ai_deno_report_init_failure,
 };
@@ -2,5 +2,26 @@ declare var _AI_DENO_: {
   op_aideno_debug_enabled(): boolean;
   op_ai_alert(message: string): void;
   op_ai_deno_get_user_locale(): string;
+  op_ai_deno_get_effect_stats(effectId: string): string;
   op_ai_get_plugin_version(): string;
+  op_ai_deno_wait_cancelled(token: bigint): Promise<boolean>;
+  op_ai_deno_is_cancelled(token: bigint): boolean;
+  op_ai_deno_trace_enabled(): boolean;
+  op_ai_deno_trace_now(): number;
+  op_ai_deno_trace_record(
+    name: string,
+    traceId: number,
+    startNs: number,
+    endNs: number
+  ): void;
+  /** `pipelinesJson`: JSON array of `{ code, entryPoint, constants }` */
+  op_ai_deno_pipeline_cache_record(
+    adapter: string,
+    group: string,
+    pipelinesJson: string
+  ): void;
+  /** JSON array of `{ code, entryPoint, constants }` */
+  op_ai_deno_pipeline_cache_load(adapter: string, group: string): string;
+  /** Queues an init failure for the host to alert from its main thread */
+  op_ai_deno_report_init_failure(effectId: string, message: string): void;
 };
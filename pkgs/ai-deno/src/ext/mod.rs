@@ -6,11 +6,18 @@ use std::ffi::{CStr, CString};
 use std::string;
 use std::{cell::RefCell, rc::Rc};
 
-use crate::ai_deno_get_user_locale;
+use crate::cancellation;
+use crate::executor;
+use crate::init_failures;
+use crate::pipeline_cache::{NewPipeline, PIPELINE_INDEX};
+use crate::trace;
 use crate::{ai_deno_alert, dai_println};
+use crate::{ai_deno_get_effect_stats, free};
 
 pub struct AiExtOptions {
     // pub alert: fn(&str),
+    /// Asked from Illustrator by the thread that started the runtime
+    pub user_locale: String,
 }
 
 #[derive(Serialize, Deserialize)]
@@ -21,7 +28,21 @@ struct AlertRequest {
 
 extension!(
     ai_user_extension,
-    ops = [op_ai_alert, op_ai_get_plugin_version, op_ai_deno_get_user_locale, op_aideno_debug_enabled],
+    ops = [
+        op_ai_alert,
+        op_ai_get_plugin_version,
+        op_ai_deno_get_user_locale,
+        op_ai_deno_get_effect_stats,
+        op_aideno_debug_enabled,
+        op_ai_deno_wait_cancelled,
+        op_ai_deno_is_cancelled,
+        op_ai_deno_trace_enabled,
+        op_ai_deno_trace_now,
+        op_ai_deno_trace_record,
+        op_ai_deno_pipeline_cache_record,
+        op_ai_deno_pipeline_cache_load,
+        op_ai_deno_report_init_failure,
+    ],
     esm_entry_point = "ext:ai-deno/init",
     esm = [
         dir "src/ext",
@@ -47,9 +68,9 @@ fn op_ai_alert(state: Rc<RefCell<OpState>>, #[string] message: String) -> Result
 
     dai_println!("op_ai_alert: {}", message);
 
-    unsafe {
-        ai_deno_alert(CString::new(message).unwrap().as_ptr());
-    }
+    // A modal dialog of Illustrator, shown by the thread that called in
+    let message = CString::new(message).unwrap();
+    executor::post_to_caller(move || unsafe { ai_deno_alert(message.as_ptr()) });
 
     Ok(())
 }
@@ -59,13 +80,32 @@ fn op_ai_alert(state: Rc<RefCell<OpState>>, #[string] message: String) -> Result
 #[op2]
 #[string]
 fn op_ai_deno_get_user_locale(state: Rc<RefCell<OpState>>) -> String {
-    let locale = unsafe {
-        CStr::from_ptr(ai_deno_get_user_locale())
-            .to_string_lossy()
-            .to_string()
+    state.borrow().borrow::<AiExtOptions>().user_locale.clone()
+}
+
+/// The host's stats of an effect as JSON (calls, cache hits, latency
+/// percentiles, ...), "null" for effects it never rendered or when no caller
+/// waits to read them
+#[op2]
+#[string]
+fn op_ai_deno_get_effect_stats(#[string] effect_id: String) -> String {
+    let Ok(effect_id) = CString::new(effect_id) else {
+        return "null".to_string();
     };
 
-    locale.to_string()
+    // The host reads its stats map on the thread that called in
+    let stats = executor::call_on_caller(move || unsafe {
+        let stats = ai_deno_get_effect_stats(effect_id.as_ptr());
+        if stats.is_null() {
+            return None;
+        }
+
+        let json = CStr::from_ptr(stats).to_string_lossy().to_string();
+        free(stats as *mut std::ffi::c_void);
+        Some(json)
+    });
+
+    stats.flatten().unwrap_or_else(|| "null".to_string())
 }
 
 #[op2(fast)]
@@ -76,3 +116,75 @@ fn op_aideno_debug_enabled(state: Rc<RefCell<OpState>>) -> Result<bool, JsErrorB
         Ok(false)
     }
 }
+
+/// Resolves with true when the render of `token_id` is cancelled, false when it
+/// finishes first (or was never cancellable).
+#[op2(async)]
+async fn op_ai_deno_wait_cancelled(#[bigint] token_id: u64) -> bool {
+    match cancellation::find(token_id) {
+        Some(token) => token.settled().await,
+        None => false,
+    }
+}
+
+#[op2(fast)]
+fn op_ai_deno_is_cancelled(#[bigint] token_id: u64) -> bool {
+    cancellation::find(token_id).map_or(false, |token| token.is_cancelled())
+}
+
+#[op2(fast)]
+fn op_ai_deno_trace_enabled() -> bool {
+    trace::is_enabled()
+}
+
+/// Nanoseconds on the trace clock. A double, JS has no cheaper 64-bit integer.
+#[op2(fast)]
+fn op_ai_deno_trace_now() -> f64 {
+    trace::now_ns() as f64
+}
+
+/// Records a JS span of the render `trace_id`, times from `op_ai_deno_trace_now`
+#[op2(fast)]
+fn op_ai_deno_trace_record(#[string] name: String, trace_id: f64, start_ns: f64, end_ns: f64) {
+    trace::record("js", name, trace_id as u64, start_ns as u64, end_ns as u64);
+}
+
+/// Remembers the pipelines the effect `group` created on `adapter`, see
+/// `pipeline_cache`. `pipelines_json` is an array of
+/// `{ code, entryPoint, constants }`, written to the index in one go.
+#[op2(fast)]
+fn op_ai_deno_pipeline_cache_record(
+    #[string] adapter: String,
+    #[string] group: String,
+    #[string] pipelines_json: String,
+) {
+    let pipelines = match serde_json::from_str::<Vec<NewPipeline>>(&pipelines_json) {
+        Ok(pipelines) => pipelines,
+        Err(e) => {
+            dai_println!("pipeline_cache: unreadable pipelines: {}", e);
+            return;
+        }
+    };
+
+    let mut index = PIPELINE_INDEX.lock().unwrap();
+    if let Err(e) = index.record(&adapter, &group, &pipelines) {
+        dai_println!("pipeline_cache: failed to record pipelines: {}", e);
+    }
+}
+
+/// The pipelines `group` created on `adapter` in earlier sessions, as a JSON
+/// array of `{ code, entryPoint, constants }`
+#[op2]
+#[string]
+fn op_ai_deno_pipeline_cache_load(#[string] adapter: String, #[string] group: String) -> String {
+    let pipelines = PIPELINE_INDEX.lock().unwrap().pipelines(&adapter, &group);
+    serde_json::to_string(&pipelines).unwrap_or_else(|_| "[]".to_string())
+}
+
+/// Queues the init failure of `effect_id` for the host, see `init_failures`.
+/// Inits run inside renders, which must never show an alert themselves.
+#[op2(fast)]
+fn op_ai_deno_report_init_failure(#[string] effect_id: String, #[string] message: String) {
+    dai_println!("op_ai_deno_report_init_failure: {}", message);
+    init_failures::report(&effect_id, message);
+}
@@ -0,0 +1,338 @@
+//! Ownership of pixel buffers crossing the FFI boundary.
+//!
+//! Each side frees only what it allocated, and pixels are never copied:
+//!
+//! - Input: the host lends its buffer through `ImageDataPayload`. V8 wraps the
+//!   pointer in a backing store that never frees it, and `go_live_effect`
+//!   detaches the ArrayBuffer before returning so JS can't keep a view of memory
+//!   that goes back to the host.
+//! - Output: the host receives an `ImageDataLease` pointing straight into the V8
+//!   backing store of the returned array. The lease keeps that store alive until
+//!   `release` is called (`dispose_go_live_effect_result` does it at the latest).
+//!
+//! When an effect returns the buffer it was given, the lease points into the
+//! host's own buffer, so the host must keep it alive until the lease is released.
+
+use deno_runtime::deno_core::v8;
+use std::ffi::c_void;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use crate::ImageDataPayload;
+
+#[repr(C)]
+pub struct ImageDataLease {
+    pub width: u32,
+    pub height: u32,
+    pub data_ptr: *mut c_void,
+    pub byte_length: usize,
+    /// Opaque owner of `data_ptr`, null once released
+    pub owner: *mut c_void,
+    /// Hands the pixels back to their owner. Calling it more than once is a no-op.
+    pub release: extern "C" fn(lease: *mut ImageDataLease),
+}
+
+static LIVE_LEASES: AtomicUsize = AtomicUsize::new(0);
+static LENT_BUFFERS: AtomicUsize = AtomicUsize::new(0);
+
+/// Output leases not released yet
+pub fn live_leases() -> usize {
+    LIVE_LEASES.load(Ordering::SeqCst)
+}
+
+/// Host buffers V8 still holds a backing store for
+pub fn lent_buffers() -> usize {
+    LENT_BUFFERS.load(Ordering::SeqCst)
+}
+
+/// Wraps a host buffer in a backing store V8 can read and write but never frees.
+pub fn lend_host_buffer(payload: &ImageDataPayload) -> v8::SharedRef<v8::BackingStore> {
+    LENT_BUFFERS.fetch_add(1, Ordering::SeqCst);
+
+    unsafe {
+        v8::ArrayBuffer::new_backing_store_from_ptr(
+            payload.data_ptr,
+            payload.byte_length,
+            lent_backing_store_deleter,
+            std::ptr::null_mut(),
+        )
+    }
+    .make_shared()
+}
+
+unsafe extern "C" fn lent_backing_store_deleter(
+    _data: *mut c_void,
+    _byte_length: usize,
+    _deleter_data: *mut c_void,
+) {
+    // The memory belongs to the host, only the bookkeeping is ours
+    LENT_BUFFERS.fetch_sub(1, Ordering::SeqCst);
+}
+
+/// Leases the pixels of `view` to the host, honoring its offset into the buffer.
+pub fn lease_pixels(
+    width: u32,
+    height: u32,
+    view: v8::Local<v8::Uint8ClampedArray>,
+) -> Option<ImageDataLease> {
+    let store = view.get_backing_store()?;
+    let base = store.data()?.cast::<u8>().as_ptr();
+    let data_ptr = unsafe { base.add(view.byte_offset()) } as *mut c_void;
+    let byte_length = view.byte_length();
+
+    LIVE_LEASES.fetch_add(1, Ordering::SeqCst);
+
+    Some(ImageDataLease {
+        width,
+        height,
+        data_ptr,
+        byte_length,
+        owner: Box::into_raw(Box::new(store)) as *mut c_void,
+        release: release_image_lease,
+    })
+}
+
+pub extern "C" fn release_image_lease(lease: *mut ImageDataLease) {
+    if lease.is_null() {
+        return;
+    }
+
+    let lease = unsafe { &mut *lease };
+    if lease.owner.is_null() {
+        return;
+    }
+
+    unsafe {
+        drop(Box::from_raw(
+            lease.owner as *mut v8::SharedRef<v8::BackingStore>,
+        ));
+    }
+
+    lease.owner = std::ptr::null_mut();
+    lease.data_ptr = std::ptr::null_mut();
+    lease.byte_length = 0;
+
+    LIVE_LEASES.fetch_sub(1, Ordering::SeqCst);
+}
+
+/// Leases pixels produced outside V8 (e.g. read from the disk cache).
+pub fn lease_owned_pixels(width: u32, height: u32, data: Vec<u8>) -> ImageDataLease {
+    let mut data = Box::new(data);
+    let data_ptr = data.as_mut_ptr() as *mut c_void;
+    let byte_length = data.len();
+
+    LIVE_LEASES.fetch_add(1, Ordering::SeqCst);
+
+    ImageDataLease {
+        width,
+        height,
+        data_ptr,
+        byte_length,
+        owner: Box::into_raw(data) as *mut c_void,
+        release: release_owned_lease,
+    }
+}
+
+extern "C" fn release_owned_lease(lease: *mut ImageDataLease) {
+    if lease.is_null() {
+        return;
+    }
+
+    let lease = unsafe { &mut *lease };
+    if lease.owner.is_null() {
+        return;
+    }
+
+    unsafe {
+        drop(Box::from_raw(lease.owner as *mut Vec<u8>));
+    }
+
+    lease.owner = std::ptr::null_mut();
+    lease.data_ptr = std::ptr::null_mut();
+    lease.byte_length = 0;
+
+    LIVE_LEASES.fetch_sub(1, Ordering::SeqCst);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::executor::Executor;
+    use crate::stub_host::spawn_stub_runtime;
+    use crate::{dispose_go_live_effect_result, go_live_effect, GoLiveEffectResult, OpaqueAiMain};
+    use std::ffi::CString;
+    use std::sync::Mutex;
+
+    // Counters are process wide, so scenarios must not interleave
+    static SERIAL: Mutex<()> = Mutex::new(());
+
+    const EFFECTS: &str = r#"
+        let retained = null;
+
+        export async function goLiveEffect(id, params, env, width, height, data) {
+            switch (id) {
+                case "in-place": {
+                    for (let i = 0; i < data.length; i++) data[i] = 255 - data[i];
+                    return { width, height, data };
+                }
+                case "new-buffer": {
+                    const out = new Uint8ClampedArray(width * height * 4);
+                    out.fill(7);
+                    return { width, height, data: out };
+                }
+                case "subarray": {
+                    const out = new Uint8ClampedArray(16 + width * height * 4);
+                    out.fill(9, 16);
+                    return { width, height, data: out.subarray(16) };
+                }
+                case "retain": {
+                    retained = data;
+                    return { width, height, data: new Uint8ClampedArray(data) };
+                }
+                case "read-retained": {
+                    return {
+                        width: 1,
+                        height: 1,
+                        data: new Uint8ClampedArray([retained.byteLength, retained.length, 1, 1]),
+                    };
+                }
+                default:
+                    throw new Error(`Unknown effect: ${id}`);
+            }
+        }
+    "#;
+
+    fn stub_host() -> Executor {
+        spawn_stub_runtime("image_lease_test.js", EFFECTS)
+    }
+
+    fn run(
+        runtime: &Executor,
+        effect_id: &str,
+        pixels: &mut [u8],
+        width: u32,
+        height: u32,
+    ) -> *mut GoLiveEffectResult {
+        let effect_id = CString::new(effect_id).unwrap();
+        let params = CString::new("{}").unwrap();
+        let env = CString::new(r#"{"dpi":72,"baseDpi":72,"isInPreview":false}"#).unwrap();
+        let mut input = ImageDataPayload {
+            width,
+            height,
+            data_ptr: pixels.as_mut_ptr() as *mut c_void,
+            byte_length: pixels.len(),
+        };
+
+        go_live_effect(
+            runtime as *const Executor as OpaqueAiMain,
+            effect_id.as_ptr(),
+            params.as_ptr(),
+            env.as_ptr(),
+            &mut input,
+            0,
+            0,
+        )
+    }
+
+    fn leased_bytes<'a>(result: *mut GoLiveEffectResult) -> &'a [u8] {
+        let result = unsafe { &*result };
+        assert!(result.success);
+        let lease = unsafe { &*result.data };
+        unsafe { std::slice::from_raw_parts(lease.data_ptr as *const u8, lease.byte_length) }
+    }
+
+    #[test]
+    fn in_place_result_is_leased_from_host_buffer() {
+        let _serial = SERIAL.lock().unwrap_or_else(|e| e.into_inner());
+        let runtime = stub_host();
+        let (leases, lent) = (live_leases(), lent_buffers());
+
+        let mut pixels = vec![10u8; 2 * 2 * 4];
+        let result = run(&runtime, "in-place", &mut pixels, 2, 2);
+
+        let bytes = leased_bytes(result);
+        assert_eq!(bytes.as_ptr(), pixels.as_ptr());
+        assert_eq!(bytes.len(), pixels.len());
+        assert!(bytes.iter().all(|&b| b == 245));
+        assert_eq!(live_leases(), leases + 1);
+
+        dispose_go_live_effect_result(result);
+        assert_eq!(live_leases(), leases);
+        assert_eq!(lent_buffers(), lent);
+    }
+
+    #[test]
+    fn new_buffer_is_leased_without_copy_and_released_once() {
+        let _serial = SERIAL.lock().unwrap_or_else(|e| e.into_inner());
+        let runtime = stub_host();
+        let (leases, lent) = (live_leases(), lent_buffers());
+
+        let mut pixels = vec![0u8; 3 * 2 * 4];
+        let result = run(&runtime, "new-buffer", &mut pixels, 3, 2);
+
+        let bytes = leased_bytes(result);
+        assert_ne!(bytes.as_ptr(), pixels.as_ptr());
+        assert_eq!(bytes.len(), 3 * 2 * 4);
+        assert!(bytes.iter().all(|&b| b == 7));
+        assert!(pixels.iter().all(|&b| b == 0));
+
+        // The host may hand pixels back early; disposing afterwards must not double free
+        let lease = unsafe { (*result).data };
+        (unsafe { &*lease }.release)(lease);
+        (unsafe { &*lease }.release)(lease);
+        assert_eq!(live_leases(), leases);
+        assert!(unsafe { &*lease }.data_ptr.is_null());
+
+        dispose_go_live_effect_result(result);
+        assert_eq!(live_leases(), leases);
+        assert_eq!(lent_buffers(), lent);
+    }
+
+    #[test]
+    fn lease_honors_view_offset() {
+        let _serial = SERIAL.lock().unwrap_or_else(|e| e.into_inner());
+        let runtime = stub_host();
+
+        let mut pixels = vec![0u8; 4];
+        let result = run(&runtime, "subarray", &mut pixels, 1, 1);
+
+        assert_eq!(leased_bytes(result), &[9, 9, 9, 9]);
+        dispose_go_live_effect_result(result);
+    }
+
+    #[test]
+    fn lent_buffer_is_detached_after_call() {
+        let _serial = SERIAL.lock().unwrap_or_else(|e| e.into_inner());
+        let runtime = stub_host();
+        let lent = lent_buffers();
+
+        let mut pixels = vec![1u8; 4 * 4 * 4];
+        let result = run(&runtime, "retain", &mut pixels, 4, 4);
+        dispose_go_live_effect_result(result);
+        assert_eq!(lent_buffers(), lent);
+
+        // Stands in for the host returning the block to its pool
+        drop(pixels);
+
+        let mut probe = vec![0u8; 4];
+        let result = run(&runtime, "read-retained", &mut probe, 1, 1);
+        assert_eq!(&leased_bytes(result)[..2], &[0, 0]);
+        dispose_go_live_effect_result(result);
+    }
+
+    #[test]
+    fn failed_effect_releases_lent_buffer() {
+        let _serial = SERIAL.lock().unwrap_or_else(|e| e.into_inner());
+        let runtime = stub_host();
+        let (leases, lent) = (live_leases(), lent_buffers());
+
+        let mut pixels = vec![0u8; 4];
+        let result = run(&runtime, "unknown", &mut pixels, 1, 1);
+
+        assert!(!unsafe { &*result }.success);
+        assert!(unsafe { &*result }.data.is_null());
+        dispose_go_live_effect_result(result);
+
+        assert_eq!(live_leases(), leases);
+        assert_eq!(lent_buffers(), lent);
+    }
+}
@@ -0,0 +1,50 @@
+//! Effect init failures waiting to be shown to the user.
+//!
+//! Effects initialize on first use, which is usually inside a render. That
+//! render may run on an Illustrator render thread, where no alert can be shown.
+//! So JS reports failures here through `op_ai_deno_report_init_failure`. The
+//! host takes them with `take_effect_init_failures` from its main thread. An
+//! effect is reported once per session, whichever runtime failed to init it.
+
+use once_cell::sync::Lazy;
+use std::collections::HashSet;
+use std::sync::Mutex;
+
+#[derive(Default)]
+struct InitFailures {
+    reported: HashSet<String>,
+    pending: Vec<String>,
+}
+
+static FAILURES: Lazy<Mutex<InitFailures>> = Lazy::new(|| Mutex::new(InitFailures::default()));
+
+/// Queues `message` for the host, unless `effect_id` failed before
+pub fn report(effect_id: &str, message: String) {
+    let mut failures = FAILURES.lock().unwrap();
+    if failures.reported.insert(effect_id.to_string()) {
+        failures.pending.push(message);
+    }
+}
+
+/// Messages queued since the last call
+pub fn take() -> Vec<String> {
+    std::mem::take(&mut FAILURES.lock().unwrap().pending)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn reports_each_effect_once() {
+        report("init-failures-test", "first".to_string());
+        report("init-failures-test", "second".to_string());
+
+        let taken = take();
+        assert!(taken.contains(&"first".to_string()));
+        assert!(!taken.contains(&"second".to_string()));
+
+        report("init-failures-test", "third".to_string());
+        assert!(!take().contains(&"third".to_string()));
+    }
+}
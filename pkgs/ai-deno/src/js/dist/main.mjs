@@ -426,34 +426,238 @@ var logger = {
 };
 
 // src/js/src/live-effects/_shared.ts
-async function createGPUDevice(options = {}, initializer) {
-  var _a;
-  let deviceRef = null;
-  let inits = null;
-  const init = async () => {
-    var _a2;
+var _AI_DENO_4 = globalThis._AI_DENO_ ?? {
+  op_ai_deno_pipeline_cache_record: () => {
+  },
+  op_ai_deno_pipeline_cache_load: () => "[]"
+};
+var SharedGPUDevice = class {
+  device = null;
+  listeners = /* @__PURE__ */ new Set();
+  created = 0;
+  get() {
+    this.device ??= this.create().catch((e) => {
+      this.device = null;
+      throw e;
+    });
+    return this.device;
+  }
+  onRecreate(listener) {
+    this.listeners.add(listener);
+  }
+  async create() {
     const adapter = await navigator.gpu.requestAdapter({
-      powerPreference: "high-performance",
-      ...options.adapter
+      powerPreference: "high-performance"
     });
     if (!adapter) {
       throw new Error("No adapter found");
     }
     const device = await adapter.requestDevice({
-      ...options.device,
+      label: "AiDeno shared device",
       requiredLimits: {
-        ...(_a2 = options.device) == null ? void 0 : _a2.requiredLimits,
         maxTextureDimension2D: adapter.limits.maxTextureDimension2D
       }
     });
     device.addEventListener("uncapturederror", (e) => {
       console.error(e.error);
     });
-    inits = await initializer(device);
+    installPipelineCache(device, adapterIdentity(adapter));
+    device.lost.then((info) => {
+      if (info.reason === "destroyed") return;
+      logger.error("GPU device lost, recreating", info.message);
+      this.device = null;
+      this.get().catch((e) => logger.error(e));
+    });
+    logger.info("Create GPU Device: ", device.label);
+    if (this.created++ > 0) {
+      const results = await Promise.allSettled(
+        [...this.listeners].map(async (listener) => listener(device))
+      );
+      results.forEach((result) => {
+        if (result.status === "rejected") logger.error(result.reason);
+      });
+    }
     return device;
+  }
+};
+var sharedDevice = new SharedGPUDevice();
+function hashSource(source) {
+  let h1 = 3735928559;
+  let h2 = 1103547991;
+  for (let i = 0; i < source.length; i++) {
+    const ch = source.charCodeAt(i);
+    h1 = Math.imul(h1 ^ ch, 2654435761);
+    h2 = Math.imul(h2 ^ ch, 1597334677);
+  }
+  h1 = Math.imul(h1 ^ h1 >>> 16, 2246822507);
+  h1 ^= Math.imul(h2 ^ h2 >>> 13, 3266489909);
+  h2 = Math.imul(h2 ^ h2 >>> 16, 2246822507);
+  h2 ^= Math.imul(h1 ^ h1 >>> 13, 3266489909);
+  return 4294967296 * (2097151 & h2) + (h1 >>> 0);
+}
+function adapterIdentity(adapter) {
+  const { vendor, architecture, device, description } = adapter.info;
+  return [vendor, architecture, device, description].join("/");
+}
+var pipelineCaches = /* @__PURE__ */ new WeakMap();
+function installPipelineCache(device, adapter) {
+  const modules = /* @__PURE__ */ new Map();
+  const moduleHashes = /* @__PURE__ */ new WeakMap();
+  const pipelines = /* @__PURE__ */ new Map();
+  const pendingPipelines = /* @__PURE__ */ new Map();
+  const createShaderModule = device.createShaderModule.bind(device);
+  const createComputePipeline = device.createComputePipeline.bind(device);
+  const createComputePipelineAsync = device.createComputePipelineAsync.bind(device);
+  device.createShaderModule = (descriptor) => {
+    const hash = hashSource(descriptor.code);
+    const cached = modules.get(hash);
+    if ((cached == null ? void 0 : cached.code) === descriptor.code) return cached.module;
+    const module = createShaderModule(descriptor);
+    if (!cached) {
+      modules.set(hash, { code: descriptor.code, module });
+      moduleHashes.set(module, hash);
+    }
+    return module;
   };
-  deviceRef = await init();
-  logger.info("Create GPU Device: ", ((_a = options.device) == null ? void 0 : _a.label) ?? "<<unnamed>>");
+  const pipelineKey = (descriptor) => {
+    const hash = moduleHashes.get(descriptor.compute.module);
+    if (descriptor.layout !== "auto" || hash == null) return null;
+    const constants = descriptor.compute.constants ? Object.entries(descriptor.compute.constants).sort(
+      ([a], [b]) => a < b ? -1 : a > b ? 1 : 0
+    ) : null;
+    return JSON.stringify([
+      hash,
+      descriptor.compute.entryPoint ?? "",
+      constants
+    ]);
+  };
+  const record = (key, descriptor, recorder) => {
+    if (!(recorder == null ? void 0 : recorder.open) || recorder.entries.has(key)) return;
+    const hash = moduleHashes.get(descriptor.compute.module);
+    const source = hash != null ? modules.get(hash) : null;
+    if (!source) return;
+    recorder.entries.set(key, {
+      code: source.code,
+      entryPoint: descriptor.compute.entryPoint ?? "",
+      constants: descriptor.compute.constants ?? null
+    });
+  };
+  const cache = {
+    adapter,
+    createComputePipeline(descriptor, recorder) {
+      const key = pipelineKey(descriptor);
+      if (key == null) return createComputePipeline(descriptor);
+      let pipeline = pipelines.get(key);
+      if (!pipeline) {
+        pipeline = createComputePipeline(descriptor);
+        pipelines.set(key, pipeline);
+      }
+      record(key, descriptor, recorder);
+      return pipeline;
+    },
+    createComputePipelineAsync(descriptor, recorder) {
+      const key = pipelineKey(descriptor);
+      if (key == null) return createComputePipelineAsync(descriptor);
+      const pipeline = pipelines.get(key);
+      if (pipeline) {
+        record(key, descriptor, recorder);
+        return Promise.resolve(pipeline);
+      }
+      let pending = pendingPipelines.get(key);
+      if (!pending) {
+        pending = createComputePipelineAsync(descriptor).then(
+          (pipeline2) => {
+            pipelines.set(key, pipeline2);
+            pendingPipelines.delete(key);
+            return pipeline2;
+          },
+          (e) => {
+            pendingPipelines.delete(key);
+            throw e;
+          }
+        );
+        pendingPipelines.set(key, pending);
+      }
+      return pending.then((pipeline2) => {
+        record(key, descriptor, recorder);
+        return pipeline2;
+      });
+    }
+  };
+  device.createComputePipeline = (descriptor) => cache.createComputePipeline(descriptor);
+  device.createComputePipelineAsync = (descriptor) => cache.createComputePipelineAsync(descriptor);
+  pipelineCaches.set(device, cache);
+}
+function recordingDevice(device, recorder) {
+  const cache = pipelineCaches.get(device);
+  if (!cache) return device;
+  return new Proxy(device, {
+    get(target, key) {
+      if (key === "createComputePipeline") {
+        return (descriptor) => cache.createComputePipeline(descriptor, recorder);
+      }
+      if (key === "createComputePipelineAsync") {
+        return (descriptor) => cache.createComputePipelineAsync(descriptor, recorder);
+      }
+      const value = Reflect.get(target, key, target);
+      return typeof value === "function" ? value.bind(target) : value;
+    }
+  });
+}
+async function prewarmPipelines(device, group) {
+  var _a;
+  const adapter = (_a = pipelineCaches.get(device)) == null ? void 0 : _a.adapter;
+  if (adapter == null) return;
+  const cached = JSON.parse(_AI_DENO_4.op_ai_deno_pipeline_cache_load(adapter, group));
+  if (cached.length === 0) return;
+  const results = await Promise.allSettled(
+    cached.map(
+      ({ code, entryPoint, constants }) => device.createComputePipelineAsync({
+        layout: "auto",
+        compute: {
+          module: device.createShaderModule({ code }),
+          entryPoint,
+          ...constants ? { constants } : {}
+        }
+      })
+    )
+  );
+  logger.info(
+    `Prewarmed ${results.filter((r) => r.status === "fulfilled").length}/${cached.length} pipelines of ${group}`
+  );
+}
+async function runInitializer(device, group, initializer) {
+  var _a;
+  const adapter = (_a = pipelineCaches.get(device)) == null ? void 0 : _a.adapter;
+  if (group == null || adapter == null) return await initializer(device);
+  await prewarmPipelines(device, group);
+  const recorder = { entries: /* @__PURE__ */ new Map(), open: true };
+  try {
+    return await initializer(recordingDevice(device, recorder));
+  } finally {
+    recorder.open = false;
+    if (recorder.entries.size > 0) {
+      _AI_DENO_4.op_ai_deno_pipeline_cache_record(
+        adapter,
+        group,
+        JSON.stringify([...recorder.entries.values()])
+      );
+    }
+  }
+}
+async function createGPUDevice(options = {}, initializer) {
+  var _a, _b;
+  const group = ((_a = options.device) == null ? void 0 : _a.label) ?? null;
+  let deviceRef = await sharedDevice.get();
+  let inits = await runInitializer(deviceRef, group, initializer);
+  sharedDevice.onRecreate(async (device) => {
+    inits = await runInitializer(device, group, initializer);
+    deviceRef = device;
+  });
+  logger.info(
+    "Initialized on shared GPU Device: ",
+    ((_b = options.device) == null ? void 0 : _b.label) ?? "<<unnamed>>"
+  );
   return new Proxy(
     {},
     {
@@ -3565,6 +3769,78 @@ var glitch = definePlugin({
   }
 });
 
+// src/js/src/tracing.ts
+var _AI_DENO_3 = globalThis._AI_DENO_ ?? {
+  op_ai_deno_trace_enabled: () => false,
+  op_ai_deno_trace_now: () => 0,
+  op_ai_deno_trace_record: () => {
+  }
+};
+var currentTraceId = 0;
+var isTracing = () => _AI_DENO_3.op_ai_deno_trace_enabled();
+var traceSpan = async (name, traceId, fn) => {
+  if (!isTracing()) return fn();
+  const id = traceId ?? currentTraceId;
+  const startNs = _AI_DENO_3.op_ai_deno_trace_now();
+  try {
+    return await fn();
+  } finally {
+    _AI_DENO_3.op_ai_deno_trace_record(
+      name,
+      id,
+      startNs,
+      _AI_DENO_3.op_ai_deno_trace_now()
+    );
+  }
+};
+var withTraceId = async (traceId, fn) => {
+  const previous = currentTraceId;
+  currentTraceId = traceId ?? 0;
+  try {
+    return await fn();
+  } finally {
+    currentTraceId = previous;
+  }
+};
+var gpuTracingInstalled = false;
+var installGpuTracing = () => {
+  if (gpuTracingInstalled) return;
+  if (typeof GPUQueue === "undefined" || typeof GPUBuffer === "undefined") {
+    return;
+  }
+  gpuTracingInstalled = true;
+  const submit = GPUQueue.prototype.submit;
+  GPUQueue.prototype.submit = function(commandBuffers) {
+    if (!isTracing()) return submit.call(this, commandBuffers);
+    const traceId = currentTraceId;
+    const startNs = _AI_DENO_3.op_ai_deno_trace_now();
+    const result = submit.call(this, commandBuffers);
+    this.onSubmittedWorkDone().then(() => {
+      _AI_DENO_3.op_ai_deno_trace_record(
+        "GPU",
+        traceId,
+        startNs,
+        _AI_DENO_3.op_ai_deno_trace_now()
+      );
+    });
+    return result;
+  };
+  const mapAsync = GPUBuffer.prototype.mapAsync;
+  GPUBuffer.prototype.mapAsync = function(...args) {
+    if (!isTracing()) return mapAsync.apply(this, args);
+    const traceId = currentTraceId;
+    const startNs = _AI_DENO_3.op_ai_deno_trace_now();
+    return mapAsync.apply(this, args).finally(() => {
+      _AI_DENO_3.op_ai_deno_trace_record(
+        "Readback",
+        traceId,
+        startNs,
+        _AI_DENO_3.op_ai_deno_trace_now()
+      );
+    });
+  };
+};
+
 // src/js/src/live-effects/stylize-outline.ts
 import {
   makeShaderDataDefinitions as makeShaderDataDefinitions6,
@@ -7844,6 +8120,7 @@ var selectiveColorCorrection = definePlugin({
       type: 2 /* kPostEffectFilter */,
       features: []
     },
+    tiling: { halo: 0 },
     paramSchema: {
       // ブレンドモード
       blendMode: {
@@ -8640,6 +8917,7 @@ var posterization = definePlugin({
       type: 2 /* kPostEffectFilter */,
       features: []
     },
+    tiling: { halo: 0 },
     paramSchema: {
       levels: {
         type: "int",
@@ -13780,6 +14058,7 @@ var gradientMap = definePlugin({
       type: 2 /* kPostEffectFilter */,
       features: []
     },
+    tiling: { halo: 0 },
     paramSchema: {
       preset: {
         type: "string",
@@ -16280,42 +16559,51 @@ var allPlugins = [
   }
   return collator.compare(a.title, b.title);
 });
-var effectInits = /* @__PURE__ */ new Map();
+installGpuTracing();
 var allEffectPlugins = Object.fromEntries(
   allPlugins.filter((p) => !!p.liveEffect).map((p) => [p.id, p])
 );
-try {
-  await Promise.all(
-    Object.values(allEffectPlugins).map(
-      async (effect) => {
-        return retry(6, async () => {
-          var _a, _b;
-          try {
-            effectInits.set(
-              effect,
-              await ((_b = (_a = effect.liveEffect).initLiveEffect) == null ? void 0 : _b.call(_a)) ?? {}
-            );
-          } catch (e) {
-            await new Promise((resolve) => setTimeout(resolve, 500));
-            throw new Error(
-              `[effect: ${effect.id}] Failed to initialize effect: ${e.message}
+var effectInits = /* @__PURE__ */ new Map();
+var failedInits = /* @__PURE__ */ new Set();
+function ensureEffectInit(effect) {
+  let init = effectInits.get(effect);
+  if (init) return init;
+  init = retry(6, async () => {
+    var _a, _b;
+    try {
+      return await ((_b = (_a = effect.liveEffect).initLiveEffect) == null ? void 0 : _b.call(_a)) ?? {};
+    } catch (e) {
+      await new Promise((resolve) => setTimeout(resolve, 500));
+      throw new Error(
+        `[effect: ${effect.id}] Failed to initialize effect: ${e.message}
 `,
-              {
-                cause: e
-              }
-            );
-          }
-        });
-      }
-    )
-  );
-} catch (e) {
-  console.error(e);
-  if (e instanceof AggregateError) {
-    const _e = e;
-    const logs = _e.errors.map((e2) => `${e2.message}`).join("\n");
-    _AI_DENO_.op_ai_alert("[AiDeno] Failed to initialize effects\n\n" + logs);
+        {
+          cause: e
+        }
+      );
+    }
+  }).catch((e) => {
+    failedInits.add(effect);
+    console.error(e);
+    if (e instanceof AggregateError) {
+      const logs = e.errors.map((e2) => `${e2.message}`).join("\n");
+      _AI_DENO_.op_ai_deno_report_init_failure(effect.id, logs);
+    }
+    throw e;
+  });
+  effectInits.set(effect, init);
+  return init;
+}
+async function warmUpLiveEffects(ids) {
+  const effects = (ids ?? Object.keys(allEffectPlugins)).map((id) => findEffect(id)).filter((effect) => effect != null);
+  for (const effect of effects) {
+    if (failedInits.delete(effect)) effectInits.delete(effect);
   }
+  const results = await Promise.allSettled(effects.map(ensureEffectInit));
+  return {
+    initialized: effects.filter((_, i) => results[i].status === "fulfilled").map((effect) => effect.id),
+    failed: effects.filter((_, i) => results[i].status === "rejected").map((effect) => effect.id)
+  };
 }
 async function loadEffects() {
   ensureDirSync(EFFECTS_DIR);
@@ -16338,14 +16626,27 @@ function getLiveEffects() {
   return Object.values(allEffectPlugins).map((effect) => ({
     id: effect.id,
     title: effect.title,
-    version: effect.version
+    version: effect.version,
+    pixelFormat: effect.liveEffect.pixelFormat ?? "rgba8",
+    tiling: effect.liveEffect.tiling != null,
+    paramSchema: effect.liveEffect.paramSchema
   }));
 }
+function getLiveEffectTiling(effectId, params, env) {
+  const effect = findEffect(effectId);
+  const tiling = effect == null ? void 0 : effect.liveEffect.tiling;
+  if (!tiling) return null;
+  params = getParams(effectId, params);
+  const halo = typeof tiling.halo === "function" ? tiling.halo(params, env) : tiling.halo;
+  return { halo: Math.max(0, Math.ceil(halo)) };
+}
 var nodeState = null;
 function getEffectViewNode(effectId, params) {
   var _a, _b;
   const effect = findEffect(effectId);
   if (!effect) return null;
+  ensureEffectInit(effect).catch(() => {
+  });
   params = getParams(effectId, params);
   params = ((_b = (_a = effect.liveEffect).onEditParameters) == null ? void 0 : _b.call(_a, params)) ?? params;
   let localNodeState = null;
@@ -16396,7 +16697,8 @@ function getEffectViewNode(effectId, params) {
           size: "sm",
           text: `AiDeno: ${_AI_DENO_.op_ai_get_plugin_version()} Plugin: ${effect.version.major}.${effect.version.minor}`
         })
-      ])
+      ]),
+      ...effectCostNodes(effect.id)
     ]);
     const nodeMap = attachNodeIds(tree);
     localNodeState.nodeMap = nodeMap;
@@ -16406,6 +16708,20 @@ function getEffectViewNode(effectId, params) {
     throw e;
   }
 }
+function effectCostNodes(effectId) {
+  const stats = JSON.parse(
+    _AI_DENO_.op_ai_deno_get_effect_stats(effectId)
+  );
+  if (!stats || stats.calls === 0) return [];
+  const ms = (us) => (us / 1e3).toFixed(us < 1e4 ? 1 : 0);
+  const cached = Math.round(stats.cacheHits / stats.calls * 100);
+  return [
+    ui.text({
+      size: "sm",
+      text: `Cost: p50 ${ms(stats.p50Us)}ms / p95 ${ms(stats.p95Us)}ms, ${stats.calls} renders (${cached}% cached, ${stats.failures} failed)`
+    })
+  ];
+}
 function editLiveEffectParameters(id, params) {
   var _a, _b;
   const effect = findEffect(id);
@@ -16493,43 +16809,89 @@ function liveEffectInterpolate(id, params, params2, t27) {
   params2 = getParams(id, params2);
   return effect.liveEffect.onInterpolate(params, params2, t27);
 }
-var goLiveEffect = async (id, params, env, width, height, data) => {
+var goLiveEffect = async (id, params, env, width, height, data, cancelToken) => {
   const effect = findEffect(id);
   if (!effect) return null;
+  const controller = new AbortController();
+  if (cancelToken != null) {
+    _AI_DENO_.op_ai_deno_wait_cancelled(cancelToken).then((cancelled) => {
+      if (!cancelled) return;
+      controller.abort(
+        new DOMException("Superseded by a newer render", "AbortError")
+      );
+    });
+  }
   const defaultParams = getDefaultValus(id);
-  const init = effectInits.get(effect);
-  if (!init) {
+  let init;
+  try {
+    init = await ensureEffectInit(effect);
+  } catch (e) {
     logger.error("Effect not initialized", id);
     return null;
   }
   logger.log("goLiveEffect", { id, input: { width, height }, env, params });
   logger.log("--- LiveEffect Logs ---");
   try {
+    const isFloat = effect.liveEffect.pixelFormat === "rgba32f";
     const input = {
-      data,
+      data: isFloat ? new Float32Array(data.buffer, data.byteOffset, data.byteLength / 4) : data,
       width,
       height
     };
-    const result = await effect.liveEffect.goLiveEffect(
-      init,
-      {
-        ...defaultParams,
-        ...params
-      },
-      input,
-      {
-        ...env
-      }
+    const result = await withTraceId(
+      env.traceId,
+      () => traceSpan(
+        `goLiveEffect ${id}`,
+        env.traceId,
+        () => abortable(
+          effect.liveEffect.goLiveEffect(
+            init,
+            {
+              ...defaultParams,
+              ...params
+            },
+            input,
+            {
+              ...env,
+              signal: controller.signal
+            }
+          ),
+          controller.signal
+        )
+      )
     );
-    if (typeof result.width !== "number" || typeof result.height !== "number" || !(result.data instanceof Uint8ClampedArray)) {
+    const resultData = result.data;
+    if (typeof result.width !== "number" || typeof result.height !== "number" || !(isFloat ? resultData instanceof Float32Array : resultData instanceof Uint8ClampedArray)) {
       throw new Error("Invalid result from goLiveEffect");
     }
-    return result;
+    return {
+      width: result.width,
+      height: result.height,
+      data: resultData instanceof Float32Array ? new Uint8ClampedArray(
+        resultData.buffer,
+        resultData.byteOffset,
+        resultData.byteLength
+      ) : resultData
+    };
   } catch (e) {
-    logger.error(e);
+    if (controller.signal.aborted) {
+      logger.log("goLiveEffect cancelled", id);
+    } else {
+      logger.error(e);
+    }
     throw e;
   }
 };
+function abortable(promise, signal) {
+  if (signal.aborted) return Promise.reject(signal.reason);
+  return new Promise((resolve, reject) => {
+    const onAbort = () => reject(signal.reason);
+    signal.addEventListener("abort", onAbort, { once: true });
+    promise.then(resolve, reject).finally(() => {
+      signal.removeEventListener("abort", onAbort);
+    });
+  });
+}
 function getParams(effectId, state) {
   const effect = findEffect(effectId);
   if (!effect) return null;
@@ -16571,10 +16933,12 @@ export {
   editLiveEffectFireCallback,
   editLiveEffectParameters,
   getEffectViewNode,
+  getLiveEffectTiling,
   getLiveEffects,
   goLiveEffect,
   liveEffectAdjustColors,
   liveEffectInterpolate,
   liveEffectScaleParameters,
-  loadEffects
+  loadEffects,
+  warmUpLiveEffects
 };
@@ -26,6 +26,7 @@ import {
   createGPUDevice,
   includeOklabMix,
   includeOklchMix,
+  mapAsyncOrAbort,
 } from "./_shared.ts";
 
 // RMIT:
@@ -240,7 +241,7 @@ export const pluginTemplate = definePlugin({
       },
       params,
       imgData,
-      { dpi, baseDpi }
+      { dpi, baseDpi, signal }
     ) => {
       // RMIT: Input images default DPI is 72 get as `baseDpi`.
       // RMIT: That if the `dpi` changes, the size of the elements *MUST* be according to visual elements and parameters will not change.
@@ -363,7 +364,8 @@ export const pluginTemplate = definePlugin({
       device.queue.submit([commandEncoder.finish()]);
 
       // Read back and display the result
-      await stagingBuffer.mapAsync(GPUMapMode.READ);
+      // RMIT: Gives up when a newer render (e.g. the next slider tick) supersedes this one
+      await mapAsyncOrAbort(stagingBuffer, GPUMapMode.READ, signal);
       const copyArrayBuffer = stagingBuffer.getMappedRange();
       const resultData = new Uint8Array(copyArrayBuffer.slice(0));
       stagingBuffer.unmap();
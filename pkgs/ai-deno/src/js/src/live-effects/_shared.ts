@@ -1,34 +1,48 @@
 import { logger } from "../logger.ts";
 
-export async function createGPUDevice<
-  T extends (device: GPUDevice) => any | Promise<any>
->(
-  options: {
-    adapter?: GPURequestAdapterOptions;
-    device?: GPUDeviceDescriptor;
-  } = {},
-  initializer: T
-): Promise<
-  {
-    device: GPUDevice;
-  } & Awaited<ReturnType<T>>
-> {
-  let deviceRef: GPUDevice | null = null;
-  let inits: Awaited<ReturnType<T>> | null = null;
+// No disk cache outside the runtime (effect-checker)
+const _AI_DENO_ = globalThis._AI_DENO_ ?? {
+  op_ai_deno_pipeline_cache_record: () => {},
+  op_ai_deno_pipeline_cache_load: () => "[]",
+};
+
+type DeviceListener = (device: GPUDevice) => void | Promise<void>;
+
+/**
+ * The one GPUDevice of this runtime, shared by every effect. A lost device is
+ * recreated and handed to the listeners, so effects rebuild their resources
+ * without noticing.
+ */
+class SharedGPUDevice {
+  private device: Promise<GPUDevice> | null = null;
+  private listeners = new Set<DeviceListener>();
+  private created = 0;
+
+  get(): Promise<GPUDevice> {
+    this.device ??= this.create().catch((e) => {
+      // Let the next effect try again
+      this.device = null;
+      throw e;
+    });
+    return this.device;
+  }
 
-  const init = async () => {
+  /** Called with every device that replaces a lost one */
+  onRecreate(listener: DeviceListener) {
+    this.listeners.add(listener);
+  }
+
+  private async create() {
     const adapter = await navigator.gpu.requestAdapter({
       powerPreference: "high-performance",
-      ...options.adapter,
     });
     if (!adapter) {
       throw new Error("No adapter found");
     }
 
     const device = await adapter.requestDevice({
-      ...options.device,
+      label: "AiDeno shared device",
       requiredLimits: {
-        ...options.device?.requiredLimits,
         maxTextureDimension2D: adapter.limits.maxTextureDimension2D!,
       },
     });
@@ -37,18 +51,346 @@ export async function createGPUDevice<
       console.error(e.error);
     });
 
-    // device.lost.then(async () => {
-    //   deviceRef = await init();
-    // });
+    installPipelineCache(device, adapterIdentity(adapter));
 
-    inits = await initializer(device);
+    device.lost.then((info) => {
+      if (info.reason === "destroyed") return;
+
+      logger.error("GPU device lost, recreating", info.message);
+      this.device = null;
+      // On failure the next effect that needs the device tries again
+      this.get().catch((e) => logger.error(e));
+    });
+
+    logger.info("Create GPU Device: ", device.label);
+
+    // Effects initialized on a lost device move over before anyone gets it
+    if (this.created++ > 0) {
+      const results = await Promise.allSettled(
+        [...this.listeners].map(async (listener) => listener(device))
+      );
+      results.forEach((result) => {
+        if (result.status === "rejected") logger.error(result.reason);
+      });
+    }
 
     return device;
+  }
+}
+
+const sharedDevice = new SharedGPUDevice();
+
+/** 53 bit hash of WGSL sources, cyrb53 */
+function hashSource(source: string) {
+  let h1 = 0xdeadbeef;
+  let h2 = 0x41c6ce57;
+  for (let i = 0; i < source.length; i++) {
+    const ch = source.charCodeAt(i);
+    h1 = Math.imul(h1 ^ ch, 2654435761);
+    h2 = Math.imul(h2 ^ ch, 1597334677);
+  }
+  h1 = Math.imul(h1 ^ (h1 >>> 16), 2246822507);
+  h1 ^= Math.imul(h2 ^ (h2 >>> 13), 3266489909);
+  h2 = Math.imul(h2 ^ (h2 >>> 16), 2246822507);
+  h2 ^= Math.imul(h1 ^ (h1 >>> 13), 3266489909);
+
+  return 4294967296 * (2097151 & h2) + (h1 >>> 0);
+}
+
+/** What another GPU or driver, whose compiler may differ, never shares */
+function adapterIdentity(adapter: GPUAdapter) {
+  const { vendor, architecture, device, description } = adapter.info;
+  return [vendor, architecture, device, description].join("/");
+}
+
+/** Pipelines an initializer created, recorded for its effect in one batch */
+type PipelineRecorder = {
+  entries: Map<
+    string,
+    {
+      code: string;
+      entryPoint: string;
+      constants: Record<string, number> | null;
+    }
+  >;
+  /** Closed once the initializer is done, later pipelines aren't its own */
+  open: boolean;
+};
+
+type PipelineCache = {
+  adapter: string;
+  createComputePipeline(
+    descriptor: GPUComputePipelineDescriptor,
+    recorder?: PipelineRecorder
+  ): GPUComputePipeline;
+  createComputePipelineAsync(
+    descriptor: GPUComputePipelineDescriptor,
+    recorder?: PipelineRecorder
+  ): Promise<GPUComputePipeline>;
+};
+
+const pipelineCaches = new WeakMap<GPUDevice, PipelineCache>();
+
+/**
+ * Makes `device` reuse shader modules with the same WGSL source, and compute
+ * pipelines with the same module, entry point and constants, across effects.
+ * Only pipelines with an "auto" layout are shared: their bind group layouts
+ * come from the pipeline itself, so each user's bind groups still match.
+ *
+ * Pipelines an initializer creates through its `recordingDevice` are also
+ * recorded on disk (see pipeline_cache.rs), for `prewarmPipelines` of the next
+ * session.
+ */
+function installPipelineCache(device: GPUDevice, adapter: string) {
+  const modules = new Map<number, { code: string; module: GPUShaderModule }>();
+  const moduleHashes = new WeakMap<GPUShaderModule, number>();
+  const pipelines = new Map<string, GPUComputePipeline>();
+  const pendingPipelines = new Map<string, Promise<GPUComputePipeline>>();
+
+  const createShaderModule = device.createShaderModule.bind(device);
+  const createComputePipeline = device.createComputePipeline.bind(device);
+  const createComputePipelineAsync =
+    device.createComputePipelineAsync.bind(device);
+
+  device.createShaderModule = (descriptor: GPUShaderModuleDescriptor) => {
+    const hash = hashSource(descriptor.code);
+    const cached = modules.get(hash);
+    if (cached?.code === descriptor.code) return cached.module;
+
+    const module = createShaderModule(descriptor);
+    // A colliding hash keeps the first source cached
+    if (!cached) {
+      modules.set(hash, { code: descriptor.code, module });
+      moduleHashes.set(module, hash);
+    }
+    return module;
   };
 
-  deviceRef = await init();
+  const pipelineKey = (descriptor: GPUComputePipelineDescriptor) => {
+    const hash = moduleHashes.get(descriptor.compute.module);
+    if (descriptor.layout !== "auto" || hash == null) return null;
+
+    // Sorted, constants read back from the disk cache come in key order
+    const constants = descriptor.compute.constants
+      ? Object.entries(descriptor.compute.constants).sort(([a], [b]) =>
+          a < b ? -1 : a > b ? 1 : 0
+        )
+      : null;
+    return JSON.stringify([
+      hash,
+      descriptor.compute.entryPoint ?? "",
+      constants,
+    ]);
+  };
 
-  logger.info("Create GPU Device: ", options.device?.label ?? "<<unnamed>>");
+  // Also pipelines found in the cache, another effect may have created them
+  const record = (
+    key: string,
+    descriptor: GPUComputePipelineDescriptor,
+    recorder?: PipelineRecorder
+  ) => {
+    if (!recorder?.open || recorder.entries.has(key)) return;
+
+    const hash = moduleHashes.get(descriptor.compute.module);
+    const source = hash != null ? modules.get(hash) : null;
+    if (!source) return;
+
+    recorder.entries.set(key, {
+      code: source.code,
+      entryPoint: descriptor.compute.entryPoint ?? "",
+      constants: (descriptor.compute.constants ?? null) as Record<
+        string,
+        number
+      > | null,
+    });
+  };
+
+  const cache: PipelineCache = {
+    adapter,
+
+    createComputePipeline(descriptor, recorder) {
+      const key = pipelineKey(descriptor);
+      if (key == null) return createComputePipeline(descriptor);
+
+      let pipeline = pipelines.get(key);
+      if (!pipeline) {
+        pipeline = createComputePipeline(descriptor);
+        pipelines.set(key, pipeline);
+      }
+      record(key, descriptor, recorder);
+      return pipeline;
+    },
+
+    createComputePipelineAsync(descriptor, recorder) {
+      const key = pipelineKey(descriptor);
+      if (key == null) return createComputePipelineAsync(descriptor);
+
+      const pipeline = pipelines.get(key);
+      if (pipeline) {
+        record(key, descriptor, recorder);
+        return Promise.resolve(pipeline);
+      }
+
+      let pending = pendingPipelines.get(key);
+      if (!pending) {
+        pending = createComputePipelineAsync(descriptor).then(
+          (pipeline) => {
+            pipelines.set(key, pipeline);
+            pendingPipelines.delete(key);
+            return pipeline;
+          },
+          (e) => {
+            pendingPipelines.delete(key);
+            throw e;
+          }
+        );
+        pendingPipelines.set(key, pending);
+      }
+      return pending.then((pipeline) => {
+        record(key, descriptor, recorder);
+        return pipeline;
+      });
+    },
+  };
+
+  device.createComputePipeline = (descriptor) =>
+    cache.createComputePipeline(descriptor);
+  device.createComputePipelineAsync = (descriptor) =>
+    cache.createComputePipelineAsync(descriptor);
+  pipelineCaches.set(device, cache);
+}
+
+/**
+ * `device` as an initializer gets it: the pipelines it creates go to `recorder`.
+ * Initializers of several effects run at once, each with its own recorder.
+ */
+function recordingDevice(
+  device: GPUDevice,
+  recorder: PipelineRecorder
+): GPUDevice {
+  const cache = pipelineCaches.get(device);
+  if (!cache) return device;
+
+  return new Proxy(device, {
+    get(target, key) {
+      if (key === "createComputePipeline") {
+        return (descriptor: GPUComputePipelineDescriptor) =>
+          cache.createComputePipeline(descriptor, recorder);
+      }
+      if (key === "createComputePipelineAsync") {
+        return (descriptor: GPUComputePipelineDescriptor) =>
+          cache.createComputePipelineAsync(descriptor, recorder);
+      }
+
+      // WebGPU methods only accept the device itself as `this`
+      const value = Reflect.get(target, key, target);
+      return typeof value === "function" ? value.bind(target) : value;
+    },
+  });
+}
+
+/**
+ * Compiles the pipelines `group` created in earlier sessions, all at once with
+ * `createComputePipelineAsync`, so its initializer finds them in the cache
+ */
+async function prewarmPipelines(device: GPUDevice, group: string) {
+  const adapter = pipelineCaches.get(device)?.adapter;
+  if (adapter == null) return;
+
+  const cached: Array<{
+    code: string;
+    entryPoint: string;
+    constants: Record<string, number> | null;
+  }> = JSON.parse(_AI_DENO_.op_ai_deno_pipeline_cache_load(adapter, group));
+  if (cached.length === 0) return;
+
+  const results = await Promise.allSettled(
+    cached.map(({ code, entryPoint, constants }) =>
+      device.createComputePipelineAsync({
+        layout: "auto",
+        compute: {
+          module: device.createShaderModule({ code }),
+          entryPoint,
+          ...(constants ? { constants } : {}),
+        },
+      })
+    )
+  );
+  logger.info(
+    `Prewarmed ${results.filter((r) => r.status === "fulfilled").length}/${
+      cached.length
+    } pipelines of ${group}`
+  );
+}
+
+/**
+ * Runs `initializer` after prewarming the pipelines of `group`, then records
+ * the pipelines it created for `group` with one write of the index
+ */
+async function runInitializer<T>(
+  device: GPUDevice,
+  group: string | null,
+  initializer: (device: GPUDevice) => T
+): Promise<Awaited<T>> {
+  const adapter = pipelineCaches.get(device)?.adapter;
+  if (group == null || adapter == null) return await initializer(device);
+
+  await prewarmPipelines(device, group);
+
+  const recorder: PipelineRecorder = { entries: new Map(), open: true };
+  try {
+    return await initializer(recordingDevice(device, recorder));
+  } finally {
+    recorder.open = false;
+    if (recorder.entries.size > 0) {
+      _AI_DENO_.op_ai_deno_pipeline_cache_record(
+        adapter,
+        group,
+        JSON.stringify([...recorder.entries.values()])
+      );
+    }
+  }
+}
+
+/**
+ * Runs `initializer` with the runtime's shared device, see `SharedGPUDevice`.
+ * It runs again with the new device when the device is lost, and `device` and
+ * the initialized values then refer to the new ones.
+ */
+export async function createGPUDevice<
+  T extends (device: GPUDevice) => any | Promise<any>
+>(
+  options: {
+    /** Ignored, every effect shares one adapter */
+    adapter?: GPURequestAdapterOptions;
+    /** Only the label is used, it names the effect's pipelines in the cache */
+    device?: GPUDeviceDescriptor;
+  } = {},
+  initializer: T
+): Promise<
+  {
+    device: GPUDevice;
+  } & Awaited<ReturnType<T>>
+> {
+  // Pipelines are cached per effect, unnamed effects aren't
+  const group = options.device?.label ?? null;
+
+  let deviceRef = await sharedDevice.get();
+  let inits: Awaited<ReturnType<T>> = await runInitializer(
+    deviceRef,
+    group,
+    initializer
+  );
+
+  sharedDevice.onRecreate(async (device) => {
+    inits = await runInitializer(device, group, initializer);
+    deviceRef = device;
+  });
+
+  logger.info(
+    "Initialized on shared GPU Device: ",
+    options.device?.label ?? "<<unnamed>>"
+  );
 
   return new Proxy(
     {},
@@ -66,6 +408,29 @@ export async function createGPUDevice<
   ) as { device: GPUDevice } & Awaited<ReturnType<T>>;
 }
 
+/**
+ * `buffer.mapAsync` that gives up once `signal` aborts. Unmapping a pending map
+ * rejects it, so the readback of a superseded render doesn't hold the buffer.
+ */
+export async function mapAsyncOrAbort(
+  buffer: GPUBuffer,
+  mode: GPUMapModeFlags,
+  signal?: AbortSignal
+): Promise<void> {
+  signal?.throwIfAborted();
+
+  const onAbort = () => buffer.unmap();
+  signal?.addEventListener("abort", onAbort, { once: true });
+
+  try {
+    await buffer.mapAsync(mode);
+  } finally {
+    signal?.removeEventListener("abort", onAbort);
+  }
+
+  signal?.throwIfAborted();
+}
+
 export function includeOklchMix() {
   // fn mixOklch(rgbColor1: vec3<f32>, rgbColor2: vec3<f32>, t: f32) -> vec3<f32>;
   // fn mixOklchVec4(rgbColor1: vec4<f32>, rgbColor2: vec4<f32>, t: f32) -> vec4<f32>;
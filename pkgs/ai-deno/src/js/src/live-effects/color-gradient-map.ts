@@ -269,6 +269,8 @@ export const gradientMap = definePlugin({
       type: StyleFilterFlag.kPostEffectFilter,
       features: [],
     },
+    // Per pixel, no neighbours needed
+    tiling: { halo: 0 },
     paramSchema: {
       preset: {
         type: "string",
@@ -38,6 +38,8 @@ export const posterization = definePlugin({
       type: StyleFilterFlag.kPostEffectFilter,
       features: [],
     },
+    // Per pixel, no neighbours needed
+    tiling: { halo: 0 },
     paramSchema: {
       levels: {
         type: "int",
@@ -78,6 +78,8 @@ export const colorReplacement = definePlugin({
       type: StyleFilterFlag.kPostEffectFilter,
       features: [],
     },
+    // Per pixel, no neighbours needed
+    tiling: { halo: 0 },
     paramSchema: {
       // 置換元の色（UIで選択するためのもの）
       sourceColor: {
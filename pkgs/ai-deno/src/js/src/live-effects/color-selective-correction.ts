@@ -92,6 +92,8 @@ export const selectiveColorCorrection = definePlugin({
       type: StyleFilterFlag.kPostEffectFilter,
       features: [],
     },
+    // Per pixel, no neighbours needed
+    tiling: { halo: 0 },
     paramSchema: {
       // ブレンドモード
       blendMode: {
@@ -5,6 +5,9 @@ import {
   AIPlugin,
   LiveEffectEnv,
   ColorRGBA,
+  GoLiveEffectPayload,
+  PixelFormat,
+  ParameterSchema,
 } from "./plugin.ts";
 import { expandGlobSync, ensureDirSync } from "jsr:@std/fs@1.0.14";
 import { toFileUrl, join, fromFileUrl } from "jsr:@std/path@1.0.8";
@@ -23,6 +26,7 @@ import { dithering } from "./live-effects/stylize-dithering.ts";
 import { pixelSort } from "./live-effects/pixel-sort.ts";
 import { glitch } from "./live-effects/distortion-glitch.ts";
 import { logger } from "./logger.ts";
+import { installGpuTracing, traceSpan, withTraceId } from "./tracing.ts";
 import { outline } from "./live-effects/stylize-outline.ts";
 import { innerGlow } from "./live-effects/stylize-inner-glow.ts";
 import { coastic } from "./live-effects/other-coastic.ts";
@@ -119,7 +123,8 @@ const allPlugins: AIPlugin<any, any, any>[] = [
   return collator.compare(a.title, b.title);
 });
 
-const effectInits = new Map<AIPlugin<any, any, any>, any>();
+// Cheap while tracing is off, so always patched: tracing can start at any time
+installGpuTracing();
 
 const allEffectPlugins: Record<
   string,
@@ -130,38 +135,74 @@ const allEffectPlugins: Record<
     .map((p) => [p.id, p])
 );
 
-// Initialize effects at Startup of Illustrator
-try {
-  await Promise.all(
-    Object.values(allEffectPlugins).map(
-      async (effect: AIEffectPlugin<any, any, any>) => {
-        return retry(6, async () => {
-          try {
-            effectInits.set(
-              effect,
-              (await effect.liveEffect.initLiveEffect?.()) ?? {}
-            );
-          } catch (e) {
-            await new Promise((resolve) => setTimeout(resolve, 500));
-            throw new Error(
-              `[effect: ${effect.id}] Failed to initialize effect: ${e.message}\n`,
-              {
-                cause: e,
-              }
-            );
-          }
-        });
-      }
-    )
-  );
-} catch (e) {
-  console.error(e);
+// Effects are initialized on first use rather than at startup: most create a
+// GPU device and compile their pipelines, and a document uses only a few of them.
+// A failed init stays failed for the session, so renders of a broken effect
+// (e.g. without a GPU adapter) don't pay for the retries on every redraw. Only
+// warmUpLiveEffects tries again.
+const effectInits = new Map<AIEffectPlugin<any, any, any>, Promise<any>>();
+const failedInits = new Set<AIEffectPlugin<any, any, any>>();
+
+function ensureEffectInit(effect: AIEffectPlugin<any, any, any>): Promise<any> {
+  let init = effectInits.get(effect);
+  if (init) return init;
+
+  init = retry(6, async () => {
+    try {
+      return (await effect.liveEffect.initLiveEffect?.()) ?? {};
+    } catch (e) {
+      await new Promise((resolve) => setTimeout(resolve, 500));
+      throw new Error(
+        `[effect: ${effect.id}] Failed to initialize effect: ${e.message}\n`,
+        {
+          cause: e,
+        }
+      );
+    }
+  }).catch((e) => {
+    failedInits.add(effect);
+    console.error(e);
+
+    // Inits run inside renders, which may be on a thread that can't show an
+    // alert, so the host alerts queued failures itself (once per effect)
+    if (e instanceof AggregateError) {
+      const logs = e.errors.map((e: Error) => `${e.message}`).join("\n");
+      _AI_DENO_.op_ai_deno_report_init_failure(effect.id, logs);
+    }
+
+    throw e;
+  });
+
+  effectInits.set(effect, init);
+  return init;
+}
 
-  if (e instanceof AggregateError) {
-    const _e: AggregateError = e as unknown as AggregateError;
-    const logs = _e.errors.map((e: Error) => `${e.message}`).join("\n");
-    _AI_DENO_.op_ai_alert("[AiDeno] Failed to initialize effects\n\n" + logs);
+/**
+ * Initializes `ids` (every effect when null) ahead of their first render, e.g.
+ * the effects of the opened document. Effects that failed before are tried again.
+ */
+export async function warmUpLiveEffects(ids: string[] | null): Promise<{
+  initialized: string[];
+  failed: string[];
+}> {
+  const effects = (ids ?? Object.keys(allEffectPlugins))
+    .map((id) => findEffect(id))
+    .filter((effect) => effect != null);
+
+  for (const effect of effects) {
+    if (failedInits.delete(effect)) effectInits.delete(effect);
   }
+
+  const results = await Promise.allSettled(effects.map(ensureEffectInit));
+
+  return {
+    initialized: effects
+      .filter((_, i) => results[i].status === "fulfilled")
+      .map((effect) => effect.id),
+    failed: effects
+      .filter((_, i) => results[i].status === "rejected")
+      .map((effect) => effect.id),
+  };
 }
 
 export async function loadEffects() {
@@ -189,6 +230,9 @@ export function getLiveEffects(): Array<{
   id: string;
   title: string;
   version: { major: number; minor: number };
+  pixelFormat: PixelFormat;
+  tiling: boolean;
+  paramSchema: ParameterSchema;
 }> {
   logger.log("allEffectPlugins", allEffectPlugins);
 
@@ -196,9 +240,28 @@ export function getLiveEffects(): Array<{
     id: effect.id,
     title: effect.title,
     version: effect.version,
+    pixelFormat: effect.liveEffect.pixelFormat ?? "rgba8",
+    tiling: effect.liveEffect.tiling != null,
+    paramSchema: effect.liveEffect.paramSchema,
   }));
 }
 
+export function getLiveEffectTiling(
+  effectId: string,
+  params: any,
+  env: LiveEffectEnv
+): { halo: number } | null {
+  const effect = findEffect(effectId);
+  const tiling = effect?.liveEffect.tiling;
+  if (!tiling) return null;
+
+  params = getParams(effectId, params);
+  const halo =
+    typeof tiling.halo === "function" ? tiling.halo(params, env) : tiling.halo;
+
+  return { halo: Math.max(0, Math.ceil(halo)) };
+}
+
 type NodeState = {
   effectId: string;
   nodeMap: Map<string, UINode>;
@@ -213,6 +276,9 @@ export function getEffectViewNode(effectId: string, params: any): UINode {
   const effect = findEffect(effectId);
   if (!effect) return null;
 
+  // The preview follows shortly; ensureEffectInit reports failures itself
+  ensureEffectInit(effect).catch(() => {});
+
   params = getParams(effectId, params);
   params = effect.liveEffect.onEditParameters?.(params) ?? params;
 
@@ -281,6 +347,7 @@ export function getEffectViewNode(effectId: string, params: any): UINode {
           }.${effect.version.minor}`,
         }),
       ]),
+      ...effectCostNodes(effect.id),
     ]);
 
     const nodeMap = attachNodeIds(tree);
@@ -302,6 +369,35 @@ export function getEffectViewNode(effectId: string, params: any): UINode {
   }
 }
 
+type EffectStats = {
+  calls: number;
+  cacheHits: number;
+  failures: number;
+  cancelled: number;
+  p50Us: number;
+  p95Us: number;
+};
+
+/** What rendering the effect costs so far, measured by the host */
+function effectCostNodes(effectId: string): UINode[] {
+  const stats: EffectStats | null = JSON.parse(
+    _AI_DENO_.op_ai_deno_get_effect_stats(effectId)
+  );
+  if (!stats || stats.calls === 0) return [];
+
+  const ms = (us: number) => (us / 1000).toFixed(us < 10_000 ? 1 : 0);
+  const cached = Math.round((stats.cacheHits / stats.calls) * 100);
+
+  return [
+    ui.text({
+      size: "sm",
+      text: `Cost: p50 ${ms(stats.p50Us)}ms / p95 ${ms(stats.p95Us)}ms, ${
+        stats.calls
+      } renders (${cached}% cached, ${stats.failures} failed)`,
+    }),
+  ];
+}
+
 export function editLiveEffectParameters(id: string, params: any) {
   const effect = findEffect(id);
   if (!effect) throw new Error(`Effect not found: ${id}`);
@@ -447,17 +543,31 @@ export function liveEffectInterpolate(
 export const goLiveEffect = async (
   id: string,
   params: any,
-  env: LiveEffectEnv,
+  env: Omit<LiveEffectEnv, "signal">,
   width: number,
   height: number,
-  data: Uint8ClampedArray
+  data: Uint8ClampedArray,
+  cancelToken: bigint | null
 ) => {
   const effect = findEffect(id);
   if (!effect) return null;
+
+  // The host cancels the token when a newer render supersedes this one
+  const controller = new AbortController();
+  if (cancelToken != null) {
+    _AI_DENO_.op_ai_deno_wait_cancelled(cancelToken).then((cancelled) => {
+      if (!cancelled) return;
+      controller.abort(
+        new DOMException("Superseded by a newer render", "AbortError")
+      );
+    });
+  }
   const defaultParams = getDefaultValus(id);
 
-  const init = effectInits.get(effect);
-  if (!init) {
+  let init: any;
+  try {
+    init = await ensureEffectInit(effect);
+  } catch (e) {
     logger.error("Effect not initialized", id);
     return null;
   }
@@ -465,39 +575,84 @@ export const goLiveEffect = async (
   logger.log("goLiveEffect", { id, input: { width, height }, env, params });
   logger.log("--- LiveEffect Logs ---");
   try {
+    // The host already converted to the declared format; float pixels arrive as
+    // raw bytes and only need a typed view
+    const isFloat = effect.liveEffect.pixelFormat === "rgba32f";
     const input = {
-      data,
+      data: isFloat
+        ? new Float32Array(data.buffer, data.byteOffset, data.byteLength / 4)
+        : data,
       width,
       height,
-    };
-
-    const result = await effect.liveEffect.goLiveEffect(
-      init,
-      {
-        ...defaultParams,
-        ...params,
-      },
-      input,
-      {
-        ...env,
-      }
+    } as GoLiveEffectPayload;
+
+    // Effects that ignore the signal still stop holding up the host
+    const result = await withTraceId(env.traceId, () =>
+      traceSpan(`goLiveEffect ${id}`, env.traceId, () =>
+        abortable(
+          effect.liveEffect.goLiveEffect(
+            init,
+            {
+              ...defaultParams,
+              ...params,
+            },
+            input,
+            {
+              ...env,
+              signal: controller.signal,
+            }
+          ),
+          controller.signal
+        )
+      )
     );
 
+    const resultData = result.data as Uint8ClampedArray | Float32Array;
     if (
       typeof result.width !== "number" ||
       typeof result.height !== "number" ||
-      !(result.data instanceof Uint8ClampedArray)
+      !(isFloat
+        ? resultData instanceof Float32Array
+        : resultData instanceof Uint8ClampedArray)
     ) {
       throw new Error("Invalid result from goLiveEffect");
     }
 
-    return result;
+    return {
+      width: result.width,
+      height: result.height,
+      data:
+        resultData instanceof Float32Array
+          ? new Uint8ClampedArray(
+              resultData.buffer,
+              resultData.byteOffset,
+              resultData.byteLength
+            )
+          : resultData,
+    };
   } catch (e) {
-    logger.error(e);
+    if (controller.signal.aborted) {
+      logger.log("goLiveEffect cancelled", id);
+    } else {
+      logger.error(e);
+    }
     throw e;
   }
 };
 
+function abortable<T>(promise: Promise<T>, signal: AbortSignal): Promise<T> {
+  if (signal.aborted) return Promise.reject(signal.reason);
+
+  return new Promise<T>((resolve, reject) => {
+    const onAbort = () => reject(signal.reason);
+    signal.addEventListener("abort", onAbort, { once: true });
+
+    promise.then(resolve, reject).finally(() => {
+      signal.removeEventListener("abort", onAbort);
+    });
+  });
+}
+
 function getParams(effectId: string, state: any) {
   const effect = findEffect(effectId);
   if (!effect) return null;
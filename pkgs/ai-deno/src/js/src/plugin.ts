@@ -130,16 +130,52 @@ export enum StyleFilterFlag {
   kParallelExecutionFilter = 1 << 23,
 }
 
-export type GoLiveEffectPayload = {
+/**
+ * Pixel layout an effect receives and returns, see `liveEffect.pixelFormat`.
+ * - `rgba8`: straight alpha, 8bit per channel
+ * - `rgba8-premultiplied`: premultiplied alpha, 8bit per channel
+ * - `rgba32f`: straight alpha, 0 to 1 floats in a Float32Array
+ */
+export type PixelFormat = "rgba8" | "rgba8-premultiplied" | "rgba32f";
+
+export type GoLiveEffectPayload<
+  TData extends Uint8ClampedArray | Float32Array = Uint8ClampedArray
+> = {
   width: number;
   height: number;
-  data: Uint8ClampedArray;
+  data: TData;
 };
 
 export type LiveEffectEnv = {
   baseDpi: number;
   dpi: number;
   isInPreview: boolean;
+  /**
+   * Resolution of this render relative to the document's, below 1 while a
+   * preview is rendered at reduced size. `dpi` already includes it.
+   */
+  previewScale: number;
+  /**
+   * Aborted once a newer render supersedes this one (e.g. the next slider tick).
+   * Check it between GPU passes, or pass it to `mapAsyncOrAbort`.
+   */
+  signal: AbortSignal;
+  /** Set when the raster is processed in tiles, see `liveEffect.tiling` */
+  tile?: LiveEffectTile;
+  /** Id of this render in exported traces, pass it to `traceSpan` */
+  traceId?: number;
+};
+
+/**
+ * Where the current input sits in the whole raster. The input already includes
+ * the halo; only the part outside of it is kept.
+ */
+export type LiveEffectTile = {
+  /** Position of the input in the whole raster, in pixels */
+  x: number;
+  y: number;
+  fullWidth: number;
+  fullHeight: number;
 };
 
 export type AIPlugin<
@@ -162,6 +198,29 @@ export type AIPlugin<
       | "Other";
     paramSchema: T;
 
+    /**
+     * Layout of `input.data` and the returned data. Defaults to "rgba8".
+     * Conversion runs natively, so prefer declaring the format you need over
+     * converting in JS. Effects using "rgba32f" receive a Float32Array.
+     */
+    pixelFormat?: PixelFormat;
+
+    /**
+     * Opts in to tiled execution for large rasters. The effect is called once
+     * per tile, with `halo` extra pixels of context on each side, and must
+     * return data of the same size as its input.
+     * Effects that read the whole image at once (e.g. histogram based) must not
+     * declare this.
+     *
+     * The halo is also how far the effect reaches into transparent pixels:
+     * input is trimmed to its visible pixels plus the halo (passed as a tile),
+     * and fully transparent input is returned without calling the effect.
+     */
+    tiling?: {
+      /** Pixels of context needed around each tile at the given params and DPI */
+      halo: number | ((params: Params, env: LiveEffectEnv) => number);
+    };
+
     /** map to styleFilterFlags */
     styleFilterFlags: {
       type:
@@ -0,0 +1,103 @@
+// JS spans of the trace the host exports as Chrome trace JSON. Spans carry the
+// host's trace id (env.traceId) so a render is followed across host, Rust and JS.
+
+const _AI_DENO_ = globalThis._AI_DENO_ ?? {
+  op_ai_deno_trace_enabled: () => false,
+  op_ai_deno_trace_now: () => 0,
+  op_ai_deno_trace_record: () => {},
+};
+
+/** Trace id of the render running now, for spans with no env at hand */
+let currentTraceId = 0;
+
+export const isTracing = () => _AI_DENO_.op_ai_deno_trace_enabled();
+
+/** Times `fn` as a span of the render `traceId`. Plain call while tracing is off. */
+export const traceSpan = async <T>(
+  name: string,
+  traceId: number | undefined,
+  fn: () => Promise<T> | T
+): Promise<T> => {
+  if (!isTracing()) return fn();
+
+  const id = traceId ?? currentTraceId;
+  const startNs = _AI_DENO_.op_ai_deno_trace_now();
+  try {
+    return await fn();
+  } finally {
+    _AI_DENO_.op_ai_deno_trace_record(
+      name,
+      id,
+      startNs,
+      _AI_DENO_.op_ai_deno_trace_now()
+    );
+  }
+};
+
+/** Runs a render with `traceId` as the id GPU spans are recorded under */
+export const withTraceId = async <T>(
+  traceId: number | undefined,
+  fn: () => Promise<T>
+): Promise<T> => {
+  const previous = currentTraceId;
+  currentTraceId = traceId ?? 0;
+  try {
+    return await fn();
+  } finally {
+    currentTraceId = previous;
+  }
+};
+
+let gpuTracingInstalled = false;
+
+/**
+ * Records submitted GPU work (submit until the queue drained it) and buffer
+ * readbacks (mapAsync until mapped) of every effect, without touching them.
+ */
+export const installGpuTracing = () => {
+  if (gpuTracingInstalled) return;
+  if (typeof GPUQueue === "undefined" || typeof GPUBuffer === "undefined") {
+    return;
+  }
+  gpuTracingInstalled = true;
+
+  const submit = GPUQueue.prototype.submit;
+  GPUQueue.prototype.submit = function (
+    this: GPUQueue,
+    commandBuffers: Iterable<GPUCommandBuffer>
+  ) {
+    if (!isTracing()) return submit.call(this, commandBuffers);
+
+    const traceId = currentTraceId;
+    const startNs = _AI_DENO_.op_ai_deno_trace_now();
+    const result = submit.call(this, commandBuffers);
+    this.onSubmittedWorkDone().then(() => {
+      _AI_DENO_.op_ai_deno_trace_record(
+        "GPU",
+        traceId,
+        startNs,
+        _AI_DENO_.op_ai_deno_trace_now()
+      );
+    });
+    return result;
+  };
+
+  const mapAsync = GPUBuffer.prototype.mapAsync;
+  GPUBuffer.prototype.mapAsync = function (
+    this: GPUBuffer,
+    ...args: Parameters<GPUBuffer["mapAsync"]>
+  ) {
+    if (!isTracing()) return mapAsync.apply(this, args);
+
+    const traceId = currentTraceId;
+    const startNs = _AI_DENO_.op_ai_deno_trace_now();
+    return mapAsync.apply(this, args).finally(() => {
+      _AI_DENO_.op_ai_deno_trace_record(
+        "Readback",
+        traceId,
+        startNs,
+        _AI_DENO_.op_ai_deno_trace_now()
+      );
+    });
+  };
+};
@@ -12,22 +12,41 @@ use deno_runtime::deno_core::v8;
 use deno_runtime::deno_core::PollEventLoopOptions;
 use ext::ai_user_extension;
 use ext::AiExtOptions;
+use disk_cache::{DiskCacheKey, DISK_CACHE};
+use executor::{CallerPtr, Executor, ExecutorMetrics, Pending};
 use homedir::my_home;
+use cancellation::CancellationToken;
+use image_lease::ImageDataLease;
+use std::cell::RefCell;
 use std::collections::HashSet;
 use std::ffi::{c_char, c_void, CStr, CString};
 use std::fmt::Display;
 use std::path::PathBuf;
+use std::rc::Rc;
+use std::sync::mpsc::TryRecvError;
 use std::sync::Arc;
 use std::time::{Duration, Instant};
+use typed_message::SchemaKeys;
 
+mod cancellation;
 mod debug;
 mod deno;
+mod disk_cache;
+mod executor;
 mod ext;
+mod image_lease;
+mod init_failures;
+mod pipeline_cache;
+#[cfg(test)]
+mod stub_host;
+mod trace;
+mod typed_message;
 
 pub type OpaqueAiMain = *mut c_void;
 pub type OpaqueDenoRuntime = *mut c_void;
 pub type OpaqueDenoModule = *mut c_void;
 
+/// Pixels lent by the host for the duration of a call
 #[repr(C)]
 pub struct ImageDataPayload {
     width: u32,
@@ -58,10 +77,90 @@ impl JsonFunctionResult {
     }
 }
 
+/// A typed message lent by the host for the duration of a call, see `typed_message`
+#[repr(C)]
+pub struct TypedMessage {
+    data: *const u8,
+    byte_length: usize,
+}
+
+/// A typed message returned to the host. Dispose with `dispose_typed_function_result`.
+#[repr(C)]
+pub struct TypedFunctionResult {
+    success: bool,
+    data: *mut u8,
+    byte_length: usize,
+}
+
+impl TypedFunctionResult {
+    fn new(message: Vec<u8>) -> TypedFunctionResult {
+        let byte_length = message.len();
+        TypedFunctionResult {
+            success: true,
+            data: Box::into_raw(message.into_boxed_slice()) as *mut u8,
+            byte_length,
+        }
+    }
+
+    fn failed() -> TypedFunctionResult {
+        TypedFunctionResult {
+            success: false,
+            data: std::ptr::null_mut(),
+            byte_length: 0,
+        }
+    }
+}
+
+/// Argument of an FFI call, as JSON text or as a typed message
+enum CallArg {
+    Json(String),
+    Typed(Vec<u8>),
+}
+
+impl CallArg {
+    fn json(json: *const c_char) -> CallArg {
+        CallArg::Json(unsafe { CStr::from_ptr(json).to_string_lossy().to_string() })
+    }
+
+    /// Copied, calls may run after the host's call returned
+    fn typed(message: *const TypedMessage) -> CallArg {
+        let message = unsafe { &*message };
+        let bytes = unsafe { std::slice::from_raw_parts(message.data, message.byte_length) };
+        CallArg::Typed(bytes.to_vec())
+    }
+
+    /// `keys` resolve the key indices of a typed params message
+    fn to_v8<'s>(
+        &self,
+        scope: &mut v8::PinnedRef<'s, v8::HandleScope>,
+        keys: Option<&SchemaKeys>,
+    ) -> Result<v8::Local<'s, v8::Value>, anyhow::Error> {
+        match self {
+            CallArg::Json(json) => {
+                let json = v8::String::new(scope, json.as_str())
+                    .ok_or_else(|| anyhow::anyhow!("argument too long"))?;
+                v8::json::parse(scope, json).ok_or_else(|| anyhow::anyhow!("invalid JSON argument"))
+            }
+            CallArg::Typed(message) => typed_message::decode(scope, message, keys),
+        }
+    }
+}
+
 #[repr(C)]
 pub struct GoLiveEffectResult {
     pub success: bool,
-    pub data: *mut ImageDataPayload,
+    /// The render was superseded by a newer generation, or its ticket cancelled,
+    /// before it finished
+    pub cancelled: bool,
+    pub data: *mut ImageDataLease,
+    /// From the go_live_effect call to the effect starting (queueing included), ns
+    pub js_offset_ns: u64,
+    /// Spent in the effect, GPU work it awaits included, ns. 0 if it never ran.
+    pub js_ns: u64,
+    /// Of `js_ns`, queue submits until the GPU drained them, ns. 0 while tracing is off.
+    pub gpu_ns: u64,
+    /// Of `js_ns`, waiting on buffer maps, ns. 0 while tracing is off.
+    pub readback_ns: u64,
 }
 
 pub struct AlertPayload {}
@@ -103,6 +202,51 @@ pub extern "C" fn get_version() -> *const c_char {
 
 #[no_mangle]
 pub extern "C" fn initialize(_ai_alert: extern "C" fn(*const JsonFunctionResult)) -> OpaqueAiMain {
+    spawn_runtime("ai-deno-main".to_string(), _ai_alert)
+        .expect("ai-deno: Failed to start the runtime thread")
+}
+
+/// Starts a runtime on an executor thread of its own; calls made while it's
+/// still initializing wait for it.
+fn spawn_runtime(
+    name: String,
+    ai_alert: extern "C" fn(*const JsonFunctionResult),
+) -> std::io::Result<OpaqueAiMain> {
+    // Illustrator is only asked on its own thread, the runtime keeps the answer
+    let user_locale = unsafe { CStr::from_ptr(ai_deno_get_user_locale()) }
+        .to_string_lossy()
+        .to_string();
+
+    let executor = Executor::spawn(name, move || create_ai_main(ai_alert, user_locale))?;
+    Ok(Box::into_raw(Box::new(executor)) as OpaqueAiMain)
+}
+
+/// Runs `call` on the runtime's executor thread and waits for it. None when the
+/// executor is gone or the call panicked.
+fn on_executor<R: 'static>(
+    ai_main_ref: OpaqueAiMain,
+    call: impl FnOnce(&mut AiMain) -> *mut R + Send + 'static,
+) -> Option<*mut R> {
+    executor::from_opaque(ai_main_ref)
+        .run(move |ai_main| CallerPtr(call(ai_main)))
+        .map(|result| result.get())
+}
+
+fn failed_json_result() -> *mut JsonFunctionResult {
+    Box::into_raw(Box::new(JsonFunctionResult::failed_default()))
+}
+
+/// Queue and timing counters of a runtime's executor thread
+#[no_mangle]
+pub extern "C" fn get_runtime_metrics(ai_main_ref: OpaqueAiMain) -> ExecutorMetrics {
+    executor::from_opaque(ai_main_ref).metrics()
+}
+
+/// Builds a runtime with the bundled effects loaded, on the calling thread
+fn create_ai_main(
+    _ai_alert: extern "C" fn(*const JsonFunctionResult),
+    user_locale: String,
+) -> Box<AiMain> {
     // let alert_fn = move |req: &str| alert_function(req, _ai_alert);
 
     dai_println!("Initializing");
@@ -113,6 +257,7 @@ pub extern "C" fn initialize(_ai_alert: extern "C" fn(*const JsonFunctionResult)
     let mut runtime = Runtime::new(RuntimeInit {
         extensions: vec![ai_user_extension::init(AiExtOptions {
             // alert: alert_fn,
+            user_locale,
         })],
         allowed_module_schemas: allowed_schemas,
         package_root_dir: package_root_dir(),
@@ -151,9 +296,38 @@ pub extern "C" fn initialize(_ai_alert: extern "C" fn(*const JsonFunctionResult)
     });
 
     dai_println!("Calling loadEffects");
-    execute_export_function_and_raw_return(&mut *boxed_main, "loadEffects", |scope| Ok(vec![]));
+    execute_export_function_and_raw_return(&mut *boxed_main, "loadEffects", None, |scope| {
+        Ok(vec![])
+    });
 
-    Box::into_raw(boxed_main) as OpaqueAiMain
+    boxed_main
+}
+
+/// Starts an independent runtime, for live effects to render in parallel. Takes
+/// the same calls as the one from `initialize`. `index` only names the thread.
+/// Null when the thread couldn't start.
+#[no_mangle]
+pub extern "C" fn initialize_runtime_worker(
+    ai_alert: extern "C" fn(*const JsonFunctionResult),
+    index: u32,
+) -> OpaqueAiMain {
+    match spawn_runtime(format!("ai-deno-runtime-{}", index), ai_alert) {
+        Ok(ai_main) => ai_main,
+        Err(e) => {
+            eprintln!("initialize_runtime_worker: failed to spawn: {}", e);
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Stops a runtime once its queued calls finished
+#[no_mangle]
+pub extern "C" fn dispose_runtime_worker(ai_main_ref: OpaqueAiMain) {
+    if ai_main_ref.is_null() {
+        return;
+    }
+
+    unsafe { drop(Box::from_raw(ai_main_ref as *mut Executor)) };
 }
 
 #[no_mangle]
@@ -171,15 +345,74 @@ pub extern "C" fn dispose_json_function_result(result: *mut JsonFunctionResult)
 }
 
 #[no_mangle]
-pub extern "C" fn get_live_effects(ai_main_ref: OpaqueAiMain) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
+pub extern "C" fn dispose_typed_function_result(result: *mut TypedFunctionResult) {
+    if result.is_null() {
+        return;
+    }
+
+    unsafe {
+        if !(*result).data.is_null() {
+            drop(Box::from_raw(std::ptr::slice_from_raw_parts_mut(
+                (*result).data,
+                (*result).byte_length,
+            )));
+        }
+        drop(Box::from_raw(result));
+    }
+}
 
+/// Also learns each effect's `paramSchema` keys for the typed calls
+#[no_mangle]
+pub extern "C" fn get_live_effects(ai_main_ref: OpaqueAiMain) -> *mut JsonFunctionResult {
     dai_println!("✨️ get_live_effects");
 
-    let result = execute_exported_function(ai_main, "getLiveEffects", |scope| Ok(vec![]));
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "getLiveEffects", |scope| Ok(vec![]));
+        if result.success {
+            let effects_json = unsafe { CStr::from_ptr(result.json) }.to_string_lossy();
+            typed_message::register_effects(&effects_json);
+        }
 
-    let boxed_result = Box::new(result);
-    Box::into_raw(boxed_result)
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
+}
+
+/// Queues the initialization of effects ahead of their first render and returns
+/// without waiting for it. `effect_ids_json` is a JSON array of effect ids, or
+/// null for every effect. False when the runtime is gone.
+#[no_mangle]
+pub extern "C" fn warm_up_live_effects(
+    ai_main_ref: OpaqueAiMain,
+    effect_ids_json: *const c_char,
+) -> bool {
+    let effect_ids = (!effect_ids_json.is_null()).then(|| {
+        unsafe { CStr::from_ptr(effect_ids_json) }
+            .to_string_lossy()
+            .to_string()
+    });
+
+    let receiver = executor::from_opaque(ai_main_ref).submit(move |ai_main| {
+        let result = execute_exported_function(ai_main, "warmUpLiveEffects", move |scope| {
+            let effect_ids = match effect_ids {
+                Some(effect_ids) => {
+                    let effect_ids = v8::String::new(&*scope, &effect_ids).unwrap();
+                    v8::json::parse(&*scope, effect_ids)
+                        .ok_or_else(|| anyhow::anyhow!("effect ids are not JSON"))?
+                }
+                None => v8::null(&*scope).into(),
+            };
+            Ok(vec![effect_ids])
+        });
+
+        dai_println!(
+            "warm_up_live_effects: {}",
+            unsafe { CStr::from_ptr(result.json) }.to_string_lossy()
+        );
+        dispose_json_function_result(Box::into_raw(Box::new(result)));
+    });
+
+    receiver.is_some()
 }
 
 #[no_mangle]
@@ -188,103 +421,433 @@ pub extern "C" fn get_live_effect_view_tree(
     effect_id: *const c_char,
     params: *const c_char,
 ) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
     let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
     let params = unsafe { CStr::from_ptr(params).to_string_lossy().to_string() };
 
     let effect_id_clone = effect_id.clone();
     let params_clone = params.clone();
 
-    let result = execute_exported_function(ai_main, "getEffectViewNode", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id_clone.as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
-        let params = v8::String::new(&*scope, params_clone.to_string().as_str()).unwrap();
-        let params = v8::json::parse(&*scope, params).unwrap();
-        let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "getEffectViewNode", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id_clone.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
+            let params = v8::String::new(&*scope, params_clone.to_string().as_str()).unwrap();
+            let params = v8::json::parse(&*scope, params).unwrap();
+            let params = v8::Local::<v8::Object>::try_from(params).unwrap();
 
-        let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into()];
-        Ok(args)
-    });
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into()];
+            Ok(args)
+        });
+
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
+}
+
+/// Tiling metadata of an effect for the given params, `null` when it can't be tiled
+#[no_mangle]
+pub extern "C" fn get_live_effect_tiling(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const c_char,
+    env_json: *const c_char,
+) -> *mut JsonFunctionResult {
+    let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
+    let params = unsafe { CStr::from_ptr(params).to_string_lossy().to_string() };
+    let env_json = unsafe { CStr::from_ptr(env_json).to_string_lossy().to_string() };
+
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "getLiveEffectTiling", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
+
+            let params = v8::String::new(&*scope, params.as_str()).unwrap();
+            let params = v8::json::parse(&*scope, params).unwrap();
+            let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+
+            let env_json = v8::String::new(&*scope, env_json.as_str()).unwrap();
+            let env_json = v8::json::parse(&*scope, env_json).unwrap();
+            let env_json = v8::Local::<v8::Object>::try_from(env_json).unwrap();
+
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into(), env_json.into()];
+            Ok(args)
+        });
+
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
+}
+
+/// `get_live_effect_tiling` taking typed messages, returns one
+#[no_mangle]
+pub extern "C" fn get_live_effect_tiling_typed(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const TypedMessage,
+    env: *const TypedMessage,
+) -> *mut TypedFunctionResult {
+    let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
+    let params = CallArg::typed(params);
+    let env = CallArg::typed(env);
+
+    on_executor(ai_main_ref, move |ai_main| {
+        let keys = typed_message::schema_keys(&effect_id);
+        let result = execute_exported_function_typed(ai_main, "getLiveEffectTiling", None, move |scope| {
+            let params = params.to_v8(&mut *scope, keys.as_deref())?;
+            let env = env.to_v8(&mut *scope, None)?;
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params, env];
+            Ok(args)
+        });
+
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(|| Box::into_raw(Box::new(TypedFunctionResult::failed())))
+}
+
+/// Arguments of a goLiveEffect call, owned so the call can run on the executor
+struct GoLiveEffectArgs {
+    effect_id: String,
+    params: CallArg,
+    env: CallArg,
+    image_data: ImageDataPayload,
+    /// Registered by the caller, so the render can be cancelled before it starts
+    cancel_token: Option<Arc<CancellationToken>>,
+    called_at: Instant,
+    trace_id: u64,
+}
+
+// The host keeps the pixels alive until the call completed
+unsafe impl Send for GoLiveEffectArgs {}
+
+impl GoLiveEffectArgs {
+    fn from_raw(
+        effect_id: *const c_char,
+        params: CallArg,
+        env: CallArg,
+        image_data: *const ImageDataPayload,
+        generation: u64,
+        trace_id: u64,
+    ) -> GoLiveEffectArgs {
+        let image_data = unsafe { &*image_data };
+
+        GoLiveEffectArgs {
+            effect_id: unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() },
+            params,
+            env,
+            image_data: ImageDataPayload {
+                width: image_data.width,
+                height: image_data.height,
+                data_ptr: image_data.data_ptr,
+                byte_length: image_data.byte_length,
+            },
+            cancel_token: (generation != 0).then(|| cancellation::register(generation)),
+            called_at: Instant::now(),
+            trace_id,
+        }
+    }
+}
+
+fn cancelled_go_live_effect_result() -> *mut GoLiveEffectResult {
+    Box::into_raw(Box::new(GoLiveEffectResult {
+        success: false,
+        cancelled: true,
+        data: std::ptr::null_mut(),
+        js_offset_ns: 0,
+        js_ns: 0,
+        gpu_ns: 0,
+        readback_ns: 0,
+    }))
+}
+
+fn failed_go_live_effect_result() -> *mut GoLiveEffectResult {
+    Box::into_raw(Box::new(GoLiveEffectResult {
+        success: false,
+        cancelled: false,
+        data: std::ptr::null_mut(),
+        js_offset_ns: 0,
+        js_ns: 0,
+        gpu_ns: 0,
+        readback_ns: 0,
+    }))
+}
+
+/// `generation` numbers preview renders for `cancel_live_effect_renders`, 0 makes the
+/// render uncancellable. `trace_id` tags the render's spans, see `trace_export_chrome`.
+/// Blocks until the render finished.
+#[no_mangle]
+pub extern "C" fn go_live_effect(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const c_char,
+    env_json: *const c_char,
+    image_data: *mut ImageDataPayload,
+    generation: u64,
+    trace_id: u64,
+) -> *mut GoLiveEffectResult {
+    let args = GoLiveEffectArgs::from_raw(
+        effect_id,
+        CallArg::json(params),
+        CallArg::json(env_json),
+        image_data,
+        generation,
+        trace_id,
+    );
+    call_go_live_effect(ai_main_ref, args)
+}
+
+/// `go_live_effect` taking typed messages for the params and env
+#[no_mangle]
+pub extern "C" fn go_live_effect_typed(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const TypedMessage,
+    env: *const TypedMessage,
+    image_data: *mut ImageDataPayload,
+    generation: u64,
+    trace_id: u64,
+) -> *mut GoLiveEffectResult {
+    let args = GoLiveEffectArgs::from_raw(
+        effect_id,
+        CallArg::typed(params),
+        CallArg::typed(env),
+        image_data,
+        generation,
+        trace_id,
+    );
+    call_go_live_effect(ai_main_ref, args)
+}
 
-    // print!("get_live_effect_view_tree result: {}", result);
+fn call_go_live_effect(
+    ai_main_ref: OpaqueAiMain,
+    args: GoLiveEffectArgs,
+) -> *mut GoLiveEffectResult {
+    let cancel_token = args.cancel_token.clone();
 
-    let boxed = Box::new(result);
+    on_executor(ai_main_ref, move |ai_main| {
+        run_go_live_effect(ai_main, args)
+    })
+    .unwrap_or_else(|| {
+        if let Some(token) = &cancel_token {
+            cancellation::finish(token);
+        }
+        failed_go_live_effect_result()
+    })
+}
 
-    Box::into_raw(boxed)
+/// Ticket of a goLiveEffect call queued by `go_live_effect_submit`
+pub struct LiveEffectTicket {
+    /// None when the render was never queued, `result` holds the failure then
+    pending: Option<Pending<CallerPtr<GoLiveEffectResult>>>,
+    result: Option<*mut GoLiveEffectResult>,
+    cancel_token: Arc<CancellationToken>,
 }
 
+/// Ticket-based `go_live_effect`: queues the render and returns immediately, so the
+/// host can prepare the next input meanwhile. The strings are copied, but
+/// `image_data`'s pixels must stay alive until the ticket is waited on.
+///
+/// Poll with `live_effect_ticket_is_ready`, stop with `live_effect_ticket_cancel`,
+/// and always collect with `live_effect_ticket_wait`, which frees the ticket.
 #[no_mangle]
-extern "C" fn go_live_effect(
+pub extern "C" fn go_live_effect_submit(
     ai_main_ref: OpaqueAiMain,
     effect_id: *const c_char,
     params: *const c_char,
     env_json: *const c_char,
     image_data: *mut ImageDataPayload,
+    generation: u64,
+    trace_id: u64,
+) -> *mut LiveEffectTicket {
+    let args = GoLiveEffectArgs::from_raw(
+        effect_id,
+        CallArg::json(params),
+        CallArg::json(env_json),
+        image_data,
+        generation,
+        trace_id,
+    );
+    submit_go_live_effect(ai_main_ref, args)
+}
+
+/// `go_live_effect_submit` taking typed messages for the params and env
+#[no_mangle]
+pub extern "C" fn go_live_effect_submit_typed(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const TypedMessage,
+    env: *const TypedMessage,
+    image_data: *mut ImageDataPayload,
+    generation: u64,
+    trace_id: u64,
+) -> *mut LiveEffectTicket {
+    let args = GoLiveEffectArgs::from_raw(
+        effect_id,
+        CallArg::typed(params),
+        CallArg::typed(env),
+        image_data,
+        generation,
+        trace_id,
+    );
+    submit_go_live_effect(ai_main_ref, args)
+}
+
+fn submit_go_live_effect(
+    ai_main_ref: OpaqueAiMain,
+    mut args: GoLiveEffectArgs,
+) -> *mut LiveEffectTicket {
+    // Tickets are always cancellable, generation 0 ones only through the ticket
+    let cancel_token = args
+        .cancel_token
+        .get_or_insert_with(|| cancellation::register(0))
+        .clone();
+
+    let pending = executor::from_opaque(ai_main_ref)
+        .submit(move |ai_main| CallerPtr(run_go_live_effect(ai_main, args)));
+
+    let result = match pending {
+        Some(_) => None,
+        // Never queued, the ticket is ready with a failure
+        None => {
+            cancellation::finish(&cancel_token);
+            Some(failed_go_live_effect_result())
+        }
+    };
+
+    Box::into_raw(Box::new(LiveEffectTicket {
+        pending,
+        result,
+        cancel_token,
+    }))
+}
+
+/// Whether `live_effect_ticket_wait` would return without blocking
+#[no_mangle]
+pub extern "C" fn live_effect_ticket_is_ready(ticket: *mut LiveEffectTicket) -> bool {
+    let ticket = unsafe { &mut *ticket };
+
+    if let (None, Some(pending)) = (ticket.result, &ticket.pending) {
+        ticket.result = match pending.try_recv() {
+            Ok(result) => Some(result.get()),
+            Err(TryRecvError::Empty) => None,
+            Err(TryRecvError::Disconnected) => Some(failed_go_live_effect_result()),
+        };
+    }
+
+    ticket.result.is_some()
+}
+
+/// Cancels the render: skipped if it hasn't started, aborted like a superseded
+/// preview otherwise. The ticket must still be waited on; its result is then
+/// `cancelled` unless the render had already finished.
+#[no_mangle]
+pub extern "C" fn live_effect_ticket_cancel(ticket: *mut LiveEffectTicket) {
+    let ticket = unsafe { &*ticket };
+    ticket.cancel_token.cancel();
+}
+
+/// Waits for the render and returns its result. Frees `ticket`.
+#[no_mangle]
+pub extern "C" fn live_effect_ticket_wait(
+    ticket: *mut LiveEffectTicket,
 ) -> *mut GoLiveEffectResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
+    let ticket = unsafe { Box::from_raw(ticket) };
 
-    let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy() };
-    let params = unsafe { CStr::from_ptr(params).to_string_lossy() }.clone();
-    let env_json = unsafe { CStr::from_ptr(env_json).to_string_lossy() };
-    let image_data = unsafe { &mut *image_data };
-    let source_buffer_ptr = (*image_data).data_ptr;
+    match (ticket.result, &ticket.pending) {
+        (Some(result), _) => result,
+        (None, Some(pending)) => match pending.recv() {
+            Ok(result) => result.get(),
+            Err(_) => failed_go_live_effect_result(),
+        },
+        (None, None) => failed_go_live_effect_result(),
+    }
+}
+
+fn run_go_live_effect(ai_main: &mut AiMain, args: GoLiveEffectArgs) -> *mut GoLiveEffectResult {
+    let GoLiveEffectArgs {
+        effect_id,
+        params,
+        env,
+        image_data,
+        cancel_token,
+        called_at,
+        trace_id,
+    } = args;
+    let source_buffer_ptr = image_data.data_ptr;
+
+    let queued_ns = trace::instant_ns(called_at);
+    trace::record("rust", "queued", trace_id, queued_ns, trace::now_ns());
+    let _span = trace::Span::new("go_live_effect", trace_id);
+
+    // Cancelled while queued, the effect never sees it
+    if let Some(token) = cancel_token.as_ref().filter(|token| token.is_cancelled()) {
+        cancellation::finish(token);
+        dai_println!("go_live_effect: {} cancelled before it started", effect_id);
+        return cancelled_go_live_effect_result();
+    }
+
+    // Filled by the args factory so the lent buffer can be detached after the call
+    let lent_buffer: Rc<RefCell<Option<v8::Global<v8::ArrayBuffer>>>> = Default::default();
+    let lent_buffer_slot = lent_buffer.clone();
+
+    let cancel_token_id = cancel_token.as_ref().map(|token| token.id);
 
     let t = Instant::now();
+    let js_offset_ns = called_at.elapsed().as_nanos() as u64;
     dai_println!("go_live_effect: effect_id = {}", effect_id);
+    let keys = typed_message::schema_keys(&effect_id);
 
-    let result = execute_export_function_and_raw_return(ai_main, "goLiveEffect", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id.to_string().as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
+    let result = execute_export_function_and_raw_return(
+        ai_main,
+        "goLiveEffect",
+        cancel_token.clone(),
+        move |scope| {
+            let _span = trace::Span::new("marshal args", trace_id);
 
-        let params = v8::String::new(&*scope, params.to_string().as_str()).unwrap();
-        let params = v8::json::parse(&*scope, params).unwrap();
-        let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
 
-        let env_json = v8::String::new(&*scope, env_json.to_string().as_str()).unwrap();
-        let env_json = v8::json::parse(&*scope, env_json).unwrap();
-        let env_json = v8::Local::<v8::Object>::try_from(env_json).unwrap();
+            let params = params.to_v8(&mut *scope, keys.as_deref())?;
+            let params = v8::Local::<v8::Object>::try_from(params)?;
 
-        let width = v8::Number::new(&*scope, image_data.width as f64);
-        let height = v8::Number::new(&*scope, image_data.height as f64);
+            let env_json = env.to_v8(&mut *scope, None)?;
+            let env_json = v8::Local::<v8::Object>::try_from(env_json)?;
+            // Lets the effect tag its own spans with `traceSpan`
+            let trace_id_key = v8::String::new(&*scope, "traceId").unwrap();
+            let trace_id_value = v8::Number::new(&*scope, trace_id as f64);
+            env_json.set(&mut *scope, trace_id_key.into(), trace_id_value.into());
 
-        let buffer = {
-            let bufferdata = unsafe {
-                Vec::from_raw_parts(
-                    image_data.data_ptr as *mut u8,
-                    image_data.byte_length,
-                    image_data.byte_length,
-                )
-            };
-            let len = image_data.byte_length;
+            let width = v8::Number::new(&*scope, image_data.width as f64);
+            let height = v8::Number::new(&*scope, image_data.height as f64);
 
-            let store = v8::ArrayBuffer::new_backing_store_from_bytes(bufferdata).make_shared();
-            let array_buffer = v8::ArrayBuffer::with_backing_store(&*scope, &store);
+            let buffer = {
+                let store = image_lease::lend_host_buffer(&image_data);
+                let array_buffer = v8::ArrayBuffer::with_backing_store(&*scope, &store);
+                lent_buffer_slot.replace(Some(v8::Global::new(&mut *scope, array_buffer)));
 
-            v8::Uint8ClampedArray::new(&*scope, array_buffer, 0, len)
-        }
-        .unwrap();
-
-        let args: Vec<v8::Local<v8::Value>> = vec![
-            effect_id.into(),
-            params.into(),
-            env_json.into(),
-            width.into(),
-            height.into(),
-            buffer.into(),
-        ];
-        Ok(args)
-    });
+                v8::Uint8ClampedArray::new(&*scope, array_buffer, 0, image_data.byte_length)
+            }
+            .unwrap();
 
-    let result = match result {
-        Some(result) => result,
-        None => {
-            dai_println!("go_live_effect: error: result is None");
-            return Box::into_raw(Box::new(GoLiveEffectResult {
-                success: false,
-                data: std::ptr::null_mut(),
-            }));
-        }
-    };
+            let args: Vec<v8::Local<v8::Value>> = vec![
+                effect_id.into(),
+                params.into(),
+                env_json.into(),
+                width.into(),
+                height.into(),
+                buffer.into(),
+                match cancel_token_id {
+                    Some(id) => v8::BigInt::new_from_u64(&*scope, id).into(),
+                    None => v8::null(&*scope).into(),
+                },
+            ];
+            Ok(args)
+        },
+    );
+    let js_ns = t.elapsed().as_nanos() as u64;
+    // Spans tracing.ts records around the effect's queue submits and buffer maps
+    let [gpu_ns, readback_ns] = trace::js_totals_ns(trace_id, ["GPU", "Readback"]);
 
     let deno_runtime = &mut ai_main.main_runtime.deno_runtime();
     let context = deno_runtime.main_context();
@@ -293,33 +856,21 @@ extern "C" fn go_live_effect(
     let context_local = v8::Local::new(handle_scope, context);
     let scope = &mut v8::ContextScope::new(handle_scope, context_local);
 
-    let print_js_object = {
-        let source = v8::String::new(&*scope, "(value)=>console.log(value)").unwrap();
-        let script = v8::Script::compile(&*scope, source, None).unwrap();
-        let __fn = script.run(&mut *scope).unwrap();
-        let __fn = v8::Local::<v8::Function>::try_from(__fn).unwrap();
-        let undefined = v8::undefined(&*scope);
-
-        move |scope: &mut v8::HandleScope, value: v8::Local<v8::Value>| {
-            let args = vec![value];
-            let pinned = unsafe { std::pin::Pin::new_unchecked(scope) };
-            let pinned_ref = v8::PinnedRef::from(pinned);
-            __fn.call(&pinned_ref, undefined.into(), &args);
-        }
-    };
-
-    let result = v8::Local::<v8::Value>::new(scope, result);
-
-    if !result.is_object() {
-        return Box::into_raw(Box::new(GoLiveEffectResult {
-            success: false,
-            data: std::ptr::null_mut(),
-        }));
+    // Whatever the effect returned, a superseded render must not reach the host
+    let cancelled = cancel_token.as_ref().map_or(false, |token| token.is_cancelled());
+    if let Some(token) = &cancel_token {
+        cancellation::finish(token);
     }
 
-    let returned = (|| -> Result<GoLiveEffectResult, anyhow::Error> {
-        let obj = v8::Local::<v8::Value>::try_from(result)?;
-        let obj = v8::Local::<v8::Object>::try_from(obj)?;
+    let lease_span = trace::Span::new("lease result", trace_id);
+    let returned = (|| -> Result<ImageDataLease, anyhow::Error> {
+        if cancelled {
+            return Err(anyhow::anyhow!("cancelled by a newer render"));
+        }
+
+        let result = result.ok_or_else(|| anyhow::anyhow!("result is None"))?;
+        let result = v8::Local::<v8::Value>::new(&mut *scope, result);
+        let obj = v8::Local::<v8::Object>::try_from(result)?;
 
         let property = v8::String::new(&*scope, "width").unwrap();
         let width = obj
@@ -338,43 +889,64 @@ extern "C" fn go_live_effect(
         let property = v8::String::new(&*scope, "data").unwrap();
         let buffer = obj.get(&mut *scope, property.into()).unwrap();
         let buffer = v8::Local::<v8::Uint8ClampedArray>::try_from(buffer)?;
-        let buffer = buffer.get_backing_store().unwrap();
-
-        let len = buffer.byte_length();
-
-        let is_new_buffer = buffer.data().unwrap().as_ptr() == source_buffer_ptr;
-        dai_println!("is_new_buffer: {}", is_new_buffer);
-
-        let data_ptr = buffer.data().unwrap().cast::<u8>().as_ptr() as *mut c_void;
-        // let data_ptr = Box::into_raw(Box::new(data_ptr)) as *mut c_void;
-        dai_println!("source_ptr: {:p}", source_buffer_ptr);
-        dai_println!("data_ptr: {:p}", data_ptr);
 
-        Ok(GoLiveEffectResult {
-            success: true,
-            data: Box::into_raw(Box::new(ImageDataPayload {
-                width: width as u32,
-                height: height as u32,
-                data_ptr,
-                byte_length: len,
-            })),
-        })
+        image_lease::lease_pixels(width as u32, height as u32, buffer)
+            .ok_or_else(|| anyhow::anyhow!("result data has no backing store"))
     })();
 
+    // Effects may keep a reference to their input, but the host reuses the memory
+    // once we return. Detaching turns any later access into an empty view.
+    if let Some(lent_buffer) = lent_buffer.take() {
+        let lent_buffer = v8::Local::new(&mut *scope, lent_buffer);
+        lent_buffer.detach(None);
+    }
+    drop(lease_span);
+
     dai_println!("go_live_effect: elapsed = {:?}", t.elapsed());
+    dai_println!(
+        "go_live_effect: live leases = {}, lent buffers = {}",
+        image_lease::live_leases(),
+        image_lease::lent_buffers()
+    );
 
     match returned {
-        Ok(result) => Box::into_raw(Box::new(result)),
+        Ok(lease) => {
+            dai_println!("is_new_buffer: {}", lease.data_ptr != source_buffer_ptr);
+            dai_println!("source_ptr: {:p}", source_buffer_ptr);
+            dai_println!("data_ptr: {:p}", lease.data_ptr);
+
+            Box::into_raw(Box::new(GoLiveEffectResult {
+                success: true,
+                cancelled: false,
+                data: Box::into_raw(Box::new(lease)),
+                js_offset_ns,
+                js_ns,
+                gpu_ns,
+                readback_ns,
+            }))
+        }
         Err(e) => {
-            eprintln!("go_live_effect: error: {}", e);
+            if cancelled {
+                dai_println!("go_live_effect: {}", e);
+            } else {
+                eprintln!("go_live_effect: error: {}", e);
+            }
+
             Box::into_raw(Box::new(GoLiveEffectResult {
                 success: false,
+                cancelled,
                 data: std::ptr::null_mut(),
+                js_offset_ns,
+                js_ns,
+                gpu_ns,
+                readback_ns,
             }))
         }
     }
 }
 
+/// Releases the output lease (if the host didn't already) and the result itself.
+/// The host's input buffer is never touched.
 #[no_mangle]
 pub extern "C" fn dispose_go_live_effect_result(result: *mut GoLiveEffectResult) {
     if result.is_null() {
@@ -382,39 +954,223 @@ pub extern "C" fn dispose_go_live_effect_result(result: *mut GoLiveEffectResult)
     }
 
     unsafe {
-        // if !(*result).data.is_null() {
-        //     drop(Box::from_raw((*result).data));
-        // }
+        let data = (*result).data;
+        if !data.is_null() {
+            ((*data).release)(data);
+            drop(Box::from_raw(data));
+        }
         drop(Box::from_raw(result));
     }
 }
 
+/// Cancels in-flight renders of a generation below `generation`. Safe to call from
+/// any thread.
+#[no_mangle]
+pub extern "C" fn cancel_live_effect_renders(generation: u64) {
+    cancellation::cancel_below(generation);
+}
+
+/// Reads a live effect output back from the disk cache. Null on a miss.
+/// Dispose the lease with `dispose_image_lease`.
+#[no_mangle]
+pub extern "C" fn disk_cache_read(key: *const DiskCacheKey) -> *mut ImageDataLease {
+    let key = unsafe { &*key }.to_result_key();
+
+    match DISK_CACHE.read(&key) {
+        Some(pixels) => Box::into_raw(Box::new(image_lease::lease_owned_pixels(
+            pixels.width,
+            pixels.height,
+            pixels.data,
+        ))),
+        None => std::ptr::null_mut(),
+    }
+}
+
+/// Stores a live effect output in the disk cache. The pixels are copied before
+/// returning and written in the background. Returns false when nothing will be written.
+#[no_mangle]
+pub extern "C" fn disk_cache_write(
+    key: *const DiskCacheKey,
+    image_data: *const ImageDataPayload,
+) -> bool {
+    let key = unsafe { &*key }.to_result_key();
+    let image_data = unsafe { &*image_data };
+
+    if !DISK_CACHE.is_enabled() {
+        return false;
+    }
+
+    let data = unsafe {
+        std::slice::from_raw_parts(image_data.data_ptr as *const u8, image_data.byte_length)
+    }
+    .to_vec();
+
+    DISK_CACHE.write_in_background(key, image_data.width, image_data.height, data)
+}
+
+/// Effect init failures queued since the last call, as a JSON array of messages.
+/// Inits run inside renders, so the host alerts these from its main thread.
+#[no_mangle]
+pub extern "C" fn take_effect_init_failures() -> *mut JsonFunctionResult {
+    Box::into_raw(Box::new(JsonFunctionResult {
+        success: true,
+        json: CString::new(json!(init_failures::take()).to_string())
+            .unwrap()
+            .into_raw(),
+    }))
+}
+
+/// Caps the disk cache size in bytes, 0 disables it
+#[no_mangle]
+pub extern "C" fn disk_cache_set_budget(budget_bytes: u64) {
+    DISK_CACHE.set_budget(budget_bytes);
+}
+
+/// Writes the host's per effect stats report as `effect-stats-<unix seconds>.json`
+/// and `.csv` under `~/.ai-deno/stats`. Returns `{"json": ..., "csv": ...}`.
+#[no_mangle]
+pub extern "C" fn write_effect_stats_report(
+    report_json: *const c_char,
+    report_csv: *const c_char,
+) -> *mut JsonFunctionResult {
+    let report_json = unsafe { CStr::from_ptr(report_json) }.to_bytes();
+    let report_csv = unsafe { CStr::from_ptr(report_csv) }.to_bytes();
+
+    let dir = package_root_dir().join("stats");
+    let seconds = std::time::SystemTime::now()
+        .duration_since(std::time::SystemTime::UNIX_EPOCH)
+        .map_or(0, |elapsed| elapsed.as_secs());
+    let json_path = dir.join(format!("effect-stats-{}.json", seconds));
+    let csv_path = dir.join(format!("effect-stats-{}.csv", seconds));
+
+    let written = std::fs::create_dir_all(&dir)
+        .and_then(|_| std::fs::write(&json_path, report_json))
+        .and_then(|_| std::fs::write(&csv_path, report_csv));
+
+    match written {
+        Ok(()) => Box::into_raw(Box::new(JsonFunctionResult {
+            success: true,
+            json: CString::new(
+                json!({
+                    "json": json_path.to_string_lossy(),
+                    "csv": csv_path.to_string_lossy(),
+                })
+                .to_string(),
+            )
+            .unwrap()
+            .into_raw(),
+        })),
+        Err(e) => {
+            eprintln!("write_effect_stats_report: {}", e);
+            failed_json_result()
+        }
+    }
+}
+
+/// Starts or stops recording Rust and JS spans for `trace_export_chrome`
+#[no_mangle]
+pub extern "C" fn trace_set_enabled(enabled: bool) {
+    trace::set_enabled(enabled);
+}
+
+/// Writes the spans recorded so far, the host's `host_spans_json` included, as a
+/// Chrome trace under `~/.ai-deno/traces` and forgets them. `host_spans_json` is
+/// an array of `{name, traceId, thread, startNs, durationNs}` and `host_now_ns` the
+/// host clock read right before the call. Returns `{"path": ...}`.
+#[no_mangle]
+pub extern "C" fn trace_export_chrome(
+    host_spans_json: *const c_char,
+    host_now_ns: u64,
+) -> *mut JsonFunctionResult {
+    let host_spans_json = unsafe { CStr::from_ptr(host_spans_json) }.to_string_lossy();
+
+    let host_spans: Vec<trace::HostSpan> = match serde_json::from_str(&host_spans_json) {
+        Ok(spans) => spans,
+        Err(e) => {
+            eprintln!("trace_export_chrome: invalid host spans: {}", e);
+            return failed_json_result();
+        }
+    };
+
+    let chrome_trace = trace::chrome_trace(&host_spans, host_now_ns, &trace::take());
+    match trace::write_chrome_trace(&package_root_dir().join("traces"), &chrome_trace) {
+        Ok(path) => Box::into_raw(Box::new(JsonFunctionResult {
+            success: true,
+            json: CString::new(json!({ "path": path.to_string_lossy() }).to_string())
+                .unwrap()
+                .into_raw(),
+        })),
+        Err(e) => {
+            eprintln!("trace_export_chrome: {}", e);
+            failed_json_result()
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn dispose_image_lease(lease: *mut ImageDataLease) {
+    if lease.is_null() {
+        return;
+    }
+
+    unsafe {
+        ((*lease).release)(lease);
+        drop(Box::from_raw(lease));
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn edit_live_effect_parameters(
     ai_main_ref: OpaqueAiMain,
     effect_id: *const c_char,
     params: *const c_char,
 ) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
 
     let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
     let params = unsafe { CStr::from_ptr(params).to_string_lossy().to_string() };
 
-    let result = execute_exported_function(ai_main, "editLiveEffectParameters", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "editLiveEffectParameters", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
 
-        let params = v8::String::new(&*scope, params.as_str()).unwrap();
-        let params = v8::json::parse(&*scope, params).unwrap();
-        let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+            let params = v8::String::new(&*scope, params.as_str()).unwrap();
+            let params = v8::json::parse(&*scope, params).unwrap();
+            let params = v8::Local::<v8::Object>::try_from(params).unwrap();
 
-        let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into()];
-        Ok(args)
-    });
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into()];
+            Ok(args)
+        });
 
-    let boxed = Box::new(result);
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
+}
 
-    Box::into_raw(boxed)
+/// `edit_live_effect_parameters` taking and returning typed messages
+#[no_mangle]
+pub extern "C" fn edit_live_effect_parameters_typed(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const TypedMessage,
+) -> *mut TypedFunctionResult {
+    let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
+    let params = CallArg::typed(params);
+
+    on_executor(ai_main_ref, move |ai_main| {
+        let keys = typed_message::schema_keys(&effect_id);
+        let factory_keys = keys.clone();
+        let result = execute_exported_function_typed(ai_main, "editLiveEffectParameters", keys, move |scope| {
+            let params = params.to_v8(&mut *scope, factory_keys.as_deref())?;
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params];
+            Ok(args)
+        });
+
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(|| Box::into_raw(Box::new(TypedFunctionResult::failed())))
 }
 
 /// Fire view event and returns normalized next parameters
@@ -425,31 +1181,31 @@ pub extern "C" fn edit_live_effect_fire_event(
     event_payload: *const c_char,
     params: *const c_char,
 ) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
     let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
     let event_payload = unsafe { CStr::from_ptr(event_payload).to_string_lossy().to_string() };
     let params = unsafe { CStr::from_ptr(params).to_string_lossy().to_string() };
 
-    let result = execute_exported_function(ai_main, "editLiveEffectFireCallback", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
-
-        let event_payload = v8::String::new(&*scope, event_payload.as_str()).unwrap();
-        let event_payload = v8::json::parse(&*scope, event_payload).unwrap();
-        let event_payload = v8::Local::<v8::Object>::try_from(event_payload).unwrap();
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "editLiveEffectFireCallback", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
 
-        let params = v8::String::new(&*scope, params.as_str()).unwrap();
-        let params = v8::json::parse(&*scope, params).unwrap();
-        let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+            let event_payload = v8::String::new(&*scope, event_payload.as_str()).unwrap();
+            let event_payload = v8::json::parse(&*scope, event_payload).unwrap();
+            let event_payload = v8::Local::<v8::Object>::try_from(event_payload).unwrap();
 
-        let args: Vec<v8::Local<v8::Value>> =
-            vec![effect_id.into(), event_payload.into(), params.into()];
-        Ok(args)
-    });
+            let params = v8::String::new(&*scope, params.as_str()).unwrap();
+            let params = v8::json::parse(&*scope, params).unwrap();
+            let params = v8::Local::<v8::Object>::try_from(params).unwrap();
 
-    let boxed = Box::new(result);
+            let args: Vec<v8::Local<v8::Value>> =
+                vec![effect_id.into(), event_payload.into(), params.into()];
+            Ok(args)
+        });
 
-    Box::into_raw(boxed)
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
 }
 
 extern "C" {
@@ -460,6 +1216,10 @@ extern "C" {
 
     fn ai_deno_alert(message: *const c_char);
     fn ai_deno_get_user_locale() -> *const c_char;
+    /// JSON stats of an effect, allocated with malloc. Null for unknown effects.
+    fn ai_deno_get_effect_stats(effect_id: *const c_char) -> *mut c_char;
+
+    fn free(ptr: *mut c_void);
 }
 
 #[no_mangle]
@@ -469,73 +1229,80 @@ pub extern "C" fn live_effect_adjust_colors(
     params: *const c_char,
     adjust_color_fn: *mut c_void,
 ) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
     let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
     let params = unsafe { CStr::from_ptr(params).to_string_lossy().to_string() };
+    // Called back on the host's thread, which waits in this call
+    let adjust_color_fn = CallerPtr(adjust_color_fn);
+
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "liveEffectAdjustColors", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
+
+            let params = v8::String::new(&*scope, params.as_str()).unwrap();
+            let params = v8::json::parse(&*scope, params).unwrap();
+            let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+
+            let adjust_color_ptr = adjust_color_fn.get();
+            let adjust_color_ext = v8::External::new(&*scope, adjust_color_ptr);
+
+            let adjust_color = v8::Function::builder(
+                |scope: &mut v8::PinnedRef<v8::HandleScope>,
+                 args: v8::FunctionCallbackArguments,
+                 mut ret: v8::ReturnValue| {
+                    // args[0]: ColorRGBA to json
+                    let color = args.get(0);
+                    let color = v8::json::stringify(scope, color).unwrap();
+                    let color = color.to_rust_string_lossy(scope);
+
+                    // Call adjust_color_fn
+                    let adjust_color_fn_ref = v8::Local::<v8::External>::try_from(args.data()).unwrap();
+                    let adjust_color_fn_ptr = CallerPtr(unsafe { adjust_color_fn_ref.value() as *mut c_void });
+
+                    dai_println!("Calling adjust_color_fn: {}", color);
+
+                    // It calls into Illustrator, so it runs on the thread that called in
+                    let Some(result_json) = executor::call_on_caller(move || {
+                        let color = CString::new(color).unwrap();
+                        let result = unsafe {
+                            ai_deno_trampoline_adjust_color_callback(
+                                adjust_color_fn_ptr.get(),
+                                color.as_ptr(),
+                            )
+                        };
+                        unsafe { CStr::from_ptr(result) }.to_string_lossy().to_string()
+                    }) else {
+                        dai_println!("adjust_color_fn has no caller to run on");
+                        return;
+                    };
+
+                    dai_println!("Called adjust_color_fn: {}", result_json);
+
+                    // Parse json to ColorRGBA
+                    let Some(result) = v8::String::new(scope, result_json.as_str())
+                        .and_then(|s| v8::json::parse(scope, s))
+                        .and_then(|v| v8::Local::<v8::Object>::try_from(v).ok())
+                    else {
+                        // Failed to parse, return undefined
+                        dai_println!("Failed to parse adjust_color_fn result");
+                        return;
+                    };
+
+                    // Set return value
+                    ret.set(result.into());
+                },
+            )
+            .data(adjust_color_ext.into())
+            .build(&*scope)
+            .unwrap();
 
-    let result = execute_exported_function(ai_main, "liveEffectAdjustColors", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
-
-        let params = v8::String::new(&*scope, params.as_str()).unwrap();
-        let params = v8::json::parse(&*scope, params).unwrap();
-        let params = v8::Local::<v8::Object>::try_from(params).unwrap();
-
-        let adjust_color_ptr = adjust_color_fn as *mut c_void;
-        let adjust_color_ext = v8::External::new(&*scope, adjust_color_ptr);
-
-        let adjust_color = v8::Function::builder(
-            |scope: &mut v8::PinnedRef<v8::HandleScope>,
-             args: v8::FunctionCallbackArguments,
-             mut ret: v8::ReturnValue| {
-                // args[0]: ColorRGBA to json
-                let color = args.get(0);
-                let color = v8::json::stringify(scope, color).unwrap();
-                let color = color.to_rust_string_lossy(scope);
-
-                // Call adjust_color_fn
-                let adjust_color_fn_ref = v8::Local::<v8::External>::try_from(args.data()).unwrap();
-                let adjust_color_fn_ptr = unsafe { adjust_color_fn_ref.value() as *mut c_void };
-
-                dai_println!("Calling adjust_color_fn: {}", color);
-
-                let result_json = unsafe {
-                    ai_deno_trampoline_adjust_color_callback(
-                        adjust_color_fn_ptr,
-                        CString::new(color).unwrap().into_raw(),
-                    )
-                }
-                .to_owned();
-                let result_json = unsafe { CStr::from_ptr(result_json).to_string_lossy() };
-                dai_println!(result_json);
-
-                dai_println!("Called adjust_color_fn: {}", result_json);
-
-                // Parse json to ColorRGBA
-                let Some(result) = v8::String::new(scope, result_json.to_string().as_str())
-                    .and_then(|s| v8::json::parse(scope, s))
-                    .and_then(|v| v8::Local::<v8::Object>::try_from(v).ok())
-                else {
-                    // Failed to parse, return undefined
-                    dai_println!("Failed to parse adjust_color_fn result");
-                    return;
-                };
-
-                // Set return value
-                ret.set(result.into());
-            },
-        )
-        .data(adjust_color_ext.into())
-        .build(&*scope)
-        .unwrap();
-
-        Ok(vec![effect_id.into(), params.into(), adjust_color.into()])
-        // Ok(vec![effect_id.into(), params.into()])
-    });
-
-    let boxed = Box::new(result);
+            Ok(vec![effect_id.into(), params.into(), adjust_color.into()])
+            // Ok(vec![effect_id.into(), params.into()])
+        });
 
-    Box::into_raw(boxed)
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
 }
 
 #[no_mangle]
@@ -545,27 +1312,54 @@ pub extern "C" fn live_effect_scale_parameters(
     params: *const c_char,
     scale_factor: f64,
 ) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
     let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
     let params = unsafe { CStr::from_ptr(params).to_string_lossy().to_string() };
 
-    let result = execute_exported_function(ai_main, "liveEffectScaleParameters", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "liveEffectScaleParameters", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
 
-        let params = v8::String::new(&*scope, params.as_str()).unwrap();
-        let params = v8::json::parse(&*scope, params).unwrap();
-        let params = v8::Local::<v8::Object>::try_from(params).unwrap();
+            let params = v8::String::new(&*scope, params.as_str()).unwrap();
+            let params = v8::json::parse(&*scope, params).unwrap();
+            let params = v8::Local::<v8::Object>::try_from(params).unwrap();
 
-        let scale = v8::Number::new(&*scope, scale_factor);
+            let scale = v8::Number::new(&*scope, scale_factor);
 
-        let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into(), scale.into()];
-        Ok(args)
-    });
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params.into(), scale.into()];
+            Ok(args)
+        });
+
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
+}
 
-    let boxed = Box::new(result);
+/// `live_effect_scale_parameters` taking and returning typed messages
+#[no_mangle]
+pub extern "C" fn live_effect_scale_parameters_typed(
+    ai_main_ref: OpaqueAiMain,
+    effect_id: *const c_char,
+    params: *const TypedMessage,
+    scale_factor: f64,
+) -> *mut TypedFunctionResult {
+    let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
+    let params = CallArg::typed(params);
 
-    Box::into_raw(boxed)
+    on_executor(ai_main_ref, move |ai_main| {
+        let keys = typed_message::schema_keys(&effect_id);
+        let result = execute_exported_function_typed(ai_main, "liveEffectScaleParameters", None, move |scope| {
+            let params = params.to_v8(&mut *scope, keys.as_deref())?;
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let scale = v8::Number::new(&*scope, scale_factor);
+
+            let args: Vec<v8::Local<v8::Value>> = vec![effect_id.into(), params, scale.into()];
+            Ok(args)
+        });
+
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(|| Box::into_raw(Box::new(TypedFunctionResult::failed())))
 }
 
 #[no_mangle]
@@ -576,42 +1370,45 @@ pub extern "C" fn live_effect_interpolate(
     params_b: *const c_char,
     percent: f64,
 ) -> *mut JsonFunctionResult {
-    let ai_main = unsafe { &mut *(ai_main_ref as *mut AiMain) };
     let effect_id = unsafe { CStr::from_ptr(effect_id).to_string_lossy().to_string() };
     let params = unsafe { CStr::from_ptr(params_a).to_string_lossy().to_string() };
     let target_params = unsafe { CStr::from_ptr(params_b).to_string_lossy().to_string() };
 
-    let result = execute_exported_function(ai_main, "liveEffectInterpolate", move |scope| {
-        let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
-        let effect_id = v8::Local::new(&mut *scope, effect_id);
+    on_executor(ai_main_ref, move |ai_main| {
+        let result = execute_exported_function(ai_main, "liveEffectInterpolate", move |scope| {
+            let effect_id = v8::String::new(&*scope, effect_id.as_str()).unwrap();
+            let effect_id = v8::Local::new(&mut *scope, effect_id);
 
-        let params_a = v8::String::new(&*scope, params.as_str()).unwrap();
-        let params_a = v8::json::parse(&*scope, params_a).unwrap();
-        let params_a = v8::Local::<v8::Object>::try_from(params_a).unwrap();
+            let params_a = v8::String::new(&*scope, params.as_str()).unwrap();
+            let params_a = v8::json::parse(&*scope, params_a).unwrap();
+            let params_a = v8::Local::<v8::Object>::try_from(params_a).unwrap();
 
-        let target_params = v8::String::new(&*scope, target_params.as_str()).unwrap();
-        let target_params = v8::json::parse(&*scope, target_params).unwrap();
-        let target_params = v8::Local::<v8::Object>::try_from(target_params).unwrap();
+            let target_params = v8::String::new(&*scope, target_params.as_str()).unwrap();
+            let target_params = v8::json::parse(&*scope, target_params).unwrap();
+            let target_params = v8::Local::<v8::Object>::try_from(target_params).unwrap();
 
-        let percent = v8::Number::new(&*scope, percent);
-
-        let args: Vec<v8::Local<v8::Value>> = vec![
-            effect_id.into(),
-            params_a.into(),
-            target_params.into(),
-            percent.into(),
-        ];
-        Ok(args)
-    });
+            let percent = v8::Number::new(&*scope, percent);
 
-    let boxed = Box::new(result);
+            let args: Vec<v8::Local<v8::Value>> = vec![
+                effect_id.into(),
+                params_a.into(),
+                target_params.into(),
+                percent.into(),
+            ];
+            Ok(args)
+        });
 
-    Box::into_raw(boxed)
+        Box::into_raw(Box::new(result))
+    })
+    .unwrap_or_else(failed_json_result)
 }
 
+/// With `cancel`, stops waiting as soon as the token is cancelled (the JS side may
+/// still settle later, on a following call's event loop).
 fn execute_export_function_and_raw_return<F>(
     ai_main: &mut AiMain,
     function_name: &str,
+    cancel: Option<Arc<CancellationToken>>,
     args_factory: F,
 ) -> Option<v8::Global<v8::Value>>
 where
@@ -632,8 +1429,7 @@ where
     );
 
     // It's required for WebGPU async methods
-    let localset = tokio::task::LocalSet::new();
-    let result = localset.block_on(&tokio_runtime, async move {
+    let result = executor::block_on_local(&tokio_runtime, async move {
         // It's required for WebGPU async methods
         tokio::task::spawn_local(async move {
             let runtime = &mut ai_main.main_runtime;
@@ -657,7 +1453,10 @@ where
                 let context_local = v8::Local::new(handle_scope_temp, context);
                 let handle_scope = &mut v8::ContextScope::new(handle_scope_temp, context_local);
                 let scope_ptr: *mut v8::ContextScope<v8::HandleScope> = handle_scope as *mut _;
-                let args_vec = args_factory(handle_scope).unwrap();
+                let args_vec = match args_factory(handle_scope) {
+                    Ok(args_vec) => args_vec,
+                    Err(e) => return Err(anyhow::anyhow!("Error building arguments: {}", e)),
+                };
                 let handle_scope_ref = unsafe { &mut *scope_ptr };
                 args_vec
                     .into_iter()
@@ -667,9 +1466,17 @@ where
 
             dai_println!("Executing function: {}", function_name);
 
+            let cancelled = async {
+                match &cancel {
+                    Some(token) => token.cancelled().await,
+                    None => std::future::pending().await,
+                }
+            };
+
             let call = deno_runtime.call_with_args(&fn_ref, &args);
             let ret = tokio::select! {
                 _ = tokio::time::sleep(Duration::from_secs(10)) => Err(anyhow::anyhow!("Timeout")),
+                _ = cancelled => Err(anyhow::anyhow!("Cancelled")),
                 ret = deno_runtime
                 .with_event_loop_promise(call, PollEventLoopOptions::default()) => Ok(ret),
             };
@@ -728,7 +1535,8 @@ where
         json: CString::new("{}".to_string()).unwrap().into_raw(),
     };
 
-    let result = execute_export_function_and_raw_return(ai_main, function_name, args_factory);
+    let result =
+        execute_export_function_and_raw_return(ai_main, function_name, None, args_factory);
 
     let result = match result {
         Some(result) => result,
@@ -756,6 +1564,49 @@ where
     }
 }
 
+/// `execute_exported_function` returning a typed message, with `keys` the schema
+/// keys of the effect whose params the function returns
+fn execute_exported_function_typed<F>(
+    ai_main: &mut AiMain,
+    function_name: &str,
+    keys: Option<Arc<SchemaKeys>>,
+    args_factory: F,
+) -> TypedFunctionResult
+where
+    F: for<'a> FnOnce(
+            &'a mut v8::ContextScope<v8::HandleScope>,
+        ) -> Result<Vec<v8::Local<'a, v8::Value>>, anyhow::Error>
+        + 'static,
+{
+    let result =
+        execute_export_function_and_raw_return(ai_main, function_name, None, args_factory);
+
+    let result = match result {
+        Some(result) => result,
+        None => {
+            dai_println!("Error: function call returned None");
+            return TypedFunctionResult::failed();
+        }
+    };
+
+    let runtime = &mut ai_main.main_runtime;
+    let deno_runtime = runtime.deno_runtime();
+    let context = deno_runtime.main_context();
+    let isolate = deno_runtime.v8_isolate();
+    v8::scope!(handle_scope_temp, isolate);
+    let context_local = v8::Local::new(handle_scope_temp, context);
+    let scope = &mut v8::ContextScope::new(handle_scope_temp, context_local);
+    let result = v8::Local::<v8::Value>::new(&mut *scope, result);
+
+    match typed_message::encode(&mut *scope, result, keys.as_deref()) {
+        Ok(message) => TypedFunctionResult::new(message),
+        Err(e) => {
+            eprintln!("[deno_ai]: Failed to encode the result of {}: {}", function_name, e);
+            TypedFunctionResult::failed()
+        }
+    }
+}
+
 pub fn c_char_to_string(c_char: *mut c_char) -> String {
     unsafe { CStr::from_ptr(c_char).to_string_lossy().into_owned() }
 }
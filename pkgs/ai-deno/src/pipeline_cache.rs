@@ -0,0 +1,375 @@
+//! Index of the compute pipelines effects compiled, kept in `~/.ai-deno/cache/pipelines`.
+//!
+//! WebGPU offers no way to store compiled pipelines, so the index keeps what it
+//! takes to compile them again: the WGSL source, entry point and constants of
+//! every "auto" layout pipeline an effect created while initializing. The next
+//! session compiles an effect's pipelines ahead of its initializer (see
+//! `createGPUDevice` in _shared.ts), in parallel and off the path of its first
+//! render.
+//!
+//! Pipelines are grouped by adapter, since another GPU or driver may reject a
+//! shader, and by effect. The whole index belongs to one runtime version, the
+//! index of another one is dropped. Sources are stored once per WGSL hash.
+
+use once_cell::sync::Lazy;
+use serde::{Deserialize, Serialize};
+use std::collections::BTreeMap;
+use std::fs::{self, File};
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::sync::Mutex;
+use twox_hash::XxHash64;
+
+use crate::dai_println;
+
+const FORMAT_VERSION: u32 = 1;
+const INDEX_FILE: &str = "index.json";
+const SOURCE_EXTENSION: &str = "wgsl";
+/// Pipelines kept per effect and adapter, the oldest go first
+const MAX_PIPELINES_PER_GROUP: usize = 64;
+
+#[derive(Clone, Debug, PartialEq, Serialize, Deserialize)]
+#[serde(rename_all = "camelCase")]
+struct IndexEntry {
+    /// xxh64 of the WGSL source, names its file
+    source: String,
+    entry_point: String,
+    constants: Option<serde_json::Value>,
+}
+
+#[derive(Debug, Serialize, Deserialize)]
+struct IndexFile {
+    version: u32,
+    runtime: String,
+    /// Adapter identity, then effect
+    adapters: BTreeMap<String, BTreeMap<String, Vec<IndexEntry>>>,
+}
+
+/// A pipeline an effect created, as `op_ai_deno_pipeline_cache_record` takes them
+#[derive(Clone, Debug, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct NewPipeline {
+    pub code: String,
+    pub entry_point: String,
+    pub constants: Option<serde_json::Value>,
+}
+
+/// A pipeline to compile again, as `op_ai_deno_pipeline_cache_load` returns it
+#[derive(Clone, Debug, PartialEq, Serialize)]
+#[serde(rename_all = "camelCase")]
+pub struct CachedPipeline {
+    pub code: String,
+    pub entry_point: String,
+    pub constants: Option<serde_json::Value>,
+}
+
+pub struct PipelineIndex {
+    dir: PathBuf,
+    index: IndexFile,
+}
+
+pub static PIPELINE_INDEX: Lazy<Mutex<PipelineIndex>> = Lazy::new(|| {
+    Mutex::new(PipelineIndex::open(
+        crate::package_root_dir().join("cache").join("pipelines"),
+        crate::VERSION,
+    ))
+});
+
+fn source_hash(code: &str) -> String {
+    format!("{:016x}", XxHash64::oneshot(0, code.as_bytes()))
+}
+
+impl PipelineIndex {
+    /// Starts empty when there is no index, or one of another format or
+    /// `runtime_version`
+    pub fn open(dir: PathBuf, runtime_version: &str) -> Self {
+        let empty = IndexFile {
+            version: FORMAT_VERSION,
+            runtime: runtime_version.to_string(),
+            adapters: BTreeMap::new(),
+        };
+
+        let index = match fs::read(dir.join(INDEX_FILE)) {
+            Ok(bytes) => match serde_json::from_slice::<IndexFile>(&bytes) {
+                Ok(index)
+                    if index.version == FORMAT_VERSION && index.runtime == runtime_version =>
+                {
+                    index
+                }
+                Ok(_) => {
+                    dai_println!("pipeline_cache: dropping the index of another version");
+                    empty
+                }
+                Err(e) => {
+                    dai_println!("pipeline_cache: dropping unreadable index: {}", e);
+                    empty
+                }
+            },
+            Err(_) => empty,
+        };
+
+        Self { dir, index }
+    }
+
+    fn source_path(&self, hash: &str) -> PathBuf {
+        self.dir.join(format!("{}.{}", hash, SOURCE_EXTENSION))
+    }
+
+    /// Adds the pipelines `group` (an effect) created on `adapter`, and writes
+    /// the index once if any was new. Returns how many were.
+    pub fn record(
+        &mut self,
+        adapter: &str,
+        group: &str,
+        pipelines: &[NewPipeline],
+    ) -> io::Result<usize> {
+        let mut added = 0;
+        for pipeline in pipelines {
+            if self.add(adapter, group, pipeline)? {
+                added += 1;
+            }
+        }
+
+        if added > 0 {
+            self.save()?;
+        }
+        Ok(added)
+    }
+
+    /// False when the pipeline was known already
+    fn add(&mut self, adapter: &str, group: &str, pipeline: &NewPipeline) -> io::Result<bool> {
+        let entry = IndexEntry {
+            source: source_hash(&pipeline.code),
+            entry_point: pipeline.entry_point.clone(),
+            constants: pipeline.constants.clone(),
+        };
+
+        let entries = self
+            .index
+            .adapters
+            .entry(adapter.to_string())
+            .or_default()
+            .entry(group.to_string())
+            .or_default();
+        if entries.contains(&entry) {
+            return Ok(false);
+        }
+
+        entries.push(entry.clone());
+        let excess = entries.len().saturating_sub(MAX_PIPELINES_PER_GROUP);
+        let evicted: Vec<IndexEntry> = entries.drain(..excess).collect();
+
+        fs::create_dir_all(&self.dir)?;
+        let source_path = self.source_path(&entry.source);
+        if !source_path.exists() {
+            write_atomically(&source_path, pipeline.code.as_bytes())?;
+        }
+
+        for evicted in evicted {
+            if !self.references(&evicted.source) {
+                let _ = fs::remove_file(self.source_path(&evicted.source));
+            }
+        }
+
+        Ok(true)
+    }
+
+    fn references(&self, hash: &str) -> bool {
+        self.index
+            .adapters
+            .values()
+            .flat_map(|groups| groups.values())
+            .flatten()
+            .any(|entry| entry.source == hash)
+    }
+
+    /// Pipelines `group` created on `adapter` before. Those whose source is
+    /// missing or was changed are left out.
+    pub fn pipelines(&self, adapter: &str, group: &str) -> Vec<CachedPipeline> {
+        let Some(entries) = self
+            .index
+            .adapters
+            .get(adapter)
+            .and_then(|groups| groups.get(group))
+        else {
+            return vec![];
+        };
+
+        entries
+            .iter()
+            .filter_map(|entry| {
+                let code = fs::read_to_string(self.source_path(&entry.source)).ok()?;
+                if source_hash(&code) != entry.source {
+                    return None;
+                }
+
+                Some(CachedPipeline {
+                    code,
+                    entry_point: entry.entry_point.clone(),
+                    constants: entry.constants.clone(),
+                })
+            })
+            .collect()
+    }
+
+    fn save(&self) -> io::Result<()> {
+        let json = serde_json::to_vec(&self.index)
+            .map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))?;
+        write_atomically(&self.dir.join(INDEX_FILE), &json)
+    }
+}
+
+/// Readers, other processes included, only ever see complete files
+fn write_atomically(path: &Path, data: &[u8]) -> io::Result<()> {
+    let tmp_path = path.with_extension(format!("tmp{}", std::process::id()));
+
+    {
+        let mut file = File::create(&tmp_path)?;
+        file.write_all(data)?;
+    }
+
+    if let Err(e) = fs::rename(&tmp_path, path) {
+        let _ = fs::remove_file(&tmp_path);
+        return Err(e);
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use serde_json::json;
+
+    const ADAPTER: &str = "fake-vendor/fake-arch/fake-device";
+    const SHADER: &str = "@compute @workgroup_size(8) fn main() {}";
+
+    fn pipeline(code: &str, constants: Option<serde_json::Value>) -> NewPipeline {
+        NewPipeline {
+            code: code.to_string(),
+            entry_point: "main".to_string(),
+            constants,
+        }
+    }
+
+    fn temp_dir(name: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!(
+            "ai-deno-pipeline-cache-{}-{}",
+            name,
+            std::process::id()
+        ));
+        let _ = fs::remove_dir_all(&dir);
+        dir
+    }
+
+    #[test]
+    fn round_trips_pipelines_across_sessions() {
+        let dir = temp_dir("round-trip");
+        let mut index = PipelineIndex::open(dir.clone(), "1.0.0");
+        let pipelines = [
+            pipeline(SHADER, None),
+            pipeline(SHADER, Some(json!({"size": 4}))),
+        ];
+        assert_eq!(index.record(ADAPTER, "blur", &pipelines).unwrap(), 2);
+
+        let reopened = PipelineIndex::open(dir, "1.0.0");
+        assert_eq!(
+            reopened.pipelines(ADAPTER, "blur"),
+            vec![
+                CachedPipeline {
+                    code: SHADER.to_string(),
+                    entry_point: "main".to_string(),
+                    constants: None,
+                },
+                CachedPipeline {
+                    code: SHADER.to_string(),
+                    entry_point: "main".to_string(),
+                    constants: Some(json!({"size": 4})),
+                },
+            ]
+        );
+    }
+
+    #[test]
+    fn records_known_pipelines_once() {
+        let mut index = PipelineIndex::open(temp_dir("once"), "1.0.0");
+        let pipelines = [pipeline(SHADER, None), pipeline(SHADER, None)];
+        assert_eq!(index.record(ADAPTER, "blur", &pipelines).unwrap(), 1);
+        assert_eq!(index.record(ADAPTER, "blur", &pipelines).unwrap(), 0);
+        assert_eq!(index.pipelines(ADAPTER, "blur").len(), 1);
+    }
+
+    #[test]
+    fn keys_by_adapter_and_group() {
+        let mut index = PipelineIndex::open(temp_dir("keys"), "1.0.0");
+        index
+            .record(ADAPTER, "blur", &[pipeline(SHADER, None)])
+            .unwrap();
+
+        assert!(index
+            .pipelines("other-vendor/arch/device", "blur")
+            .is_empty());
+        assert!(index.pipelines(ADAPTER, "glow").is_empty());
+    }
+
+    #[test]
+    fn drops_the_index_of_another_runtime_version() {
+        let dir = temp_dir("version");
+        let mut index = PipelineIndex::open(dir.clone(), "1.0.0");
+        index
+            .record(ADAPTER, "blur", &[pipeline(SHADER, None)])
+            .unwrap();
+
+        assert!(PipelineIndex::open(dir, "1.1.0")
+            .pipelines(ADAPTER, "blur")
+            .is_empty());
+    }
+
+    #[test]
+    fn drops_unreadable_indices() {
+        let dir = temp_dir("unreadable");
+        fs::create_dir_all(&dir).unwrap();
+        fs::write(dir.join(INDEX_FILE), b"{ not json").unwrap();
+
+        let mut index = PipelineIndex::open(dir.clone(), "1.0.0");
+        assert!(index.pipelines(ADAPTER, "blur").is_empty());
+        assert_eq!(
+            index
+                .record(ADAPTER, "blur", &[pipeline(SHADER, None)])
+                .unwrap(),
+            1
+        );
+        assert_eq!(
+            PipelineIndex::open(dir, "1.0.0")
+                .pipelines(ADAPTER, "blur")
+                .len(),
+            1
+        );
+    }
+
+    #[test]
+    fn skips_changed_sources() {
+        let dir = temp_dir("changed-source");
+        let mut index = PipelineIndex::open(dir.clone(), "1.0.0");
+        index
+            .record(ADAPTER, "blur", &[pipeline(SHADER, None)])
+            .unwrap();
+
+        fs::write(index.source_path(&source_hash(SHADER)), "fn tampered() {}").unwrap();
+        assert!(index.pipelines(ADAPTER, "blur").is_empty());
+    }
+
+    #[test]
+    fn evicts_the_oldest_pipelines_and_their_sources() {
+        let mut index = PipelineIndex::open(temp_dir("evict"), "1.0.0");
+        let shader = |i: usize| format!("{} // {}", SHADER, i);
+        let pipelines: Vec<_> = (0..MAX_PIPELINES_PER_GROUP + 1)
+            .map(|i| pipeline(&shader(i), None))
+            .collect();
+        index.record(ADAPTER, "blur", &pipelines).unwrap();
+
+        let pipelines = index.pipelines(ADAPTER, "blur");
+        assert_eq!(pipelines.len(), MAX_PIPELINES_PER_GROUP);
+        assert_eq!(pipelines[0].code, shader(1));
+        assert!(!index.source_path(&source_hash(&shader(0))).exists());
+    }
+}
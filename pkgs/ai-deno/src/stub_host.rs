@@ -0,0 +1,64 @@
+//! Callbacks normally implemented by the plugin (see `bridging.h`), so the crate
+//! links and runs under `cargo test` without Illustrator.
+
+use std::cell::Cell;
+use std::ffi::{c_char, c_void};
+
+thread_local! {
+    /// Callbacks that Illustrator would have run on this thread
+    pub static HOST_CALLS: Cell<usize> = const { Cell::new(0) };
+}
+
+fn count_host_call() {
+    HOST_CALLS.with(|calls| calls.set(calls.get() + 1));
+}
+
+#[no_mangle]
+pub extern "C" fn ai_deno_alert(_message: *const c_char) {
+    count_host_call();
+}
+
+#[no_mangle]
+pub extern "C" fn ai_deno_get_user_locale() -> *const c_char {
+    // Return a static string pointer for testing
+    b"en_US\0".as_ptr() as *const c_char
+}
+
+#[no_mangle]
+pub extern "C" fn ai_deno_get_effect_stats(_effect_id: *const c_char) -> *mut c_char {
+    // No effect has stats
+    std::ptr::null_mut()
+}
+
+#[no_mangle]
+pub extern "C" fn ai_deno_trampoline_adjust_color_callback(
+    _ptr: *mut c_void,
+    color: *const c_char,
+) -> *const c_char {
+    count_host_call();
+    // Leaves colors untouched
+    color
+}
+
+extern "C" fn stub_alert(_result: *const crate::JsonFunctionResult) {}
+
+/// An executor running `source` as its main module instead of the bundled effects
+pub fn spawn_stub_runtime(
+    file_name: &'static str,
+    source: &'static str,
+) -> crate::executor::Executor {
+    use crate::deno::{Module, Runtime};
+
+    crate::executor::Executor::spawn(format!("ai-deno-stub-{}", file_name), move || {
+        let mut runtime = Runtime::new(Default::default()).unwrap();
+        let module = Module::from_string(file_name, source);
+        let main_module = runtime.load_main_module(&module).unwrap();
+
+        Box::new(crate::AiMain {
+            main_runtime: runtime,
+            main_module,
+            ai_alert: stub_alert,
+        })
+    })
+    .unwrap()
+}
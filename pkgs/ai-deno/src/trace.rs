@@ -0,0 +1,313 @@
+//! Spans of the Rust bridge and the JS effects, exported together with the
+//! host's as a Chrome trace (open it in Perfetto or `chrome://tracing`).
+//!
+//! The host mints a trace id per `GoLiveEffect` and passes it through
+//! `go_live_effect`; Rust spans and JS spans (`op_ai_deno_trace_record`) carry it
+//! so one render can be followed across the three layers. Recording is off
+//! until `trace_set_enabled`, and then costs a lock per span.
+
+use once_cell::sync::Lazy;
+use serde::Deserialize;
+use serde_json::{json, Value};
+use std::borrow::Cow;
+use std::collections::{HashMap, VecDeque};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Instant, SystemTime};
+
+/// Spans kept at most, older ones are dropped first
+const CAPACITY: usize = 65536;
+
+#[derive(Clone, Debug)]
+pub struct SpanRecord {
+    /// "rust" or "js"
+    pub layer: &'static str,
+    pub name: Cow<'static, str>,
+    pub trace_id: u64,
+    pub thread: Arc<str>,
+    pub start_ns: u64,
+    pub duration_ns: u64,
+}
+
+/// A span recorded by the host, on the host's clock
+#[derive(Clone, Debug, Deserialize)]
+#[serde(rename_all = "camelCase")]
+pub struct HostSpan {
+    pub name: String,
+    pub trace_id: u64,
+    pub thread: String,
+    pub start_ns: u64,
+    pub duration_ns: u64,
+}
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static EPOCH: Lazy<Instant> = Lazy::new(Instant::now);
+static SPANS: Lazy<Mutex<VecDeque<SpanRecord>>> =
+    Lazy::new(|| Mutex::new(VecDeque::with_capacity(1024)));
+
+thread_local! {
+    static THREAD_NAME: Arc<str> = Arc::from(
+        std::thread::current()
+            .name()
+            .map(|name| name.to_string())
+            .unwrap_or_else(|| format!("{:?}", std::thread::current().id())),
+    );
+}
+
+pub fn is_enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+pub fn set_enabled(enabled: bool) {
+    Lazy::force(&EPOCH);
+    ENABLED.store(enabled, Ordering::SeqCst);
+}
+
+/// Monotonic nanoseconds on the trace clock
+pub fn now_ns() -> u64 {
+    EPOCH.elapsed().as_nanos() as u64
+}
+
+/// `instant` on the trace clock
+pub fn instant_ns(instant: Instant) -> u64 {
+    instant.saturating_duration_since(*EPOCH).as_nanos() as u64
+}
+
+pub fn record(
+    layer: &'static str,
+    name: impl Into<Cow<'static, str>>,
+    trace_id: u64,
+    start_ns: u64,
+    end_ns: u64,
+) {
+    if !is_enabled() {
+        return;
+    }
+
+    let span = SpanRecord {
+        layer,
+        name: name.into(),
+        trace_id,
+        thread: THREAD_NAME.with(|name| name.clone()),
+        start_ns,
+        duration_ns: end_ns.saturating_sub(start_ns),
+    };
+
+    let mut spans = SPANS.lock().unwrap_or_else(|e| e.into_inner());
+    if spans.len() == CAPACITY {
+        spans.pop_front();
+    }
+    spans.push_back(span);
+}
+
+/// Times its scope as a Rust span. Does nothing while tracing is off.
+pub struct Span {
+    name: &'static str,
+    trace_id: u64,
+    start_ns: Option<u64>,
+}
+
+impl Span {
+    pub fn new(name: &'static str, trace_id: u64) -> Span {
+        Span {
+            name,
+            trace_id,
+            start_ns: is_enabled().then(now_ns),
+        }
+    }
+}
+
+impl Drop for Span {
+    fn drop(&mut self) {
+        if let Some(start_ns) = self.start_ns {
+            record("rust", self.name, self.trace_id, start_ns, now_ns());
+        }
+    }
+}
+
+/// Total duration of the JS spans of render `trace_id` named like `names`, as
+/// recorded so far. 0 while tracing is off.
+pub fn js_totals_ns<const N: usize>(trace_id: u64, names: [&str; N]) -> [u64; N] {
+    let mut totals = [0; N];
+    if !is_enabled() || trace_id == 0 {
+        return totals;
+    }
+
+    let spans = SPANS.lock().unwrap_or_else(|e| e.into_inner());
+    for span in spans.iter().rev() {
+        if span.trace_id != trace_id || span.layer != "js" {
+            continue;
+        }
+        if let Some(i) = names.iter().position(|name| *name == span.name) {
+            totals[i] += span.duration_ns;
+        }
+    }
+    totals
+}
+
+/// Removes and returns the recorded spans
+pub fn take() -> Vec<SpanRecord> {
+    let mut spans = SPANS.lock().unwrap_or_else(|e| e.into_inner());
+    spans.drain(..).collect()
+}
+
+/// Chrome trace event JSON of the host's and our spans. `host_now_ns` is the
+/// host clock read right before the call, to move host spans onto our clock.
+pub fn chrome_trace(host_spans: &[HostSpan], host_now_ns: u64, spans: &[SpanRecord]) -> Value {
+    let offset = now_ns() as i128 - host_now_ns as i128;
+
+    // Chrome wants numeric thread ids, named by metadata events
+    let mut threads: HashMap<(&'static str, String), u64> = HashMap::new();
+    let mut events = vec![];
+    let mut thread_id = |layer: &'static str, thread: &str, events: &mut Vec<Value>| {
+        let next = threads.len() as u64 + 1;
+        *threads
+            .entry((layer, thread.to_string()))
+            .or_insert_with(|| {
+                events.push(json!({
+                    "ph": "M",
+                    "name": "thread_name",
+                    "pid": 1,
+                    "tid": next,
+                    "args": { "name": format!("{} {}", layer, thread) },
+                }));
+                next
+            })
+    };
+
+    for span in host_spans {
+        let tid = thread_id("host", &span.thread, &mut events);
+        let start_ns = (span.start_ns as i128 + offset).max(0) as u64;
+        events.push(complete_event(
+            "host",
+            &span.name,
+            span.trace_id,
+            tid,
+            start_ns,
+            span.duration_ns,
+        ));
+    }
+
+    for span in spans {
+        let tid = thread_id(span.layer, &span.thread, &mut events);
+        events.push(complete_event(
+            span.layer,
+            &span.name,
+            span.trace_id,
+            tid,
+            span.start_ns,
+            span.duration_ns,
+        ));
+    }
+
+    json!({
+        "traceEvents": events,
+        "displayTimeUnit": "ms",
+    })
+}
+
+fn complete_event(
+    layer: &str,
+    name: &str,
+    trace_id: u64,
+    tid: u64,
+    start_ns: u64,
+    duration_ns: u64,
+) -> Value {
+    json!({
+        "ph": "X",
+        "cat": layer,
+        "name": name,
+        "pid": 1,
+        "tid": tid,
+        // Microseconds, fractions keep the nanoseconds
+        "ts": start_ns as f64 / 1000.0,
+        "dur": duration_ns as f64 / 1000.0,
+        "args": { "traceId": trace_id },
+    })
+}
+
+/// Writes `trace` as `trace-<unix seconds>.json` into `dir`
+pub fn write_chrome_trace(dir: &Path, trace: &Value) -> std::io::Result<PathBuf> {
+    std::fs::create_dir_all(dir)?;
+
+    let seconds = SystemTime::now()
+        .duration_since(SystemTime::UNIX_EPOCH)
+        .map_or(0, |elapsed| elapsed.as_secs());
+    let path = dir.join(format!("trace-{}.json", seconds));
+
+    std::fs::write(&path, serde_json::to_vec(trace)?)?;
+    Ok(path)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn spans_are_only_recorded_while_enabled() {
+        set_enabled(false);
+        drop(Span::new("disabled", 1));
+        assert!(take().iter().all(|span| span.name != "disabled"));
+
+        set_enabled(true);
+        drop(Span::new("enabled", 2));
+        record("js", "effect".to_string(), 2, 10, 30);
+        record("js", "GPU".to_string(), 2, 12, 15);
+        record("js", "GPU".to_string(), 2, 20, 24);
+        record("js", "GPU".to_string(), 3, 20, 40);
+        assert_eq!(js_totals_ns(2, ["GPU", "Readback"]), [7, 0]);
+        let spans = take();
+        set_enabled(false);
+
+        let rust = spans.iter().find(|span| span.name == "enabled").unwrap();
+        assert_eq!((rust.layer, rust.trace_id), ("rust", 2));
+        let js = spans.iter().find(|span| span.name == "effect").unwrap();
+        assert_eq!((js.layer, js.duration_ns), ("js", 20));
+    }
+
+    #[test]
+    fn chrome_trace_aligns_host_spans_and_names_threads() {
+        let host_now_ns = 10_000_000_000;
+        let host = vec![HostSpan {
+            name: "Rasterize".to_string(),
+            trace_id: 7,
+            thread: "0".to_string(),
+            start_ns: host_now_ns - 1_000_000_000,
+            duration_ns: 2_000,
+        }];
+        let ours = vec![SpanRecord {
+            layer: "js",
+            name: Cow::Borrowed("goLiveEffect"),
+            trace_id: 7,
+            thread: Arc::from("ai-deno-runtime-0"),
+            start_ns: now_ns(),
+            duration_ns: 3_000,
+        }];
+
+        let trace = chrome_trace(&host, host_now_ns, &ours);
+        let events = trace["traceEvents"].as_array().unwrap();
+
+        let names: Vec<_> = events
+            .iter()
+            .filter(|event| event["ph"] == "M")
+            .map(|event| event["args"]["name"].as_str().unwrap())
+            .collect();
+        assert_eq!(names, vec!["host 0", "js ai-deno-runtime-0"]);
+
+        let rasterize = events
+            .iter()
+            .find(|event| event["name"] == "Rasterize")
+            .unwrap();
+        let effect = events
+            .iter()
+            .find(|event| event["name"] == "goLiveEffect")
+            .unwrap();
+        assert_eq!(rasterize["args"]["traceId"], 7);
+        assert_eq!(rasterize["dur"], 2.0);
+        // The host span ran a second before the host read its clock, before ours
+        assert!(rasterize["ts"].as_f64().unwrap() < effect["ts"].as_f64().unwrap());
+        assert_ne!(rasterize["tid"], effect["tid"]);
+    }
+}
@@ -0,0 +1,538 @@
+//! Typed binary messages of the FFI, replacing JSON text on the hot calls. Must stay
+//! in sync with the host's `pipeline/TypedMessage.h`.
+//!
+//! A message is a 12 byte header (`ADM`, a version and the hash of the schema keys
+//! used, little endian) followed by one CBOR item. Keys of a params object that the
+//! effect's `paramSchema` declares are sent as their index in the sorted key list.
+//! Values are built into V8 straight from the bytes and read back from V8 the same
+//! way, with JSON's rules: `undefined` and functions are dropped from objects and
+//! become `null` in arrays, non-finite numbers become `null`.
+
+use anyhow::{anyhow, bail};
+use dashmap::DashMap;
+use deno_runtime::deno_core::v8;
+use once_cell::sync::Lazy;
+use std::sync::Arc;
+use twox_hash::XxHash64;
+
+const MAGIC: &[u8; 3] = b"ADM";
+const VERSION: u8 = 1;
+/// magic, version, schema keys hash
+const HEADER_LEN: usize = 3 + 1 + 8;
+/// Deeper values are rejected rather than recursed into
+const MAX_DEPTH: usize = 64;
+/// Integers up to this are exact in a JS number
+const MAX_SAFE_INTEGER: f64 = 9007199254740991.0;
+
+/// Top level keys of an effect's `paramSchema`, in byte order
+#[derive(Debug, PartialEq)]
+pub struct SchemaKeys {
+    keys: Vec<String>,
+    /// xxh64 of the keys, each followed by a NUL. 0 when there are none.
+    hash: u64,
+}
+
+impl SchemaKeys {
+    pub fn new(mut keys: Vec<String>) -> SchemaKeys {
+        keys.sort();
+        keys.dedup();
+
+        let mut joined = Vec::new();
+        for key in &keys {
+            joined.extend_from_slice(key.as_bytes());
+            joined.push(0);
+        }
+        let hash = if keys.is_empty() {
+            0
+        } else {
+            XxHash64::oneshot(0, &joined)
+        };
+
+        SchemaKeys { keys, hash }
+    }
+
+    fn index_of(&self, key: &str) -> Option<usize> {
+        self.keys.binary_search_by(|k| k.as_str().cmp(key)).ok()
+    }
+}
+
+static SCHEMA_KEYS: Lazy<DashMap<String, Arc<SchemaKeys>>> = Lazy::new(DashMap::new);
+
+/// Learns the schema keys of every effect from `getLiveEffects`' result. Shared by
+/// all runtimes, they load the same effects.
+pub fn register_effects(effects_json: &str) {
+    let Ok(serde_json::Value::Array(effects)) = serde_json::from_str(effects_json) else {
+        return;
+    };
+
+    for effect in effects {
+        let Some(id) = effect.get("id").and_then(|id| id.as_str()) else {
+            continue;
+        };
+        let keys = match effect.get("paramSchema") {
+            Some(serde_json::Value::Object(schema)) => schema.keys().cloned().collect(),
+            _ => vec![],
+        };
+        SCHEMA_KEYS.insert(id.to_string(), Arc::new(SchemaKeys::new(keys)));
+    }
+}
+
+pub fn schema_keys(effect_id: &str) -> Option<Arc<SchemaKeys>> {
+    SCHEMA_KEYS.get(effect_id).map(|keys| keys.clone())
+}
+
+/// CBOR body of `message`, and the schema keys it was written with
+fn split_header<'a, 'k>(
+    message: &'a [u8],
+    keys: Option<&'k SchemaKeys>,
+) -> Result<(&'a [u8], Option<&'k SchemaKeys>), anyhow::Error> {
+    if message.len() <= HEADER_LEN || &message[..3] != MAGIC || message[3] != VERSION {
+        bail!("not a typed message");
+    }
+
+    let hash = u64::from_le_bytes(message[4..HEADER_LEN].try_into().unwrap());
+    if hash == 0 {
+        return Ok((&message[HEADER_LEN..], None));
+    }
+
+    match keys {
+        Some(keys) if keys.hash == hash => Ok((&message[HEADER_LEN..], Some(keys))),
+        _ => Err(anyhow!("typed message of an unknown params schema")),
+    }
+}
+
+#[derive(Debug, PartialEq)]
+enum Item<'a> {
+    Uint(u64),
+    /// -1 - n
+    Nint(u64),
+    Float(f64),
+    Text(&'a str),
+    Array(usize),
+    Map(usize),
+    Bool(bool),
+    Null,
+}
+
+struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn new(data: &'a [u8]) -> Reader<'a> {
+        Reader { data, pos: 0 }
+    }
+
+    fn at_end(&self) -> bool {
+        self.pos == self.data.len()
+    }
+
+    fn take(&mut self, len: usize) -> Result<&'a [u8], anyhow::Error> {
+        if self.data.len() - self.pos < len {
+            bail!("truncated typed message");
+        }
+        let bytes = &self.data[self.pos..self.pos + len];
+        self.pos += len;
+        Ok(bytes)
+    }
+
+    /// Every item takes a byte at least, so longer containers are broken
+    fn container_len(&self, len: u64) -> Result<usize, anyhow::Error> {
+        if len > (self.data.len() - self.pos) as u64 {
+            bail!("truncated typed message");
+        }
+        Ok(len as usize)
+    }
+
+    fn next(&mut self) -> Result<Item<'a>, anyhow::Error> {
+        let initial = self.take(1)?[0];
+        let (major, info) = (initial >> 5, initial & 0x1f);
+
+        let arg = match info {
+            0..=23 => info as u64,
+            24..=27 => self
+                .take(1 << (info - 24))?
+                .iter()
+                .fold(0u64, |arg, byte| (arg << 8) | *byte as u64),
+            _ => bail!("unsupported typed message item {:#x}", initial),
+        };
+
+        Ok(match (major, info) {
+            (0, _) => Item::Uint(arg),
+            (1, _) => Item::Nint(arg),
+            (3, _) => {
+                let bytes = self.take(self.container_len(arg)?)?;
+                Item::Text(std::str::from_utf8(bytes)?)
+            }
+            (4, _) => Item::Array(self.container_len(arg)?),
+            (5, _) => Item::Map(self.container_len(arg)?),
+            (7, 20) => Item::Bool(false),
+            (7, 21) => Item::Bool(true),
+            (7, 22) | (7, 23) => Item::Null,
+            (7, 26) => Item::Float(f32::from_bits(arg as u32) as f64),
+            (7, 27) => Item::Float(f64::from_bits(arg)),
+            _ => bail!("unsupported typed message item {:#x}", initial),
+        })
+    }
+}
+
+struct Writer {
+    out: Vec<u8>,
+}
+
+impl Writer {
+    fn new(schema_hash: u64) -> Writer {
+        let mut out = Vec::with_capacity(64);
+        out.extend_from_slice(MAGIC);
+        out.push(VERSION);
+        out.extend_from_slice(&schema_hash.to_le_bytes());
+        Writer { out }
+    }
+
+    fn head(&mut self, major: u8, arg: u64) {
+        let major = major << 5;
+        if arg < 24 {
+            self.out.push(major | arg as u8);
+        } else if arg <= 0xff {
+            self.out.push(major | 24);
+            self.out.push(arg as u8);
+        } else if arg <= 0xffff {
+            self.out.push(major | 25);
+            self.out.extend_from_slice(&(arg as u16).to_be_bytes());
+        } else if arg <= 0xffff_ffff {
+            self.out.push(major | 26);
+            self.out.extend_from_slice(&(arg as u32).to_be_bytes());
+        } else {
+            self.out.push(major | 27);
+            self.out.extend_from_slice(&arg.to_be_bytes());
+        }
+    }
+
+    fn null(&mut self) {
+        self.out.push(0xf6);
+    }
+
+    fn bool(&mut self, value: bool) {
+        self.out.push(if value { 0xf5 } else { 0xf4 });
+    }
+
+    /// Integral numbers as integers, the rest as the narrowest exact float
+    fn number(&mut self, value: f64) {
+        if !value.is_finite() {
+            self.null();
+        } else if value.fract() == 0.0 && value.abs() <= MAX_SAFE_INTEGER {
+            if value >= 0.0 {
+                self.head(0, value as u64);
+            } else {
+                self.head(1, (-1.0 - value) as u64);
+            }
+        } else if (value as f32) as f64 == value {
+            self.out.push(0xfa);
+            self.out
+                .extend_from_slice(&(value as f32).to_bits().to_be_bytes());
+        } else {
+            self.out.push(0xfb);
+            self.out.extend_from_slice(&value.to_bits().to_be_bytes());
+        }
+    }
+
+    fn text(&mut self, value: &str) {
+        self.head(3, value.len() as u64);
+        self.out.extend_from_slice(value.as_bytes());
+    }
+}
+
+/// Builds the V8 value of a typed message. `keys` are the schema keys of the effect
+/// the message is for; messages using other ones are rejected.
+pub fn decode<'s>(
+    scope: &mut v8::PinnedRef<'s, v8::HandleScope>,
+    message: &[u8],
+    keys: Option<&SchemaKeys>,
+) -> Result<v8::Local<'s, v8::Value>, anyhow::Error> {
+    let (body, keys) = split_header(message, keys)?;
+
+    let mut reader = Reader::new(body);
+    let value = read_value(scope, &mut reader, keys, 0)?;
+    if !reader.at_end() {
+        bail!("trailing bytes after typed message");
+    }
+    Ok(value)
+}
+
+fn read_value<'s>(
+    scope: &mut v8::PinnedRef<'s, v8::HandleScope>,
+    reader: &mut Reader,
+    keys: Option<&SchemaKeys>,
+    depth: usize,
+) -> Result<v8::Local<'s, v8::Value>, anyhow::Error> {
+    if depth > MAX_DEPTH {
+        bail!("typed message nested too deep");
+    }
+
+    Ok(match reader.next()? {
+        Item::Uint(n) => v8::Number::new(scope, n as f64).into(),
+        Item::Nint(n) => v8::Number::new(scope, -1.0 - n as f64).into(),
+        Item::Float(n) => v8::Number::new(scope, n).into(),
+        Item::Text(text) => v8::String::new(scope, text)
+            .ok_or_else(|| anyhow!("string too long"))?
+            .into(),
+        Item::Bool(value) => v8::Boolean::new(scope, value).into(),
+        Item::Null => v8::null(scope).into(),
+        Item::Array(len) => {
+            let mut items = Vec::with_capacity(len);
+            for _ in 0..len {
+                items.push(read_value(scope, reader, None, depth + 1)?);
+            }
+            v8::Array::new_with_elements(scope, &items).into()
+        }
+        Item::Map(len) => {
+            let object = v8::Object::new(scope);
+            for _ in 0..len {
+                let key = match (reader.next()?, keys) {
+                    (Item::Text(key), _) => key,
+                    (Item::Uint(index), Some(keys)) if (index as usize) < keys.keys.len() => {
+                        keys.keys[index as usize].as_str()
+                    }
+                    _ => bail!("invalid key in typed message"),
+                };
+                // Keys repeat across calls, internalized they are shared
+                let key = v8::String::new_from_utf8(
+                    scope,
+                    key.as_bytes(),
+                    v8::NewStringType::Internalized,
+                )
+                .ok_or_else(|| anyhow!("key too long"))?;
+
+                let value = read_value(scope, reader, None, depth + 1)?;
+                object.set(scope, key.into(), value);
+            }
+            object.into()
+        }
+    })
+}
+
+/// Serializes a V8 value as a typed message. With `keys`, the keys of a top level
+/// object that the schema declares are written as their index.
+pub fn encode<'s>(
+    scope: &mut v8::PinnedRef<'s, v8::HandleScope>,
+    value: v8::Local<'s, v8::Value>,
+    keys: Option<&SchemaKeys>,
+) -> Result<Vec<u8>, anyhow::Error> {
+    let keys = keys.filter(|keys| keys.hash != 0 && value.is_object() && !value.is_array());
+
+    let mut writer = Writer::new(keys.map_or(0, |keys| keys.hash));
+    write_value(scope, &mut writer, value, keys, 0)?;
+    Ok(writer.out)
+}
+
+/// Values JSON drops from objects
+fn is_skipped(value: v8::Local<v8::Value>) -> bool {
+    value.is_undefined() || value.is_function() || value.is_symbol()
+}
+
+fn write_value<'s>(
+    scope: &mut v8::PinnedRef<'s, v8::HandleScope>,
+    writer: &mut Writer,
+    value: v8::Local<'s, v8::Value>,
+    keys: Option<&SchemaKeys>,
+    depth: usize,
+) -> Result<(), anyhow::Error> {
+    if depth > MAX_DEPTH {
+        bail!("value nested too deep for a typed message");
+    }
+
+    if value.is_null_or_undefined() || is_skipped(value) {
+        writer.null();
+    } else if value.is_boolean() {
+        writer.bool(value.is_true());
+    } else if value.is_number() {
+        writer.number(value.number_value(scope).unwrap_or(f64::NAN));
+    } else if value.is_string() {
+        let text = v8::Local::<v8::String>::try_from(value)?;
+        writer.text(&text.to_rust_string_lossy(scope));
+    } else if value.is_array() {
+        let array = v8::Local::<v8::Array>::try_from(value)?;
+        let len = array.length();
+
+        writer.head(4, len as u64);
+        for index in 0..len {
+            match array.get_index(scope, index) {
+                Some(item) => write_value(scope, writer, item, None, depth + 1)?,
+                None => writer.null(),
+            }
+        }
+    } else if value.is_object() {
+        let object = v8::Local::<v8::Object>::try_from(value)?;
+        let names = object
+            .get_own_property_names(
+                scope,
+                v8::GetPropertyNamesArgs {
+                    key_conversion: v8::KeyConversionMode::ConvertToString,
+                    ..Default::default()
+                },
+            )
+            .ok_or_else(|| anyhow!("failed to list object keys"))?;
+
+        let mut entries = Vec::with_capacity(names.length() as usize);
+        for index in 0..names.length() {
+            let Some(name) = names.get_index(scope, index) else {
+                continue;
+            };
+            match object.get(scope, name) {
+                Some(item) if !is_skipped(item) => entries.push((name, item)),
+                _ => {}
+            }
+        }
+
+        writer.head(5, entries.len() as u64);
+        for (name, item) in entries {
+            let name = v8::Local::<v8::String>::try_from(name)?.to_rust_string_lossy(scope);
+            match keys.and_then(|keys| keys.index_of(&name)) {
+                Some(index) => writer.head(0, index as u64),
+                None => writer.text(&name),
+            }
+            write_value(scope, writer, item, None, depth + 1)?;
+        }
+    } else {
+        // BigInt and other values JSON can't represent either
+        writer.null();
+    }
+
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Mirror of `read_value` without V8
+    fn to_json(reader: &mut Reader, keys: Option<&SchemaKeys>) -> serde_json::Value {
+        match reader.next().unwrap() {
+            Item::Uint(n) => n.into(),
+            Item::Nint(n) => (-1 - n as i64).into(),
+            Item::Float(n) => n.into(),
+            Item::Text(text) => text.into(),
+            Item::Bool(value) => value.into(),
+            Item::Null => serde_json::Value::Null,
+            Item::Array(len) => (0..len).map(|_| to_json(reader, None)).collect(),
+            Item::Map(len) => (0..len)
+                .map(|_| {
+                    let key = match reader.next().unwrap() {
+                        Item::Text(key) => key.to_string(),
+                        Item::Uint(index) => keys.unwrap().keys[index as usize].clone(),
+                        item => panic!("unexpected key {:?}", item),
+                    };
+                    (key, to_json(reader, None))
+                })
+                .collect::<serde_json::Map<_, _>>()
+                .into(),
+        }
+    }
+
+    fn keys(names: &[&str]) -> SchemaKeys {
+        SchemaKeys::new(names.iter().map(|name| name.to_string()).collect())
+    }
+
+    #[test]
+    fn schema_keys_hash_like_the_host() {
+        // xxh64("a\0b\0"), as pipeline::typed_message::SchemaKeys computes it
+        assert_eq!(keys(&["b", "a"]).hash, 0x2b4d0fc9e4bf29e2);
+        assert_eq!(keys(&[]).hash, 0);
+        assert_eq!(keys(&["b", "a"]).index_of("b"), Some(1));
+    }
+
+    #[test]
+    fn decodes_host_messages() {
+        // pipeline::typed_message::encode of
+        // {"strength":0.75,"mode":"a","n":-2,"list":[1,true,null,0.1]}
+        // with the keys of {"strength":{},"mode":{}}
+        let message = [
+            0x41, 0x44, 0x4d, 0x01, 0x83, 0x1c, 0x70, 0xb1, 0x9e, 0x65, 0xb1, 0x78, 0xa4, 0x64,
+            0x6c, 0x69, 0x73, 0x74, 0x84, 0x01, 0xf5, 0xf6, 0xfb, 0x3f, 0xb9, 0x99, 0x99, 0x99,
+            0x99, 0x99, 0x9a, 0x00, 0x61, 0x61, 0x61, 0x6e, 0x21, 0x01, 0xfa, 0x3f, 0x40, 0x00,
+            0x00,
+        ];
+        let schema = keys(&["strength", "mode"]);
+
+        let (body, used) = split_header(&message, Some(&schema)).unwrap();
+        assert_eq!(used, Some(&schema));
+
+        let mut reader = Reader::new(body);
+        let value = to_json(&mut reader, used);
+        assert!(reader.at_end());
+        assert_eq!(
+            value,
+            serde_json::json!({"strength": 0.75, "mode": "a", "n": -2, "list": [1, true, null, 0.1]})
+        );
+
+        // Index keys can't be resolved against another schema
+        assert!(split_header(&message, None).is_err());
+        assert!(split_header(&message, Some(&keys(&["strength"]))).is_err());
+    }
+
+    #[test]
+    fn writes_what_it_reads() {
+        let schema = keys(&["angle"]);
+        let mut writer = Writer::new(schema.hash);
+        writer.head(5, 3);
+        writer.head(0, schema.index_of("angle").unwrap() as u64);
+        writer.number(45.0);
+        writer.text("values");
+        writer.head(4, 6);
+        for n in [-1.0, 300.0, 1e10, 0.5, 0.1, f64::NAN] {
+            writer.number(n);
+        }
+        writer.text("on");
+        writer.bool(false);
+
+        let (body, used) = split_header(&writer.out, Some(&schema)).unwrap();
+        assert_eq!(
+            to_json(&mut Reader::new(body), used),
+            serde_json::json!({"angle": 45, "values": [-1, 300, 10000000000u64, 0.5, 0.1, null], "on": false})
+        );
+    }
+
+    #[test]
+    fn rejects_broken_messages() {
+        let mut writer = Writer::new(0);
+        writer.head(4, 2);
+        writer.text("abc");
+        writer.number(1.5);
+        let message = writer.out;
+
+        for len in 0..message.len() {
+            let Ok((body, _)) = split_header(&message[..len], None) else {
+                continue;
+            };
+            let mut reader = Reader::new(body);
+            let read = (|| -> Result<(), anyhow::Error> {
+                let Item::Array(len) = reader.next()? else {
+                    bail!("not an array");
+                };
+                for _ in 0..len {
+                    reader.next()?;
+                }
+                Ok(())
+            })();
+            assert!(read.is_err(), "truncated at {} was accepted", len);
+        }
+
+        // A length beyond the message must not be trusted for allocation
+        let mut writer = Writer::new(0);
+        writer.head(4, u32::MAX as u64);
+        assert!(Reader::new(&writer.out[HEADER_LEN..]).next().is_err());
+    }
+
+    #[test]
+    fn registers_effect_schemas() {
+        register_effects(
+            r#"[{"id":"typed-message-test","paramSchema":{"b":{"type":"int"},"a":{"type":"real"}}}]"#,
+        );
+        assert_eq!(
+            schema_keys("typed-message-test").as_deref(),
+            Some(&keys(&["a", "b"]))
+        );
+        assert_eq!(schema_keys("typed-message-unknown"), None);
+    }
+}
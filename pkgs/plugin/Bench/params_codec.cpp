@@ -0,0 +1,124 @@
+//
+//  params_codec.cpp
+//  Bench
+//
+//  Stored size and write / read cost of live effect params as JSON text (the
+//  `AiDeno.params` entry) vs pipeline/ParamsCodec.h (`AiDeno.paramsCbor`).
+//
+//  The ai::UnicodeString round trip of the JSON entry happens inside
+//  Illustrator's dictionary suite and can't be timed outside the host; it only
+//  adds to the JSON side.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../Source/pipeline/Hash.h"
+#include "../Source/pipeline/ParamsCodec.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+using namespace pipeline;
+
+struct ParamSet {
+  const char* name;
+  json        params;
+};
+
+static double measure(const std::function<void()>& fn, int iterations) {
+  fn();  // warm up
+
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start
+    )
+                    .count();
+    if (us < best) best = us;
+  }
+  return best;
+}
+
+/** gradient-map stores its stops as a JSON string inside the params */
+static json gradientMap(int stops) {
+  json colorStops = json::array();
+  for (int i = 0; i < stops; i++) {
+    char color[64];
+    snprintf(color, sizeof(color), "hsv(%d, %d%%, %d%%)", i * 360 / stops, 50 + i % 50,
+             100 - i % 100);
+    colorStops.push_back({color, (double)i / (stops - 1)});
+  }
+  return {{"preset", "custom"}, {"colorStops", colorStops.dump()}, {"strength", 100.0}};
+}
+
+/** The same stops kept structured, e.g. a future params schema */
+static json structuredStops(int stops) {
+  json colorStops = json::array();
+  for (int i = 0; i < stops; i++) {
+    colorStops.push_back(
+        {{"h", i * 360.0 / stops},
+         {"s", (50 + i % 50) / 100.0},
+         {"v", (100 - i % 100) / 100.0},
+         {"position", (double)i / (stops - 1)}}
+    );
+  }
+  return {{"preset", "custom"}, {"colorStops", colorStops}, {"strength", 100.0}};
+}
+
+static json typical() {
+  return {
+      {"strength", 0.75},      {"angle", 45.0},          {"radius", 12},
+      {"blendMode", "normal"}, {"useColor", true},       {"color", "#ff8800"},
+      {"seed", 1234},          {"quality", "high"},      {"opacity", 1.0},
+      {"invert", false},
+  };
+}
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+  std::vector<ParamSet> sets = {
+      {"typical (10 fields)", typical()},
+      {"gradient map, 16 stops", gradientMap(16)},
+      {"gradient map, 256 stops", gradientMap(256)},
+      {"structured, 256 stops", structuredStops(256)},
+      {"structured, 4096 stops", structuredStops(4096)},
+  };
+
+  printf("%-26s %10s %10s %12s %12s %12s %12s\n", "params", "json B", "cbor B",
+         "json write", "cbor write", "json read", "cbor read");
+
+  for (const ParamSet& set : sets) {
+    std::string          text  = set.params.dump();
+    uint64_t             stamp = xxh64(text);
+    std::vector<uint8_t> bytes = params_codec::encode(set.params, stamp);
+
+    if (*params_codec::decode(bytes.data(), bytes.size(), stamp) != set.params) {
+      printf("%s: round trip mismatch\n", set.name);
+      return 1;
+    }
+
+    volatile size_t sink = 0;
+    double jsonWrite = measure([&] { sink = sink + set.params.dump().size(); }, iterations);
+    double cborWrite = measure(
+        [&] { sink = sink + params_codec::encode(set.params, stamp).size(); }, iterations
+    );
+    double jsonRead = measure([&] { sink = sink + json::parse(text).size(); }, iterations);
+    double cborRead = measure(
+        [&] {
+          sink = sink + params_codec::decode(bytes.data(), bytes.size(), stamp)->size();
+        },
+        iterations
+    );
+
+    printf("%-26s %10zu %10zu %10.1fus %10.1fus %10.1fus %10.1fus\n", set.name,
+           text.size(), bytes.size(), jsonWrite, cborWrite, jsonRead, cborRead);
+  }
+
+  return 0;
+}
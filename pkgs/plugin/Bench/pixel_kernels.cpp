@@ -0,0 +1,200 @@
+//
+//  pixel_kernels.cpp
+//  Bench
+//
+//  Throughput of pipeline/PixelKernels.h on 4K to 16K rasters.
+//
+//  `channelInterleave` is applied inside Illustrator's GetRasterTile /
+//  SetRasterTile and can't be timed outside the host, so it is emulated here as
+//  the generic per channel gather it has to perform.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "../Source/pipeline/PixelKernels.h"
+
+using namespace pipeline;
+
+struct Size {
+  const char* name;
+  size_t      width;
+  size_t      height;
+};
+
+static void interleaveCopy(const uint8_t* src, uint8_t* dst, size_t pixels,
+                           const volatile int* interleave) {
+  int order[4] = {interleave[0], interleave[1], interleave[2], interleave[3]};
+  for (size_t i = 0; i < pixels; i++) {
+    for (int c = 0; c < 4; c++) dst[i * 4 + c] = src[i * 4 + order[c]];
+  }
+}
+
+static double measure(const std::function<void()>& fn, int iterations) {
+  fn();  // warm up, fault pages in
+
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start
+    )
+                    .count();
+    if (ms < best) best = ms;
+  }
+  return best;
+}
+
+static void report(const char* kernel, const char* path, double ms, size_t bytes) {
+  printf("  %-20s %-18s %9.2f ms %8.2f GB/s\n", kernel, path, ms, bytes / ms / 1e6);
+}
+
+/** Every (color, alpha) pair, then random bytes. SIMD must match scalar exactly. */
+static bool verify(SimdLevel level, size_t pixels) {
+  std::vector<uint8_t> src(pixels * 4);
+  for (size_t i = 0; i < src.size(); i++) src[i] = (uint8_t)(rand() & 0xff);
+  for (size_t i = 0; i < 65536 && i < pixels; i++) {
+    uint8_t c = (uint8_t)(i & 0xff), a = (uint8_t)(i >> 8);
+    // ARGB
+    src[i * 4 + 0] = a;
+    src[i * 4 + 1] = src[i * 4 + 2] = src[i * 4 + 3] = c;
+  }
+
+  std::vector<uint8_t> expected(src), actual(src);
+  std::vector<float>   expectedF(pixels * 4), actualF(pixels * 4);
+
+  const PixelKernelTable& scalar = pixelKernels(SimdLevel::Scalar);
+  const PixelKernelTable& simd   = pixelKernels(level);
+  auto same = [&] { return expected == actual; };
+
+  scalar.argbToRgba(expected.data(), expected.data(), pixels);
+  simd.argbToRgba(actual.data(), actual.data(), pixels);
+  if (!same()) return false;
+
+  // Unpremultiply straight values too: colors above alpha must clamp the same way
+  scalar.unpremultiplyRgba(expected.data(), pixels);
+  simd.unpremultiplyRgba(actual.data(), pixels);
+  if (!same()) return false;
+
+  scalar.premultiplyRgba(expected.data(), pixels);
+  simd.premultiplyRgba(actual.data(), pixels);
+  if (!same()) return false;
+
+  scalar.widenToFloat(expected.data(), expectedF.data(), pixels);
+  simd.widenToFloat(actual.data(), actualF.data(), pixels);
+  if (expectedF != actualF) return false;
+
+  expectedF[0] = actualF[0] = -1.0f;
+  expectedF[1] = actualF[1] = 2.0f;
+  expectedF[2] = actualF[2] = std::nanf("");
+  scalar.narrowFromFloat(expectedF.data(), expected.data(), pixels);
+  simd.narrowFromFloat(actualF.data(), actual.data(), pixels);
+  if (!same()) return false;
+
+  scalar.rgbaToArgb(expected.data(), expected.data(), pixels);
+  simd.rgbaToArgb(actual.data(), actual.data(), pixels);
+  if (!same()) return false;
+
+  // A single visible pixel anywhere, also in the scalar tail
+  std::vector<uint8_t> clear(pixels * 4, 0);
+  for (size_t i : {(size_t)0, (size_t)17, pixels / 2, pixels - 1}) {
+    clear[i * 4] = 1;
+    for (size_t n : {pixels, pixels - 5, (size_t)40}) {
+      const uint8_t* p = clear.data();
+      if (scalar.firstVisibleArgb(p, n) != simd.firstVisibleArgb(p, n) ||
+          scalar.endVisibleArgb(p, n) != simd.endVisibleArgb(p, n)) {
+        return false;
+      }
+    }
+    clear[i * 4] = 0;
+  }
+  return simd.firstVisibleArgb(clear.data(), pixels) == pixels &&
+         simd.endVisibleArgb(clear.data(), pixels) == 0;
+}
+
+int main(int argc, const char* argv[]) {
+  const Size sizes[] = {
+      {"4K", 3840, 2160},
+      {"8K", 7680, 4320},
+      {"16K", 15360, 8640},
+  };
+  int iterations = argc > 1 ? atoi(argv[1]) : 5;
+
+  const PixelKernelTable& best = pixelKernels();
+  printf("dispatch: %s\n", simdLevelName(best.level));
+
+  std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+  for (SimdLevel level : {SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::NEON}) {
+    if (!isSimdLevelSupported(level)) continue;
+    levels.push_back(level);
+
+    if (!verify(level, 1024 * 1024 + 13)) {
+      printf("MISMATCH: %s kernels differ from scalar\n", simdLevelName(level));
+      return 1;
+    }
+  }
+
+  static volatile int toRgba[4] = {3, 0, 1, 2};
+
+  for (const Size& size : sizes) {
+    size_t pixels = size.width * size.height;
+    size_t bytes  = pixels * 4;
+    printf("\n%s (%zux%zu, %.0f MB)\n", size.name, size.width, size.height, bytes / 1e6);
+
+    std::vector<uint8_t> a(bytes), b(bytes);
+    for (size_t i = 0; i < bytes; i++) a[i] = (uint8_t)(i * 2654435761u >> 24);
+
+    double ms = measure([&] { interleaveCopy(a.data(), b.data(), pixels, toRgba); },
+                        iterations);
+    report("argb->rgba", "channelInterleave", ms, bytes);
+
+    for (SimdLevel level : levels) {
+      const PixelKernelTable& k = pixelKernels(level);
+      report("argb->rgba", simdLevelName(level),
+             measure([&] { k.argbToRgba(a.data(), b.data(), pixels); }, iterations),
+             bytes);
+    }
+    // Worst case of the alpha bounds scan: nothing visible, every byte is read
+    std::vector<uint8_t> clear(bytes, 0);
+    for (SimdLevel level : levels) {
+      const PixelKernelTable& k = pixelKernels(level);
+      report("visible scan", simdLevelName(level),
+             measure([&] { (void)k.firstVisibleArgb(clear.data(), pixels); }, iterations),
+             bytes);
+    }
+    for (SimdLevel level : levels) {
+      const PixelKernelTable& k = pixelKernels(level);
+      report("premultiply", simdLevelName(level),
+             measure([&] { k.premultiplyRgba(b.data(), pixels); }, iterations), bytes);
+    }
+    for (SimdLevel level : levels) {
+      const PixelKernelTable& k = pixelKernels(level);
+      report("unpremultiply", simdLevelName(level),
+             measure([&] { k.unpremultiplyRgba(b.data(), pixels); }, iterations), bytes);
+    }
+
+    // 16 bytes per pixel: 16K would need over 2 GB for the float side alone
+    if (pixels > (size_t)7680 * 4320) continue;
+
+    std::vector<float> f(pixels * 4);
+    for (SimdLevel level : levels) {
+      const PixelKernelTable& k = pixelKernels(level);
+      report("widen u8->f32", simdLevelName(level),
+             measure([&] { k.widenToFloat(a.data(), f.data(), pixels); }, iterations),
+             bytes);
+    }
+    for (SimdLevel level : levels) {
+      const PixelKernelTable& k = pixelKernels(level);
+      report("narrow f32->u8", simdLevelName(level),
+             measure([&] { k.narrowFromFloat(f.data(), b.data(), pixels); }, iterations),
+             bytes);
+    }
+  }
+
+  return 0;
+}
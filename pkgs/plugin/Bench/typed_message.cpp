@@ -0,0 +1,140 @@
+//
+//  typed_message.cpp
+//  Bench
+//
+//  Host side marshalling cost of one live effect call: the params and env as
+//  JSON text (`go_live_effect`) vs pipeline/TypedMessage.h
+//  (`go_live_effect_typed`), and reading back normalized params
+//  (`edit_live_effect_parameters[_typed]`).
+//
+//  The runtime side, JSON.parse vs building the V8 values from the typed
+//  message, needs a V8 isolate; it shows as the "marshal args" span of
+//  `trace_export_chrome`.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../Source/pipeline/TypedMessage.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+using namespace pipeline;
+
+struct Call {
+  const char* name;
+  json        params;
+  json        paramSchema;
+};
+
+static double measure(const std::function<void()>& fn, int iterations) {
+  fn();  // warm up
+
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start
+    )
+                    .count();
+    if (us < best) best = us;
+  }
+  return best;
+}
+
+/** A schema declaring every top level key of `params` */
+static json schemaOf(const json& params) {
+  json schema = json::object();
+  for (auto& [key, _] : params.items()) schema[key] = {{"type", "real"}};
+  return schema;
+}
+
+static json typical() {
+  return {
+      {"strength", 0.75},      {"angle", 45.0},          {"radius", 12},
+      {"blendMode", "normal"}, {"useColor", true},       {"color", "#ff8800"},
+      {"seed", 1234},          {"quality", "high"},      {"opacity", 1.0},
+      {"invert", false},
+  };
+}
+
+static json structuredStops(int stops) {
+  json colorStops = json::array();
+  for (int i = 0; i < stops; i++) {
+    colorStops.push_back(
+        {{"h", i * 360.0 / stops},
+         {"s", (50 + i % 50) / 100.0},
+         {"v", (100 - i % 100) / 100.0},
+         {"position", (double)i / (stops - 1)}}
+    );
+  }
+  return {{"preset", "custom"}, {"colorStops", colorStops}, {"strength", 100.0}};
+}
+
+/** What renderLiveEffect sends along with every render */
+static json env() {
+  return {
+      {"dpi", 144.0},
+      {"baseDpi", 72.0},
+      {"isInPreview", true},
+      {"previewScale", 0.5},
+      {"tile", {{"x", 0}, {"y", 0}, {"fullWidth", 1024}, {"fullHeight", 768}}},
+  };
+}
+
+int main(int argc, char** argv) {
+  int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+  std::vector<Call> calls = {
+      {"typical (10 fields)", typical(), schemaOf(typical())},
+      {"structured, 16 stops", structuredStops(16), schemaOf(structuredStops(16))},
+      {"structured, 256 stops", structuredStops(256), schemaOf(structuredStops(256))},
+  };
+  json renderEnv = env();
+
+  printf("%-24s %8s %8s %12s %12s %12s %12s\n", "params", "json B", "typed B",
+         "json args", "typed args", "json result", "typed result");
+
+  for (const Call& call : calls) {
+    auto keys = typed_message::SchemaKeys::fromSchema(call.paramSchema);
+
+    std::string          text    = call.params.dump();
+    std::vector<uint8_t> message = typed_message::encode(call.params, &keys);
+
+    if (*typed_message::decode(message.data(), message.size(), &keys) != call.params) {
+      printf("%s: round trip mismatch\n", call.name);
+      return 1;
+    }
+
+    volatile size_t sink = 0;
+    double jsonArgs = measure(
+        [&] { sink = sink + call.params.dump().size() + renderEnv.dump().size(); },
+        iterations
+    );
+    double typedArgs = measure(
+        [&] {
+          sink = sink + typed_message::encode(call.params, &keys).size() +
+                 typed_message::encode(renderEnv).size();
+        },
+        iterations
+    );
+    double jsonResult =
+        measure([&] { sink = sink + json::parse(text).size(); }, iterations);
+    double typedResult = measure(
+        [&] {
+          auto params = typed_message::decode(message.data(), message.size(), &keys);
+          sink        = sink + params->size();
+        },
+        iterations
+    );
+
+    printf("%-24s %8zu %8zu %10.2fus %10.2fus %10.2fus %10.2fus\n", call.name,
+           text.size(), message.size(), jsonArgs, typedArgs, jsonResult, typedResult);
+  }
+
+  return 0;
+}
@@ -1,23 +1,30 @@
+#include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <numeric>
-#include <regex>
+#include <sstream>
+#include <thread>
 
 #include "./AiDenoPlugin.h"
 #include "./AiDenoSuites.h"
 #include "./consts.h"
-#include "./libs/regex.h"
 #include "./views/ImgUIEditModal.h"
 
 #include "debugHelper.h"
 
-using json = nlohmann::json;
+using json      = nlohmann::json;
+namespace trace = pipeline::trace;
 
 Plugin* AllocatePlugin(SPPluginRef pluginRef) {
   return new HelloWorldPlugin(pluginRef);
 }
 
+/** Lends `message` to a typed ai_deno call */
+static ai_deno::TypedMessage lendMessage(const std::vector<uint8_t>& message) {
+  return {.data = message.data(), .byte_length = message.size()};
+}
+
 void FixupReload(Plugin* plugin) {
   csl("FixupReload");
   HelloWorldPlugin::FixupVTable((HelloWorldPlugin*)plugin);
@@ -44,10 +51,91 @@ ASErr HelloWorldPlugin::StartupPlugin(SPInterfaceMessage* message) {
     if (!pluginStarted) {
       pluginStarted = true;
 
+      if (const char* budgetMb = std::getenv(AI_DENO_ENV_TILE_POOL_BUDGET_MB.c_str())) {
+        tileBufferPool.setBudget((size_t)std::strtoull(budgetMb, nullptr, 10) << 20);
+      }
+      csl("Tile buffer pool budget: %zu bytes", tileBufferPool.getBudget());
+
+      if (const char* budgetMb = std::getenv(AI_DENO_ENV_RESULT_CACHE_MB.c_str())) {
+        resultCache.setBudget((size_t)std::strtoull(budgetMb, nullptr, 10) << 20);
+      }
+      csl("Result cache budget: %zu bytes", resultCache.getBudget());
+
+      if (const char* budgetMb = std::getenv(AI_DENO_ENV_DISK_CACHE_MB.c_str())) {
+        uint64_t budget = (uint64_t)std::strtoull(budgetMb, nullptr, 10) << 20;
+        ai_deno::disk_cache_set_budget(budget);
+      }
+
+      if (const char* megapixels = std::getenv(AI_DENO_ENV_PREVIEW_MEGAPIXELS.c_str())) {
+        previewPixelBudget = (size_t)(std::atof(megapixels) * 1024 * 1024);
+      }
+
+      if (const char* settleMs = std::getenv(AI_DENO_ENV_PREVIEW_SETTLE_MS.c_str())) {
+        previewSettleInterval =
+            std::chrono::milliseconds(std::max(0, std::atoi(settleMs)));
+      }
+
+      if (const char* size = std::getenv(AI_DENO_ENV_TILE_SIZE.c_str())) {
+        tileSize = std::max(256, std::min(kMaxTileSide, std::atoi(size)));
+      }
+
+      if (const char* traced = std::getenv(AI_DENO_ENV_TRACE.c_str())) {
+        trace::setEnabled(std::string(traced) == "1");
+        ai_deno::trace_set_enabled(trace::isEnabled());
+      }
+
       csl("Loading live effects");
       aiDenoMain = ai_deno::initialize(&HelloWorldPlugin::StaticHandleDenoAiAlert);
-      error      = this->InitLiveEffect(message);
+
+      // Each runtime is a full V8 isolate with its own GPU device, so keep a core
+      // for Illustrator itself
+      int poolSize = std::min<int>(
+          kDefaultRuntimePoolSize, (int)std::thread::hardware_concurrency() / 2
+      );
+      if (const char* size = std::getenv(AI_DENO_ENV_RUNTIME_POOL_SIZE.c_str())) {
+        poolSize = std::atoi(size);
+      }
+      for (int i = 0; i < poolSize; i++) {
+        ai_deno::OpaqueAiMain worker = ai_deno::initialize_runtime_worker(
+            &HelloWorldPlugin::StaticHandleDenoAiAlert, (uint32_t)i
+        );
+        if (worker != nullptr) runtimePool.add(worker);
+      }
+      csl("Runtime pool: %zu runtimes", runtimePool.size());
+
+      error = this->InitLiveEffect(message);
       CHKERR();
+
+      // Effects otherwise initialize on first use
+      if (const char* ids = std::getenv(AI_DENO_ENV_WARM_UP_EFFECTS.c_str())) {
+        json              effectIds = json::array();
+        std::stringstream stream(ids);
+        for (std::string id; std::getline(stream, id, ',');) {
+          if (!id.empty()) effectIds.push_back(id);
+        }
+        std::string idsJson = effectIds.dump();
+        warmUpEffects(std::string(ids) == "*" ? nullptr : idsJson.c_str(), true);
+      }
+
+      error = this->InitMenus(message);
+      CHKERR();
+
+      error = sAINotifier->AddNotifier(
+          message->d.self, kPluginName, kAIDocumentClosedNotifier,
+          &fDocumentClosedNotifier
+      );
+      CHKERR();
+      error = sAINotifier->AddNotifier(
+          message->d.self, kPluginName, kAIDocumentChangedNotifier,
+          &fDocumentChangedNotifier
+      );
+      CHKERR();
+      error = sAINotifier->AddNotifier(
+          message->d.self, kPluginName, kAIDocumentViewChangedNotifier,
+          &fDocumentViewChangedNotifier
+      );
+      CHKERR();
+      dpiResolver.snapshotKey();
     }
   } catch (ai::Error& ex) {
     error = ex;
@@ -65,6 +153,15 @@ ASErr HelloWorldPlugin::StartupPlugin(SPInterfaceMessage* message) {
 ASErr HelloWorldPlugin::ShutdownPlugin(SPInterfaceMessage* message) {
   ASErr error = kNoErr;
   //	sAIUser->MessageAlert(ai::UnicodeString("Goodbye from HelloWorld!"));
+
+  logTraceSummary();
+  dumpChromeTrace();
+  logRuntimeMetrics("main", aiDenoMain);
+  for (ai_deno::OpaqueAiMain worker : runtimePool.drain()) {
+    logRuntimeMetrics("pooled", worker);
+    ai_deno::dispose_runtime_worker(worker);
+  }
+
   error = Plugin::ShutdownPlugin(message);
   return error;
 }
@@ -74,9 +171,55 @@ ASErr HelloWorldPlugin::Message(char* caller, char* selector, void* message) {
   return Plugin::Message(caller, selector, message);
 }
 
+ASErr HelloWorldPlugin::InitMenus(SPInterfaceMessage* message) {
+  ASErr error = kNoErr;
+
+  AIPlatformAddMenuItemDataUS menuData;
+  menuData.groupName = kWindowUtilsMenuGroup;
+  menuData.itemText  = ai::UnicodeString("AiDeno: Export Effect Stats");
+  error              = sAIMenu->AddMenuItem(
+      message->d.self, "AiDeno Export Effect Stats", &menuData, kMenuItemNoOptions,
+      &fExportStatsMenuItem
+  );
+  if (error != kNoErr || !trace::isEnabled()) return error;
+
+  menuData.itemText = ai::UnicodeString("AiDeno: Export Trace");
+  return sAIMenu->AddMenuItem(
+      message->d.self, "AiDeno Export Trace", &menuData, kMenuItemNoOptions,
+      &fExportTraceMenuItem
+  );
+}
+
+ASErr HelloWorldPlugin::GoMenuItem(AIMenuMessage* message) {
+  alertEffectInitFailures();
+
+  if (message->menuItem == fExportStatsMenuItem) writeEffectStatsReport();
+  if (message->menuItem == fExportTraceMenuItem) dumpChromeTrace();
+  return kNoErr;
+}
+
+ASErr HelloWorldPlugin::Notify(AINotifierMessage* message) {
+  // Notifiers arrive on the main thread, renders that failed to init can't alert
+  alertEffectInitFailures();
+
+  if (message->notifier == fDocumentClosedNotifier) {
+    // Document handles can be reused after close, drop everything learned so far
+    dpiResolver.clear();
+    paramsCache.clear();
+  }
+
+  // Zoom, document switches and raster settings change what renders rasterize at
+  if (message->notifier == fDocumentClosedNotifier ||
+      message->notifier == fDocumentChangedNotifier ||
+      message->notifier == fDocumentViewChangedNotifier) {
+    dpiResolver.snapshotKey();
+  }
+
+  return kNoErr;
+}
+
 ASErr HelloWorldPlugin::InitLiveEffect(SPInterfaceMessage* message) {
-  ASErr error       = kNoErr;
-  short filterIndex = 0;
+  ASErr error = kNoErr;
 
   csl("✨️ Init Live Effect");
 
@@ -93,27 +236,54 @@ ASErr HelloWorldPlugin::InitLiveEffect(SPInterfaceMessage* message) {
   for (auto& effectDef : effects) {
     csl(" Loading deno-ai effect: %s", effectDef.dump().c_str());
 
+    pipeline::EffectDescriptor descriptor = {
+        .id           = effectDef["id"].get<std::string>(),
+        .name         = EFFECT_PREFIX + effectDef["id"].get<std::string>(),
+        .title        = effectDef["title"].get<std::string>(),
+        .majorVersion = effectDef["version"]["major"].get<int>(),
+        .minorVersion = effectDef["version"]["minor"].get<int>(),
+        .tiling       = effectDef.value("tiling", false),
+        .paramSchema  = effectDef.value("paramSchema", json::object()),
+    };
+    descriptor.version =
+        string_format("%d.%d", descriptor.majorVersion, descriptor.minorVersion);
+    descriptor.paramKeys =
+        pipeline::typed_message::SchemaKeys::fromSchema(descriptor.paramSchema);
+
+    if (effectDef.contains("pixelFormat") && effectDef["pixelFormat"].is_string()) {
+      auto format =
+          pipeline::parsePixelFormat(effectDef["pixelFormat"].get<std::string>());
+      if (format) {
+        descriptor.pixelFormat = *format;
+      } else {
+        csl(" unknown pixelFormat, falling back to rgba8");
+      }
+    }
+
+    pipeline::effectStats().registerEffect(descriptor.id);
+    descriptor.stats = pipeline::effectStats().find(descriptor.id);
+
     csl(" creating effect data");
     AILiveEffectData effect;
     effect.self = message->d.self;
-
-    std::string name;
-    effect.name = suai::str::strdup(string_format_to_char(
-        "%s%s", EFFECT_PREFIX.c_str(), effectDef["id"].get<std::string>().c_str()
-    ));
+    effect.name = suai::str::strdup(descriptor.name.c_str());
 
     char title[128];
-    suai::str::toAiUnicodeStringUtf8(effectDef["title"].get<std::string>())
-        .as_Platform(title, 128);
+    suai::str::toAiUnicodeStringUtf8(descriptor.title).as_Platform(title, 128);
 
     effect.title          = title;
-    effect.majorVersion   = effectDef["version"]["major"].get<int>();
-    effect.minorVersion   = effectDef["version"]["minor"].get<int>();
+    effect.majorVersion   = descriptor.majorVersion;
+    effect.minorVersion   = descriptor.minorVersion;
     effect.prefersAsInput = AIStyleFilterPreferredInputArtType::kInputArtDynamic;
     // effect.prefersAsInput   = AIStyleFilterPreferredInputArtType::kRasterInputArt;
     effect.styleFilterFlags = AIStyleFilterFlags::kPostEffectFilter |
                               AIStyleFilterFlags::kHasScalableParams |
                               AIStyleFilterFlags::kHandlesAdjustColorsMsg;
+    // GoLiveEffect leases a pooled runtime, so Illustrator may call it concurrently
+    if (runtimePool.size() > 0) {
+      effect.styleFilterFlags |= AIStyleFilterFlags::kParallelExecutionFilter;
+    }
+    descriptor.flags = (int32_t)effect.styleFilterFlags;
 
     csl(" creating menu data");
     AddLiveEffectMenuData menu;
@@ -123,18 +293,17 @@ ASErr HelloWorldPlugin::InitLiveEffect(SPInterfaceMessage* message) {
     menu.options = 0;
 
     csb("title", effect.title);
-    error = sAILiveEffect->AddLiveEffect(&effect, &this->fEffects[filterIndex]);
+    AILiveEffectHandle handle = nullptr;
+    error                     = sAILiveEffect->AddLiveEffect(&effect, &handle);
     CHKERR();
 
-    error = sAILiveEffect->AddLiveEffectMenuItem(
-        this->fEffects[filterIndex], effect.name, &menu, NULL, NULL
-    );
+    error = sAILiveEffect->AddLiveEffectMenuItem(handle, effect.name, &menu, NULL, NULL);
     CHKERR();
 
-    filterIndex++;
+    effectRegistry.add(handle, std::move(descriptor));
   };
 
-  this->fNumEffects = filterIndex;
+  csl(" %zu effects registered", effectRegistry.size());
 
   return error;
 }
@@ -144,17 +313,46 @@ ASErr HelloWorldPlugin::InitLiveEffect(SPInterfaceMessage* message) {
 // }
 
 ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
+  // Ties this render's spans together, the runtime's included
+  trace::TraceScope    traceScope;
+  trace::Span          goLiveEffectSpan(trace::Stage::GoLiveEffect);
+  pipeline::EffectCall call;
+
+  ASErr error = this->renderLiveEffect(message, call);
+  call.finish(
+      error == kNoErr         ? pipeline::EffectStats::Outcome::Succeeded
+      : error == kCanceledErr ? pipeline::EffectStats::Outcome::Cancelled
+                              : pipeline::EffectStats::Outcome::Failed
+  );
+
+  return error;
+}
+
+ASErr HelloWorldPlugin::renderLiveEffect(
+    AILiveEffectGoMessage* message,
+    pipeline::EffectCall&  call
+) {
   ASErr error = kNoErr;
 
   csl("**");
   csl("** GO LIVE!! EFFECT!!!");
   csl("**");
 
-  suai::LiveEffect* effect     = new suai::LiveEffect(message->effect);
-  std::string       effectName = effect->getName();
+  // Resolved in InitLiveEffect, rendering never asks Illustrator for the name
+  const pipeline::EffectDescriptor* effect = effectRegistry.find(message->effect);
+  if (effect == nullptr) {
+    csl("GoLiveEffect: unregistered effect");
+    return kCantHappenErr;
+  }
+  const std::string& normalizeEffectId = effect->id;
+  call.bind(effect->stats);
 
   AIArtHandle art = message->art;
 
+  // Renders in flight together share the pool's window, the first one of a
+  // redraw drops the blocks that the previous one did not need
+  pipeline::TileBufferWork bufferWork = tileBufferPool.beginWork();
+
   // It is must be 72, if it changed, illustrator will be crash
   int baseDpi = 72;
 
@@ -172,10 +370,6 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
   );
   CHKERR();
 
-  std::string normalizeEffectId = std::regex_replace(
-      effectName, std::regex("^" + escapeStringRegexp(EFFECT_PREFIX)), ""
-  );
-
   AIRasterizeSettings settings = suai::createAIRasterSetting(
       {.type               = suai::RasterType::ARGB,
        .antiAlias          = 4,
@@ -195,9 +389,6 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
     artSet->AddArt(art);
 
     AIArtHandle rasterArt;
-    error =
-        sAIArt->NewArt(AIArtType::kRasterArt, AIPaintOrder::kPlaceAbove, art, &rasterArt);
-    CHKERR();
 
     AIRealRect bounds;
     error = sAIRasterize->ComputeArtBounds(artSet->ToAIArtSet(), &bounds, false);
@@ -206,51 +397,61 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
     // get dpi
     int dpi;
     {
-      AIRealRect getDpiBounds;
-      getDpiBounds.left   = bounds.left * 0.01;
-      getDpiBounds.top    = bounds.top * 0.01;
-      getDpiBounds.right  = bounds.right * 0.01;
-      getDpiBounds.bottom = bounds.bottom * 0.01;
+      // Queried on the main thread, snapshotted by Notify for worker threads
+      pipeline::DpiKey   dpiKey   = dpiResolver.renderKey();
+      std::optional<int> resolved = dpiResolver.resolve(dpiKey);
 
-      print_AIRealRect(&getDpiBounds, "bounds (source)");
-
-      error = sAIRasterize->Rasterize(
-          artSet->ToAIArtSet(), &settings, &getDpiBounds, AIPaintOrder::kPlaceAbove, art,
-          &rasterArt, NULL
-      );
-      CHKERR();
-
-      AIRealMatrix tmpMatrix;
-      error = sAIRaster->GetRasterMatrix(rasterArt, &tmpMatrix);
-      CHKERR();
-
-      print_AIRealMatrix(&tmpMatrix, "tmpMatrix");
-
-      dpi   = baseDpi * (1 / tmpMatrix.a);
-      error = sAIArt->DisposeArt(rasterArt);
-      CHKERR();
+      if (resolved) {
+        dpi = *resolved;
+      } else {
+        dpi = this->probeDpi(artSet->ToAIArtSet(), bounds, art, &error);
+        CHKERR();
+        dpiResolver.learn(dpiKey, dpi);
+      }
     };
 
-    csl("dpi: %d", dpi);
+    csl("dpi: %d (resolver hits: %zu, misses: %zu)", dpi, dpiResolver.getHits(),
+        dpiResolver.getMisses());
 
-    error =
-        sAIArt->NewArt(AIArtType::kRasterArt, AIPaintOrder::kPlaceAbove, art, &rasterArt);
-    CHKERR();
+    const bool previewing = this->isPreviewing(normalizeEffectId);
+    // Only previews are superseded by newer parameters
+    const uint64_t generation = previewing ? previewGeneration.load() : 0;
+
+    // Slider ticks render at a capped pixel count, the result is upscaled back
+    double previewScale = 1.0;
+    if (previewing) {
+      previewScale = pipeline::previewScale(
+          std::abs(bounds.right - bounds.left) * dpi / 72.0,
+          std::abs(bounds.top - bounds.bottom) * dpi / 72.0, previewPixelBudget
+      );
+    }
+    const double renderDpi = dpi * previewScale;
+    if (previewScale < 1.0) {
+      csl("Preview scale: %.3f (%.1f dpi)", previewScale, renderDpi);
+    }
 
     // Rasterizing
-    settings.resolution = (double)dpi;
-    timeStart("Rasterize");
-    error = sAIRasterize->Rasterize(
-        artSet->ToAIArtSet(), &settings, &bounds, AIPaintOrder::kPlaceAbove, art,
-        &rasterArt, NULL
-    );
-    timeEnd();
+    settings.resolution = renderDpi;
+    {
+      trace::Span span(trace::Stage::Rasterize);
+      error = sAIRasterize->Rasterize(
+          artSet->ToAIArtSet(), &settings, &bounds, AIPaintOrder::kPlaceAbove, art,
+          &rasterArt, NULL
+      );
+    }
     CHKERR();
 
     AIRasterRecord sourceRasterRecord;
     sAIRaster->GetRasterInfo(rasterArt, &sourceRasterRecord);
     unsigned char bytes = sourceRasterRecord.bitsPerPixel / 8;
 
+    // Pixel kernels and tiles below assume ARGB8
+    if (bytes != 4) {
+      csl("GoLiveEffect: unexpected %d bytes per pixel", bytes);
+      sAIArt->DisposeArt(rasterArt);
+      return kCantHappenErr;
+    }
+
     AIRealMatrix sourceMatrix;
     AIRealRect   rasterBounds;
     sAIRaster->GetRasterBoundingBox(rasterArt, &rasterBounds);
@@ -271,20 +472,75 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
     uint32 sourceWidth  = artSlice.right - artSlice.left;
     uint32 sourceHeight = artSlice.bottom - artSlice.top;
 
-    size_t dataSize   = sourceWidth * sourceHeight * bytes;
-    workTile.data     = new unsigned char[dataSize];
-    workTile.rowBytes = sourceWidth * bytes;
+    pipeline::PixelFormat pixelFormat = effect->pixelFormat;
+
+    // Effects scale radii by dpi / baseDpi, so a scaled preview looks the same
+    json env(
+        {{"dpi", previewScale < 1.0 ? json(renderDpi) : json(dpi)},
+         {"baseDpi", baseDpi},
+         {"isInPreview", previewing},
+         {"previewScale", previewScale}}
+    );
+
+    // Large rasters of effects that support it are streamed through in tiles, so
+    // neither the whole raster nor a huge GPU texture is ever needed at once
+    if (effect->tiling &&
+        (sourceWidth > (uint32)tileSize || sourceHeight > (uint32)tileSize)) {
+      std::optional<int> halo = this->getTilingHalo(params, env);
+
+      if (halo && tileSize + 2 * *halo <= kMaxTileSide) {
+        auto        runtime  = runtimePool.acquire();
+        AIArtHandle tiledArt = nullptr;
+        error = this->goLiveEffectTiled(
+            params, env, pixelFormat, rasterArt, art, *halo, runtime.get(), generation,
+            &tiledArt
+        );
+
+        if (error == kNoErr) {
+          // Tiles keep the source size, halos aside
+          uint64_t tiledBytes =
+              (uint64_t)sourceWidth * sourceHeight * pipeline::bytesPerPixel(pixelFormat);
+          call.addBytesIn(tiledBytes);
+          call.addBytesOut(tiledBytes);
+
+          error = sAIArt->DisposeArt(rasterArt);
+          CHKERR();
+
+          message->art = tiledArt;
+          return kNoErr;
+        }
+
+        if (error == kCanceledErr) {
+          sAIArt->DisposeArt(rasterArt);
+          return kCanceledErr;
+        }
+
+        csl("Tiled execution failed (%d), processing the whole raster", error);
+        error = kNoErr;
+      }
+    }
+
+    // Lent to the runtime for the duration of go_live_effect, returned to the
+    // pool on every exit path of this scope
+    size_t               dataSize     = (size_t)sourceWidth * sourceHeight * bytes;
+    pipeline::TileBuffer sourceBuffer = tileBufferPool.acquire(dataSize);
+    workTile.data                     = sourceBuffer.data();
+    workTile.rowBytes                 = sourceWidth * bytes;
 
     // print_AITile(&workTile, "workTile(before)");
 
-    // to RGBA
-    workTile.channelInterleave[0] = 3;
-    workTile.channelInterleave[1] = 0;
-    workTile.channelInterleave[2] = 1;
-    workTile.channelInterleave[3] = 2;
+    // Keep Illustrator's ARGB, pipeline::PixelKernels converts it far faster than
+    // a channelInterleave gather
+    workTile.channelInterleave[0] = 0;
+    workTile.channelInterleave[1] = 1;
+    workTile.channelInterleave[2] = 2;
+    workTile.channelInterleave[3] = 3;
     workTile.bounds               = artSlice;
 
-    error = sAIRaster->GetRasterTile(rasterArt, &artSlice, &workTile, &workSlice);
+    {
+      trace::Span span(trace::Stage::GetRasterTile);
+      error = sAIRaster->GetRasterTile(rasterArt, &artSlice, &workTile, &workSlice);
+    }
     CHKERR();
 
     csl("LiveEffect Input:");
@@ -304,74 +560,296 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
     const ai::uint32 totalPixels = sourceWidth * sourceHeight;
     const ai::uint32 pixelStride = workTile.colBytes;
     ai::uint8*       pixelData   = static_cast<ai::uint8*>(workTile.data);
-    uintptr_t        byteLength  = totalPixels * pixelStride;
 
-    json env(
-        {{"dpi", dpi},
-         {"baseDpi", baseDpi},
-         {"isInPreview",
-          isInPreview && this->editingEffectId == (std::string)normalizeEffectId}}
-    );
+    // Nothing to render on a fully transparent input. Effects with a halo also get
+    // only the visible pixels and that halo around them, see trimRect below.
+    std::optional<pipeline::PixelRect> visible = std::nullopt;
+    {
+      trace::Span span(trace::Stage::Trim);
+      visible =
+          pipeline::alphaBounds(pixelData, sourceWidth, sourceHeight, workTile.rowBytes);
+    }
 
-    ai_deno::ImageDataPayload input = ai_deno::ImageDataPayload{
-        .width       = sourceWidth,
-        .height      = sourceHeight,
-        .data_ptr    = (void*)pixelData,
-        .byte_length = byteLength,
+    if (!visible) {
+      csl("Fully transparent input, effect skipped");
+      message->art = rasterArt;
+      return kNoErr;
+    }
+
+    // Identical requests (scroll, selection, undo) are answered from the cache.
+    // Previews are never cached: their params change with every slider tick.
+    pipeline::ResultCacheKey cacheKey = {
+        .effectId   = normalizeEffectId,
+        .paramsHash = params.paramsHash,
+        .pixelsHash = pipeline::xxh64(pixelData, dataSize),
+        .dpi        = dpi,
+        .width      = sourceWidth,
+        .height     = sourceHeight,
     };
 
-    ai_deno::GoLiveEffectResult* result = ai_deno::go_live_effect(
-        aiDenoMain, params.effectName.c_str(), params.params.dump().c_str(),
-        env.dump().c_str(), &input
-    );
+    // Outputs of previous sessions (e.g. reopening a document) come from disk
+    ai_deno::DiskCacheKey diskKey = {
+        .effect_id      = normalizeEffectId.c_str(),
+        .effect_version = effect->version.c_str(),
+        .params_hash    = cacheKey.paramsHash,
+        .pixels_hash    = cacheKey.pixelsHash,
+        .dpi            = dpi,
+        .width          = sourceWidth,
+        .height         = sourceHeight,
+    };
 
-    csl("LiveEffect Result: %s", result->success ? "true" : "false");
-    if (result->success) {
-      csl("  Original bytes: %d", byteLength);
-      csl("  Result bytes: %d", result->data->byte_length);
-      csl("  Source size: %d x %d", sourceWidth, sourceHeight);
-      csl("  Result size: %d x %d", result->data->width, result->data->height);
-      csl("    dpi: %d (%.3f, input %.3f %.3f)", dpi, dpiScaledFactor, sourceMatrix.a,
-          sourceMatrix.d);
-      csl("  Source data_ptr: %p", pixelData);
-      csl("  Result data_ptr: %p", result->data->data_ptr);
-      csl("  Result byte length: %d", result->data->byte_length);
-    }
-
-    if (!result->success) {
-      // Fill region as blue
-      for (int i = 0; i < totalPixels; i++) {
-        pixelData[i * pixelStride + 0] = 0;
-        pixelData[i * pixelStride + 1] = 0;
-        pixelData[i * pixelStride + 2] = 255;
-        pixelData[i * pixelStride + 3] = 255;
-      }
-
-      error = sAIRaster->SetRasterTile(rasterArt, &artSlice, &workTile, &workSlice);
-      CHKERR();
+    std::shared_ptr<const pipeline::CachedResult> cached = nullptr;
+    if (previewing) {
+      resultCache.bypass();
+    } else {
+      cached = resultCache.find(cacheKey);
+
+      if (!cached) {
+        ai_deno::ImageDataLease* lease = ai_deno::disk_cache_read(&diskKey);
+        if (lease != nullptr) {
+          csl("Disk cache hit");
+          cached = resultCache.insert(
+              cacheKey, lease->width, lease->height,
+              static_cast<ai::uint8*>(lease->data_ptr), lease->byte_length
+          );
+          ai_deno::dispose_image_lease(lease);
+        }
+      }
+    }
 
-      message->art = rasterArt;
-      return kCantHappenErr;
+    // 8bit formats are converted in place, wider ones get their own pooled buffer
+    const size_t         effectPixelBytes = pipeline::bytesPerPixel(pixelFormat);
+    pipeline::TileBuffer trimBuffer;
+    pipeline::TileBuffer effectBuffer;
+    pipeline::TileBuffer outputBuffer;
+
+    // Releases the output lease on every path below. Declared after the buffers
+    // lent to the runtime so it goes first: an in-place result still points into
+    // them.
+    std::unique_ptr<ai_deno::GoLiveEffectResult, void (*)(ai_deno::GoLiveEffectResult*)>
+        resultGuard(nullptr, ai_deno::dispose_go_live_effect_result);
+
+    uint32     resultWidth  = 0;
+    uint32     resultHeight = 0;
+    ai::uint8* outputData   = nullptr;
+
+    if (cached) {
+      call.cacheHit();
+
+      auto stats = resultCache.getStats();
+      csl("Result cache hit (hits: %zu, misses: %zu, %zu bytes)", stats.hits,
+          stats.misses, stats.bytes);
+
+      resultWidth  = cached->width;
+      resultHeight = cached->height;
+      // SetRasterTile only reads from the tile
+      outputData = const_cast<ai::uint8*>(cached->pixels.data());
+    } else {
+      // The transparent margin of rotated shapes or thin strokes stays here. Only
+      // effects with a halo know how much of it they still read.
+      std::optional<pipeline::PixelRect> trimRect = std::nullopt;
+      if (effect->tiling &&
+          pipeline::worthTrimming(*visible, sourceWidth, sourceHeight)) {
+        std::optional<int> halo = this->getTilingHalo(params, env);
+
+        if (halo) {
+          pipeline::PixelRect rect =
+              pipeline::inflateRect(*visible, *halo, sourceWidth, sourceHeight);
+          if (pipeline::worthTrimming(rect, sourceWidth, sourceHeight)) trimRect = rect;
+        }
+      }
+
+      // A trimmed render sees its rect as a tile of the whole raster
+      ai::uint8* inputData   = pixelData;
+      uint32     inputWidth  = sourceWidth;
+      uint32     inputHeight = sourceHeight;
+      if (trimRect) {
+        trace::Span span(trace::Stage::Trim);
+        trimBuffer = tileBufferPool.acquire(trimRect->pixels() * pixelStride);
+        pipeline::copyRect(
+            pixelData, workTile.rowBytes, *trimRect, pixelStride, trimBuffer.data()
+        );
+
+        inputData   = trimBuffer.data();
+        inputWidth  = trimRect->width();
+        inputHeight = trimRect->height();
+        env["tile"] = {
+            {"x", trimRect->left},
+            {"y", trimRect->top},
+            {"fullWidth", sourceWidth},
+            {"fullHeight", sourceHeight},
+        };
+        csl("Trimmed to %d x %d at (%d, %d)", inputWidth, inputHeight, trimRect->left,
+            trimRect->top);
+      }
+      const size_t inputPixels = (size_t)inputWidth * inputHeight;
+
+      void* effectData = inputData;
+      if (effectPixelBytes != pixelStride) {
+        effectBuffer = tileBufferPool.acquire(inputPixels * effectPixelBytes);
+        effectData   = effectBuffer.data();
+      }
+
+      {
+        trace::Span span(trace::Stage::Convert);
+        pipeline::convertToEffectFormat(pixelFormat, inputData, effectData, inputPixels);
+      }
+
+      uintptr_t byteLength = inputPixels * effectPixelBytes;
+
+      ai_deno::ImageDataPayload input = ai_deno::ImageDataPayload{
+        .width       = inputWidth,
+        .height      = inputHeight,
+          .data_ptr    = effectData,
+          .byte_length = byteLength,
+      };
+
+      call.addBytesIn(byteLength);
+
+      ai_deno::GoLiveEffectResult* result;
+      {
+        // Held only for the call, conversions around it don't need a runtime
+        auto runtime = runtimePool.acquire();
+        result = this->runGoLiveEffect(runtime.get(), params, env, &input, generation);
+      }
+      resultGuard.reset(result);
+
+      if (result->cancelled) {
+        csl("Render of generation %llu superseded", generation);
+        sAIArt->DisposeArt(rasterArt);
+        return kCanceledErr;
+      }
+
+      csl("LiveEffect Result: %s", result->success ? "true" : "false");
+      if (result->success) {
+        csl("  Original bytes: %d", byteLength);
+        csl("  Result bytes: %d", result->data->byte_length);
+        csl("  Source size: %d x %d", sourceWidth, sourceHeight);
+        csl("  Result size: %d x %d", result->data->width, result->data->height);
+        csl("    dpi: %d (%.3f, input %.3f %.3f)", dpi, dpiScaledFactor, sourceMatrix.a,
+            sourceMatrix.d);
+        csl("  Source data_ptr: %p", pixelData);
+        csl("  Result data_ptr: %p", result->data->data_ptr);
+        csl("  Result byte length: %d", result->data->byte_length);
+      }
+
+      bool hasValidResult =
+          result->success && result->data != nullptr &&
+          result->data->byte_length >= (size_t)result->data->width *
+                                           result->data->height * effectPixelBytes;
+      // Trimmed results are pasted back by position, like tiles
+      if (hasValidResult && trimRect) {
+        hasValidResult =
+            result->data->width == inputWidth && result->data->height == inputHeight;
+      }
+
+      if (!hasValidResult) {
+        // Fill region as blue (ARGB)
+        for (int i = 0; i < totalPixels; i++) {
+          pixelData[i * pixelStride + 0] = 255;
+          pixelData[i * pixelStride + 1] = 0;
+          pixelData[i * pixelStride + 2] = 0;
+          pixelData[i * pixelStride + 3] = 255;
+        }
+
+        error = sAIRaster->SetRasterTile(rasterArt, &artSlice, &workTile, &workSlice);
+        CHKERR();
+
+        message->art = rasterArt;
+        return kCantHappenErr;
+      }
+
+      call.addBytesOut(result->data->byte_length);
+
+      resultWidth         = result->data->width;
+      resultHeight        = result->data->height;
+      size_t resultPixels = (size_t)resultWidth * resultHeight;
+
+      // Back to ARGB, in the leased memory itself when the sizes match
+      outputData = static_cast<ai::uint8*>(result->data->data_ptr);
+      if (effectPixelBytes != pixelStride) {
+        outputBuffer = tileBufferPool.acquire(resultPixels * pixelStride);
+        outputData   = outputBuffer.data();
+      }
+
+      {
+        trace::Span span(trace::Stage::Convert);
+        pipeline::convertFromEffectFormat(
+            pixelFormat, result->data->data_ptr, outputData, resultPixels
+        );
+      }
+
+      // Back into the whole raster, its margin stays as transparent as it was
+      if (trimRect) {
+        trace::Span span(trace::Stage::Trim);
+        pipeline::pasteRect(
+            outputData, *trimRect, pixelStride, pixelData, workTile.rowBytes
+        );
+
+        outputData   = pixelData;
+        resultWidth  = sourceWidth;
+        resultHeight = sourceHeight;
+        resultPixels = totalPixels;
+      }
+
+      if (!previewing) {
+        resultCache.insert(
+            cacheKey, resultWidth, resultHeight, outputData, resultPixels * pixelStride
+        );
+
+        ai_deno::ImageDataPayload output = {
+            .width       = resultWidth,
+            .height      = resultHeight,
+            .data_ptr    = outputData,
+            .byte_length = resultPixels * pixelStride,
+        };
+        ai_deno::disk_cache_write(&diskKey, &output);
+      }
+    }
+
+    // Only the latest preview may reach SetRasterTile
+    if (this->isStaleRender(generation)) {
+      csl("Render of generation %llu superseded", generation);
+      sAIArt->DisposeArt(rasterArt);
+      return kCanceledErr;
+    }
+
+    // Back to the resolution the preview would have had without scaling
+    uint32               outputWidth  = resultWidth;
+    uint32               outputHeight = resultHeight;
+    pipeline::TileBuffer upscaleBuffer;
+    if (outputData != nullptr && previewScale < 1.0) {
+      outputWidth  = (uint32)std::max(1L, std::lround(resultWidth / previewScale));
+      outputHeight = (uint32)std::max(1L, std::lround(resultHeight / previewScale));
+
+      upscaleBuffer = tileBufferPool.acquire((size_t)outputWidth * outputHeight * 4);
+
+      {
+        trace::Span span(trace::Stage::Upscale);
+        pipeline::resizeArgbBilinear(
+            outputData, resultWidth, resultHeight, upscaleBuffer.data(), outputWidth,
+            outputHeight
+        );
+      }
+
+      outputData = upscaleBuffer.data();
     }
 
-    if (result->data != nullptr) {
+    if (outputData != nullptr) {
       csl("Setting pointer");
-      workTile.rowBytes = result->data->width * 4;
+      workTile.rowBytes = outputWidth * 4;
       workTile.colBytes = 4;
-      workTile.data     = result->data->data_ptr;
+      workTile.data     = outputData;
 
-      auto widthDiff  = result->data->width - sourceWidth;
-      auto heightDiff = result->data->height - sourceHeight;
+      // In pixels of the rasterized source
+      auto widthDiff  = resultWidth - sourceWidth;
+      auto heightDiff = resultHeight - sourceHeight;
 
-      workTile.channelInterleave[0] = 1;
-      workTile.channelInterleave[1] = 2;
-      workTile.channelInterleave[2] = 3;
-      workTile.channelInterleave[3] = 0;
-
-      if (widthDiff != 0 || heightDiff != 0) {
+      if (widthDiff != 0 || heightDiff != 0 || outputWidth != resultWidth ||
+          outputHeight != resultHeight) {
         csl("Resizing tile");
         csl("  widthDiff: %d, heightDiff: %d", widthDiff, heightDiff);
-        timeStart("Renew artset");
+        trace::Span span(trace::Stage::RenewArt);
 
         AIArtHandle newRasterArt;
         error = sAIArt->NewArt(
@@ -386,8 +864,8 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
         newInfo.originalColorSpace = sourceRasterRecord.originalColorSpace;
         newInfo.bounds.left        = 0;  // Illustrator specific
         newInfo.bounds.top         = 0;  // Illustrator specific
-        newInfo.bounds.right       = result->data->width;
-        newInfo.bounds.bottom      = result->data->height;
+        newInfo.bounds.right       = outputWidth;
+        newInfo.bounds.bottom      = outputHeight;
         newInfo.byteWidth          = 4;
 
         print_AIRasterRecord(newInfo, "newInfo");
@@ -411,9 +889,9 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
         float expandedRatioX = (artBoundsPts.right - artBoundsPts.left) / widthPx;
         float expandedRatioY = (artBoundsPts.bottom - artBoundsPts.top) / heightPx;
 
-        // Centering image
-        newMatrix.a = sourceMatrix.a;
-        newMatrix.d = sourceMatrix.d;
+        // Centering image. Upscaled pixels cover proportionally less area.
+        newMatrix.a = sourceMatrix.a * resultWidth / outputWidth;
+        newMatrix.d = sourceMatrix.d * resultHeight / outputHeight;
         newMatrix.tx -= (widthDiff / 2.0) * expandedRatioX;
         newMatrix.ty -= (heightDiff / 2.0) * expandedRatioY;
 
@@ -427,45 +905,48 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
 
         AISlice newArtSlice = {0}, newWorkSlice = {0};
         newWorkSlice.top = newArtSlice.top = 0;
-        newWorkSlice.bottom = newArtSlice.bottom = result->data->height;
+        newWorkSlice.bottom = newArtSlice.bottom = outputHeight;
         newWorkSlice.left = newArtSlice.left = 0;
-        newWorkSlice.right = newArtSlice.right = result->data->width;
+        newWorkSlice.right = newArtSlice.right = outputWidth;
         newWorkSlice.back = newArtSlice.back = workTile.colBytes;
 
         AITile newWorkTile   = {0};
-        newWorkTile.data     = result->data->data_ptr;
+        newWorkTile.data     = outputData;
         newWorkTile.bounds   = newArtSlice;
-        newWorkTile.rowBytes = result->data->width * workTile.colBytes;
+        newWorkTile.rowBytes = outputWidth * workTile.colBytes;
         newWorkTile.colBytes = workTile.colBytes;
 
         for (int i = 0; i < kMaxChannels; i++) {
           newWorkTile.channelInterleave[i] = workTile.channelInterleave[i];
         }
 
-        error = sAIRaster->SetRasterTile(
-            newRasterArt, &newArtSlice, &newWorkTile, &newWorkSlice
-        );
+        {
+          trace::Span span(trace::Stage::SetRasterTile);
+          error = sAIRaster->SetRasterTile(
+              newRasterArt, &newArtSlice, &newWorkTile, &newWorkSlice
+          );
+        }
         CHKERR();
 
         error = sAIArt->DisposeArt(rasterArt);
         CHKERR();
 
-        timeEnd();
+        span.end();
 
         message->art = newRasterArt;
 
         return error;
       } else {
-        error = sAIRaster->SetRasterTile(rasterArt, &artSlice, &workTile, &workSlice);
+        {
+          trace::Span span(trace::Stage::SetRasterTile);
+          error = sAIRaster->SetRasterTile(rasterArt, &artSlice, &workTile, &workSlice);
+        }
         CHKERR();
 
         message->art = rasterArt;
 
         return error;
       }
-
-      csl("GoLiveEffect: Completed");
-      ai_deno::dispose_go_live_effect_result(result);
     }
   } catch (const ai::Error& ex) {
     std::cout << (AIErr)ex << ":" << ex.what() << std::endl;
@@ -478,18 +959,525 @@ ASErr HelloWorldPlugin::GoLiveEffect(AILiveEffectGoMessage* message) {
   return error;
 }
 
+ai_deno::GoLiveEffectResult* HelloWorldPlugin::runGoLiveEffect(
+    ai_deno::OpaqueAiMain        worker,
+    const PluginParams&          params,
+    const json&                  env,
+    ai_deno::ImageDataPayload*   input,
+    uint64_t                     generation
+) {
+  trace::Span encodeSpan(trace::Stage::Encode);
+  std::vector<uint8_t> paramsMessage =
+      pipeline::typed_message::encode(params.params, paramKeysOf(params.effectName));
+  std::vector<uint8_t> envMessage = pipeline::typed_message::encode(env);
+  encodeSpan.end();
+
+  ai_deno::TypedMessage paramsArg = lendMessage(paramsMessage);
+  ai_deno::TypedMessage envArg    = lendMessage(envMessage);
+
+  uint64_t calledAtNs = trace::isEnabled() ? trace::nowNs() : 0;
+  ai_deno::GoLiveEffectResult* result = ai_deno::go_live_effect_typed(
+      worker != nullptr ? worker : aiDenoMain, params.effectName.c_str(), &paramsArg,
+      &envArg, input, generation, trace::currentTraceId()
+  );
+  recordRenderSpans(calledAtNs, result);
+
+  return result;
+}
+
+pipeline::RenderTicket HelloWorldPlugin::submitGoLiveEffect(
+    ai_deno::OpaqueAiMain      worker,
+    const PluginParams&        params,
+    const json&                env,
+    ai_deno::ImageDataPayload* input,
+    uint64_t                   generation
+) {
+  // The messages are copied by the call, only the pixels must outlive the ticket
+  trace::Span encodeSpan(trace::Stage::Encode);
+  std::vector<uint8_t> paramsMessage =
+      pipeline::typed_message::encode(params.params, paramKeysOf(params.effectName));
+  std::vector<uint8_t> envMessage = pipeline::typed_message::encode(env);
+  encodeSpan.end();
+
+  ai_deno::TypedMessage paramsArg = lendMessage(paramsMessage);
+  ai_deno::TypedMessage envArg    = lendMessage(envMessage);
+
+  return pipeline::RenderTicket(ai_deno::go_live_effect_submit_typed(
+      worker != nullptr ? worker : aiDenoMain, params.effectName.c_str(), &paramsArg,
+      &envArg, input, generation, trace::currentTraceId()
+  ));
+}
+
+void HelloWorldPlugin::recordRenderSpans(
+    uint64_t                           calledAtNs,
+    const ai_deno::GoLiveEffectResult* result
+) {
+  if (calledAtNs == 0 || !trace::isEnabled()) return;
+
+  trace::record(trace::Stage::Ffi, calledAtNs, trace::nowNs() - calledAtNs);
+  if (result != nullptr && result->js_ns > 0) {
+    uint64_t jsStartNs = calledAtNs + result->js_offset_ns;
+    trace::record(trace::Stage::Js, jsStartNs, result->js_ns);
+    if (result->gpu_ns > 0) trace::record(trace::Stage::Gpu, jsStartNs, result->gpu_ns);
+    if (result->readback_ns > 0) {
+      trace::record(trace::Stage::Readback, jsStartNs, result->readback_ns);
+    }
+  }
+}
+
+void HelloWorldPlugin::logTraceSummary() {
+  if (!trace::isEnabled()) return;
+
+  auto summary = trace::summarize(trace::collect());
+  for (size_t i = 0; i < trace::kStageCount; i++) {
+    const trace::StageSummary& stage = summary[i];
+    if (stage.count == 0) continue;
+
+    csl("Stage %-14s %6zu spans, avg %9.3fms, max %9.3fms",
+        trace::stageName((trace::Stage)i), stage.count,
+        stage.totalNs / 1e6 / stage.count, stage.maxNs / 1e6);
+  }
+}
+
+void HelloWorldPlugin::dumpChromeTrace() {
+  if (!trace::isEnabled()) return;
+
+  // Runtime spans are handed over once, so skip host spans already exported too
+  uint64_t exportedUntilNs = traceExportedUntilNs;
+  traceExportedUntilNs     = trace::nowNs();
+
+  json hostSpans = json::array();
+  for (const trace::ThreadEvents& thread : trace::collect()) {
+    std::string threadName = "illustrator-" + std::to_string(thread.threadIndex);
+    for (const trace::SpanEvent& event : thread.events) {
+      if (event.startNs < exportedUntilNs) continue;
+      // Totals for the summary, the runtime exports the spans they sum up
+      if (event.stage == trace::Stage::Gpu || event.stage == trace::Stage::Readback) {
+        continue;
+      }
+      hostSpans.push_back({
+          {"name", trace::stageName(event.stage)},
+          {"traceId", event.traceId},
+          {"thread", threadName},
+          {"startNs", event.startNs},
+          {"durationNs", event.durationNs},
+      });
+    }
+  }
+
+  ai_deno::JsonFunctionResult* result =
+      ai_deno::trace_export_chrome(hostSpans.dump().c_str(), traceExportedUntilNs);
+  if (result->success) {
+    csl("Trace written to %s", json::parse(result->json)["path"].get<std::string>().c_str());
+  } else {
+    csl("Failed to export the trace");
+  }
+  ai_deno::dispose_json_function_result(result);
+}
+
+void HelloWorldPlugin::writeEffectStatsReport() {
+  std::vector<pipeline::EffectStatsSnapshot> stats = pipeline::effectStats().snapshot();
+  std::string reportJson = pipeline::EffectStatsStore::toJson(stats).dump(2);
+  std::string reportCsv  = pipeline::EffectStatsStore::toCsv(stats);
+
+  ai_deno::JsonFunctionResult* result =
+      ai_deno::write_effect_stats_report(reportJson.c_str(), reportCsv.c_str());
+  if (result->success) {
+    json paths = json::parse(result->json);
+    csl("Effect stats written to %s and %s", paths["json"].get<std::string>().c_str(),
+        paths["csv"].get<std::string>().c_str());
+  } else {
+    csl("Failed to write the effect stats");
+  }
+  ai_deno::dispose_json_function_result(result);
+}
+
+void HelloWorldPlugin::warmUpEffects(const char* effectIdsJson, bool onMain) {
+  if (onMain) ai_deno::warm_up_live_effects(aiDenoMain, effectIdsJson);
+  for (ai_deno::OpaqueAiMain worker : runtimePool.handles()) {
+    ai_deno::warm_up_live_effects(worker, effectIdsJson);
+  }
+}
+
+void HelloWorldPlugin::alertEffectInitFailures() {
+  ai_deno::JsonFunctionResult* result = ai_deno::take_effect_init_failures();
+  json failures = result->success ? json::parse(result->json) : json::array();
+  ai_deno::dispose_json_function_result(result);
+
+  if (!failures.is_array() || failures.empty()) return;
+
+  std::string logs;
+  for (const json& failure : failures) {
+    if (!logs.empty()) logs += "\n";
+    logs += failure.get<std::string>();
+  }
+
+  sAIUser->MessageAlert(
+      suai::str::toAiUnicodeStringUtf8("[AiDeno] Failed to initialize effects\n\n" + logs)
+  );
+}
+
+void HelloWorldPlugin::logRuntimeMetrics(const char* label, ai_deno::OpaqueAiMain runtime) {
+  if (runtime == nullptr) return;
+
+  ai_deno::ExecutorMetrics metrics = ai_deno::get_runtime_metrics(runtime);
+  uint64_t                 calls   = std::max<uint64_t>(1, metrics.completed);
+
+  csl("Runtime %s: %llu calls, queue depth %llu (max %llu), wait avg %lluus (max "
+      "%lluus), exec avg %lluus (max %lluus)",
+      label, metrics.completed, metrics.queue_depth, metrics.max_queue_depth,
+      metrics.total_wait_us / calls, metrics.max_wait_us, metrics.total_exec_us / calls,
+      metrics.max_exec_us);
+}
+
+bool HelloWorldPlugin::isPreviewing(const std::string& effectId) {
+  std::lock_guard<std::mutex> lock(editingMutex);
+  return isInPreview && editingEffectId == effectId;
+}
+
+std::optional<int> HelloWorldPlugin::getTilingHalo(
+    const PluginParams& params,
+    const json&         env
+) {
+  pipeline::HaloCacheKey key = {
+      .effectId   = params.effectName,
+      .paramsHash = params.paramsJson.empty() ? pipeline::xxh64(params.serializedParams())
+                                              : params.paramsHash,
+      .envHash    = pipeline::xxh64(env.dump()),
+  };
+  if (std::optional<std::optional<int>> cached = haloCache.find(key)) return *cached;
+
+  // Only a miss takes a runtime
+  auto                  runtime = runtimePool.acquire();
+  ai_deno::OpaqueAiMain worker  = runtime.get();
+
+  std::vector<uint8_t> paramsMessage =
+      pipeline::typed_message::encode(params.params, paramKeysOf(params.effectName));
+  std::vector<uint8_t> envMessage = pipeline::typed_message::encode(env);
+
+  ai_deno::TypedMessage        paramsArg = lendMessage(paramsMessage);
+  ai_deno::TypedMessage        envArg    = lendMessage(envMessage);
+  ai_deno::TypedFunctionResult* result    = ai_deno::get_live_effect_tiling_typed(
+      worker != nullptr ? worker : aiDenoMain, params.effectName.c_str(), &paramsArg,
+      &envArg
+  );
+
+  std::optional<json> tiling =
+      result->success ? pipeline::typed_message::decode(result->data, result->byte_length)
+                      : std::nullopt;
+  ai_deno::dispose_typed_function_result(result);
+
+  // Failures aren't cached, the next render asks again
+  if (!tiling) {
+    csl("Failed to get tiling of %s", params.effectName.c_str());
+    return std::nullopt;
+  }
+
+  std::optional<int> halo = std::nullopt;
+  if (tiling->is_object() && (*tiling)["halo"].is_number()) {
+    halo = std::max(0, (*tiling)["halo"].get<int>());
+  }
+  haloCache.insert(std::move(key), halo);
+  return halo;
+}
+
+/**
+ * Tiled counterpart of the whole raster path of GoLiveEffect. Each tile is read
+ * from `sourceRaster` with its halo, run through the effect, and its core is
+ * written into a new raster art placed above `placement`. Only one tile's
+ * buffers exist at a time, so peak memory follows `tileSize`, not the art.
+ */
+ASErr HelloWorldPlugin::goLiveEffectTiled(
+    const PluginParams&          params,
+    const json&                  env,
+    pipeline::PixelFormat        pixelFormat,
+    AIArtHandle                  sourceRaster,
+    AIArtHandle                  placement,
+    int                          halo,
+    ai_deno::OpaqueAiMain        worker,
+    uint64_t                     generation,
+    AIArtHandle*                 outArt
+) {
+  ASErr error = kNoErr;
+
+  AIRasterRecord record;
+  error = sAIRaster->GetRasterInfo(sourceRaster, &record);
+  CHKERR();
+
+  AIRealMatrix matrix;
+  error = sAIRaster->GetRasterMatrix(sourceRaster, &matrix);
+  CHKERR();
+
+  const ai::int32 bytes            = record.bitsPerPixel / 8;
+  const ai::int32 width            = record.bounds.right - record.bounds.left;
+  const ai::int32 height           = record.bounds.bottom - record.bounds.top;
+  const size_t    effectPixelBytes = pipeline::bytesPerPixel(pixelFormat);
+
+  AIArtHandle tiledArt = nullptr;
+  error                = sAIArt->NewArt(
+      AIArtType::kRasterArt, AIPaintOrder::kPlaceAbove, placement, &tiledArt
+  );
+  CHKERR();
+
+  // Rect in raster coordinates -> slice of the raster art
+  auto toArtSlice = [&](const pipeline::PixelRect& rect) {
+    AISlice slice = {0};
+    slice.left    = record.bounds.left + rect.left;
+    slice.top     = record.bounds.top + rect.top;
+    slice.right   = record.bounds.left + rect.right;
+    slice.bottom  = record.bounds.top + rect.bottom;
+    slice.back    = bytes;
+    return slice;
+  };
+
+  // Rect relative to a tile buffer
+  auto toTileSlice = [&](ai::int32 left, ai::int32 top, ai::int32 w, ai::int32 h) {
+    AISlice slice = {0};
+    slice.left    = left;
+    slice.top     = top;
+    slice.right   = left + w;
+    slice.bottom  = top + h;
+    slice.back    = bytes;
+    return slice;
+  };
+
+  std::vector<pipeline::TileRegion> tiles =
+      pipeline::planTiles(width, height, tileSize, halo);
+
+  // Two tiles are alive at once: the one rendering and the one being read
+  csl("Tiled execution: %zu tiles of %d px (halo %d), peak tiles %zu bytes", tiles.size(),
+      tileSize, halo,
+      2 * pipeline::maxTileSourcePixels(tileSize, halo) * (bytes + effectPixelBytes));
+
+  // A tile from its read to its write back. The ticket is declared last so it's
+  // cancelled and waited before the buffers it reads are released.
+  struct InFlightTile {
+    const pipeline::TileRegion* region        = nullptr;
+    AITile                      tile          = {0};
+    uint64_t                    submittedAtNs = 0;
+    pipeline::TileBuffer        sourceBuffer;
+    pipeline::TileBuffer        effectBuffer;
+    pipeline::RenderTicket      ticket;
+  };
+
+  // Reads a tile and queues its render
+  auto submitTile = [&](const pipeline::TileRegion& region) {
+    const ai::int32 tileWidth  = region.source.width();
+    const ai::int32 tileHeight = region.source.height();
+    const size_t    pixels     = region.source.pixels();
+
+    InFlightTile inFlight;
+    inFlight.region       = &region;
+    inFlight.sourceBuffer = tileBufferPool.acquire(pixels * bytes);
+
+    AITile& tile  = inFlight.tile;
+    tile.data     = inFlight.sourceBuffer.data();
+    tile.bounds   = toTileSlice(0, 0, tileWidth, tileHeight);
+    tile.rowBytes = tileWidth * bytes;
+    tile.colBytes = bytes;
+    for (int c = 0; c < 4; c++) tile.channelInterleave[c] = c;
+
+    AISlice artSlice  = toArtSlice(region.source);
+    AISlice workSlice = tile.bounds;
+    {
+      trace::Span span(trace::Stage::GetRasterTile);
+      error = sAIRaster->GetRasterTile(sourceRaster, &artSlice, &tile, &workSlice);
+    }
+    CHKERR();
+
+    void* effectData = inFlight.sourceBuffer.data();
+    if (effectPixelBytes != (size_t)bytes) {
+      inFlight.effectBuffer = tileBufferPool.acquire(pixels * effectPixelBytes);
+      effectData            = inFlight.effectBuffer.data();
+    }
+    {
+      trace::Span span(trace::Stage::Convert);
+      pipeline::convertToEffectFormat(
+          pixelFormat, inFlight.sourceBuffer.data(), effectData, pixels
+      );
+    }
+
+    json tileEnv    = env;
+    tileEnv["tile"] = {
+        {"x", region.source.left},
+        {"y", region.source.top},
+        {"fullWidth", width},
+        {"fullHeight", height},
+    };
+
+    ai_deno::ImageDataPayload input = ai_deno::ImageDataPayload{
+        .width       = (uint32_t)tileWidth,
+        .height      = (uint32_t)tileHeight,
+        .data_ptr    = effectData,
+        .byte_length = pixels * effectPixelBytes,
+    };
+
+    inFlight.submittedAtNs = trace::isEnabled() ? trace::nowNs() : 0;
+    inFlight.ticket =
+        this->submitGoLiveEffect(worker, params, tileEnv, &input, generation);
+    return inFlight;
+  };
+
+  // Waits for a tile's render and writes its core into `tiledArt`
+  auto writeBackTile = [&](InFlightTile& inFlight) -> ASErr {
+    const pipeline::TileRegion& region     = *inFlight.region;
+    const ai::int32             tileWidth  = region.source.width();
+    const ai::int32             tileHeight = region.source.height();
+    const size_t                pixels     = region.source.pixels();
+
+    pipeline::RenderTicket::Result result = inFlight.ticket.wait();
+    recordRenderSpans(inFlight.submittedAtNs, result.get());
+
+    if (result->cancelled || this->isStaleRender(generation)) {
+      csl("Tiled render of generation %llu superseded", generation);
+      return kCanceledErr;
+    }
+
+    // Tiles are stitched back by position, so the effect must keep the size
+    if (!result->success || result->data == nullptr ||
+        result->data->width != (uint32_t)tileWidth ||
+        result->data->height != (uint32_t)tileHeight ||
+        result->data->byte_length < pixels * effectPixelBytes) {
+      csl("Tile (%d, %d) failed or changed size", region.core.left, region.core.top);
+      return kCantHappenErr;
+    }
+
+    ai::uint8* outputData = static_cast<ai::uint8*>(result->data->data_ptr);
+    if (effectPixelBytes != (size_t)bytes) outputData = inFlight.sourceBuffer.data();
+    {
+      trace::Span span(trace::Stage::Convert);
+      pipeline::convertFromEffectFormat(
+          pixelFormat, result->data->data_ptr, outputData, pixels
+      );
+    }
+
+    AITile outTile   = inFlight.tile;
+    outTile.data     = outputData;
+    AISlice outArt   = toArtSlice(region.core);
+    AISlice outSlice = toTileSlice(
+        region.coreOffsetX(), region.coreOffsetY(), region.core.width(),
+        region.core.height()
+    );
+    trace::Span span(trace::Stage::SetRasterTile);
+    return sAIRaster->SetRasterTile(tiledArt, &outArt, &outTile, &outSlice);
+  };
+
+  try {
+    error = sAIRaster->SetRasterInfo(tiledArt, &record);
+    CHKERR();
+
+    error = sAIRaster->SetRasterMatrix(tiledArt, &matrix);
+    CHKERR();
+
+    // Tile N+1 is read while tile N renders, then N is written back. A tile left
+    // in flight by an early return is cancelled on its way out.
+    std::optional<InFlightTile> rendering;
+    for (const pipeline::TileRegion& region : tiles) {
+      InFlightTile next = submitTile(region);
+
+      if (rendering) {
+        error = writeBackTile(*rendering);
+        if (error != kNoErr) {
+          sAIArt->DisposeArt(tiledArt);
+          return error;
+        }
+      }
+
+      rendering = std::move(next);
+    }
+
+    if (rendering) {
+      error = writeBackTile(*rendering);
+      if (error != kNoErr) {
+        sAIArt->DisposeArt(tiledArt);
+        return error;
+      }
+    }
+  } catch (const ai::Error& ex) {
+    sAIArt->DisposeArt(tiledArt);
+    return (AIErr)ex;
+  }
+
+  *outArt = tiledArt;
+  return kNoErr;
+}
+
+/**
+ * Rasterizes 1% of the art bounds only to read back the resolution Illustrator
+ * chose for `useEffectsRes`. Used when `dpiResolver` cannot answer yet.
+ */
+int HelloWorldPlugin::probeDpi(
+    AIArtSet    artSet,
+    AIRealRect  bounds,
+    AIArtHandle art,
+    ASErr*      err
+) {
+  ASErr error = kNoErr;
+
+  // It is must be 72, if it changed, illustrator will be crash
+  int baseDpi = 72;
+
+  AIRasterizeSettings settings = suai::createAIRasterSetting(
+      {.type               = suai::RasterType::ARGB,
+       .antiAlias          = 4,
+       .colorConvert       = suai::RasterSettingColorConvert::Standard,
+       .preserveSpotColors = true,
+       .resolution         = (double)baseDpi,
+       .options =
+           {
+               .useMinTiles   = false,
+               .useEffectsRes = true,
+               .doLayers      = true,
+           }}
+  );
+
+  AIRealRect getDpiBounds;
+  getDpiBounds.left   = bounds.left * 0.01;
+  getDpiBounds.top    = bounds.top * 0.01;
+  getDpiBounds.right  = bounds.right * 0.01;
+  getDpiBounds.bottom = bounds.bottom * 0.01;
+
+  print_AIRealRect(&getDpiBounds, "bounds (source)");
+
+  trace::Span span(trace::Stage::Probe);
+  AIArtHandle probeArt;
+  error = sAIRasterize->Rasterize(
+      artSet, &settings, &getDpiBounds, AIPaintOrder::kPlaceAbove, art, &probeArt, NULL
+  );
+  *err = error;
+  CHKERR();
+
+  AIRealMatrix tmpMatrix;
+  error = sAIRaster->GetRasterMatrix(probeArt, &tmpMatrix);
+  *err  = error;
+  CHKERR();
+
+  print_AIRealMatrix(&tmpMatrix, "tmpMatrix");
+
+  error = sAIArt->DisposeArt(probeArt);
+  *err  = error;
+  CHKERR();
+
+  return baseDpi * (1 / tmpMatrix.a);
+}
+
 ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* message) {
   ASErr error = kNoErr;
   std::cout << "EDIT LIVE!! EFFECT!!!" << std::endl;
-  suai::LiveEffect* effect = new suai::LiveEffect(message->effect);
+  const pipeline::EffectDescriptor* effect = effectRegistry.find(message->effect);
+  if (effect == nullptr) {
+    csl("EditLiveEffectParameters: unregistered effect");
+    return kCantHappenErr;
+  }
 
   try {
-    std::string effectName  = effect->getName();
-    std::string effectTitle = effect->getTitle();
+    const std::string& normalizeEffectId = effect->id;
+    const std::string& effectTitle       = effect->title;
 
-    std::string normalizeEffectId = std::regex_replace(
-        effectName, std::regex("^" + escapeStringRegexp(EFFECT_PREFIX)), ""
-    );
+    // The preview follows the dialog, possibly on any pooled runtime. The main one
+    // starts on its own with the view tree and must stay free for the dialog.
+    warmUpEffects(json::array({normalizeEffectId}).dump().c_str(), false);
+    alertEffectInitFailures();
 
     csl("GetDictionaryValues for %s", normalizeEffectId.c_str());
     PluginParams pluginParams;
@@ -498,7 +1486,8 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
         PluginParams{
             .effectName = normalizeEffectId,
             .params     = json::object(),
-        }
+        },
+        true
     );
 
     csl(" effectName: %s, params: %s", pluginParams.effectName.c_str(),
@@ -523,9 +1512,78 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
 
     bool isModalOpened = true;
 
+    // Merges a batch of patches into the params, normalizes them and rebuilds the view
+    auto applyParamsPatch = [&pluginParams, &currentParams, &nodeTree, &modal,
+                             this](const json& patch) {
+      currentParams.merge_patch(patch);
+      pluginParams.params = currentParams;
+
+      // Normalize params
+      {
+        const pipeline::typed_message::SchemaKeys* keys =
+            this->paramKeysOf(pluginParams.effectName);
+        std::vector<uint8_t> paramsMessage =
+            pipeline::typed_message::encode(currentParams, keys);
+        ai_deno::TypedMessage paramsArg = lendMessage(paramsMessage);
+
+        ai_deno::TypedFunctionResult* result = ai_deno::edit_live_effect_parameters_typed(
+            this->aiDenoMain, pluginParams.effectName.c_str(), &paramsArg
+        );
+
+        std::optional<json> normalized =
+            result->success
+                ? pipeline::typed_message::decode(result->data, result->byte_length, keys)
+                : std::nullopt;
+        ai_deno::dispose_typed_function_result(result);
+
+        if (normalized) {
+          currentParams = std::move(*normalized);
+        } else {
+          csl("Failed to normalize live effect parameters: %s",
+              pluginParams.effectName.c_str());
+        }
+      }
+
+      // rerender tree
+      {
+        ai_deno::JsonFunctionResult* result = ai_deno::get_live_effect_view_tree(
+            this->aiDenoMain, pluginParams.effectName.c_str(),
+            currentParams.dump().c_str()
+        );
+
+        if (!result->success) {
+          std::cerr << "Failed to get live effect view tree" << std::endl;
+        } else {
+          nodeTree = json::parse(result->json);
+          modal->updateRenderTree(nodeTree);
+        }
+
+        ai_deno::dispose_json_function_result(result);
+      }
+    };
+
+    auto renderPreview = [&pluginParams, &isModalOpened, &error, &message, this]() {
+      if (isModalOpened) this->isInPreview = true;
+
+      this->supersedePreviewRenders();
+      error = this->putParamsToDictionaly(message->parameters, pluginParams);
+      CHKERR();
+      error = sAILiveEffect->UpdateParameters(message->context);
+      CHKERR();
+    };
+
+    // Slider drags patch params every frame; batches them so normalization and
+    // preview renders don't run at input rate
+    pipeline::ParamUpdateScheduler paramUpdates(
+        {.settleInterval = this->previewSettleInterval}, applyParamsPatch, renderPreview
+    );
+
     ImGuiModal::OnFireEventCallback modalOnFireEventCallback =
-        [this, &pluginParams, &currentParams, &error, &message, &nodeTree,
-         &modal](json event) {
+        [this, &pluginParams, &currentParams, &error, &message, &nodeTree, &modal,
+         &paramUpdates](json event) {
+          // Events must see the edits made before them
+          paramUpdates.flush(false);
+
           csl("onFireEvent: %s state: %s", event.dump().c_str(),
               currentParams.dump().c_str());
 
@@ -559,6 +1617,7 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
             csl("updated");
 
             // Rerender preview
+            this->supersedePreviewRenders();
             error = this->putParamsToDictionaly(message->parameters, pluginParams);
             CHKERR();
             error = sAILiveEffect->UpdateParameters(message->context);
@@ -568,57 +1627,17 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
           }
         };
 
-    ImGuiModal::OnChangeCallback modalOnChangeCallback =
-        [&pluginParams, &isModalOpened, &error, &message, &currentParams, &nodeTree,
-         &modal, this](json patch) {
-          if (isModalOpened) this->isInPreview = true;
-          csl("onChange:", patch.dump().c_str());
-
-          currentParams.merge_patch(patch);
-          pluginParams.params = currentParams;
-
-          // Normalize params
-          {
-            ai_deno::JsonFunctionResult* result = ai_deno::edit_live_effect_parameters(
-                this->aiDenoMain, pluginParams.effectName.c_str(),
-                currentParams.dump().c_str()
-            );
-
-            if (!result->success) {
-              csl("Failed to normalize live effect parameters: %s",
-                  pluginParams.effectName.c_str());
-            }
-
-            currentParams = json::parse(result->json);
-
-            ai_deno::dispose_json_function_result(result);
-          }
-
-          // rerender tree
-          {
-            ai_deno::JsonFunctionResult* result = ai_deno::get_live_effect_view_tree(
-                this->aiDenoMain, pluginParams.effectName.c_str(),
-                currentParams.dump().c_str()
-            );
-
-            if (!result->success) {
-              std::cerr << "Failed to get live effect view tree" << std::endl;
-            } else {
-              nodeTree = json::parse(result->json);
-              modal->updateRenderTree(nodeTree);
-            }
-
-            ai_deno::dispose_json_function_result(result);
+    ImGuiModal::OnChangeCallback modalOnChangeCallback = [&paramUpdates](json patch) {
+      csl("onChange: %s", patch.dump().c_str());
+      paramUpdates.push(patch);
+    };
 
-            // Rerender preview
-            error = this->putParamsToDictionaly(message->parameters, pluginParams);
-            CHKERR();
-            error = sAILiveEffect->UpdateParameters(message->context);
-            CHKERR();
-          }
-        };
+    ImGuiModal::OnFrameCallback modalOnFrameCallback = [&paramUpdates]() {
+      paramUpdates.tick();
+    };
 
-    modalOnChangeCallback(initialParams);
+    paramUpdates.push(initialParams);
+    paramUpdates.flush(true);
 
     PluginPreferences pref = this->getPreferences(&error);
     CHKERR();
@@ -632,16 +1651,40 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
       lastPosition = pos;
     }
 
-    isModalOpened         = true;
-    this->editingEffectId = normalizeEffectId;
+    isModalOpened = true;
+    {
+      std::lock_guard<std::mutex> lock(editingMutex);
+      this->editingEffectId = normalizeEffectId;
+    }
 
     csl("Opening modal: pos (%d, %d); %s", std::get<0>(lastPosition),
         std::get<1>(lastPosition), nodeTree.dump().c_str());
     ModalStatusCode dialogResult = modal->runModal(
         nodeTree, effectTitle, &lastPosition, modalOnChangeCallback,
-        modalOnFireEventCallback
+        modalOnFireEventCallback, modalOnFrameCallback
     );
 
+    // The last edits may still be waiting for their batch
+    if (dialogResult == ModalStatusCode::OK) {
+      paramUpdates.flush(false);
+    } else {
+      paramUpdates.discard();
+    }
+
+    {
+      const pipeline::ParamUpdateStats& stats = paramUpdates.getStats();
+      csl("Param updates: %zu patches (%zu coalesced) in %zu batches, %zu renders (%zu "
+          "dropped), max latency apply %lldms render %lldms",
+          stats.patches, stats.coalescedPatches, stats.batches, stats.renders,
+          stats.droppedRenders,
+          (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+              stats.maxApplyLatency
+          ).count(),
+          (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+              stats.maxRenderLatency
+          ).count());
+    }
+
     pref.windowPosition    = AIPoint{};
     pref.windowPosition->h = std::get<0>(lastPosition);
     pref.windowPosition->v = std::get<1>(lastPosition);
@@ -650,6 +1693,11 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
         pref.windowPosition->v, std::get<0>(lastPosition), std::get<1>(lastPosition));
     CHKERR();
 
+    // Previews may have rendered at reduced resolution, the final render must not
+    const bool previewed = this->isInPreview;
+    this->isInPreview    = false;
+    this->supersedePreviewRenders();
+
     if (dialogResult == ModalStatusCode::OK) {
       csl("Put params to dictionary");
       error = this->putParamsToDictionaly(message->parameters, pluginParams);
@@ -657,7 +1705,7 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
 
       error = sAILiveEffect->UpdateParameters(message->context);
       CHKERR();
-    } else if (this->isInPreview) {
+    } else if (previewed) {
       if (message->isNewInstance) {
         // Remove effect if canceled in first edit
         error = sAIUndo->UndoChanges();
@@ -678,8 +1726,11 @@ ASErr HelloWorldPlugin::EditLiveEffectParameters(AILiveEffectEditParamMessage* m
     cse("Error: %s", ex.what());
   } catch (...) { error = kCantHappenErr; }
 
-  this->isInPreview     = false;
-  this->editingEffectId = std::nullopt;
+  this->isInPreview = false;
+  {
+    std::lock_guard<std::mutex> lock(editingMutex);
+    this->editingEffectId = std::nullopt;
+  }
 
   return error;
 }
@@ -718,11 +1769,13 @@ ASErr HelloWorldPlugin::LiveEffectAdjustColors(AILiveEffectAdjustColorsMessage*
   };
 
   PluginParams params;
-  error = this->getDictionaryValues(message->parameters, &params, defaultPluginParams);
+  error = this->getDictionaryValues(
+      message->parameters, &params, defaultPluginParams, true
+  );
   CHKERR();
 
   ai_deno::JsonFunctionResult* result = ai_deno::live_effect_adjust_colors(
-      aiDenoMain, params.effectName.c_str(), params.params.dump().c_str(),
+      aiDenoMain, params.effectName.c_str(), params.serializedParams().c_str(),
       (void*)&adjustColorCallback
   );
 
@@ -764,31 +1817,37 @@ ASErr HelloWorldPlugin::LiveEffectScaleParameters(
       PluginParams{
           .effectName = "__FAILED_TO_GET_EFFECT_NAME__",
           .params     = json(),
-      }
+      },
+      true
   );
 
   // Scale the parameters
-  ai_deno::JsonFunctionResult* result = ai_deno::live_effect_scale_parameters(
-      aiDenoMain, params.effectName.c_str(), params.params.dump().c_str(), scale
+  std::vector<uint8_t> paramsMessage =
+      pipeline::typed_message::encode(params.params, paramKeysOf(params.effectName));
+  ai_deno::TypedMessage paramsArg = lendMessage(paramsMessage);
+
+  ai_deno::TypedFunctionResult* result = ai_deno::live_effect_scale_parameters_typed(
+      aiDenoMain, params.effectName.c_str(), &paramsArg, scale
   );
 
-  if (!result->success) {
+  std::optional<json> response =
+      result->success ? pipeline::typed_message::decode(result->data, result->byte_length)
+                      : std::nullopt;
+  ai_deno::dispose_typed_function_result(result);
+
+  if (!response) {
     csl("Failed to scale live effect parameters");
     return kCantHappenErr;
   }
 
-  json response = json::parse(result->json);
-
-  if (response["hasChanged"].get<bool>()) {
-    params.params = response["params"];
+  if ((*response)["hasChanged"].get<bool>()) {
+    params.params = (*response)["params"];
     error         = this->putParamsToDictionaly(parameters, params);
     CHKERR();
 
     message->scaledParams = true;
   }
 
-  ai_deno::dispose_json_function_result(result);
-
   return error;
 }
 
@@ -839,31 +1898,101 @@ ASErr HelloWorldPlugin::LiveEffectInterpolate(AILiveEffectInterpParamMessage* me
   this->putParamsToDictionaly(message->outParams, outParams);
 }
 
+/** Stamp of the binary params: xxh64 of the JSON entry's UTF-16 units */
+static uint64_t paramsJsonStamp(const ai::UnicodeString& paramsJson) {
+  std::basic_string<ASUnicode> units = paramsJson.as_ASUnicode();
+  return pipeline::xxh64(units.data(), units.size() * sizeof(ASUnicode));
+}
+
 ASErr HelloWorldPlugin::getDictionaryValues(
     const AILiveEffectParameters& dict,
     PluginParams*                 params,
-    PluginParams                  defaultParams
+    PluginParams                  defaultParams,
+    bool                          reencodeStale
 ) {
   ASErr error = kNoErr;
 
-  std::string effectName = suai::str::toUtf8StdString(
-      suai::dict::getUnicodeString(
-          dict, AI_DENO_DICT_EFFECT_NAME,
-          suai::str::toAiUnicodeStringUtf8(defaultParams.effectName), &error
-      )
+  auto assign = [params](const pipeline::ParsedParams& parsed) {
+    params->effectName = parsed.effectName;
+    params->params     = parsed.params;
+    params->paramsJson = parsed.paramsJson;
+    params->paramsHash = parsed.paramsHash;
+  };
+
+  // Missing entries read as empty, defaults are only converted when needed
+  ai::UnicodeString effectName = suai::dict::getUnicodeString(
+      dict, AI_DENO_DICT_EFFECT_NAME, ai::UnicodeString(), &error
   );
   CHKERR();
 
-  std::string paramsJson = suai::str::toUtf8StdString(
-      suai::dict::getUnicodeString(
-          dict, AI_DENO_DICT_PARAMS,
-          suai::str::toAiUnicodeStringUtf8(defaultParams.params.dump()), &error
-      )
-  );
+  // The JSON text is the source of truth, the binary params only save parsing it
+  ai::UnicodeString paramsJson =
+      suai::dict::getUnicodeString(dict, AI_DENO_DICT_PARAMS, ai::UnicodeString(), &error);
+  CHKERR();
+
+  // Fresh dictionaries differ only by the caller's defaults, not worth caching
+  if (effectName.empty() || paramsJson.empty()) {
+    assign(pipeline::ParsedParams::parse(
+        effectName.empty() ? defaultParams.effectName
+                           : suai::str::toUtf8StdString(effectName),
+        paramsJson.empty() ? defaultParams.params.dump()
+                           : suai::str::toUtf8StdString(paramsJson)
+    ));
+    return error;
+  }
+
+  // Hashing the raw UTF-16 is far cheaper than converting and parsing it, and
+  // unchanged dictionaries are read on every redraw
+  std::basic_string<ASUnicode> nameUnits = effectName.as_ASUnicode();
+  uint64_t                     nameHash =
+      pipeline::xxh64(nameUnits.data(), nameUnits.size() * sizeof(ASUnicode));
+  uint64_t stamp       = paramsJsonStamp(paramsJson);
+  uint64_t contentHash = pipeline::xxh64(&stamp, sizeof(stamp), nameHash);
+
+  std::shared_ptr<const pipeline::ParsedParams> parsed =
+      paramsCache.find(dict, contentHash);
+  if (parsed) {
+    assign(*parsed);
+    return error;
+  }
+
+  std::optional<std::vector<uint8_t>> paramsCbor =
+      suai::dict::getBinary(dict, AI_DENO_DICT_PARAMS_CBOR, &error);
   CHKERR();
 
-  params->effectName = effectName;
-  params->params     = json::parse(paramsJson);
+  // Missing, of an older version, or left behind by a build that only wrote the
+  // JSON text, which changed it since
+  std::optional<json> decoded =
+      paramsCbor
+          ? pipeline::params_codec::decode(paramsCbor->data(), paramsCbor->size(), stamp)
+          : std::nullopt;
+
+  if (decoded) {
+    parsed = paramsCache.insert(
+        dict, contentHash,
+        pipeline::ParsedParams::fromJson(
+            suai::str::toUtf8StdString(effectName), std::move(*decoded)
+        )
+    );
+  } else {
+    parsed = paramsCache.insert(
+        dict, contentHash,
+        pipeline::ParsedParams::parse(
+            suai::str::toUtf8StdString(effectName), suai::str::toUtf8StdString(paramsJson)
+        )
+    );
+
+    // Renders must not write the dictionary they render, so they only fall back
+    if (reencodeStale) {
+      error = suai::dict::setBinary(
+          dict, AI_DENO_DICT_PARAMS_CBOR,
+          pipeline::params_codec::encode(parsed->params, stamp)
+      );
+      CHKERR();
+    }
+  }
+
+  assign(*parsed);
 
   return error;
 }
@@ -874,12 +2003,22 @@ ASErr HelloWorldPlugin::putParamsToDictionaly(
 ) {
   ASErr error = kNoErr;
 
-  suai::dict::setUnicodeString(
+  ai::UnicodeString paramsJson = suai::str::toAiUnicodeStringUtf8(params.params.dump());
+
+  error = suai::dict::setUnicodeString(
       dict, AI_DENO_DICT_EFFECT_NAME, suai::str::toAiUnicodeStringUtf8(params.effectName)
   );
-  suai::dict::setUnicodeString(
-      dict, AI_DENO_DICT_PARAMS, suai::str::toAiUnicodeStringUtf8(params.params.dump())
+  CHKERR();
+  // Written for builds that only read the JSON text, and stamped into the binary
+  // params so readers can tell whether both still agree
+  error = suai::dict::setUnicodeString(dict, AI_DENO_DICT_PARAMS, paramsJson);
+  CHKERR();
+  error = suai::dict::setBinary(
+      dict, AI_DENO_DICT_PARAMS_CBOR,
+      pipeline::params_codec::encode(params.params, paramsJsonStamp(paramsJson))
   );
+  CHKERR();
+  paramsCache.invalidate(dict);
 
   return error;
 }
@@ -6,6 +6,8 @@
 #include <AIDictionary.h>
 #include <AIRasterize.h>
 #include <IllustratorSDK.h>
+#include <atomic>
+#include <mutex>
 #include "./consts.h"
 #include "./libs/format.h"
 #include "Plugin.hpp"
@@ -14,11 +16,36 @@
 #include "libai_deno.h"
 
 #include "./bridging.h"
+#include "./pipeline/AlphaBounds.h"
+#include "./pipeline/DpiResolver.h"
+#include "./pipeline/EffectRegistry.h"
+#include "./pipeline/EffectStats.h"
+#include "./pipeline/HaloCache.h"
+#include "./pipeline/ParamsCache.h"
+#include "./pipeline/ParamsCodec.h"
+#include "./pipeline/ParamUpdateScheduler.h"
+#include "./pipeline/PixelFormat.h"
+#include "./pipeline/PreviewScale.h"
+#include "./pipeline/RenderTicket.h"
+#include "./pipeline/ResultCache.h"
+#include "./pipeline/RuntimePool.h"
+#include "./pipeline/TileBufferPool.h"
+#include "./pipeline/TilePlan.h"
+#include "./pipeline/Trace.h"
 #include "./views/ImgUIEditModal.h"
 #include "debugHelper.h"
 #include "super-illustrator.h"
 
-#define kMaxEffects 1000
+// Default core size of tiled execution, in pixels per side
+#define kDefaultTileSize 2048
+// WebGPU's default maxTextureDimension2D; a tile plus its halo must fit in it
+#define kMaxTileSide 8192
+// Pixels an interactive preview renders at most (4 megapixels)
+#define kDefaultPreviewPixelBudget (4 * 1024 * 1024)
+// Milliseconds between two preview renders while parameters are being edited
+#define kDefaultPreviewSettleMs 100
+// Runtimes rendering live effects in parallel at most, also capped by the core count
+#define kDefaultRuntimePoolSize 4
 
 using json = nlohmann::json;
 
@@ -37,25 +64,149 @@ class HelloWorldPlugin : public Plugin {
   ASErr ShutdownPlugin(SPInterfaceMessage*);
 
  private:
-  bool               pluginStarted = false;
-  AILiveEffectHandle fEffects[kMaxEffects];
-  ASInt32            fNumEffects;
+  bool                     pluginStarted = false;
+  /** Every effect added in InitLiveEffect, by its AILiveEffectHandle */
+  pipeline::EffectRegistry effectRegistry;
+
+  /**
+   * Runtimes GoLiveEffect leases, each on an executor thread of its own. Empty when
+   * parallel execution is off; GoLiveEffect then runs on `aiDenoMain`.
+   */
+  pipeline::RuntimePool<ai_deno::OpaqueAiMain> runtimePool;
 
   ai_deno::OpaqueAiMain      aiDenoMain;
+  /** Guards `editingEffectId`, GoLiveEffect may read it from another thread */
+  std::mutex                 editingMutex;
   std::optional<std::string> editingEffectId;
-  bool                       isInPreview;
+  std::atomic<bool>          isInPreview;
+  /**
+   * Bumped on every parameter change in the modal. Preview renders of an older
+   * generation are cancelled and never written back. 0 marks uncancellable renders.
+   */
+  std::atomic<uint64_t>      previewGeneration{1};
+
+  pipeline::DpiResolver    dpiResolver;
+  pipeline::TileBufferPool tileBufferPool;
+  pipeline::ResultCache    resultCache;
+  /** Parsed live effect dictionaries, see getDictionaryValues */
+  pipeline::ParamsCache    paramsCache;
+  pipeline::HaloCache      haloCache;
+  AINotifierHandle         fDocumentClosedNotifier      = nullptr;
+  /** These two keep the DPI resolver's key of the current view up to date */
+  AINotifierHandle         fDocumentChangedNotifier     = nullptr;
+  AINotifierHandle         fDocumentViewChangedNotifier = nullptr;
+  AIMenuItemHandle         fExportStatsMenuItem         = nullptr;
+  /** Only added while tracing, see AI_DENO_ENV_TRACE */
+  AIMenuItemHandle         fExportTraceMenuItem         = nullptr;
+  /** Host spans that started before this were in an earlier trace export */
+  uint64_t                 traceExportedUntilNs         = 0;
+
+  int    tileSize           = kDefaultTileSize;
+  /** Pixels a preview renders at most, 0 renders previews at full resolution */
+  size_t previewPixelBudget = kDefaultPreviewPixelBudget;
+  /** Minimum time between preview renders requested by the modal */
+  std::chrono::milliseconds previewSettleInterval{kDefaultPreviewSettleMs};
 
   ASErr Message(char* caller, char* selector, void* message);
+  ASErr Notify(AINotifierMessage* message);
 
   ASErr InitMenus(SPInterfaceMessage*);
+  ASErr GoMenuItem(AIMenuMessage*);
   ASErr InitLiveEffect(SPInterfaceMessage*);
   ASErr GoLiveEffect(AILiveEffectGoMessage*);
+  /** GoLiveEffect itself, with `call` measuring it for the effect stats */
+  ASErr renderLiveEffect(AILiveEffectGoMessage*, pipeline::EffectCall& call);
   ASErr LiveEffectScaleParameters(AILiveEffectScaleParamMessage*);
   ASErr LiveEffectAdjustColors(AILiveEffectAdjustColorsMessage*);
   ASErr LiveEffectInterpolate(AILiveEffectInterpParamMessage*);
   ASErr EditLiveEffectParameters(AILiveEffectEditParamMessage*);
 
-  ASErr getDictionaryValues(const AILiveEffectParameters&, PluginParams*, PluginParams);
+  int probeDpi(AIArtSet artSet, AIRealRect bounds, AIArtHandle art, ASErr* error);
+
+  /** Runs goLiveEffect on `worker`, or on `aiDenoMain` when it's null */
+  ai_deno::GoLiveEffectResult* runGoLiveEffect(
+      ai_deno::OpaqueAiMain        worker,
+      const PluginParams&          params,
+      const json&                  env,
+      ai_deno::ImageDataPayload*   input,
+      uint64_t                     generation
+  );
+  /** Queues goLiveEffect like `runGoLiveEffect`, without waiting for it */
+  pipeline::RenderTicket submitGoLiveEffect(
+      ai_deno::OpaqueAiMain        worker,
+      const PluginParams&          params,
+      const json&                  env,
+      ai_deno::ImageDataPayload*   input,
+      uint64_t                     generation
+  );
+  bool isPreviewing(const std::string& effectId);
+  /** Queue and timing counters of a runtime's executor thread, to the console */
+  void logRuntimeMetrics(const char* label, ai_deno::OpaqueAiMain runtime);
+  /**
+   * Queues the initialization of effects (a JSON array of ids, nullptr for all)
+   * on every pooled runtime, and on `aiDenoMain` with `onMain`, without waiting
+   * for it. A runtime's later calls queue behind it.
+   */
+  void warmUpEffects(const char* effectIdsJson, bool onMain);
+  /**
+   * Alerts the effect init failures queued since the last call. Main thread only:
+   * inits run inside renders, which never alert themselves.
+   */
+  void alertEffectInitFailures();
+  /**
+   * Records the FFI, JS, GPU and Readback spans of a go_live_effect call made at
+   * `calledAtNs`
+   */
+  void recordRenderSpans(uint64_t calledAtNs, const ai_deno::GoLiveEffectResult* result);
+  /** Per stage totals of the recorded spans, to the console */
+  void logTraceSummary();
+  /**
+   * Writes the recorded spans, the runtime's included, as a Chrome trace under
+   * ~/.ai-deno/traces. Each export holds the spans since the previous one.
+   */
+  void dumpChromeTrace();
+  /** Per effect stats as JSON and CSV under ~/.ai-deno/stats */
+  void writeEffectStatsReport();
+
+  /** Schema keys of an effect's params, null for effects not in the registry */
+  const pipeline::typed_message::SchemaKeys* paramKeysOf(const std::string& effectId) const {
+    const pipeline::EffectDescriptor* effect = effectRegistry.findById(effectId);
+    return effect != nullptr ? &effect->paramKeys : nullptr;
+  }
+
+  /** Asks a pooled runtime only when haloCache doesn't know the halo yet */
+  std::optional<int> getTilingHalo(const PluginParams& params, const json& env);
+  ASErr goLiveEffectTiled(
+      const PluginParams&          params,
+      const json&                  env,
+      pipeline::PixelFormat        pixelFormat,
+      AIArtHandle                  sourceRaster,
+      AIArtHandle                  placement,
+      int                          halo,
+      ai_deno::OpaqueAiMain        worker,
+      uint64_t                     generation,
+      AIArtHandle*                 outArt
+  );
+
+  /** A newer preview generation superseded the render of `generation` */
+  bool isStaleRender(uint64_t generation) const {
+    return generation != 0 && generation != previewGeneration.load();
+  }
+  /** Starts a new preview generation, cancelling renders of the previous ones */
+  void supersedePreviewRenders() {
+    ai_deno::cancel_live_effect_renders(++previewGeneration);
+  }
+
+  /**
+   * `reencodeStale` rewrites binary params that no longer match the JSON text.
+   * Only for callers allowed to modify the dictionary, never renders.
+   */
+  ASErr getDictionaryValues(
+      const AILiveEffectParameters&,
+      PluginParams*,
+      PluginParams,
+      bool reencodeStale = false
+  );
   ASErr putParamsToDictionaly(const AILiveEffectParameters& dict, PluginParams);
 
   PluginPreferences getPreferences(ASErr* error);
@@ -21,6 +21,8 @@ extern "C" AILayerSuite*         sAILayer         = nullptr;
 extern "C" AIPreferenceSuite*    sAIPref          = nullptr;
 extern "C" AIMaskSuite*          sAIMask          = nullptr;
 extern "C" AIGradientSuite*      sAIGradient      = nullptr;
+extern "C" AIDocumentViewSuite*  sAIDocumentView  = nullptr;
+extern "C" AINotifierSuite*      sAINotifier      = nullptr;
 
 // Import suites
 ImportSuite gImportSuites[] = {
@@ -42,5 +44,7 @@ ImportSuite gImportSuites[] = {
     {kAIPreferenceSuite, kAIPreferenceSuiteVersion, &sAIPref},
     {kAIMaskSuite, kAIMaskSuiteVersion, &sAIMask},
     {kAIGradientSuite, kAIGradientSuiteVersion, &sAIGradient},
+    {kAIDocumentViewSuite, kAIDocumentViewSuiteVersion, &sAIDocumentView},
+    {kAINotifierSuite, kAINotifierSuiteVersion, &sAINotifier},
     {nil, 0, nil}
 };
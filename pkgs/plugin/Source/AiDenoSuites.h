@@ -2,7 +2,9 @@
 #define __HelloWorldSuites_H__
 
 #include <AIBlock.h>
+#include <AIDocumentView.h>
 #include <AIGradient.h>
+#include <AINotifier.h>
 #include <AIRasterize.h>
 #include "IllustratorSDK.h"
 #include "Suites.hpp"
@@ -27,5 +29,7 @@ extern "C" AILayerSuite*         sAILayer;
 extern "C" AIPreferenceSuite*    sAIPref;
 extern "C" AIMaskSuite*          sAIMask;
 extern "C" AIGradientSuite*      sAIGradient;
+extern "C" AIDocumentViewSuite*  sAIDocumentView;
+extern "C" AINotifierSuite*      sAINotifier;
 
 #endif
@@ -3,6 +3,7 @@
 #include <functional>
 #include <iostream>
 
+#include "./pipeline/EffectStats.h"
 #include "./super-illustrator.h"
 #include "IllustratorSDK.h"
 
@@ -13,8 +14,12 @@ using AdjustColorCallbackLambda = std::function<const char*(const char*)>;
 
 //   void        ai_deno_alert(const char* message);
 //   const char* ai_deno_get_user_locale();
+//   const char* ai_deno_get_effect_stats(const char* effectId);
 // }
 
+// ai-deno calls these on the thread blocked in the ai_deno call they belong to,
+// never on a runtime's executor thread. `ai_deno_get_user_locale` is asked once
+// per runtime, by the thread that starts it.
 extern "C" {
   const char* ai_deno_trampoline_adjust_color_callback(void* ptr, const char* color) {
     auto* lambda_ptr = static_cast<AdjustColorCallbackLambda*>(ptr);
@@ -33,4 +38,12 @@ extern "C" {
     const char* localeStr = suai::str::strdup(locale.as_UTF8().c_str());
     return localeStr;
   }
+
+  /** Stats of `effectId` as JSON, null for unknown effects. The caller frees it. */
+  const char* ai_deno_get_effect_stats(const char* effectId) {
+    pipeline::EffectStats* stats = pipeline::effectStats().find(effectId);
+    if (stats == nullptr) return nullptr;
+
+    return suai::str::strdup(nlohmann::json(stats->snapshot()).dump());
+  }
 }
@@ -11,6 +11,37 @@ const std::string EFFECT_PREFIX = "la.hanak.csxs.ai-deno.guest.";
 
 const std::string AI_DENO_DICT_EFFECT_NAME = "AiDeno.effectId";
 const std::string AI_DENO_DICT_PARAMS      = "AiDeno.params";
+/**
+ * Binary params (pipeline/ParamsCodec.h), used instead of parsing
+ * `AI_DENO_DICT_PARAMS` while their stamp matches that JSON text. Both are written
+ * until builds reading only the JSON text are gone.
+ */
+const std::string AI_DENO_DICT_PARAMS_CBOR = "AiDeno.paramsCbor";
+
+/** Overrides the tile buffer pool budget (in MiB) when set */
+const std::string AI_DENO_ENV_TILE_POOL_BUDGET_MB = "AI_DENO_TILE_POOL_BUDGET_MB";
+/** Overrides the live effect result cache budget (in MiB) when set */
+const std::string AI_DENO_ENV_RESULT_CACHE_MB = "AI_DENO_RESULT_CACHE_MB";
+/** Overrides the on-disk result cache budget (in MiB) when set, 0 disables it */
+const std::string AI_DENO_ENV_DISK_CACHE_MB = "AI_DENO_DISK_CACHE_MB";
+/** Overrides the pixel budget of previews (in megapixels) when set, 0 disables it */
+const std::string AI_DENO_ENV_PREVIEW_MEGAPIXELS = "AI_DENO_PREVIEW_MEGAPIXELS";
+/** Overrides the minimum interval between modal preview renders (in ms) when set */
+const std::string AI_DENO_ENV_PREVIEW_SETTLE_MS = "AI_DENO_PREVIEW_SETTLE_MS";
+/** Overrides the core size (pixels per side) of tiled execution when set */
+const std::string AI_DENO_ENV_TILE_SIZE = "AI_DENO_TILE_SIZE";
+/** Overrides the number of runtimes rendering in parallel when set, 0 renders serially */
+const std::string AI_DENO_ENV_RUNTIME_POOL_SIZE = "AI_DENO_RUNTIME_POOL_SIZE";
+/**
+ * Effects to initialize right after startup instead of on first use when set,
+ * comma separated ids or * for all of them
+ */
+const std::string AI_DENO_ENV_WARM_UP_EFFECTS = "AI_DENO_WARM_UP_EFFECTS";
+/**
+ * Records pipeline stage timings (pipeline/Trace.h) when set to 1, exported as a
+ * Chrome trace from the Window > Utilities menu and at shutdown
+ */
+const std::string AI_DENO_ENV_TRACE = "AI_DENO_TRACE";
 
 const std::string AI_DENO_PREF_PREFIX          = "la.hanak.csxs.ai-deno.pref.";
 const std::string AI_DENO_PREF_WINDOW_POSITION = "window-position";
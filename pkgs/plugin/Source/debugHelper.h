@@ -3,8 +3,6 @@
 #include <iostream>
 #include <sstream>
 #include <string>
-#include <stack>
-#include <chrono>
 #include <vector>
 #include "./libs/format.h"
 #include "IllustratorSDK.h"
@@ -75,41 +73,6 @@ void csb(const char* label, const char* value) {
             << std::endl;
 }
 
-class dbg__Measuring {
- public:
-  const char* label;
-
-  dbg__Measuring(const char* label = nullptr) : label(label) {
-    start = std::chrono::system_clock::now();
-  }
-
-  double elapsed() {
-    end = std::chrono::system_clock::now();
-    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-  }
-
- private:
-  std::chrono::system_clock::time_point start, end;
-};
-
-std::stack<dbg__Measuring> dbg_cstCurrent;
-
-void timeStart(const char* label) {
-  if (!AI_DENO_DEBUG) return;
-  auto m = new dbg__Measuring(label);
-  dbg_cstCurrent.push(*m);
-}
-
-void timeEnd() {
-  if (!AI_DENO_DEBUG) return;
-
-  dbg__Measuring* m = &dbg_cstCurrent.top();
-  dbg_cstCurrent.pop();
-  if (m == nullptr) return;
-
-  csl("%s Elapsed: %.2fms", m->label, m->elapsed());
-}
-
 // void print_PluginParams(const PluginParams* params) {
 //   if (!AI_DENO_DEBUG) return;
 //
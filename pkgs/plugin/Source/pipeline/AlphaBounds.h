@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+#include "./PixelKernels.h"
+#include "./TilePlan.h"
+
+namespace pipeline {
+  /**
+   * Tight rect around the pixels with a non-zero alpha of an ARGB raster, nullopt
+   * when it is fully transparent. Rows are only scanned as far as they can still
+   * widen the rect, so the cost follows the transparent margin rather than the
+   * raster size.
+   */
+  inline std::optional<PixelRect> alphaBounds(
+      const uint8_t* argb,
+      int32_t        width,
+      int32_t        height,
+      size_t         rowBytes
+  ) {
+    const PixelKernelTable& kernels = pixelKernels();
+    auto row = [&](int32_t y) { return argb + (size_t)y * rowBytes; };
+
+    int32_t top = 0;
+    while (top < height && kernels.firstVisibleArgb(row(top), width) == (size_t)width) {
+      top++;
+    }
+    if (top == height) return std::nullopt;
+
+    int32_t bottom = height;
+    while (kernels.endVisibleArgb(row(bottom - 1), width) == 0) bottom--;
+
+    PixelRect bounds = {.left = width, .top = top, .right = 0, .bottom = bottom};
+    for (int32_t y = top; y < bottom; y++) {
+      const uint8_t* line = row(y);
+
+      bounds.left = (int32_t)kernels.firstVisibleArgb(line, bounds.left);
+      if (bounds.right < width) {
+        size_t end = kernels.endVisibleArgb(
+            line + (size_t)bounds.right * 4, width - bounds.right
+        );
+        if (end > 0) bounds.right += (int32_t)end;
+      }
+    }
+
+    return bounds;
+  }
+
+  /** `rect` grown by `halo` on every side, clipped to the raster */
+  inline PixelRect inflateRect(
+      PixelRect rect,
+      int32_t   halo,
+      int32_t   width,
+      int32_t   height
+  ) {
+    halo = std::max(halo, (int32_t)0);
+    return {
+        .left   = std::max(rect.left - halo, (int32_t)0),
+        .top    = std::max(rect.top - halo, (int32_t)0),
+        .right  = std::min(rect.right + halo, width),
+        .bottom = std::min(rect.bottom + halo, height),
+    };
+  }
+
+  /** A crop pays for its two copies once it drops at least a quarter of the pixels */
+  inline bool worthTrimming(const PixelRect& rect, int32_t width, int32_t height) {
+    return rect.pixels() * 4 <= (size_t)width * height * 3;
+  }
+
+  /** Copies `rect` of a raster into a tightly packed buffer */
+  inline void copyRect(
+      const uint8_t*   src,
+      size_t           srcRowBytes,
+      const PixelRect& rect,
+      size_t           pixelBytes,
+      uint8_t*         dst
+  ) {
+    const size_t lineBytes = (size_t)rect.width() * pixelBytes;
+    for (int32_t y = 0; y < rect.height(); y++) {
+      std::memcpy(
+          dst + y * lineBytes,
+          src + (size_t)(rect.top + y) * srcRowBytes + (size_t)rect.left * pixelBytes,
+          lineBytes
+      );
+    }
+  }
+
+  /** Writes a tightly packed buffer back into `rect` of a raster */
+  inline void pasteRect(
+      const uint8_t*   src,
+      const PixelRect& rect,
+      size_t           pixelBytes,
+      uint8_t*         dst,
+      size_t           dstRowBytes
+  ) {
+    const size_t lineBytes = (size_t)rect.width() * pixelBytes;
+    for (int32_t y = 0; y < rect.height(); y++) {
+      std::memcpy(
+          dst + (size_t)(rect.top + y) * dstRowBytes + (size_t)rect.left * pixelBytes,
+          src + y * lineBytes, lineBytes
+      );
+    }
+  }
+}  // namespace pipeline
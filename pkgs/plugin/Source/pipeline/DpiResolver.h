@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+#include <AIDocument.h>
+#include <AIDocumentView.h>
+#include "IllustratorSDK.h"
+
+extern "C" AIDocumentSuite*     sAIDocument;
+extern "C" AIDocumentViewSuite* sAIDocumentView;
+
+namespace pipeline {
+  /**
+   * Identifies a rasterization context. Illustrator picks the effective
+   * resolution of `kRasterizeOptionsUseEffectsRes` from the document raster
+   * settings and (in some preview modes) the current view, so those are the
+   * only inputs the DPI depends on.
+   */
+  struct DpiKey {
+    AIDocumentHandle document           = nullptr;
+    /** View zoom quantized to 1/1000 to keep float noise out of the key */
+    ai::int32        zoomMilli          = 0;
+    /** Resolution of Document Raster Effects Settings */
+    AIReal           documentResolution = 0;
+
+    bool operator==(const DpiKey& other) const {
+      return document == other.document && zoomMilli == other.zoomMilli &&
+             documentResolution == other.documentResolution;
+    }
+  };
+
+  struct DpiKeyHash {
+    size_t operator()(const DpiKey& key) const {
+      size_t h = std::hash<void*>()((void*)key.document);
+      h ^= std::hash<ai::int32>()(key.zoomMilli) + 0x9e3779b9 + (h << 6) + (h >> 2);
+      h ^= std::hash<double>()((double)key.documentResolution) + 0x9e3779b9 + (h << 6) +
+           (h >> 2);
+      return h;
+    }
+  };
+
+  /**
+   * Resolves the DPI GoLiveEffect should rasterize at without a probe
+   * rasterization on every call.
+   *
+   * The first request for a context is answered by the probe (see
+   * `HelloWorldPlugin::probeDpi`) and learned here. Once a probe agrees with the
+   * document raster resolution, that document is analytic: its DPI is taken to
+   * be that resolution at any zoom, and zoom drops out of its lookups. Zoom only
+   * stays part of the key for documents whose probe disagreed (preview modes
+   * that follow the view). A changed raster setting is a new key either way.
+   *
+   * Which document and view a render belongs to:
+   * - Renders on the main thread (exports, scripts, documents out of view)
+   *   query the key per call (`renderKey`).
+   * - Renders on Illustrator's worker threads can't ask Illustrator. They use
+   *   the key snapshotted on the main thread by notifiers (`snapshotKey`).
+   *   This assumes worker renders only redraw the view in front, and that
+   *   switching documents or views sends a notifier before that redraw.
+   */
+  class DpiResolver {
+   public:
+    /** Asks Illustrator for the key of the current view. Main thread only. */
+    static DpiKey queryKey(ASErr* error = nullptr) {
+      ASErr  err = kNoErr;
+      DpiKey key;
+
+      err = sAIDocument->GetDocument(&key.document);
+      if (err != kNoErr) return setError(error, err, key);
+
+      AIReal zoom = 1;
+      err         = sAIDocumentView->GetDocumentViewZoom(nullptr, &zoom);
+      if (err != kNoErr) return setError(error, err, key);
+      key.zoomMilli = (ai::int32)std::lround(zoom * 1000);
+
+      AIRasterizeType       type;
+      AIRasterizeOptions    options;
+      AIReal                resolution = 0;
+      short                 antialiasing;
+      AIColorConvertOptions ccoptions;
+      AIBoolean             preserveSpotColors;
+      err = sAIDocument->GetDocumentRasterAttributes(
+          &type, &options, &resolution, &antialiasing, &ccoptions, &preserveSpotColors
+      );
+      if (err != kNoErr) return setError(error, err, key);
+      key.documentResolution = resolution;
+
+      if (error != nullptr) *error = kNoErr;
+      return key;
+    }
+
+    /**
+     * Takes the key worker thread renders use from now on. Main thread only, and
+     * the first call tells the resolver which thread that is.
+     */
+    void snapshotKey(ASErr* error = nullptr) {
+      DpiKey key = queryKey(error);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      current    = key;
+      mainThread = std::this_thread::get_id();
+    }
+
+    /** The last snapshot. Its document is null before the first one. */
+    DpiKey currentKey() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return current;
+    }
+
+    /** The key of the calling render, see the class comment */
+    DpiKey renderKey(ASErr* error = nullptr) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mainThread != std::this_thread::get_id()) return current;
+      }
+
+      DpiKey key = queryKey(error);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      current = key;
+      return key;
+    }
+
+    /** Returns the DPI for the context, or nullopt when a probe is required. */
+    std::optional<int> resolve(const DpiKey& key) {
+      if (key.document == nullptr || key.documentResolution <= 0) return std::nullopt;
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto analytic = analyticDocuments.find(key.document);
+      if (analytic != analyticDocuments.end() &&
+          analytic->second == key.documentResolution) {
+        hits++;
+        return analyticDpi(key);
+      }
+
+      auto it = cache.find(key);
+      if (it != cache.end()) {
+        hits++;
+        return it->second;
+      }
+
+      misses++;
+      return std::nullopt;
+    }
+
+    /** Records a probed DPI for the context */
+    void learn(const DpiKey& key, int probedDpi) {
+      if (key.document == nullptr || probedDpi <= 0) return;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (key.documentResolution > 0 && probedDpi == analyticDpi(key)) {
+        analyticDocuments[key.document] = key.documentResolution;
+      } else {
+        analyticDocuments.erase(key.document);
+        store(key, probedDpi);
+      }
+    }
+
+    void invalidate(AIDocumentHandle document) {
+      std::lock_guard<std::mutex> lock(mutex);
+      analyticDocuments.erase(document);
+      for (auto it = cache.begin(); it != cache.end();) {
+        if (it->first.document == document) {
+          it = cache.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    void clear() {
+      std::lock_guard<std::mutex> lock(mutex);
+      cache.clear();
+      analyticDocuments.clear();
+    }
+
+    size_t getHits() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return hits;
+    }
+    size_t getMisses() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return misses;
+    }
+
+   private:
+    static constexpr size_t kMaxEntries = 256;
+
+    // Parallel renders resolve concurrently
+    mutable std::mutex                           mutex;
+    /** DPI by full key, for documents that aren't analytic */
+    std::unordered_map<DpiKey, int, DpiKeyHash>  cache;
+    /** Analytic documents and the raster resolution a probe confirmed */
+    std::unordered_map<AIDocumentHandle, AIReal> analyticDocuments;
+    DpiKey                                       current;
+    std::thread::id                              mainThread;
+    size_t                                       hits   = 0;
+    size_t                                       misses = 0;
+
+    static int analyticDpi(const DpiKey& key) {
+      return (int)std::lround(key.documentResolution);
+    }
+
+    static DpiKey& setError(ASErr* error, ASErr err, DpiKey& key) {
+      if (error != nullptr) *error = err;
+      key.document = nullptr;
+      return key;
+    }
+
+    void store(const DpiKey& key, int dpi) {
+      // Zoom states are unbounded while the user scrolls the zoom slider
+      if (cache.size() >= kMaxEntries) cache.clear();
+      cache[key] = dpi;
+    }
+  };
+}  // namespace pipeline
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./EffectStats.h"
+#include "./PixelFormat.h"
+#include "./TypedMessage.h"
+#include "json.hpp"
+
+namespace pipeline {
+  /** What the plugin knows about one live effect, resolved once at startup */
+  struct EffectDescriptor {
+    /** Effect id without the plugin's name prefix, e.g. "blur" */
+    std::string               id;
+    /** Name Illustrator knows the effect by, the prefixed id */
+    std::string               name;
+    std::string               title;
+    int                       majorVersion = 0;
+    int                       minorVersion = 0;
+    /** "major.minor", part of the disk cache key */
+    std::string               version;
+    /** Declared `liveEffect.pixelFormat`, RGBA8 when absent */
+    PixelFormat               pixelFormat = PixelFormat::RGBA8;
+    /** Declares `liveEffect.tiling` */
+    bool                      tiling      = false;
+    /** `styleFilterFlags` the effect was added with */
+    int32_t                   flags       = 0;
+    /** Declared `paramSchema` */
+    nlohmann::json            paramSchema;
+    /** Keys of `paramSchema`, indexing the params of typed ai_deno calls */
+    typed_message::SchemaKeys paramKeys;
+    EffectStats*              stats       = nullptr;
+  };
+
+  /**
+   * Live effects by the handle Illustrator assigned to them, so a render finds
+   * its effect without asking Illustrator for the name and parsing it. Built
+   * once in InitLiveEffect and read-only afterwards, which lets render threads
+   * look up without locking. Descriptors stay at their address for the
+   * registry's lifetime.
+   */
+  class EffectRegistry {
+   public:
+    /** Adds `descriptor` under `handle`, replacing an effect of the same handle */
+    const EffectDescriptor* add(const void* handle, EffectDescriptor descriptor) {
+      descriptors.push_back(
+          std::make_unique<const EffectDescriptor>(std::move(descriptor))
+      );
+      const EffectDescriptor* added = descriptors.back().get();
+
+      byHandle[handle] = added;
+      byId[added->id]  = added;
+      return added;
+    }
+
+    const EffectDescriptor* find(const void* handle) const {
+      auto it = byHandle.find(handle);
+      return it == byHandle.end() ? nullptr : it->second;
+    }
+
+    const EffectDescriptor* findById(const std::string& id) const {
+      auto it = byId.find(id);
+      return it == byId.end() ? nullptr : it->second;
+    }
+
+    size_t size() const { return descriptors.size(); }
+
+   private:
+    std::vector<std::unique_ptr<const EffectDescriptor>>     descriptors;
+    std::unordered_map<const void*, const EffectDescriptor*> byHandle;
+    std::unordered_map<std::string, const EffectDescriptor*> byId;
+  };
+}  // namespace pipeline
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace pipeline {
+  /**
+   * Latency histogram in microseconds with 4 buckets per power of two, so a
+   * percentile is off by at most 25%. Recording is one relaxed increment.
+   */
+  class LatencyHistogram {
+   public:
+    static constexpr size_t kSubBuckets = 4;
+    /** Octaves up to 2^27us (~134s), slower calls land in the last bucket */
+    static constexpr size_t kBucketCount = kSubBuckets * 27;
+
+    void record(uint64_t us) {
+      buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Upper bound of the bucket holding the `q` quantile (0..1), 0 when empty */
+    uint64_t percentile(double q) const {
+      std::array<uint64_t, kBucketCount> counts;
+      uint64_t                           total = 0;
+      for (size_t i = 0; i < kBucketCount; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+      }
+      if (total == 0) return 0;
+
+      uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * total + 0.5));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < kBucketCount; i++) {
+        seen += counts[i];
+        if (seen >= rank) return upperBoundOf(i);
+      }
+      return upperBoundOf(kBucketCount - 1);
+    }
+
+    static size_t bucketOf(uint64_t us) {
+      if (us < kSubBuckets) return (size_t)us;
+
+      size_t octave = 63 - (size_t)std::countl_zero(us);
+      size_t sub    = (size_t)(us >> (octave - 2)) & (kSubBuckets - 1);
+      return std::min(kBucketCount - 1, (octave - 1) * kSubBuckets + sub);
+    }
+
+    static uint64_t upperBoundOf(size_t bucket) {
+      if (bucket < kSubBuckets) return bucket;
+
+      size_t octave = bucket / kSubBuckets + 1;
+      size_t sub    = bucket % kSubBuckets;
+      return ((kSubBuckets + sub + 1) << (octave - 2)) - 1;
+    }
+
+   private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets{};
+  };
+
+  struct EffectStatsSnapshot {
+    std::string effectId;
+    uint64_t    calls;
+    uint64_t    cacheHits;
+    uint64_t    failures;
+    /** Superseded by a newer preview before the result was written back */
+    uint64_t    cancelled;
+    /** Pixel bytes handed to the effect and returned by it, cache hits excluded */
+    uint64_t    bytesIn;
+    uint64_t    bytesOut;
+    uint64_t    p50Us;
+    uint64_t    p95Us;
+    uint64_t    p99Us;
+    uint64_t    maxUs;
+
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE(
+        EffectStatsSnapshot, effectId, calls, cacheHits, failures, cancelled, bytesIn,
+        bytesOut, p50Us, p95Us, p99Us, maxUs
+    )
+  };
+
+  /** Counters of one effect, updated by any render thread */
+  class EffectStats {
+   public:
+    enum class Outcome { Succeeded, Failed, Cancelled };
+
+    explicit EffectStats(std::string effectId) : effectId(std::move(effectId)) {}
+
+    void record(
+        Outcome  outcome,
+        uint64_t latencyUs,
+        bool     cacheHit,
+        uint64_t bytesIn,
+        uint64_t bytesOut
+    ) {
+      calls.fetch_add(1, std::memory_order_relaxed);
+      if (cacheHit) cacheHits.fetch_add(1, std::memory_order_relaxed);
+      if (outcome == Outcome::Failed) failures.fetch_add(1, std::memory_order_relaxed);
+      if (outcome == Outcome::Cancelled) cancelled.fetch_add(1, std::memory_order_relaxed);
+      this->bytesIn.fetch_add(bytesIn, std::memory_order_relaxed);
+      this->bytesOut.fetch_add(bytesOut, std::memory_order_relaxed);
+
+      latency.record(latencyUs);
+      uint64_t seen = maxUs.load(std::memory_order_relaxed);
+      while (latencyUs > seen &&
+             !maxUs.compare_exchange_weak(seen, latencyUs, std::memory_order_relaxed)) {
+      }
+    }
+
+    const std::string& getEffectId() const { return effectId; }
+
+    EffectStatsSnapshot snapshot() const {
+      return EffectStatsSnapshot{
+          .effectId  = effectId,
+          .calls     = calls.load(std::memory_order_relaxed),
+          .cacheHits = cacheHits.load(std::memory_order_relaxed),
+          .failures  = failures.load(std::memory_order_relaxed),
+          .cancelled = cancelled.load(std::memory_order_relaxed),
+          .bytesIn   = bytesIn.load(std::memory_order_relaxed),
+          .bytesOut  = bytesOut.load(std::memory_order_relaxed),
+          .p50Us     = latency.percentile(0.50),
+          .p95Us     = latency.percentile(0.95),
+          .p99Us     = latency.percentile(0.99),
+          .maxUs     = maxUs.load(std::memory_order_relaxed),
+      };
+    }
+
+   private:
+    const std::string     effectId;
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> cacheHits{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> cancelled{0};
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> maxUs{0};
+    LatencyHistogram      latency;
+  };
+
+  /**
+   * Stats of every registered effect. Effects are registered once at startup and
+   * never removed, so lookups walk a published prefix of a fixed array without
+   * locking; registering is the only write and must not race with itself.
+   */
+  class EffectStatsStore {
+   public:
+    static constexpr size_t kCapacity = 256;
+
+    /** Registers `effectId` unless it already is. False when the store is full. */
+    bool registerEffect(const std::string& effectId) {
+      if (find(effectId) != nullptr) return true;
+
+      size_t index = count.load(std::memory_order_relaxed);
+      if (index == kCapacity) return false;
+
+      slots[index] = std::make_unique<EffectStats>(effectId);
+      count.store(index + 1, std::memory_order_release);
+      return true;
+    }
+
+    EffectStats* find(const std::string& effectId) const {
+      size_t registered = count.load(std::memory_order_acquire);
+      for (size_t i = 0; i < registered; i++) {
+        if (slots[i]->getEffectId() == effectId) return slots[i].get();
+      }
+      return nullptr;
+    }
+
+    /** Effects that were called at least once */
+    std::vector<EffectStatsSnapshot> snapshot() const {
+      std::vector<EffectStatsSnapshot> result;
+
+      size_t registered = count.load(std::memory_order_acquire);
+      for (size_t i = 0; i < registered; i++) {
+        EffectStatsSnapshot stats = slots[i]->snapshot();
+        if (stats.calls > 0) result.push_back(std::move(stats));
+      }
+
+      std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+        return a.p95Us * a.calls > b.p95Us * b.calls;
+      });
+      return result;
+    }
+
+    static nlohmann::json toJson(const std::vector<EffectStatsSnapshot>& stats) {
+      return nlohmann::json(stats);
+    }
+
+    static std::string toCsv(const std::vector<EffectStatsSnapshot>& stats) {
+      std::ostringstream csv;
+      csv << "effectId,calls,cacheHits,failures,cancelled,bytesIn,bytesOut,p50Us,p95Us,"
+             "p99Us,maxUs\n";
+      for (const EffectStatsSnapshot& s : stats) {
+        csv << s.effectId << ',' << s.calls << ',' << s.cacheHits << ',' << s.failures
+            << ',' << s.cancelled << ',' << s.bytesIn << ',' << s.bytesOut << ','
+            << s.p50Us << ',' << s.p95Us << ',' << s.p99Us << ',' << s.maxUs << '\n';
+      }
+      return csv.str();
+    }
+
+   private:
+    std::array<std::unique_ptr<EffectStats>, kCapacity> slots;
+    std::atomic<size_t>                                 count{0};
+  };
+
+  /** Shared by the plugin and the runtime's `ai_deno_get_effect_stats` callback */
+  inline EffectStatsStore& effectStats() {
+    static EffectStatsStore instance;
+    return instance;
+  }
+
+  /**
+   * Measures one GoLiveEffect call from construction to `finish()`. A call that
+   * never finishes (an exception) counts as failed.
+   */
+  class EffectCall {
+   public:
+    EffectCall() : startedAt(std::chrono::steady_clock::now()) {}
+
+    EffectCall(const EffectCall&)            = delete;
+    EffectCall& operator=(const EffectCall&) = delete;
+
+    ~EffectCall() { finish(EffectStats::Outcome::Failed); }
+
+    /** The effect being rendered, calls before this are not recorded */
+    void bind(EffectStats* stats) { this->stats = stats; }
+
+    void cacheHit() { isCacheHit = true; }
+    void addBytesIn(uint64_t bytes) { bytesIn += bytes; }
+    void addBytesOut(uint64_t bytes) { bytesOut += bytes; }
+
+    void finish(EffectStats::Outcome outcome) {
+      if (stats == nullptr) return;
+
+      auto elapsed = std::chrono::steady_clock::now() - startedAt;
+      stats->record(
+          outcome,
+          (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(),
+          isCacheHit, bytesIn, bytesOut
+      );
+      stats = nullptr;
+    }
+
+   private:
+    std::chrono::steady_clock::time_point startedAt;
+    EffectStats*                          stats      = nullptr;
+    bool                                  isCacheHit = false;
+    uint64_t                              bytesIn    = 0;
+    uint64_t                              bytesOut   = 0;
+  };
+}  // namespace pipeline
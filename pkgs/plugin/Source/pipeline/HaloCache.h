@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "./Hash.h"
+
+namespace pipeline {
+  /** Everything an effect's tiling halo depends on */
+  struct HaloCacheKey {
+    std::string effectId;
+    /** Hash of the params JSON, as in ResultCacheKey */
+    uint64_t    paramsHash = 0;
+    /** Hash of the env JSON the halo function gets (dpi, preview scale) */
+    uint64_t    envHash    = 0;
+
+    bool operator==(const HaloCacheKey& other) const {
+      return paramsHash == other.paramsHash && envHash == other.envHash &&
+             effectId == other.effectId;
+    }
+  };
+
+  struct HaloCacheKeyHash {
+    size_t operator()(const HaloCacheKey& key) const {
+      return (size_t)xxh64(key.effectId, key.paramsHash ^ key.envHash);
+    }
+  };
+
+  /**
+   * Tiling halos as last answered by the runtime. Asking costs a queued JS call
+   * on a pooled runtime, while a halo only changes with the params or the env.
+   * Effects without tiling are kept too, as nullopt.
+   */
+  class HaloCache {
+   public:
+    /** Entries kept at most, the cache starts over once full */
+    static constexpr size_t kCapacity = 1024;
+
+    /** Nullopt on a miss, otherwise the cached halo (nullopt without tiling) */
+    std::optional<std::optional<int>> find(const HaloCacheKey& key) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto it = entries.find(key);
+      if (it == entries.end()) return std::nullopt;
+      return it->second;
+    }
+
+    void insert(HaloCacheKey key, std::optional<int> halo) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (entries.size() >= kCapacity && entries.find(key) == entries.end()) {
+        entries.clear();
+      }
+      entries[std::move(key)] = halo;
+    }
+
+   private:
+    std::mutex                                                           mutex;
+    std::unordered_map<HaloCacheKey, std::optional<int>, HaloCacheKeyHash> entries;
+  };
+}  // namespace pipeline
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace pipeline {
+  namespace xxh64_detail {
+    constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+    constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+    constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+    constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+    constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+    inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    inline uint64_t read64(const uint8_t* p) {
+      uint64_t v;
+      std::memcpy(&v, p, 8);
+      return v;
+    }
+
+    inline uint32_t read32(const uint8_t* p) {
+      uint32_t v;
+      std::memcpy(&v, p, 4);
+      return v;
+    }
+
+    inline uint64_t mix(uint64_t acc, uint64_t input) {
+      acc += input * kPrime2;
+      acc = rotl(acc, 31);
+      return acc * kPrime1;
+    }
+
+    inline uint64_t merge(uint64_t acc, uint64_t value) {
+      acc ^= mix(0, value);
+      return acc * kPrime1 + kPrime4;
+    }
+  }  // namespace xxh64_detail
+
+  /**
+   * XXH64 (https://github.com/Cyan4973/xxHash), little endian only. Fast
+   * enough to fingerprint whole rasters on every GoLiveEffect.
+   */
+  inline uint64_t xxh64(const void* data, size_t length, uint64_t seed = 0) {
+    using namespace xxh64_detail;
+
+    const uint8_t* p   = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + length;
+    uint64_t       h;
+
+    if (length >= 32) {
+      const uint8_t* limit = end - 32;
+      uint64_t       v1    = seed + kPrime1 + kPrime2;
+      uint64_t       v2    = seed + kPrime2;
+      uint64_t       v3    = seed;
+      uint64_t       v4    = seed - kPrime1;
+
+      do {
+        v1 = mix(v1, read64(p));
+        v2 = mix(v2, read64(p + 8));
+        v3 = mix(v3, read64(p + 16));
+        v4 = mix(v4, read64(p + 24));
+        p += 32;
+      } while (p <= limit);
+
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = merge(h, v1);
+      h = merge(h, v2);
+      h = merge(h, v3);
+      h = merge(h, v4);
+    } else {
+      h = seed + kPrime5;
+    }
+
+    h += (uint64_t)length;
+
+    for (; p + 8 <= end; p += 8) {
+      h ^= mix(0, read64(p));
+      h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+      h ^= (uint64_t)read32(p) * kPrime1;
+      h = rotl(h, 23) * kPrime2 + kPrime3;
+      p += 4;
+    }
+    for (; p < end; p++) {
+      h ^= (uint64_t)(*p) * kPrime5;
+      h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  inline uint64_t xxh64(const std::string& value, uint64_t seed = 0) {
+    return xxh64(value.data(), value.size(), seed);
+  }
+}  // namespace pipeline
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <utility>
+
+#include "json.hpp"
+
+namespace pipeline {
+  using json = nlohmann::json;
+
+  /**
+   * Composes two JSON merge patches into one that has the effect of applying
+   * `base` then `next`. Unlike `json::merge_patch`, nulls are kept so the
+   * composed patch still deletes what `next` deletes.
+   */
+  inline void composeMergePatch(json& base, const json& next) {
+    if (!next.is_object() || !base.is_object()) {
+      base = next;
+      return;
+    }
+
+    for (auto it = next.begin(); it != next.end(); ++it) {
+      if (it.value().is_object() && base.contains(it.key()) &&
+          base[it.key()].is_object()) {
+        composeMergePatch(base[it.key()], it.value());
+      } else {
+        base[it.key()] = it.value();
+      }
+    }
+  }
+
+  struct ParamUpdateStats {
+    using Duration = std::chrono::steady_clock::duration;
+
+    /** Patches pushed by the modal */
+    size_t   patches           = 0;
+    /** Batches applied (normalized once each) */
+    size_t   batches           = 0;
+    /** Patches folded into a batch another patch opened */
+    size_t   coalescedPatches  = 0;
+    /** Preview renders requested from the host */
+    size_t   renders           = 0;
+    /** Applied batches whose render was folded into a later one */
+    size_t   droppedRenders    = 0;
+    /** First patch of a batch to its apply */
+    Duration lastApplyLatency  = Duration::zero();
+    Duration maxApplyLatency   = Duration::zero();
+    /** Oldest unrendered patch to its render request */
+    Duration lastRenderLatency = Duration::zero();
+    Duration maxRenderLatency  = Duration::zero();
+    /** Time spent in the apply and render callbacks, last call */
+    Duration lastApplyCost     = Duration::zero();
+    Duration lastRenderCost    = Duration::zero();
+  };
+
+  /**
+   * Decouples parameter edits in the modal from their cost.
+   *
+   * Patches pushed within `frameBudget` of the first one are merged into a
+   * single batch, handed to `apply` (normalize, rebuild the view tree) once.
+   * Applied batches request a preview through `render` at most once per
+   * `settleInterval`; batches in between only mark the preview dirty.
+   *
+   * Nothing runs on push: the owner calls `tick` from its frame loop, so slow
+   * effects never stall the frame that received the input. Single threaded.
+   */
+  class ParamUpdateScheduler {
+   public:
+    using Clock    = std::chrono::steady_clock;
+    using ApplyFn  = std::function<void(const json& patch)>;
+    using RenderFn = std::function<void()>;
+
+    struct Options {
+      Clock::duration frameBudget    = std::chrono::milliseconds(16);
+      Clock::duration settleInterval = std::chrono::milliseconds(100);
+    };
+
+    ParamUpdateScheduler(Options options, ApplyFn apply, RenderFn render)
+        : options(options), apply(std::move(apply)), render(std::move(render)) {}
+
+    void push(const json& patch, Clock::time_point now = Clock::now()) {
+      stats.patches++;
+
+      if (pending) {
+        stats.coalescedPatches++;
+        composeMergePatch(*pending, patch);
+      } else {
+        pending       = patch;
+        batchOpenedAt = now;
+      }
+    }
+
+    /** Applies the pending batch and renders when their time has come */
+    void tick(Clock::time_point now = Clock::now()) {
+      if (pending && now - batchOpenedAt >= options.frameBudget) applyPending(now);
+
+      bool settled = !lastRenderAt || now - *lastRenderAt >= options.settleInterval;
+      if (dirtySince && settled) renderNow(now);
+    }
+
+    /**
+     * Applies the pending batch right away, and renders it too when `withRender`.
+     * For the initial params and before the modal closes.
+     */
+    void flush(bool withRender, Clock::time_point now = Clock::now()) {
+      if (pending) applyPending(now);
+      if (withRender && dirtySince) renderNow(now);
+    }
+
+    /** Forgets edits not applied or rendered yet */
+    void discard() {
+      pending.reset();
+      dirtySince.reset();
+    }
+
+    bool hasPendingWork() const { return pending.has_value() || dirtySince.has_value(); }
+
+    const ParamUpdateStats& getStats() const { return stats; }
+
+   private:
+    void applyPending(Clock::time_point now) {
+      // Taken out first so a throwing callback can't apply the batch twice
+      json patch = std::move(*pending);
+      pending.reset();
+
+      stats.batches++;
+      stats.lastApplyLatency = now - batchOpenedAt;
+      stats.maxApplyLatency  = std::max(stats.maxApplyLatency, stats.lastApplyLatency);
+
+      if (dirtySince) {
+        stats.droppedRenders++;
+      } else {
+        dirtySince = batchOpenedAt;
+      }
+
+      auto startedAt = Clock::now();
+      apply(patch);
+      stats.lastApplyCost = Clock::now() - startedAt;
+    }
+
+    void renderNow(Clock::time_point now) {
+      stats.renders++;
+      stats.lastRenderLatency = now - *dirtySince;
+      stats.maxRenderLatency  = std::max(stats.maxRenderLatency, stats.lastRenderLatency);
+
+      dirtySince.reset();
+      lastRenderAt = now;
+
+      auto startedAt = Clock::now();
+      render();
+      stats.lastRenderCost = Clock::now() - startedAt;
+    }
+
+    Options  options;
+    ApplyFn  apply;
+    RenderFn render;
+
+    std::optional<json>              pending;
+    Clock::time_point                batchOpenedAt;
+    /** Patch time of the oldest applied batch not rendered yet */
+    std::optional<Clock::time_point> dirtySince;
+    std::optional<Clock::time_point> lastRenderAt;
+    ParamUpdateStats                 stats;
+  };
+}  // namespace pipeline
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "./Hash.h"
+#include "json.hpp"
+
+namespace pipeline {
+  /** Live effect parameters as read from a dictionary, with their serialization */
+  struct ParsedParams {
+    std::string    effectName;
+    nlohmann::json params;
+    /** `params.dump()`, what the caches key on and the JSON ai_deno calls get */
+    std::string    paramsJson;
+    /** xxh64 of `paramsJson` */
+    uint64_t       paramsHash = 0;
+
+    static ParsedParams parse(std::string effectName, const std::string& paramsJson) {
+      return fromJson(std::move(effectName), nlohmann::json::parse(paramsJson));
+    }
+
+    static ParsedParams fromJson(std::string effectName, nlohmann::json params) {
+      ParsedParams parsed{
+          .effectName = std::move(effectName),
+          .params     = std::move(params),
+          .paramsJson = "",
+      };
+      // Reserialized so equal params hash equally, whatever the stored form
+      parsed.paramsJson = parsed.params.dump();
+      parsed.paramsHash = xxh64(parsed.paramsJson);
+      return parsed;
+    }
+  };
+
+  struct ParamsCacheStats {
+    size_t hits          = 0;
+    size_t misses        = 0;
+    size_t invalidations = 0;
+    size_t entries       = 0;
+  };
+
+  /**
+   * Parsed parameters by dictionary handle. Entries also carry a hash of the raw
+   * dictionary strings: Illustrator changes dictionaries behind our back (undo,
+   * reused handles), so a lookup only hits when the content is unchanged too.
+   */
+  class ParamsCache {
+   public:
+    /** Entries kept at most, the cache starts over once full */
+    static constexpr size_t kCapacity = 1024;
+
+    std::shared_ptr<const ParsedParams> find(const void* dict, uint64_t contentHash) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto it = entries.find(dict);
+      if (it == entries.end() || it->second.contentHash != contentHash) {
+        stats.misses++;
+        return nullptr;
+      }
+
+      stats.hits++;
+      return it->second.params;
+    }
+
+    std::shared_ptr<const ParsedParams> insert(
+        const void*  dict,
+        uint64_t     contentHash,
+        ParsedParams params
+    ) {
+      auto shared = std::make_shared<const ParsedParams>(std::move(params));
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (entries.size() >= kCapacity && entries.find(dict) == entries.end()) {
+        entries.clear();
+      }
+      entries[dict] = Entry{.contentHash = contentHash, .params = shared};
+      return shared;
+    }
+
+    /** Forgets `dict`, e.g. after writing new parameters to it */
+    void invalidate(const void* dict) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (entries.erase(dict) > 0) stats.invalidations++;
+    }
+
+    void clear() {
+      std::lock_guard<std::mutex> lock(mutex);
+      entries.clear();
+    }
+
+    ParamsCacheStats getStats() {
+      std::lock_guard<std::mutex> lock(mutex);
+      ParamsCacheStats result = stats;
+      result.entries          = entries.size();
+      return result;
+    }
+
+   private:
+    struct Entry {
+      uint64_t                            contentHash;
+      std::shared_ptr<const ParsedParams> params;
+    };
+
+    std::mutex                             mutex;
+    std::unordered_map<const void*, Entry> entries;
+    ParamsCacheStats                       stats;
+  };
+}  // namespace pipeline
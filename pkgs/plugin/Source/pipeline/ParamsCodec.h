@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "json.hpp"
+
+namespace pipeline {
+  /**
+   * Binary form of stored live effect parameters: a 12 byte header ("ADP", a
+   * version and the stamp) followed by the params as CBOR. Smaller than the JSON
+   * text and decoded without string conversions.
+   *
+   * The stamp is the hash of the JSON text stored next to it. Builds that only
+   * know the JSON entry rewrite it without touching the CBOR, and the stamp is how
+   * readers notice the CBOR is stale.
+   */
+  namespace params_codec {
+    constexpr uint8_t kMagic[3]   = {'A', 'D', 'P'};
+    constexpr uint8_t kVersion    = 2;
+    constexpr size_t  kStampSize  = sizeof(uint64_t);
+    constexpr size_t  kHeaderSize = sizeof(kMagic) + 1 + kStampSize;
+
+    inline std::vector<uint8_t> encode(const nlohmann::json& params, uint64_t stamp) {
+      std::vector<uint8_t> bytes(kMagic, kMagic + sizeof(kMagic));
+      bytes.push_back(kVersion);
+      for (size_t i = 0; i < kStampSize; i++) {
+        bytes.push_back(static_cast<uint8_t>(stamp >> (i * 8)));
+      }
+      nlohmann::json::to_cbor(params, bytes);
+      return bytes;
+    }
+
+    /**
+     * Nullopt for data of another format or version, a stamp other than `stamp`
+     * or broken CBOR
+     */
+    inline std::optional<nlohmann::json> decode(
+        const uint8_t* data,
+        size_t         size,
+        uint64_t       stamp
+    ) {
+      if (size <= kHeaderSize || data[0] != kMagic[0] || data[1] != kMagic[1] ||
+          data[2] != kMagic[2] || data[3] != kVersion) {
+        return std::nullopt;
+      }
+
+      uint64_t stored = 0;
+      for (size_t i = 0; i < kStampSize; i++) {
+        stored |= static_cast<uint64_t>(data[4 + i]) << (i * 8);
+      }
+      if (stored != stamp) return std::nullopt;
+
+      nlohmann::json params = nlohmann::json::from_cbor(
+          data + kHeaderSize, data + size, true, /* allow_exceptions */ false
+      );
+      if (params.is_discarded()) return std::nullopt;
+      return params;
+    }
+  }  // namespace params_codec
+}  // namespace pipeline
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#include "./PixelKernels.h"
+
+namespace pipeline {
+  /**
+   * Pixel layout an effect declares with `liveEffect.pixelFormat`. The host
+   * converts Illustrator's straight alpha ARGB8 tiles to it before
+   * `go_live_effect` and converts the result back afterwards.
+   */
+  enum class PixelFormat {
+    /** Straight alpha, 8bit per channel (default) */
+    RGBA8,
+    /** Premultiplied alpha, 8bit per channel */
+    RGBA8Premultiplied,
+    /** Straight alpha, 0 to 1 floats */
+    RGBAFloat32,
+  };
+
+  inline std::optional<PixelFormat> parsePixelFormat(const std::string& name) {
+    if (name == "rgba8") return PixelFormat::RGBA8;
+    if (name == "rgba8-premultiplied") return PixelFormat::RGBA8Premultiplied;
+    if (name == "rgba32f") return PixelFormat::RGBAFloat32;
+    return std::nullopt;
+  }
+
+  inline size_t bytesPerPixel(PixelFormat format) {
+    return format == PixelFormat::RGBAFloat32 ? 4 * sizeof(float) : 4;
+  }
+
+  /**
+   * Host ARGB8 -> effect format. `argb` is reused as scratch, so for 8bit
+   * formats pass `dst == argb` to convert in place.
+   */
+  inline void convertToEffectFormat(
+      PixelFormat    format,
+      unsigned char* argb,
+      void*          dst,
+      size_t         pixels
+  ) {
+    const PixelKernelTable& k = pixelKernels();
+
+    k.argbToRgba(argb, argb, pixels);
+
+    switch (format) {
+      case PixelFormat::RGBA8:
+        if (dst != argb) std::memcpy(dst, argb, pixels * 4);
+        break;
+      case PixelFormat::RGBA8Premultiplied:
+        k.premultiplyRgba(argb, pixels);
+        if (dst != argb) std::memcpy(dst, argb, pixels * 4);
+        break;
+      case PixelFormat::RGBAFloat32:
+        k.widenToFloat(argb, static_cast<float*>(dst), pixels);
+        break;
+    }
+  }
+
+  /**
+   * Effect format -> host ARGB8. 8bit sources are converted in place when
+   * `argbDst == src`.
+   */
+  inline void convertFromEffectFormat(
+      PixelFormat    format,
+      void*          src,
+      unsigned char* argbDst,
+      size_t         pixels
+  ) {
+    const PixelKernelTable& k = pixelKernels();
+
+    switch (format) {
+      case PixelFormat::RGBA8:
+        k.rgbaToArgb(static_cast<unsigned char*>(src), argbDst, pixels);
+        break;
+      case PixelFormat::RGBA8Premultiplied:
+        k.unpremultiplyRgba(static_cast<unsigned char*>(src), pixels);
+        k.rgbaToArgb(static_cast<unsigned char*>(src), argbDst, pixels);
+        break;
+      case PixelFormat::RGBAFloat32:
+        k.narrowFromFloat(static_cast<const float*>(src), argbDst, pixels);
+        k.rgbaToArgb(argbDst, argbDst, pixels);
+        break;
+    }
+  }
+}  // namespace pipeline
@@ -0,0 +1,720 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PIPELINE_PIXEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PIPELINE_PIXEL_NEON 1
+#include <arm_neon.h>
+#endif
+
+// AVX2 code is compiled per function so the plugin still loads on SSE2-only CPUs.
+// MSVC accepts AVX2 intrinsics without it.
+#if defined(PIPELINE_PIXEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIPELINE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIPELINE_TARGET_AVX2
+#endif
+
+/**
+ * Pixel format kernels for 8bit 4 channel rasters.
+ *
+ * Illustrator tiles are ARGB (alpha first); effects work on RGBA. All kernels
+ * accept `src == dst`. Premultiplication uses the exactly rounded `c * a / 255`
+ * and unpremultiplication `min(255, (c * 255 + a / 2) / a)`, so every SIMD path
+ * produces the same bytes as the scalar one.
+ */
+namespace pipeline {
+  enum class SimdLevel { Scalar, SSE2, AVX2, NEON };
+
+  struct PixelKernelTable {
+    SimdLevel level;
+
+    void (*argbToRgba)(const uint8_t* src, uint8_t* dst, size_t pixels);
+    void (*rgbaToArgb)(const uint8_t* src, uint8_t* dst, size_t pixels);
+    /** In place, alpha in the 4th byte */
+    void (*premultiplyRgba)(uint8_t* rgba, size_t pixels);
+    /** In place, alpha in the 4th byte */
+    void (*unpremultiplyRgba)(uint8_t* rgba, size_t pixels);
+    /** Channel order is kept, values are mapped to 0 to 1 */
+    void (*widenToFloat)(const uint8_t* src, float* dst, size_t pixels);
+    /** Clamps to 0 to 1 (NaN becomes 0) and rounds to nearest */
+    void (*narrowFromFloat)(const float* src, uint8_t* dst, size_t pixels);
+    /** Index of the first ARGB pixel with a non-zero alpha, `pixels` when none has */
+    size_t (*firstVisibleArgb)(const uint8_t* argb, size_t pixels);
+    /** One past the last ARGB pixel with a non-zero alpha, 0 when none has */
+    size_t (*endVisibleArgb)(const uint8_t* argb, size_t pixels);
+  };
+
+  namespace pixel_kernels {
+    constexpr float kInv255 = 1.0f / 255.0f;
+
+    namespace scalar {
+      inline uint8_t mulDiv255(uint32_t c, uint32_t a) {
+        uint32_t t = c * a + 128;
+        return (uint8_t)((t + (t >> 8)) >> 8);
+      }
+
+      inline uint8_t unmul(uint32_t c, uint32_t a) {
+        if (a == 0) return 0;
+        uint32_t v = (c * 255 + (a >> 1)) / a;
+        return (uint8_t)(v > 255 ? 255 : v);
+      }
+
+      inline void argbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels) {
+        for (size_t i = 0; i < pixels; i++) {
+          uint32_t px;
+          std::memcpy(&px, src + i * 4, 4);
+          px = (px >> 8) | (px << 24);
+          std::memcpy(dst + i * 4, &px, 4);
+        }
+      }
+
+      inline void rgbaToArgb(const uint8_t* src, uint8_t* dst, size_t pixels) {
+        for (size_t i = 0; i < pixels; i++) {
+          uint32_t px;
+          std::memcpy(&px, src + i * 4, 4);
+          px = (px << 8) | (px >> 24);
+          std::memcpy(dst + i * 4, &px, 4);
+        }
+      }
+
+      inline void premultiplyRgba(uint8_t* rgba, size_t pixels) {
+        for (size_t i = 0; i < pixels; i++) {
+          uint8_t* px = rgba + i * 4;
+          uint32_t a  = px[3];
+          px[0]       = mulDiv255(px[0], a);
+          px[1]       = mulDiv255(px[1], a);
+          px[2]       = mulDiv255(px[2], a);
+        }
+      }
+
+      inline void unpremultiplyRgba(uint8_t* rgba, size_t pixels) {
+        for (size_t i = 0; i < pixels; i++) {
+          uint8_t* px = rgba + i * 4;
+          uint32_t a  = px[3];
+          px[0]       = unmul(px[0], a);
+          px[1]       = unmul(px[1], a);
+          px[2]       = unmul(px[2], a);
+        }
+      }
+
+      inline void widenToFloat(const uint8_t* src, float* dst, size_t pixels) {
+        for (size_t i = 0; i < pixels * 4; i++) dst[i] = (float)src[i] * kInv255;
+      }
+
+      inline void narrowFromFloat(const float* src, uint8_t* dst, size_t pixels) {
+        for (size_t i = 0; i < pixels * 4; i++) {
+          float v = src[i] > 0.0f ? src[i] : 0.0f;
+          v       = v < 1.0f ? v : 1.0f;
+          // Kept as separate statements so the compiler can't fuse into an FMA
+          float scaled = v * 255.0f;
+          scaled += 0.5f;
+          dst[i] = (uint8_t)scaled;
+        }
+      }
+
+      inline size_t firstVisibleArgb(const uint8_t* argb, size_t pixels) {
+        for (size_t i = 0; i < pixels; i++) {
+          if (argb[i * 4] != 0) return i;
+        }
+        return pixels;
+      }
+
+      inline size_t endVisibleArgb(const uint8_t* argb, size_t pixels) {
+        for (size_t i = pixels; i > 0; i--) {
+          if (argb[(i - 1) * 4] != 0) return i;
+        }
+        return 0;
+      }
+    }  // namespace scalar
+
+#ifdef PIPELINE_PIXEL_X86
+    namespace sse2 {
+      inline void argbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+          v         = _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24));
+          _mm_storeu_si128((__m128i*)(dst + i * 4), v);
+        }
+        scalar::argbToRgba(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      inline void rgbaToArgb(const uint8_t* src, uint8_t* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+          v         = _mm_or_si128(_mm_slli_epi32(v, 8), _mm_srli_epi32(v, 24));
+          _mm_storeu_si128((__m128i*)(dst + i * 4), v);
+        }
+        scalar::rgbaToArgb(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      /** Two pixels widened to 16bit lanes */
+      inline __m128i premultiply2(__m128i px, __m128i alphaMask) {
+        __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+        a         = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), _mm_set1_epi16(128));
+        t         = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        return _mm_or_si128(_mm_andnot_si128(alphaMask, t), _mm_and_si128(alphaMask, px));
+      }
+
+      inline void premultiplyRgba(uint8_t* rgba, size_t pixels) {
+        const __m128i zero      = _mm_setzero_si128();
+        const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v  = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+          __m128i lo = premultiply2(_mm_unpacklo_epi8(v, zero), alphaMask);
+          __m128i hi = premultiply2(_mm_unpackhi_epi8(v, zero), alphaMask);
+          _mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_packus_epi16(lo, hi));
+        }
+        scalar::premultiplyRgba(rgba + i * 4, pixels - i);
+      }
+
+      /** One pixel in 32bit lanes. Float division is exact here: see unmul */
+      inline __m128i unpremultiply1(__m128i px, __m128i alphaMask) {
+        __m128i a   = _mm_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128  af  = _mm_cvtepi32_ps(a);
+        __m128  num = _mm_add_ps(
+            _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(255.0f)),
+            _mm_cvtepi32_ps(_mm_srli_epi32(a, 1))
+        );
+        __m128  q = _mm_min_ps(_mm_div_ps(num, af), _mm_set1_ps(255.0f));
+        __m128i r = _mm_cvttps_epi32(q);
+        r         = _mm_and_si128(r, _mm_castps_si128(_mm_cmpneq_ps(af, _mm_setzero_ps())));
+        return _mm_or_si128(_mm_andnot_si128(alphaMask, r), _mm_and_si128(alphaMask, px));
+      }
+
+      inline void unpremultiplyRgba(uint8_t* rgba, size_t pixels) {
+        const __m128i zero      = _mm_setzero_si128();
+        const __m128i alphaMask = _mm_set_epi32(-1, 0, 0, 0);
+
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v  = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+          __m128i lo = _mm_unpacklo_epi8(v, zero);
+          __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+          __m128i p0 = unpremultiply1(_mm_unpacklo_epi16(lo, zero), alphaMask);
+          __m128i p1 = unpremultiply1(_mm_unpackhi_epi16(lo, zero), alphaMask);
+          __m128i p2 = unpremultiply1(_mm_unpacklo_epi16(hi, zero), alphaMask);
+          __m128i p3 = unpremultiply1(_mm_unpackhi_epi16(hi, zero), alphaMask);
+
+          __m128i packed =
+              _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+          _mm_storeu_si128((__m128i*)(rgba + i * 4), packed);
+        }
+        scalar::unpremultiplyRgba(rgba + i * 4, pixels - i);
+      }
+
+      inline void widenToFloat(const uint8_t* src, float* dst, size_t pixels) {
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128  scale = _mm_set1_ps(kInv255);
+
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v  = _mm_loadu_si128((const __m128i*)(src + i * 4));
+          __m128i lo = _mm_unpacklo_epi8(v, zero);
+          __m128i hi = _mm_unpackhi_epi8(v, zero);
+          float*  o  = dst + i * 4;
+
+          _mm_storeu_ps(o, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+          _mm_storeu_ps(o + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+          _mm_storeu_ps(o + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+          _mm_storeu_ps(o + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+        }
+        scalar::widenToFloat(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      inline __m128i narrow4(__m128 v) {
+        // max() returns its second operand for NaN, which maps NaN to 0
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+        return _mm_cvttps_epi32(v);
+      }
+
+      inline void narrowFromFloat(const float* src, uint8_t* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          const float* s  = src + i * 4;
+          __m128i      lo = _mm_packs_epi32(
+              narrow4(_mm_loadu_ps(s)), narrow4(_mm_loadu_ps(s + 4))
+          );
+          __m128i hi = _mm_packs_epi32(
+              narrow4(_mm_loadu_ps(s + 8)), narrow4(_mm_loadu_ps(s + 12))
+          );
+          _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_packus_epi16(lo, hi));
+        }
+        scalar::narrowFromFloat(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      /** Whether any of 16 ARGB pixels has a non-zero alpha */
+      inline bool anyVisible16(const uint8_t* argb) {
+        const __m128i* p = (const __m128i*)argb;
+        __m128i        v = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+            _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3))
+        );
+        v = _mm_and_si128(v, _mm_set1_epi32(0xFF));
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xFFFF;
+      }
+
+      inline size_t firstVisibleArgb(const uint8_t* argb, size_t pixels) {
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16) {
+          if (anyVisible16(argb + i * 4)) break;
+        }
+        return i + scalar::firstVisibleArgb(argb + i * 4, pixels - i);
+      }
+
+      inline size_t endVisibleArgb(const uint8_t* argb, size_t pixels) {
+        size_t end = pixels;
+        for (; end >= 16; end -= 16) {
+          if (anyVisible16(argb + (end - 16) * 4)) break;
+        }
+        return scalar::endVisibleArgb(argb, end);
+      }
+    }  // namespace sse2
+
+    namespace avx2 {
+      PIPELINE_TARGET_AVX2 inline void argbToRgba(
+          const uint8_t* src,
+          uint8_t*       dst,
+          size_t         pixels
+      ) {
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8) {
+          __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+          v = _mm256_or_si256(_mm256_srli_epi32(v, 8), _mm256_slli_epi32(v, 24));
+          _mm256_storeu_si256((__m256i*)(dst + i * 4), v);
+        }
+        sse2::argbToRgba(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      PIPELINE_TARGET_AVX2 inline void rgbaToArgb(
+          const uint8_t* src,
+          uint8_t*       dst,
+          size_t         pixels
+      ) {
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8) {
+          __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+          v = _mm256_or_si256(_mm256_slli_epi32(v, 8), _mm256_srli_epi32(v, 24));
+          _mm256_storeu_si256((__m256i*)(dst + i * 4), v);
+        }
+        sse2::rgbaToArgb(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      PIPELINE_TARGET_AVX2 inline __m256i premultiply4(__m256i px, __m256i alphaMask) {
+        __m256i a = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+        a         = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), _mm256_set1_epi16(128));
+        t         = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+        return _mm256_or_si256(
+            _mm256_andnot_si256(alphaMask, t), _mm256_and_si256(alphaMask, px)
+        );
+      }
+
+      PIPELINE_TARGET_AVX2 inline void premultiplyRgba(uint8_t* rgba, size_t pixels) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i alphaMask =
+            _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8) {
+          // Unpack and pack both work per 128bit lane, so pixel order round trips
+          __m256i v  = _mm256_loadu_si256((const __m256i*)(rgba + i * 4));
+          __m256i lo = premultiply4(_mm256_unpacklo_epi8(v, zero), alphaMask);
+          __m256i hi = premultiply4(_mm256_unpackhi_epi8(v, zero), alphaMask);
+          _mm256_storeu_si256((__m256i*)(rgba + i * 4), _mm256_packus_epi16(lo, hi));
+        }
+        sse2::premultiplyRgba(rgba + i * 4, pixels - i);
+      }
+
+      /** Two pixels in 32bit lanes, one per 128bit lane */
+      PIPELINE_TARGET_AVX2 inline __m256i unpremultiply2(__m256i px, __m256i alphaMask) {
+        __m256i a   = _mm256_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 3));
+        __m256  af  = _mm256_cvtepi32_ps(a);
+        __m256  num = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_cvtepi32_ps(px), _mm256_set1_ps(255.0f)),
+            _mm256_cvtepi32_ps(_mm256_srli_epi32(a, 1))
+        );
+        __m256  q = _mm256_min_ps(_mm256_div_ps(num, af), _mm256_set1_ps(255.0f));
+        __m256i r = _mm256_cvttps_epi32(q);
+        r         = _mm256_and_si256(
+            r, _mm256_castps_si256(_mm256_cmp_ps(af, _mm256_setzero_ps(), _CMP_NEQ_OQ))
+        );
+        return _mm256_or_si256(
+            _mm256_andnot_si256(alphaMask, r), _mm256_and_si256(alphaMask, px)
+        );
+      }
+
+      PIPELINE_TARGET_AVX2 inline void unpremultiplyRgba(uint8_t* rgba, size_t pixels) {
+        const __m256i alphaMask = _mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0);
+
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+
+          __m256i p01 = unpremultiply2(_mm256_cvtepu8_epi32(v), alphaMask);
+          __m256i p23 = unpremultiply2(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), alphaMask);
+
+          __m128i w01 = _mm_packs_epi32(
+              _mm256_castsi256_si128(p01), _mm256_extracti128_si256(p01, 1)
+          );
+          __m128i w23 = _mm_packs_epi32(
+              _mm256_castsi256_si128(p23), _mm256_extracti128_si256(p23, 1)
+          );
+          _mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_packus_epi16(w01, w23));
+        }
+        scalar::unpremultiplyRgba(rgba + i * 4, pixels - i);
+      }
+
+      PIPELINE_TARGET_AVX2 inline void widenToFloat(
+          const uint8_t* src,
+          float*         dst,
+          size_t         pixels
+      ) {
+        const __m256 scale = _mm256_set1_ps(kInv255);
+
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+          float*  o = dst + i * 4;
+
+          __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+          __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+          _mm256_storeu_ps(o, _mm256_mul_ps(lo, scale));
+          _mm256_storeu_ps(o + 8, _mm256_mul_ps(hi, scale));
+        }
+        scalar::widenToFloat(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      PIPELINE_TARGET_AVX2 inline __m256i narrow8(__m256 v) {
+        v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+        v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f));
+        return _mm256_cvttps_epi32(v);
+      }
+
+      PIPELINE_TARGET_AVX2 inline void narrowFromFloat(
+          const float* src,
+          uint8_t*     dst,
+          size_t       pixels
+      ) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          const float* s = src + i * 4;
+          __m256i      a = narrow8(_mm256_loadu_ps(s));
+          __m256i      b = narrow8(_mm256_loadu_ps(s + 8));
+
+          // packs works per lane: [a0-3 b0-3 a4-7 b4-7] -> [a0-7 b0-7]
+          __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+          __m128i packed =
+              _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+          _mm_storeu_si128((__m128i*)(dst + i * 4), packed);
+        }
+        scalar::narrowFromFloat(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      PIPELINE_TARGET_AVX2 inline bool anyVisible16(const uint8_t* argb) {
+        const __m256i* p = (const __m256i*)argb;
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1));
+        return !_mm256_testz_si256(v, _mm256_set1_epi32(0xFF));
+      }
+
+      PIPELINE_TARGET_AVX2 inline size_t firstVisibleArgb(
+          const uint8_t* argb,
+          size_t         pixels
+      ) {
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16) {
+          if (anyVisible16(argb + i * 4)) break;
+        }
+        return i + scalar::firstVisibleArgb(argb + i * 4, pixels - i);
+      }
+
+      PIPELINE_TARGET_AVX2 inline size_t endVisibleArgb(
+          const uint8_t* argb,
+          size_t         pixels
+      ) {
+        size_t end = pixels;
+        for (; end >= 16; end -= 16) {
+          if (anyVisible16(argb + (end - 16) * 4)) break;
+        }
+        return scalar::endVisibleArgb(argb, end);
+      }
+    }  // namespace avx2
+#endif
+
+#ifdef PIPELINE_PIXEL_NEON
+    namespace neon {
+      inline void argbToRgba(const uint8_t* src, uint8_t* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(src + i * 4));
+          v            = vorrq_u32(vshrq_n_u32(v, 8), vshlq_n_u32(v, 24));
+          vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(v));
+        }
+        scalar::argbToRgba(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      inline void rgbaToArgb(const uint8_t* src, uint8_t* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(src + i * 4));
+          v            = vorrq_u32(vshlq_n_u32(v, 8), vshrq_n_u32(v, 24));
+          vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(v));
+        }
+        scalar::rgbaToArgb(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      /** (v + ((v + 128) >> 8) + 128) >> 8, the same rounding as scalar::mulDiv255 */
+      inline uint8x16_t mulDiv255(uint8x16_t c, uint8x16_t a) {
+        uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+        uint16x8_t hi = vmull_high_u8(c, a);
+        return vcombine_u8(
+            vraddhn_u16(lo, vrshrq_n_u16(lo, 8)), vraddhn_u16(hi, vrshrq_n_u16(hi, 8))
+        );
+      }
+
+      inline void premultiplyRgba(uint8_t* rgba, size_t pixels) {
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16) {
+          uint8x16x4_t px = vld4q_u8(rgba + i * 4);
+          px.val[0]       = mulDiv255(px.val[0], px.val[3]);
+          px.val[1]       = mulDiv255(px.val[1], px.val[3]);
+          px.val[2]       = mulDiv255(px.val[2], px.val[3]);
+          vst4q_u8(rgba + i * 4, px);
+        }
+        scalar::premultiplyRgba(rgba + i * 4, pixels - i);
+      }
+
+      inline uint32x4_t unmul4(uint32x4_t c, uint32x4_t a) {
+        float32x4_t num = vcvtq_f32_u32(vmlaq_n_u32(vshrq_n_u32(a, 1), c, 255));
+        float32x4_t q   = vminq_f32(vdivq_f32(num, vcvtq_f32_u32(a)), vdupq_n_f32(255.0f));
+        return vandq_u32(vcvtq_u32_f32(q), vcgtq_u32(a, vdupq_n_u32(0)));
+      }
+
+      inline uint16x8_t unmul8(uint16x8_t c, uint16x8_t a) {
+        uint32x4_t lo = unmul4(vmovl_u16(vget_low_u16(c)), vmovl_u16(vget_low_u16(a)));
+        uint32x4_t hi = unmul4(vmovl_high_u16(c), vmovl_high_u16(a));
+        return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+      }
+
+      inline uint8x16_t unmul16(uint8x16_t c, uint8x16_t a) {
+        uint16x8_t lo = unmul8(vmovl_u8(vget_low_u8(c)), vmovl_u8(vget_low_u8(a)));
+        uint16x8_t hi = unmul8(vmovl_high_u8(c), vmovl_high_u8(a));
+        return vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+      }
+
+      inline void unpremultiplyRgba(uint8_t* rgba, size_t pixels) {
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16) {
+          uint8x16x4_t px = vld4q_u8(rgba + i * 4);
+          px.val[0]       = unmul16(px.val[0], px.val[3]);
+          px.val[1]       = unmul16(px.val[1], px.val[3]);
+          px.val[2]       = unmul16(px.val[2], px.val[3]);
+          vst4q_u8(rgba + i * 4, px);
+        }
+        scalar::unpremultiplyRgba(rgba + i * 4, pixels - i);
+      }
+
+      inline void widenToFloat(const uint8_t* src, float* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          uint8x16_t v  = vld1q_u8(src + i * 4);
+          uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+          uint16x8_t hi = vmovl_high_u8(v);
+          float*     o  = dst + i * 4;
+
+          vst1q_f32(o, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), kInv255));
+          vst1q_f32(o + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(lo)), kInv255));
+          vst1q_f32(o + 8, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), kInv255));
+          vst1q_f32(o + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(hi)), kInv255));
+        }
+        scalar::widenToFloat(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      inline uint16x4_t narrow4(float32x4_t v) {
+        // maxnm returns the number when one operand is NaN
+        v = vminq_f32(vmaxnmq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+        v = vaddq_f32(vmulq_n_f32(v, 255.0f), vdupq_n_f32(0.5f));
+        return vmovn_u32(vcvtq_u32_f32(v));
+      }
+
+      inline void narrowFromFloat(const float* src, uint8_t* dst, size_t pixels) {
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+          const float* s  = src + i * 4;
+          uint16x8_t   lo = vcombine_u16(narrow4(vld1q_f32(s)), narrow4(vld1q_f32(s + 4)));
+          uint16x8_t   hi =
+              vcombine_u16(narrow4(vld1q_f32(s + 8)), narrow4(vld1q_f32(s + 12)));
+          vst1q_u8(dst + i * 4, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+        }
+        scalar::narrowFromFloat(src + i * 4, dst + i * 4, pixels - i);
+      }
+
+      inline bool anyVisible16(const uint8_t* argb) {
+        // Deinterleaved, val[0] holds the 16 alphas
+        return vmaxvq_u8(vld4q_u8(argb).val[0]) != 0;
+      }
+
+      inline size_t firstVisibleArgb(const uint8_t* argb, size_t pixels) {
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16) {
+          if (anyVisible16(argb + i * 4)) break;
+        }
+        return i + scalar::firstVisibleArgb(argb + i * 4, pixels - i);
+      }
+
+      inline size_t endVisibleArgb(const uint8_t* argb, size_t pixels) {
+        size_t end = pixels;
+        for (; end >= 16; end -= 16) {
+          if (anyVisible16(argb + (end - 16) * 4)) break;
+        }
+        return scalar::endVisibleArgb(argb, end);
+      }
+    }  // namespace neon
+#endif
+
+    inline bool cpuHasAvx2() {
+#if defined(PIPELINE_PIXEL_X86) && defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      if (info[0] < 7) return false;
+
+      // AVX needs OS support for saving YMM registers too
+      __cpuid(info, 1);
+      bool osxsave = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+      if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+
+      __cpuidex(info, 7, 0);
+      return (info[1] & (1 << 5)) != 0;
+#elif defined(PIPELINE_PIXEL_X86)
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    }
+  }  // namespace pixel_kernels
+
+  inline bool isSimdLevelSupported(SimdLevel level) {
+    switch (level) {
+      case SimdLevel::Scalar:
+        return true;
+#ifdef PIPELINE_PIXEL_X86
+      case SimdLevel::SSE2:
+        return true;
+      case SimdLevel::AVX2: {
+        static const bool supported = pixel_kernels::cpuHasAvx2();
+        return supported;
+      }
+#endif
+#ifdef PIPELINE_PIXEL_NEON
+      case SimdLevel::NEON:
+        return true;
+#endif
+      default:
+        return false;
+    }
+  }
+
+  inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+      case SimdLevel::Scalar:
+        return "scalar";
+      case SimdLevel::SSE2:
+        return "sse2";
+      case SimdLevel::AVX2:
+        return "avx2";
+      case SimdLevel::NEON:
+        return "neon";
+    }
+    return "unknown";
+  }
+
+  /** Kernels for `level`, or the scalar ones when this CPU lacks it */
+  inline const PixelKernelTable& pixelKernels(SimdLevel level) {
+    namespace k = pixel_kernels;
+
+    static const PixelKernelTable scalar = {
+        SimdLevel::Scalar,
+        k::scalar::argbToRgba,
+        k::scalar::rgbaToArgb,
+        k::scalar::premultiplyRgba,
+        k::scalar::unpremultiplyRgba,
+        k::scalar::widenToFloat,
+        k::scalar::narrowFromFloat,
+        k::scalar::firstVisibleArgb,
+        k::scalar::endVisibleArgb,
+    };
+
+    if (!isSimdLevelSupported(level)) return scalar;
+
+#ifdef PIPELINE_PIXEL_X86
+    static const PixelKernelTable sse2 = {
+        SimdLevel::SSE2,
+        k::sse2::argbToRgba,
+        k::sse2::rgbaToArgb,
+        k::sse2::premultiplyRgba,
+        k::sse2::unpremultiplyRgba,
+        k::sse2::widenToFloat,
+        k::sse2::narrowFromFloat,
+        k::sse2::firstVisibleArgb,
+        k::sse2::endVisibleArgb,
+    };
+    static const PixelKernelTable avx2 = {
+        SimdLevel::AVX2,
+        k::avx2::argbToRgba,
+        k::avx2::rgbaToArgb,
+        k::avx2::premultiplyRgba,
+        k::avx2::unpremultiplyRgba,
+        k::avx2::widenToFloat,
+        k::avx2::narrowFromFloat,
+        k::avx2::firstVisibleArgb,
+        k::avx2::endVisibleArgb,
+    };
+    if (level == SimdLevel::SSE2) return sse2;
+    if (level == SimdLevel::AVX2) return avx2;
+#endif
+#ifdef PIPELINE_PIXEL_NEON
+    static const PixelKernelTable neon = {
+        SimdLevel::NEON,
+        k::neon::argbToRgba,
+        k::neon::rgbaToArgb,
+        k::neon::premultiplyRgba,
+        k::neon::unpremultiplyRgba,
+        k::neon::widenToFloat,
+        k::neon::narrowFromFloat,
+        k::neon::firstVisibleArgb,
+        k::neon::endVisibleArgb,
+    };
+    if (level == SimdLevel::NEON) return neon;
+#endif
+
+    return scalar;
+  }
+
+  /** Best kernels for this CPU, detected once */
+  inline const PixelKernelTable& pixelKernels() {
+    static const PixelKernelTable& best = []() -> const PixelKernelTable& {
+      for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::NEON, SimdLevel::SSE2}) {
+        if (isSimdLevelSupported(level)) return pixelKernels(level);
+      }
+      return pixelKernels(SimdLevel::Scalar);
+    }();
+    return best;
+  }
+}  // namespace pipeline
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pipeline {
+  /**
+   * Resolution scale (0, 1] that keeps a `fullWidth` x `fullHeight` raster
+   * within `pixelBudget` pixels. A budget of 0 disables scaling.
+   */
+  inline double previewScale(double fullWidth, double fullHeight, size_t pixelBudget) {
+    double pixels = fullWidth * fullHeight;
+    if (pixelBudget == 0 || pixels <= (double)pixelBudget) return 1.0;
+
+    return std::sqrt((double)pixelBudget / pixels);
+  }
+
+  /**
+   * Bilinear resize of straight alpha ARGB8 pixels. Interpolates in
+   * premultiplied space so transparent neighbours don't bleed dark fringes
+   * into edges.
+   */
+  inline void resizeArgbBilinear(
+      const unsigned char* src,
+      uint32_t             srcWidth,
+      uint32_t             srcHeight,
+      unsigned char*       dst,
+      uint32_t             dstWidth,
+      uint32_t             dstHeight
+  ) {
+    if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0) return;
+
+    // Sample positions with 8bit fractions, pixel centers aligned
+    struct Tap {
+      uint32_t i0, i1;
+      uint32_t w1;  // weight of i1 in 1/256, i0 gets the rest
+    };
+
+    auto taps = [](uint32_t srcSize, uint32_t dstSize) {
+      std::vector<Tap> result(dstSize);
+      double           ratio = (double)srcSize / dstSize;
+
+      for (uint32_t d = 0; d < dstSize; d++) {
+        double s  = std::max((d + 0.5) * ratio - 0.5, 0.0);
+        auto   i0 = std::min((uint32_t)s, srcSize - 1);
+        auto   i1 = std::min(i0 + 1, srcSize - 1);
+        result[d] = {i0, i1, (uint32_t)std::lround((s - i0) * 256.0)};
+        if (result[d].w1 > 256) result[d].w1 = 256;
+      }
+      return result;
+    };
+
+    std::vector<Tap> xTaps = taps(srcWidth, dstWidth);
+    std::vector<Tap> yTaps = taps(srcHeight, dstHeight);
+    const size_t     srcRowBytes = (size_t)srcWidth * 4;
+
+    for (uint32_t y = 0; y < dstHeight; y++) {
+      const Tap&           ty   = yTaps[y];
+      const unsigned char* row0 = src + ty.i0 * srcRowBytes;
+      const unsigned char* row1 = src + ty.i1 * srcRowBytes;
+      unsigned char*       out  = dst + (size_t)y * dstWidth * 4;
+
+      for (uint32_t x = 0; x < dstWidth; x++, out += 4) {
+        const Tap& tx = xTaps[x];
+
+        const unsigned char* p[4] = {
+            row0 + tx.i0 * 4, row0 + tx.i1 * 4, row1 + tx.i0 * 4, row1 + tx.i1 * 4
+        };
+        // Weights sum to 65536
+        const uint32_t w[4] = {
+            (256 - tx.w1) * (256 - ty.w1), tx.w1 * (256 - ty.w1), (256 - tx.w1) * ty.w1,
+            tx.w1 * ty.w1
+        };
+
+        uint32_t alpha    = 0;
+        uint64_t color[3] = {0, 0, 0};
+        for (int i = 0; i < 4; i++) {
+          uint32_t aw = p[i][0] * w[i];
+          alpha += aw;
+          color[0] += (uint64_t)p[i][1] * aw;
+          color[1] += (uint64_t)p[i][2] * aw;
+          color[2] += (uint64_t)p[i][3] * aw;
+        }
+
+        out[0] = (unsigned char)((alpha + 32768) >> 16);
+        for (int c = 0; c < 3; c++) {
+          out[c + 1] =
+              alpha == 0
+                  ? 0
+                  : (unsigned char)std::min<uint64_t>((color[c] + alpha / 2) / alpha, 255);
+        }
+      }
+    }
+  }
+}  // namespace pipeline
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "libai_deno.h"
+
+namespace pipeline {
+  /**
+   * Owns a render queued by `ai_deno::go_live_effect_submit`. Moves only.
+   *
+   * The render reads its input pixels until it's waited on, so a ticket dropped
+   * before `wait()` cancels the render and waits for it; declare the ticket
+   * after the buffers it reads.
+   */
+  class RenderTicket {
+   public:
+    using Result = std::unique_ptr<
+        ai_deno::GoLiveEffectResult,
+        void (*)(ai_deno::GoLiveEffectResult*)>;
+
+    RenderTicket() = default;
+    explicit RenderTicket(ai_deno::LiveEffectTicket* ticket) : ticket(ticket) {}
+
+    RenderTicket(const RenderTicket&)            = delete;
+    RenderTicket& operator=(const RenderTicket&) = delete;
+
+    RenderTicket(RenderTicket&& other) noexcept { *this = std::move(other); }
+
+    RenderTicket& operator=(RenderTicket&& other) noexcept {
+      if (this == &other) return *this;
+      abandon();
+      ticket       = other.ticket;
+      other.ticket = nullptr;
+      return *this;
+    }
+
+    ~RenderTicket() { abandon(); }
+
+    explicit operator bool() const { return ticket != nullptr; }
+
+    /** The render finished, `wait()` won't block */
+    bool isReady() const {
+      return ticket != nullptr && ai_deno::live_effect_ticket_is_ready(ticket);
+    }
+
+    void cancel() {
+      if (ticket != nullptr) ai_deno::live_effect_ticket_cancel(ticket);
+    }
+
+    /** Blocks until the render finished. Empties the ticket. */
+    Result wait() {
+      ai_deno::LiveEffectTicket* waited = ticket;
+      ticket                            = nullptr;
+
+      if (waited == nullptr) return Result(nullptr, ai_deno::dispose_go_live_effect_result);
+      return Result(
+          ai_deno::live_effect_ticket_wait(waited), ai_deno::dispose_go_live_effect_result
+      );
+    }
+
+   private:
+    void abandon() {
+      if (ticket == nullptr) return;
+      cancel();
+      wait();
+    }
+
+    ai_deno::LiveEffectTicket* ticket = nullptr;
+  };
+}  // namespace pipeline
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./Hash.h"
+
+namespace pipeline {
+  /** Everything a GoLiveEffect result depends on */
+  struct ResultCacheKey {
+    std::string effectId;
+    /** Hash of the params JSON. nlohmann::json objects dump with sorted keys */
+    uint64_t    paramsHash = 0;
+    /** Hash of the rasterized source pixels (ARGB) */
+    uint64_t    pixelsHash = 0;
+    int         dpi        = 0;
+    uint32_t    width      = 0;
+    uint32_t    height     = 0;
+
+    bool operator==(const ResultCacheKey& other) const {
+      return paramsHash == other.paramsHash && pixelsHash == other.pixelsHash &&
+             dpi == other.dpi && width == other.width && height == other.height &&
+             effectId == other.effectId;
+    }
+  };
+
+  struct ResultCacheKeyHash {
+    size_t operator()(const ResultCacheKey& key) const {
+      uint64_t h = xxh64(key.effectId, key.paramsHash ^ key.pixelsHash);
+      h ^= ((uint64_t)key.width << 32 | key.height) + 0x9e3779b97f4a7c15ULL + (h << 6) +
+           (h >> 2);
+      h ^= (uint64_t)key.dpi + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      return (size_t)h;
+    }
+  };
+
+  /** Final ARGB output of an effect, exactly as written to the raster art */
+  struct CachedResult {
+    uint32_t             width  = 0;
+    uint32_t             height = 0;
+    std::vector<uint8_t> pixels;
+  };
+
+  struct ResultCacheStats {
+    size_t hits      = 0;
+    size_t misses    = 0;
+    size_t bypasses  = 0;
+    size_t evictions = 0;
+    size_t entries   = 0;
+    size_t bytes     = 0;
+  };
+
+  /**
+   * LRU cache of GoLiveEffect results, bounded by the total size of the cached
+   * pixels. Entries are handed out as shared pointers so an eviction never
+   * frees pixels that are still being written to a raster art.
+   */
+  class ResultCache {
+   public:
+    static constexpr size_t kDefaultBudget = (size_t)256 * 1024 * 1024;
+
+    explicit ResultCache(size_t budgetBytes = kDefaultBudget) : budget(budgetBytes) {}
+
+    ResultCache(const ResultCache&)            = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    std::shared_ptr<const CachedResult> find(const ResultCacheKey& key) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto it = index.find(key);
+      if (it == index.end()) {
+        stats.misses++;
+        return nullptr;
+      }
+
+      entries.splice(entries.begin(), entries, it->second);
+      stats.hits++;
+      return it->second->second;
+    }
+
+    /** Counts a request that must not be served from the cache (e.g. preview) */
+    void bypass() {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.bypasses++;
+    }
+
+    /**
+     * Stores a copy of `argb` and returns it. The copy is returned even when it
+     * is too large to be kept.
+     */
+    std::shared_ptr<const CachedResult> insert(
+        const ResultCacheKey& key,
+        uint32_t              width,
+        uint32_t              height,
+        const uint8_t*        argb,
+        size_t                byteLength
+    ) {
+      auto result    = std::make_shared<CachedResult>();
+      result->width  = width;
+      result->height = height;
+      result->pixels.assign(argb, argb + byteLength);
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      // A single result over budget would only flush everything else
+      if (byteLength > budget) return result;
+
+      auto it = index.find(key);
+      if (it != index.end()) {
+        stats.bytes -= it->second->second->pixels.size();
+        entries.erase(it->second);
+        index.erase(it);
+      }
+
+      entries.emplace_front(key, result);
+      index[key] = entries.begin();
+      stats.bytes += byteLength;
+
+      evictLocked(budget);
+      return result;
+    }
+
+    void setBudget(size_t budgetBytes) {
+      std::lock_guard<std::mutex> lock(mutex);
+      budget = budgetBytes;
+      evictLocked(budget);
+    }
+
+    size_t getBudget() const { return budget; }
+
+    void clear() {
+      std::lock_guard<std::mutex> lock(mutex);
+      entries.clear();
+      index.clear();
+      stats.bytes = 0;
+    }
+
+    ResultCacheStats getStats() {
+      std::lock_guard<std::mutex> lock(mutex);
+      ResultCacheStats result = stats;
+      result.entries          = entries.size();
+      return result;
+    }
+
+   private:
+    using Entry = std::pair<ResultCacheKey, std::shared_ptr<const CachedResult>>;
+
+    std::mutex       mutex;
+    std::list<Entry> entries;
+    std::unordered_map<ResultCacheKey, std::list<Entry>::iterator, ResultCacheKeyHash>
+                     index;
+    ResultCacheStats stats;
+    size_t           budget;
+
+    void evictLocked(size_t limit) {
+      while (stats.bytes > limit && !entries.empty()) {
+        Entry& last = entries.back();
+        stats.bytes -= last.second->pixels.size();
+        index.erase(last.first);
+        entries.pop_back();
+        stats.evictions++;
+      }
+    }
+  };
+}  // namespace pipeline
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace pipeline {
+  struct RuntimePoolStats {
+    using Duration = std::chrono::steady_clock::duration;
+
+    size_t   leases   = 0;
+    /** Leases that had to wait for a runtime to come back */
+    size_t   waits    = 0;
+    size_t   inUse    = 0;
+    size_t   maxInUse = 0;
+    Duration maxWait  = Duration::zero();
+  };
+
+  /**
+   * Hands out runtimes to concurrent renders, one render per runtime at a time.
+   * `acquire` blocks while every runtime is leased. Handles are owned by the
+   * caller; the pool only tracks which ones are free.
+   */
+  template <typename Handle>
+  class RuntimePool {
+   public:
+    /** Moves only; the runtime goes back to the pool when the lease is destroyed */
+    class Lease {
+     public:
+      Lease() = default;
+      Lease(const Lease&)            = delete;
+      Lease& operator=(const Lease&) = delete;
+
+      Lease(Lease&& other) noexcept { *this = std::move(other); }
+
+      Lease& operator=(Lease&& other) noexcept {
+        if (this == &other) return *this;
+        release();
+        pool         = other.pool;
+        handle       = other.handle;
+        other.pool   = nullptr;
+        other.handle = Handle{};
+        return *this;
+      }
+
+      ~Lease() { release(); }
+
+      Handle   get() const { return handle; }
+      explicit operator bool() const { return pool != nullptr; }
+
+      void release() {
+        if (pool == nullptr) return;
+        pool->giveBack(handle);
+        pool   = nullptr;
+        handle = Handle{};
+      }
+
+     private:
+      friend class RuntimePool;
+
+      Lease(RuntimePool* pool, Handle handle) : pool(pool), handle(handle) {}
+
+      RuntimePool* pool   = nullptr;
+      Handle       handle = Handle{};
+    };
+
+    RuntimePool()                              = default;
+    RuntimePool(const RuntimePool&)            = delete;
+    RuntimePool& operator=(const RuntimePool&) = delete;
+
+    void add(Handle handle) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        all.push_back(handle);
+        free.push_back(handle);
+      }
+      returned.notify_one();
+    }
+
+    /** An empty lease when the pool has no runtimes at all */
+    Lease acquire() {
+      auto                         startedAt = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lock(mutex);
+      if (all.empty()) return Lease();
+
+      stats.leases++;
+      if (free.empty()) {
+        stats.waits++;
+        returned.wait(lock, [this] { return !free.empty(); });
+        stats.maxWait =
+            std::max(stats.maxWait, std::chrono::steady_clock::now() - startedAt);
+      }
+
+      Handle handle = free.back();
+      free.pop_back();
+
+      stats.inUse++;
+      stats.maxInUse = std::max(stats.maxInUse, stats.inUse);
+
+      return Lease(this, handle);
+    }
+
+    /**
+     * Removes every runtime once all leases came back, and returns them for the
+     * caller to dispose.
+     */
+    std::vector<Handle> drain() {
+      std::unique_lock<std::mutex> lock(mutex);
+      returned.wait(lock, [this] { return free.size() == all.size(); });
+
+      std::vector<Handle> handles = std::move(all);
+      all.clear();
+      free.clear();
+      return handles;
+    }
+
+    size_t size() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return all.size();
+    }
+
+    /** Every runtime, leased or not, for calls that queue behind renders */
+    std::vector<Handle> handles() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return all;
+    }
+
+    RuntimePoolStats getStats() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return stats;
+    }
+
+   private:
+    void giveBack(Handle handle) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        free.push_back(handle);
+        stats.inUse--;
+      }
+      // drain() may wait alongside acquire()
+      returned.notify_all();
+    }
+
+    mutable std::mutex      mutex;
+    std::condition_variable returned;
+    std::vector<Handle>     all;
+    std::vector<Handle>     free;
+    RuntimePoolStats        stats;
+  };
+}  // namespace pipeline
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace pipeline {
+  class TileBufferPool;
+
+  /**
+   * Lease of a pooled, page aligned block. Moves only; the block goes back to
+   * its pool when the lease is destroyed or `release()`d.
+   */
+  class TileBuffer {
+   public:
+    TileBuffer() = default;
+    TileBuffer(const TileBuffer&)            = delete;
+    TileBuffer& operator=(const TileBuffer&) = delete;
+
+    TileBuffer(TileBuffer&& other) noexcept { *this = std::move(other); }
+
+    TileBuffer& operator=(TileBuffer&& other) noexcept {
+      if (this == &other) return *this;
+      release();
+      pool             = other.pool;
+      ptr              = other.ptr;
+      byteLength       = other.byteLength;
+      capacity         = other.capacity;
+      other.pool       = nullptr;
+      other.ptr        = nullptr;
+      other.byteLength = 0;
+      other.capacity   = 0;
+      return *this;
+    }
+
+    ~TileBuffer() { release(); }
+
+    unsigned char* data() const { return ptr; }
+    size_t         size() const { return byteLength; }
+    size_t         blockSize() const { return capacity; }
+    explicit       operator bool() const { return ptr != nullptr; }
+
+    inline void release();
+
+   private:
+    friend class TileBufferPool;
+
+    TileBufferPool* pool       = nullptr;
+    unsigned char*  ptr        = nullptr;
+    size_t          byteLength = 0;
+    size_t          capacity   = 0;
+  };
+
+  /**
+   * A unit of work that leases buffers (e.g. a GoLiveEffect). Moves only; the
+   * work ends when it's destroyed. See `TileBufferPool::beginWork`.
+   */
+  class TileBufferWork {
+   public:
+    TileBufferWork() = default;
+    TileBufferWork(const TileBufferWork&)            = delete;
+    TileBufferWork& operator=(const TileBufferWork&) = delete;
+
+    TileBufferWork(TileBufferWork&& other) noexcept : pool(other.pool) {
+      other.pool = nullptr;
+    }
+
+    ~TileBufferWork();
+
+   private:
+    friend class TileBufferPool;
+
+    explicit TileBufferWork(TileBufferPool* pool) : pool(pool) {}
+
+    TileBufferPool* pool = nullptr;
+  };
+
+  struct TileBufferPoolStats {
+    size_t allocations   = 0;
+    size_t reuses        = 0;
+    size_t frees         = 0;
+    size_t bytesInUse    = 0;
+    size_t bytesCached   = 0;
+    size_t highWaterMark = 0;
+  };
+
+  /**
+   * Size classed pool for raster tile buffers.
+   *
+   * Blocks are rounded up to pages, then to a quarter of their power of two, so
+   * a class never wastes more than 25%. Released blocks are cached per class
+   * for the next request of the same size, as long as the total (in use +
+   * cached) stays within the budget. `trim()` releases cached blocks the recent
+   * high-water mark did not need.
+   *
+   * Work running in parallel shares one high-water window: the pool trims when
+   * the first work begins after it was idle, never under work in flight.
+   */
+  class TileBufferPool {
+   public:
+    static constexpr size_t kDefaultBudget = (size_t)1024 * 1024 * 1024;
+
+    explicit TileBufferPool(size_t budgetBytes = kDefaultBudget)
+        : budget(budgetBytes), pageSize(systemPageSize()) {}
+
+    TileBufferPool(const TileBufferPool&)            = delete;
+    TileBufferPool& operator=(const TileBufferPool&) = delete;
+
+    ~TileBufferPool() {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto& [blockSize, blocks] : freeBlocks) {
+        for (auto* block : blocks) freeAligned(block);
+      }
+      freeBlocks.clear();
+    }
+
+    TileBuffer acquire(size_t size) {
+      TileBuffer buffer;
+      if (size == 0) return buffer;
+
+      size_t blockSize = sizeClass(size);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto                        it = freeBlocks.find(blockSize);
+
+        if (it != freeBlocks.end() && !it->second.empty()) {
+          buffer.ptr = it->second.back();
+          it->second.pop_back();
+          stats.bytesCached -= blockSize;
+          stats.reuses++;
+        }
+      }
+
+      if (buffer.ptr == nullptr) {
+        buffer.ptr = allocAligned(blockSize);
+        if (buffer.ptr == nullptr) throw std::bad_alloc();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.allocations++;
+      }
+
+      buffer.pool       = this;
+      buffer.byteLength = size;
+      buffer.capacity   = blockSize;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.bytesInUse += blockSize;
+      stats.highWaterMark = std::max(stats.highWaterMark, stats.bytesInUse);
+      recentHighWater     = std::max(recentHighWater, stats.bytesInUse);
+
+      return buffer;
+    }
+
+    /**
+     * Starts a unit of work. The first one after the pool was idle trims what
+     * the previous burst of work did not need.
+     */
+    [[nodiscard]] TileBufferWork beginWork() {
+      bool idle;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle = activeWork++ == 0;
+      }
+
+      if (idle) trim();
+      return TileBufferWork(this);
+    }
+
+    /**
+     * Frees cached blocks exceeding what was needed since the last trim,
+     * largest first. `beginWork` calls it once per burst of work.
+     */
+    void trim() {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      size_t keep = recentHighWater > stats.bytesInUse
+                        ? recentHighWater - stats.bytesInUse
+                        : 0;
+      evictLocked(keep);
+      recentHighWater = stats.bytesInUse;
+    }
+
+    void setBudget(size_t budgetBytes) {
+      std::lock_guard<std::mutex> lock(mutex);
+      budget = budgetBytes;
+
+      size_t keep = budget > stats.bytesInUse ? budget - stats.bytesInUse : 0;
+      evictLocked(keep);
+    }
+
+    size_t getBudget() const { return budget; }
+
+    TileBufferPoolStats getStats() {
+      std::lock_guard<std::mutex> lock(mutex);
+      return stats;
+    }
+
+    size_t sizeClass(size_t size) const {
+      size_t pages = (size + pageSize - 1) / pageSize;
+      if (pages <= 4) return pages * pageSize;
+
+      size_t exponent = 0;
+      while ((pages >> (exponent + 1)) != 0) exponent++;
+
+      size_t step = (size_t)1 << (exponent - 2);
+      return ((pages + step - 1) / step) * step * pageSize;
+    }
+
+   private:
+    friend class TileBuffer;
+    friend class TileBufferWork;
+
+    std::mutex                                    mutex;
+    std::map<size_t, std::vector<unsigned char*>> freeBlocks;
+    TileBufferPoolStats                           stats;
+    size_t                                        recentHighWater = 0;
+    size_t                                        activeWork      = 0;
+    size_t                                        budget;
+    size_t                                        pageSize;
+
+    void endWork() {
+      std::lock_guard<std::mutex> lock(mutex);
+      activeWork--;
+    }
+
+    void giveBack(unsigned char* ptr, size_t blockSize) {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.bytesInUse -= blockSize;
+
+      if (stats.bytesInUse + stats.bytesCached + blockSize > budget) {
+        freeAligned(ptr);
+        stats.frees++;
+        return;
+      }
+
+      freeBlocks[blockSize].push_back(ptr);
+      stats.bytesCached += blockSize;
+    }
+
+    void evictLocked(size_t keepCachedBytes) {
+      for (auto it = freeBlocks.rbegin();
+           it != freeBlocks.rend() && stats.bytesCached > keepCachedBytes; ++it) {
+        auto& blocks = it->second;
+        while (!blocks.empty() && stats.bytesCached > keepCachedBytes) {
+          freeAligned(blocks.back());
+          blocks.pop_back();
+          stats.bytesCached -= it->first;
+          stats.frees++;
+        }
+      }
+    }
+
+    unsigned char* allocAligned(size_t size) {
+#ifdef _WIN32
+      return static_cast<unsigned char*>(_aligned_malloc(size, pageSize));
+#else
+      void* ptr = nullptr;
+      if (posix_memalign(&ptr, pageSize, size) != 0) return nullptr;
+      return static_cast<unsigned char*>(ptr);
+#endif
+    }
+
+    static void freeAligned(unsigned char* ptr) {
+#ifdef _WIN32
+      _aligned_free(ptr);
+#else
+      free(ptr);
+#endif
+    }
+
+    static size_t systemPageSize() {
+#ifdef _WIN32
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return (size_t)info.dwPageSize;
+#else
+      long size = sysconf(_SC_PAGESIZE);
+      return size > 0 ? (size_t)size : 4096;
+#endif
+    }
+  };
+
+  inline void TileBuffer::release() {
+    if (pool != nullptr && ptr != nullptr) pool->giveBack(ptr, capacity);
+    pool       = nullptr;
+    ptr        = nullptr;
+    byteLength = 0;
+    capacity   = 0;
+  }
+
+  inline TileBufferWork::~TileBufferWork() {
+    if (pool != nullptr) pool->endWork();
+  }
+}  // namespace pipeline
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pipeline {
+  /** Half-open pixel rect in raster coordinates */
+  struct PixelRect {
+    int32_t left   = 0;
+    int32_t top    = 0;
+    int32_t right  = 0;
+    int32_t bottom = 0;
+
+    int32_t width() const { return right - left; }
+    int32_t height() const { return bottom - top; }
+    size_t  pixels() const { return (size_t)width() * height(); }
+  };
+
+  /**
+   * One unit of tiled execution. The effect sees `source` (core plus halo,
+   * clipped to the raster) and only the `core` part of its output is kept.
+   */
+  struct TileRegion {
+    PixelRect core;
+    PixelRect source;
+
+    /** Offset of `core` inside `source` */
+    int32_t coreOffsetX() const { return core.left - source.left; }
+    int32_t coreOffsetY() const { return core.top - source.top; }
+  };
+
+  /**
+   * Splits a `width` x `height` raster into cores of at most `tileSize` pixels
+   * per side, each read with `halo` pixels of surrounding context so effects
+   * that sample neighbours (blur, distortion) don't show seams.
+   */
+  inline std::vector<TileRegion> planTiles(
+      int32_t width,
+      int32_t height,
+      int32_t tileSize,
+      int32_t halo
+  ) {
+    std::vector<TileRegion> tiles;
+    if (width <= 0 || height <= 0 || tileSize <= 0) return tiles;
+    halo = std::max(halo, (int32_t)0);
+
+    for (int32_t top = 0; top < height; top += tileSize) {
+      for (int32_t left = 0; left < width; left += tileSize) {
+        TileRegion tile;
+        tile.core = {
+            left,
+            top,
+            std::min(left + tileSize, width),
+            std::min(top + tileSize, height),
+        };
+        tile.source = {
+            std::max(tile.core.left - halo, (int32_t)0),
+            std::max(tile.core.top - halo, (int32_t)0),
+            std::min(tile.core.right + halo, width),
+            std::min(tile.core.bottom + halo, height),
+        };
+        tiles.push_back(tile);
+      }
+    }
+
+    return tiles;
+  }
+
+  /** Largest `source` any tile of the plan can have, for sizing buffers */
+  inline size_t maxTileSourcePixels(int32_t tileSize, int32_t halo) {
+    size_t side = (size_t)tileSize + 2 * (size_t)std::max(halo, (int32_t)0);
+    return side * side;
+  }
+}  // namespace pipeline
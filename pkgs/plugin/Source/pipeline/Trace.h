@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pipeline::trace {
+  /** Stages of a live effect render, in pipeline order */
+  enum class Stage : uint8_t {
+    GoLiveEffect,
+    Probe,
+    Rasterize,
+    GetRasterTile,
+    /** Alpha bounds scan and crop to the visible pixels */
+    Trim,
+    Convert,
+    /** Params and env to typed messages for the runtime */
+    Encode,
+    /** The go_live_effect call, queueing on the runtime included */
+    Ffi,
+    /** The effect's goLiveEffect, GPU work it awaits included */
+    Js,
+    /**
+     * Totals within Js of the runtime's GPU submit and buffer map spans. Not
+     * exported to the Chrome trace, which gets the runtime's own spans.
+     */
+    Gpu,
+    Readback,
+    Upscale,
+    SetRasterTile,
+    /** New raster art for results that changed size */
+    RenewArt,
+  };
+
+  constexpr size_t kStageCount = (size_t)Stage::RenewArt + 1;
+
+  inline const char* stageName(Stage stage) {
+    static constexpr std::array<const char*, kStageCount> names = {
+        "GoLiveEffect", "Probe",      "Rasterize",     "GetRasterTile", "Trim",
+        "Convert",      "Encode",     "FFI",           "JS",            "GPU",
+        "Readback",     "Upscale",    "SetRasterTile", "RenewArt",
+    };
+    return names[(size_t)stage];
+  }
+
+  struct SpanEvent {
+    Stage    stage;
+    /** The render the span belongs to, 0 outside of one */
+    uint64_t traceId;
+    uint64_t startNs;
+    uint64_t durationNs;
+  };
+
+  struct ThreadEvents {
+    /** Order the thread first recorded in, not an OS thread id */
+    uint32_t               threadIndex;
+    std::vector<SpanEvent> events;
+  };
+
+  /**
+   * Last `kCapacity` spans of one thread. Only the owning thread writes, so
+   * recording is a few relaxed stores; readers copy the slots and drop the ones
+   * overwritten while they were copying.
+   */
+  class SpanRing {
+   public:
+    static constexpr size_t kCapacity = 4096;
+
+    explicit SpanRing(uint32_t threadIndex) : threadIndex(threadIndex) {}
+
+    void push(Stage stage, uint64_t traceId, uint64_t startNs, uint64_t durationNs) {
+      uint64_t index = head.load(std::memory_order_relaxed);
+      Slot&    slot  = slots[index & (kCapacity - 1)];
+      slot.stage.store((uint8_t)stage, std::memory_order_relaxed);
+      slot.traceId.store(traceId, std::memory_order_relaxed);
+      slot.startNs.store(startNs, std::memory_order_relaxed);
+      slot.durationNs.store(durationNs, std::memory_order_relaxed);
+      head.store(index + 1, std::memory_order_release);
+    }
+
+    ThreadEvents snapshot() const {
+      ThreadEvents result{.threadIndex = threadIndex, .events = {}};
+
+      uint64_t end   = head.load(std::memory_order_acquire);
+      uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+      result.events.reserve(end - begin);
+
+      for (uint64_t i = begin; i < end; i++) {
+        const Slot& slot = slots[i & (kCapacity - 1)];
+        result.events.push_back(SpanEvent{
+            .stage      = (Stage)slot.stage.load(std::memory_order_relaxed),
+            .traceId    = slot.traceId.load(std::memory_order_relaxed),
+            .startNs    = slot.startNs.load(std::memory_order_relaxed),
+            .durationNs = slot.durationNs.load(std::memory_order_relaxed),
+        });
+      }
+
+      // The writer kept going while we copied; its oldest slots are torn
+      uint64_t after = head.load(std::memory_order_acquire);
+      if (after - begin > kCapacity) {
+        size_t torn = std::min<size_t>(after - begin - kCapacity, result.events.size());
+        result.events.erase(result.events.begin(), result.events.begin() + torn);
+      }
+
+      return result;
+    }
+
+   private:
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "kCapacity must be a power of 2");
+
+    struct Slot {
+      std::atomic<uint8_t>  stage{0};
+      std::atomic<uint64_t> traceId{0};
+      std::atomic<uint64_t> startNs{0};
+      std::atomic<uint64_t> durationNs{0};
+    };
+
+    const uint32_t        threadIndex;
+    std::atomic<uint64_t> head{0};
+    std::array<Slot, kCapacity> slots;
+  };
+
+  namespace detail {
+    inline std::atomic<bool>     enabled{false};
+    inline std::atomic<uint64_t> lastTraceId{0};
+
+    inline uint64_t& currentTraceId() {
+      thread_local uint64_t id = 0;
+      return id;
+    }
+
+    /** Rings of every thread that recorded, kept after the thread exits */
+    struct Registry {
+      std::mutex                             mutex;
+      std::vector<std::shared_ptr<SpanRing>> rings;
+    };
+
+    inline Registry& registry() {
+      static Registry instance;
+      return instance;
+    }
+
+    /** Registers under the lock once per thread, then lock free */
+    inline SpanRing& localRing() {
+      thread_local std::shared_ptr<SpanRing> ring = [] {
+        Registry&                   reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.rings.push_back(std::make_shared<SpanRing>((uint32_t)reg.rings.size()));
+        return reg.rings.back();
+      }();
+      return *ring;
+    }
+  }  // namespace detail
+
+  inline bool isEnabled() { return detail::enabled.load(std::memory_order_relaxed); }
+  inline void setEnabled(bool enabled) { detail::enabled.store(enabled); }
+
+  /** Monotonic nanoseconds, comparable across threads of the process */
+  inline uint64_t nowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+  }
+
+  /** Trace id of the render running on this thread, 0 outside of one */
+  inline uint64_t currentTraceId() { return detail::currentTraceId(); }
+
+  /**
+   * Makes a new trace id the current one of this thread for its scope. Spans
+   * recorded meanwhile carry it, and it's passed on to the runtime.
+   */
+  class TraceScope {
+   public:
+    TraceScope()
+        : traceId(detail::lastTraceId.fetch_add(1, std::memory_order_relaxed) + 1),
+          previous(detail::currentTraceId()) {
+      detail::currentTraceId() = traceId;
+    }
+
+    TraceScope(const TraceScope&)            = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() { detail::currentTraceId() = previous; }
+
+    uint64_t getTraceId() const { return traceId; }
+
+   private:
+    uint64_t traceId;
+    uint64_t previous;
+  };
+
+  /** Records a span measured elsewhere, e.g. reported back by the runtime */
+  inline void record(Stage stage, uint64_t startNs, uint64_t durationNs) {
+    if (!isEnabled()) return;
+    detail::localRing().push(stage, currentTraceId(), startNs, durationNs);
+  }
+
+  /**
+   * Times its scope as one span of `stage`. Costs a relaxed load when tracing
+   * is off; the clock is only read when it's on.
+   */
+  class Span {
+   public:
+    explicit Span(Stage stage) : stage(stage), startNs(isEnabled() ? nowNs() : 0) {}
+
+    Span(const Span&)            = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span() { end(); }
+
+    /** Ends the span before the scope does */
+    void end() {
+      if (startNs == 0) return;
+      record(stage, startNs, nowNs() - startNs);
+      startNs = 0;
+    }
+
+    uint64_t getStartNs() const { return startNs; }
+
+   private:
+    Stage    stage;
+    uint64_t startNs;
+  };
+
+  /** Spans still held by the rings, per thread */
+  inline std::vector<ThreadEvents> collect() {
+    std::vector<std::shared_ptr<SpanRing>> rings;
+    {
+      detail::Registry&           reg = detail::registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      rings = reg.rings;
+    }
+
+    std::vector<ThreadEvents> result;
+    result.reserve(rings.size());
+    for (const auto& ring : rings) result.push_back(ring->snapshot());
+    return result;
+  }
+
+  struct StageSummary {
+    size_t   count   = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs   = 0;
+  };
+
+  inline std::array<StageSummary, kStageCount> summarize(
+      const std::vector<ThreadEvents>& threads
+  ) {
+    std::array<StageSummary, kStageCount> summary{};
+    for (const ThreadEvents& thread : threads) {
+      for (const SpanEvent& event : thread.events) {
+        StageSummary& stage = summary[(size_t)event.stage];
+        stage.count++;
+        stage.totalNs += event.durationNs;
+        stage.maxNs = std::max(stage.maxNs, event.durationNs);
+      }
+    }
+    return summary;
+  }
+}  // namespace pipeline::trace
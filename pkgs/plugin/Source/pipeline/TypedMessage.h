@@ -0,0 +1,332 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./Hash.h"
+#include "json.hpp"
+
+namespace pipeline {
+  /**
+   * Binary arguments and results of the ai_deno FFI, replacing JSON text on the
+   * hot calls. A 12 byte header ("ADM", a version and the hash of the schema
+   * keys used) followed by one CBOR item. Keys of a params object that its
+   * effect's `paramSchema` declares are sent as their index, so they are neither
+   * written nor parsed as strings. The runtime builds V8 values straight from
+   * it, see typed_message.rs, which must stay in sync with this file.
+   */
+  namespace typed_message {
+    constexpr uint8_t kMagic[3]   = {'A', 'D', 'M'};
+    constexpr uint8_t kVersion    = 1;
+    constexpr size_t  kHeaderSize = sizeof(kMagic) + 1 + sizeof(uint64_t);
+    /** Deeper values are rejected rather than recursed into */
+    constexpr int     kMaxDepth   = 64;
+
+    /** Top level keys of an effect's `paramSchema`, indexed in byte order */
+    struct SchemaKeys {
+      std::vector<std::string>                  keys;
+      std::unordered_map<std::string, uint32_t> indices;
+      /** xxh64 of the keys, each followed by a NUL. 0 when there are none. */
+      uint64_t                                  hash = 0;
+
+      static SchemaKeys fromSchema(const nlohmann::json& paramSchema) {
+        SchemaKeys result;
+        if (!paramSchema.is_object()) return result;
+
+        // nlohmann keeps object keys sorted, the runtime sorts them the same way
+        std::string joined;
+        for (auto& [key, _] : paramSchema.items()) {
+          result.indices[key] = (uint32_t)result.keys.size();
+          result.keys.push_back(key);
+          joined.append(key).push_back('\0');
+        }
+        if (!result.keys.empty()) result.hash = xxh64(joined);
+        return result;
+      }
+    };
+
+    namespace detail {
+      inline void writeHead(std::vector<uint8_t>& out, uint8_t major, uint64_t arg) {
+        major <<= 5;
+        if (arg < 24) {
+          out.push_back(major | (uint8_t)arg);
+          return;
+        }
+
+        // Additional info 24 to 27: a 1, 2, 4 or 8 byte argument follows
+        uint8_t info = arg <= 0xFF ? 24 : arg <= 0xFFFF ? 25 : arg <= 0xFFFFFFFF ? 26 : 27;
+        out.push_back(major | info);
+        for (int i = (1 << (info - 24)) - 1; i >= 0; i--) {
+          out.push_back((uint8_t)(arg >> (i * 8)));
+        }
+      }
+
+      inline void writeFloat(std::vector<uint8_t>& out, double value) {
+        float narrow = (float)value;
+        if ((double)narrow == value) {
+          uint32_t bits;
+          std::memcpy(&bits, &narrow, 4);
+          out.push_back(0xFA);
+          for (int i = 3; i >= 0; i--) out.push_back((uint8_t)(bits >> (i * 8)));
+        } else {
+          uint64_t bits;
+          std::memcpy(&bits, &value, 8);
+          out.push_back(0xFB);
+          for (int i = 7; i >= 0; i--) out.push_back((uint8_t)(bits >> (i * 8)));
+        }
+      }
+
+      inline void writeText(std::vector<uint8_t>& out, const std::string& text) {
+        writeHead(out, 3, text.size());
+        out.insert(out.end(), text.begin(), text.end());
+      }
+
+      inline void writeValue(
+          std::vector<uint8_t>& out,
+          const nlohmann::json& value,
+          const SchemaKeys*     keys
+      ) {
+        using value_t = nlohmann::json::value_t;
+
+        switch (value.type()) {
+          case value_t::boolean:
+            out.push_back(value.get<bool>() ? 0xF5 : 0xF4);
+            break;
+          case value_t::number_unsigned:
+            writeHead(out, 0, value.get<uint64_t>());
+            break;
+          case value_t::number_integer: {
+            int64_t n = value.get<int64_t>();
+            if (n >= 0) {
+              writeHead(out, 0, (uint64_t)n);
+            } else {
+              writeHead(out, 1, (uint64_t)(-1 - n));
+            }
+            break;
+          }
+          case value_t::number_float: {
+            double n = value.get<double>();
+            // Like JSON: non-finite numbers become null
+            if (std::isfinite(n)) {
+              writeFloat(out, n);
+            } else {
+              out.push_back(0xF6);
+            }
+            break;
+          }
+          case value_t::string:
+            writeText(out, value.get_ref<const std::string&>());
+            break;
+          case value_t::array:
+            writeHead(out, 4, value.size());
+            for (const auto& item : value) writeValue(out, item, nullptr);
+            break;
+          case value_t::object:
+            writeHead(out, 5, value.size());
+            for (auto& [key, item] : value.items()) {
+              const uint32_t* index = nullptr;
+              if (keys != nullptr) {
+                auto found = keys->indices.find(key);
+                if (found != keys->indices.end()) index = &found->second;
+              }
+
+              if (index != nullptr) {
+                writeHead(out, 0, *index);
+              } else {
+                writeText(out, key);
+              }
+              writeValue(out, item, nullptr);
+            }
+            break;
+          default:
+            out.push_back(0xF6);
+            break;
+        }
+      }
+
+      class Reader {
+       public:
+        Reader(const uint8_t* data, size_t size) : cursor(data), end(data + size) {}
+
+        bool atEnd() const { return cursor == end; }
+
+        /** Major type and argument of the next item */
+        bool readHead(uint8_t* major, uint8_t* info, uint64_t* arg) {
+          if (cursor == end) return false;
+
+          uint8_t initial = *cursor++;
+          *major          = initial >> 5;
+          *info           = initial & 0x1F;
+          if (*info < 24) {
+            *arg = *info;
+            return true;
+          }
+          if (*info > 27) return false;
+
+          size_t bytes = (size_t)1 << (*info - 24);
+          if ((size_t)(end - cursor) < bytes) return false;
+
+          *arg = 0;
+          for (size_t i = 0; i < bytes; i++) *arg = (*arg << 8) | *cursor++;
+          return true;
+        }
+
+        bool readText(uint64_t length, std::string* text) {
+          if ((uint64_t)(end - cursor) < length) return false;
+          text->assign((const char*)cursor, (size_t)length);
+          cursor += length;
+          return true;
+        }
+
+        bool readValue(nlohmann::json* value, const SchemaKeys* keys, int depth) {
+          if (depth > kMaxDepth) return false;
+
+          uint8_t  major, info;
+          uint64_t arg;
+          if (!readHead(&major, &info, &arg)) return false;
+
+          switch (major) {
+            case 0:
+              *value = arg;
+              return true;
+            case 1:
+              if (arg > (uint64_t)INT64_MAX) return false;
+              *value = -1 - (int64_t)arg;
+              return true;
+            case 3: {
+              std::string text;
+              if (!readText(arg, &text)) return false;
+              *value = std::move(text);
+              return true;
+            }
+            case 4: {
+              // Every item takes a byte at least
+              if (arg > (uint64_t)(end - cursor)) return false;
+
+              *value = nlohmann::json::array();
+              for (uint64_t i = 0; i < arg; i++) {
+                nlohmann::json item;
+                if (!readValue(&item, nullptr, depth + 1)) return false;
+                value->push_back(std::move(item));
+              }
+              return true;
+            }
+            case 5: {
+              if (arg > (uint64_t)(end - cursor)) return false;
+
+              *value = nlohmann::json::object();
+              for (uint64_t i = 0; i < arg; i++) {
+                std::string key;
+                uint8_t     keyMajor, keyInfo;
+                uint64_t    keyArg;
+                if (!readHead(&keyMajor, &keyInfo, &keyArg)) return false;
+
+                if (keyMajor == 3) {
+                  if (!readText(keyArg, &key)) return false;
+                } else if (keyMajor == 0 && keys != nullptr && keyArg < keys->keys.size()) {
+                  key = keys->keys[(size_t)keyArg];
+                } else {
+                  return false;
+                }
+
+                nlohmann::json item;
+                if (!readValue(&item, nullptr, depth + 1)) return false;
+                (*value)[key] = std::move(item);
+              }
+              return true;
+            }
+            case 7:
+              return readSimple(value, info, arg);
+            default:
+              return false;
+          }
+        }
+
+       private:
+        const uint8_t* cursor;
+        const uint8_t* end;
+
+        bool readSimple(nlohmann::json* value, uint8_t info, uint64_t arg) {
+          switch (info) {
+            case 20:
+              *value = false;
+              return true;
+            case 21:
+              *value = true;
+              return true;
+            case 22:
+            case 23:
+              *value = nullptr;
+              return true;
+            case 26: {
+              uint32_t bits = (uint32_t)arg;
+              float    n;
+              std::memcpy(&n, &bits, 4);
+              *value = (double)n;
+              return true;
+            }
+            case 27: {
+              double n;
+              std::memcpy(&n, &arg, 8);
+              *value = n;
+              return true;
+            }
+            default:
+              return false;
+          }
+        }
+      };
+    }  // namespace detail
+
+    /**
+     * `value` as a typed message. With `keys`, the keys of a top level object
+     * that the schema declares are written as their index.
+     */
+    inline std::vector<uint8_t> encode(
+        const nlohmann::json& value,
+        const SchemaKeys*     keys = nullptr
+    ) {
+      if (keys != nullptr && (keys->hash == 0 || !value.is_object())) keys = nullptr;
+      const uint64_t hash = keys != nullptr ? keys->hash : 0;
+
+      std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+      out.push_back(kVersion);
+      for (int i = 0; i < 8; i++) out.push_back((uint8_t)(hash >> (i * 8)));
+
+      detail::writeValue(out, value, keys);
+      return out;
+    }
+
+    /**
+     * Nullopt for data of another format or version, broken CBOR, or schema keys
+     * of a schema other than `keys`.
+     */
+    inline std::optional<nlohmann::json> decode(
+        const uint8_t*    data,
+        size_t            size,
+        const SchemaKeys* keys = nullptr
+    ) {
+      if (size <= kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0 ||
+          data[3] != kVersion) {
+        return std::nullopt;
+      }
+
+      uint64_t hash = 0;
+      for (int i = 7; i >= 0; i--) hash = (hash << 8) | data[4 + i];
+      if (hash != 0 && (keys == nullptr || keys->hash != hash)) return std::nullopt;
+
+      detail::Reader reader(data + kHeaderSize, size - kHeaderSize);
+      nlohmann::json value;
+      if (!reader.readValue(&value, hash != 0 ? keys : nullptr, 0) || !reader.atEnd()) {
+        return std::nullopt;
+      }
+      return value;
+    }
+  }  // namespace typed_message
+}  // namespace pipeline
@@ -9,6 +9,17 @@ using json = nlohmann::json;
 struct PluginParams {
   std::string effectName;
   json        params;
+  /**
+   * `params.dump()` and its xxh64, as getDictionaryValues read them. Left as is when
+   * `params` is edited afterwards, so only read them through serializedParams().
+   */
+  std::string paramsJson = "";
+  uint64_t    paramsHash = 0;
+
+  /** The params JSON, serialized again only when getDictionaryValues didn't */
+  std::string serializedParams() const {
+    return paramsJson.empty() ? params.dump() : paramsJson;
+  }
 };
 
 struct PluginPreferences {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdlib>
+#include <optional>
+#include <vector>
 #include "AIGradient.h"
 #include "AIRasterize.h"
 #include "IllustratorSDK.h"
@@ -1376,6 +1378,40 @@ namespace suai {
       AIDictKey dictKey = sAIDictionary->Key(key.c_str());
       return sAIDictionary->SetRealEntry(dict, dictKey, value);
     }
+
+    /** Nullopt when the entry doesn't exist */
+    std::optional<std::vector<uint8_t>> getBinary(
+        const AILiveEffectParameters& dict,
+        const std::string&            key,
+        ASErr*                        error = nullptr
+    ) {
+      AIDictKey dictKey = dict::getKey(key);
+      if (!dict::isKnown(dict, dictKey)) return std::nullopt;
+
+      // A null buffer asks for the size
+      size_t size = 0;
+      ASErr  e    = sAIDictionary->GetBinaryEntry(dict, dictKey, nullptr, &size);
+      if (e == kNoErr) {
+        std::vector<uint8_t> value(size);
+        e = sAIDictionary->GetBinaryEntry(dict, dictKey, value.data(), &size);
+        if (error != nullptr) *error = e;
+        if (e == kNoErr) return value;
+      }
+
+      if (error != nullptr) *error = e;
+      return std::nullopt;
+    }
+
+    ASErr setBinary(
+        const AILiveEffectParameters& dict,
+        const std::string&            key,
+        const std::vector<uint8_t>&   value
+    ) {
+      AIDictKey dictKey = dict::getKey(key);
+      return sAIDictionary->SetBinaryEntry(
+          dict, dictKey, (void*)value.data(), value.size()
+      );
+    }
   }  // namespace dict
 
   std::string getErrorName(ASErr& err) {
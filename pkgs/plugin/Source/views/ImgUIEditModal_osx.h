@@ -56,7 +56,8 @@ using json = nlohmann::json;
 - (ModalStatusCode)runModal:(json)renderTree
                lastPosition:(std::tuple<int, int>*)lastPosition
                    onChange:(ImGuiModal::OnChangeCallback)onChange
-                onFireEvent:(ImGuiModal::OnFireEventCallback)onFireEventCallback;
+                onFireEvent:(ImGuiModal::OnFireEventCallback)onFireEventCallback
+                    onFrame:(ImGuiModal::OnFrameCallback)onFrame;
 - (void)restoreWindowPosition:(std::tuple<int, int>*)pos;
 - (void)releaseDialog;
 @end
@@ -102,7 +103,8 @@ class ImGuiModalOSX : public ImGuiModal::IModalImpl {
       std::string                     title,
       std::tuple<int, int>*           lastPosition,
       ImGuiModal::OnChangeCallback    onChange,
-      ImGuiModal::OnFireEventCallback onFireEventCallback
+      ImGuiModal::OnFireEventCallback onFireEventCallback,
+      ImGuiModal::OnFrameCallback     onFrame
   ) override {
     ModalStatusCode result = ModalStatusCode::None;
 
@@ -112,7 +114,8 @@ class ImGuiModalOSX : public ImGuiModal::IModalImpl {
       result = [this->controller runModal:renderTree
                              lastPosition:lastPosition
                                  onChange:onChange
-                              onFireEvent:onFireEventCallback];
+                              onFireEvent:onFireEventCallback
+                                  onFrame:onFrame];
     } catch (...) {
       [this->controller releaseDialog];
       this->controller = nullptr;
@@ -226,7 +229,8 @@ class ImGuiModalOSX : public ImGuiModal::IModalImpl {
 - (ModalStatusCode)runModal:(json)renderNodes
                lastPosition:(std::tuple<int, int>*)lastPosition
                    onChange:(ImGuiModal::OnChangeCallback)callbackFunc
-                onFireEvent:(ImGuiModal::OnFireEventCallback)onFireEventCallback {
+                onFireEvent:(ImGuiModal::OnFireEventCallback)onFireEventCallback
+                    onFrame:(ImGuiModal::OnFrameCallback)onFrame {
   std::cout << "running modal" << std::endl;
   ModalStatusCode result = ModalStatusCode::None;
   [self.window.contentView setOnChange:callbackFunc];
@@ -244,6 +248,9 @@ class ImGuiModalOSX : public ImGuiModal::IModalImpl {
     while ([self.window isVisible]) {
       if ([NSApp runModalSession:session] != NSModalResponseContinue) break;
 
+      // Deferred parameter updates, so their cost never lands inside a frame
+      if (onFrame) onFrame();
+
       NSTimeInterval currentTime = [NSDate timeIntervalSinceReferenceDate];
       NSTimeInterval elapsedTime = currentTime - lastFrameTime;
 
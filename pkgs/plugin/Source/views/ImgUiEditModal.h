@@ -23,6 +23,8 @@ using json = nlohmann::json;
 namespace ImGuiModal {
   typedef std::function<void(json)> OnChangeCallback;
   typedef std::function<void(json)> OnFireEventCallback;
+  /** Called on every iteration of the modal loop, outside of ImGui frames */
+  typedef std::function<void()> OnFrameCallback;
 
   struct EventCallbackPayload {
     std::string         type;
@@ -39,7 +41,8 @@ namespace ImGuiModal {
         std::string           title,
         std::tuple<int, int>* lastPosition,
         OnChangeCallback      onChange,
-        OnFireEventCallback   onFireEventCallback
+        OnFireEventCallback   onFireEventCallback,
+        OnFrameCallback       onFrame
     ) = 0;
 
     virtual void updateRenderTree(const json& renderTree) = 0;